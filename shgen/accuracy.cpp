@@ -0,0 +1,1292 @@
+#include "accuracy.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "ibl/cpu_features.h"
+#include "ibl/cubemap_lookup.h"
+#include "ibl/mip_chain.h"
+#include "ibl/prefilter.h"
+#include "ibl/sh_basis.h"
+#include "ibl/spherical_harmonics.h"
+#include "ibl/texel_format.h"
+#include "fsutil.h"
+#include "hdr.h"
+#include "jsonwriter.h"
+#include "libshgen.h"
+#include "pfm.h"
+#include "shb.h"
+
+namespace
+{
+    using ibl::Cubemap;
+    using ibl::ThreadPool;
+    using ibl::math::double3;
+    using SHArray = std::unique_ptr<double3[]>;
+
+    constexpr size_t ORDER = ibl::sh::MAX_ORDER;
+    constexpr size_t NUM_COEFS = ibl::sh::getCoefCount(ORDER);
+
+    // the faces of the cubemaps, the latlong images are 4 x 2 times as large
+    constexpr size_t DIMENSIONS = 64;
+
+    // the channels hold the environment scaled by these, so that a mixup shows
+    const double CHANNELS[3] = {1.0, 0.5, 0.25};
+
+    // of the float paths against the double ones, see precision.h
+    constexpr double DOUBLE_BOUND = 1e-12;
+    constexpr double FLOAT_BOUND = 1e-6;
+
+    // of the projections against the closed form, relative to the largest coefficient. the
+    // texels are point samples, so even a constant leaks into bands 4, 6 and 8. measured up to
+    // 1.6e-4 for both at 64.
+    constexpr double CUBE_BOUND = 4e-4;
+    constexpr double LATLONG_BOUND = 4e-4;
+
+    // of the rendered texels against the closed form, relative to the peak of the radiance.
+    // the texels are float, the float paths also evaluate the basis in float.
+    constexpr double DOUBLE_RENDER_BOUND = 2e-7;
+    constexpr double FLOAT_RENDER_BOUND = 4e-6;
+    constexpr double HALF_BOUND = 1e-3;     // 11 bits of mantissa
+
+    // of the batch lookups at the centers of the texels. the addresses are float, the bilinear
+    // weights of the neighbours are not quite 0 then.
+    constexpr double ADDRESS_BOUND = 1e-6;
+    constexpr double BILINEAR_BOUND = 1e-5;
+
+    // of the levels prefiltered from a constant, the weights of the samples add up in float
+    constexpr double PREFILTER_BOUND = 1e-5;
+
+    // of the levels prefiltered from band 1 or 2 against the scale of the lobe. the samples read
+    // mips one level coarser than their solid angle, which averages the directions of a texel;
+    // measured up to 9e-2 at roughness 1, where the neighbouring levels differ by 0.16 in band 1.
+    constexpr double LOBE_BOUND = 0.12;
+
+    // an environment whose spherical harmonics are known in closed form
+    struct Environment
+    {
+        std::string name;
+        double sh[NUM_COEFS] = {};      // of the radiance
+        std::function<double(const double3&)> radiance;
+        // the radiance or the irradiance divided by pi of bands 0..order in the direction n
+        std::function<double(const double3& n, size_t order, bool irradiance)> reconstruct;
+        bool constant = false;
+        size_t band = 0;                // the only band of the radiance, 0 if there is none
+    };
+
+    // what the irradiance of band l is times the radiance, divided by pi
+    double getIrradianceScale(size_t l)
+    {
+        return ibl::sh::computeTruncatedCosSh(l) / ibl::sh::PI;
+    }
+
+    double evaluateSH(const double* sh, const double3& n, size_t order, bool irradiance)
+    {
+        double Y[NUM_COEFS];
+        ibl::sh::Basis<ORDER>::evaluate(n.x, n.y, n.z, Y);
+        double v = 0;
+        for (size_t l = 0; l <= order; l++) {
+            double band = 0;
+            for (size_t i = l * l; i < (l + 1) * (l + 1); i++) {
+                band += sh[i] * Y[i];
+            }
+            v += (irradiance ? getIrradianceScale(l) : 1.0) * band;
+        }
+        return v;
+    }
+
+    double legendre(size_t l, double t)
+    {
+        double p0 = 1;
+        double p1 = t;
+        if (l == 0) {
+            return p0;
+        }
+        for (size_t k = 2; k <= l; k++) {
+            const double p2 = ((2 * k - 1) * t * p1 - (k - 1) * p0) / k;
+            p0 = p1;
+            p1 = p2;
+        }
+        return p1;
+    }
+
+    double3 normalize(double x, double y, double z)
+    {
+        const double l = std::sqrt(x * x + y * y + z * z);
+        return double3(x / l, y / l, z / l);
+    }
+
+    double dot(const double3& a, const double3& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    std::vector<Environment> createEnvironments()
+    {
+        std::vector<Environment> environments;
+
+        // a constant c, only band 0 is c * 2 sqrt(pi) and the irradiance is c
+        {
+            const double c = 1.5;
+            Environment env;
+            env.name = "constant";
+            env.sh[0] = c * 2 * std::sqrt(ibl::sh::PI);
+            env.radiance = [c](const double3&) { return c; };
+            env.reconstruct = [c](const double3&, size_t, bool) { return c; };
+            env.constant = true;
+            environments.push_back(env);
+        }
+
+        // sums of the functions of band l, the projection gives back their weights
+        for (size_t l = 0; l <= ORDER; l++) {
+            Environment env;
+            env.name = "band " + std::to_string(l);
+            env.band = l;
+            for (size_t m = 0; m < 2 * l + 1; m++) {
+                env.sh[l * l + m] = std::cos(1.0 + l + 0.7 * m);
+            }
+            const std::shared_ptr<std::vector<double>> sh(new std::vector<double>(env.sh, env.sh + NUM_COEFS));
+            env.radiance = [sh](const double3& n) { return evaluateSH(sh->data(), n, ORDER, false); };
+            env.reconstruct = [sh](const double3& n, size_t order, bool irradiance) {
+                return evaluateSH(sh->data(), n, order, irradiance);
+            };
+            environments.push_back(env);
+        }
+
+        // max(0, d.n), by Funk-Hecke band l is A_l Y_l(d) where A_l is the clamped cosine itself.
+        // truncated to bands 0..order it is sum A_l (2l + 1) / 4pi P_l(d.n), the irradiance has A_l^2 / pi.
+        const double3 lobes[] = {normalize(0.48, 0.8, 0.36), normalize(-0.6, -0.2, 0.77)};
+        for (size_t i = 0; i < 2; i++) {
+            const double3 d = lobes[i];
+            Environment env;
+            env.name = "lobe " + std::to_string(i + 1);
+            double Y[NUM_COEFS];
+            ibl::sh::Basis<ORDER>::evaluate(d.x, d.y, d.z, Y);
+            for (size_t l = 0; l <= ORDER; l++) {
+                for (size_t k = l * l; k < (l + 1) * (l + 1); k++) {
+                    env.sh[k] = ibl::sh::computeTruncatedCosSh(l) * Y[k];
+                }
+            }
+            env.radiance = [d](const double3& n) { return std::max(0.0, dot(d, n)); };
+            env.reconstruct = [d](const double3& n, size_t order, bool irradiance) {
+                const double t = dot(d, n);
+                double v = 0;
+                for (size_t l = 0; l <= order; l++) {
+                    const double A = ibl::sh::computeTruncatedCosSh(l);
+                    v += (irradiance ? A * A / ibl::sh::PI : A) * (2 * l + 1) / (4 * ibl::sh::PI) * legendre(l, t);
+                }
+                return v;
+            };
+            environments.push_back(env);
+        }
+        return environments;
+    }
+
+    // the largest error of a check over the environments, relative to its bound
+    struct Check
+    {
+        std::string name;
+        std::string simd;
+        std::string environment;
+        double error = 0;               // against the closed form
+        double bound = 0;
+        double referenceError = -1;     // against the double path, negative if there is none
+        double referenceBound = 0;
+        double ratio = -1;
+    };
+
+    class Report
+    {
+    public:
+        void setSimd(const char* simd) { mSimd = simd; }
+
+        void add(const std::string& name, const std::string& environment, double error, double bound,
+                 double referenceError = -1, double referenceBound = 0)
+        {
+            const std::string key = mSimd + " " + name;
+            auto it = mIndices.find(key);
+            if (it == mIndices.end()) {
+                it = mIndices.emplace(key, mChecks.size()).first;
+                mChecks.emplace_back();
+                mChecks.back().name = name;
+                mChecks.back().simd = mSimd;
+            }
+            Check& check = mChecks[it->second];
+
+            // a NaN makes the ratio infinite
+            double ratio = getRatio(error, bound);
+            if (referenceError >= 0 || std::isnan(referenceError)) {
+                ratio = std::max(ratio, getRatio(referenceError, referenceBound));
+            }
+            if (ratio > check.ratio) {
+                check.environment = environment;
+                check.error = error;
+                check.bound = bound;
+                check.referenceError = referenceError;
+                check.referenceBound = referenceBound;
+                check.ratio = ratio;
+            }
+        }
+
+        // returns the number of failed checks
+        size_t print() const
+        {
+            printf("%-40s %-7s %-18s %10s %10s %10s %10s\n", "check", "simd", "worst", "error", "bound",
+                   "vs double", "bound");
+            size_t failures = 0;
+            for (const Check& check : mChecks) {
+                const bool failed = check.ratio > 1;
+                failures += failed ? 1 : 0;
+                printf("%-40s %-7s %-18s %10.2e %10.2e ", check.name.c_str(), check.simd.c_str(),
+                       check.environment.c_str(), check.error, check.bound);
+                if (check.referenceError >= 0 || std::isnan(check.referenceError)) {
+                    printf("%10.2e %10.2e", check.referenceError, check.referenceBound);
+                } else {
+                    printf("%10s %10s", "-", "-");
+                }
+                printf(" %s\n", failed ? "FAILED" : "ok");
+            }
+            printf("%zu of %zu checks failed\n", failures, mChecks.size());
+            return failures;
+        }
+
+    private:
+        static double getRatio(double error, double bound)
+        {
+            if (std::isnan(error)) {
+                return INFINITY;
+            }
+            return bound > 0 ? error / bound : (error > 0 ? INFINITY : 0);
+        }
+
+        std::string mSimd;
+        std::vector<Check> mChecks;
+        std::map<std::string, size_t> mIndices;
+    };
+
+    // the largest difference of the coefficients relative to scale times the channel, NaN if any is
+    double compareSH(const double3* sh, const double3* ref, size_t count, double scale)
+    {
+        double error = 0;
+        for (size_t i = 0; i < count; i++) {
+            for (size_t ch = 0; ch < 3; ch++) {
+                const double d = std::abs(sh[i][ch] - ref[i][ch]) / (scale * CHANNELS[ch]);
+                if (!(d <= error)) {
+                    error = d;
+                }
+            }
+        }
+        return error;
+    }
+
+    // same for texels, texel(i, ch) reads channel ch of texel i of the faces in the order of Cubemap::Face
+    double compareTexels(const std::vector<double>& ref, double scale,
+                         const std::function<double(size_t, size_t)>& texel)
+    {
+        double error = 0;
+        for (size_t i = 0; i < ref.size(); i++) {
+            for (size_t ch = 0; ch < 3; ch++) {
+                const double d = std::abs(texel(i, ch) - ref[i] * CHANNELS[ch]) / (scale * CHANNELS[ch]);
+                if (!(d <= error)) {
+                    error = d;
+                }
+            }
+        }
+        return error;
+    }
+
+    double compareTexels(const std::vector<double>& ref, double scale, ibl::TexelFormat format, const void* data)
+    {
+        if (format == ibl::TexelFormat::RGBA16F) {
+            const uint16_t* texels = static_cast<const uint16_t*>(data);
+            return compareTexels(ref, scale, [texels](size_t i, size_t ch) {
+                return double(ibl::halfToFloat(texels[i * 4 + ch]));
+            });
+        }
+        const float* texels = static_cast<const float*>(data);
+        return compareTexels(ref, scale, [texels](size_t i, size_t ch) { return double(texels[i * 3 + ch]); });
+    }
+
+    // the faces of dim, packed
+    std::vector<ibl::Image> createFaces(Cubemap& cm)
+    {
+        const size_t dim = cm.getDimensions();
+        std::vector<ibl::Image> faces;
+        for (size_t f = 0; f < 6; f++) {
+            faces.emplace_back(dim, dim);
+            cm.setImageForFace(Cubemap::Face(f), faces.back());
+        }
+        return faces;
+    }
+
+    // the directions of the centers of the texels in the order of Cubemap::Face
+    std::vector<double3> getTexelDirections(const Cubemap& cm)
+    {
+        const size_t dim = cm.getDimensions();
+        std::vector<double3> directions;
+        directions.reserve(6 * dim * dim);
+        for (size_t f = 0; f < 6; f++) {
+            for (size_t y = 0; y < dim; y++) {
+                for (size_t x = 0; x < dim; x++) {
+                    directions.push_back(cm.getDirectionFor(Cubemap::Face(f), x, y));
+                }
+            }
+        }
+        return directions;
+    }
+
+    SHArray toChannels(const double* sh, size_t count)
+    {
+        SHArray SH(new double3[count]);
+        for (size_t i = 0; i < count; i++) {
+            SH[i] = double3(sh[i] * CHANNELS[0], sh[i] * CHANNELS[1], sh[i] * CHANNELS[2]);
+        }
+        return SH;
+    }
+
+    SHArray copySH(const SHArray& sh, size_t count)
+    {
+        SHArray SH(new double3[count]);
+        std::copy(sh.get(), sh.get() + count, SH.get());
+        return SH;
+    }
+
+    // an environment as the paths see it, with the results of the double paths at the scalar level
+    struct Scene
+    {
+        Scene(const Environment& env, ThreadPool& pool)
+            : cube(DIMENSIONS)
+            , faces(createFaces(cube))
+            , latLong(4 * DIMENSIONS, 2 * DIMENSIONS)
+        {
+            const std::vector<double3> directions = getTexelDirections(cube);
+            for (size_t i = 0; i < directions.size(); i++) {
+                const double v = env.radiance(directions[i]);
+                const float3 texel(float(v * CHANNELS[0]), float(v * CHANNELS[1]), float(v * CHANNELS[2]));
+                Cubemap::writeAt(faces[i / (DIMENSIONS * DIMENSIONS)].getPixelRef(i % DIMENSIONS, i / DIMENSIONS % DIMENSIONS), texel);
+                peak = std::max(peak, std::abs(v));
+                radiance.push_back(env.reconstruct(directions[i], ORDER, false));
+                irradiance.push_back(env.reconstruct(directions[i], ORDER, true));
+                irradiance3Bands.push_back(env.reconstruct(directions[i], 2, true));
+            }
+
+            // see computeRadianceSHLatLong()
+            const size_t width = latLong.getWidth();
+            const size_t height = latLong.getHeight();
+            for (size_t y = 0; y < height; y++) {
+                const double theta = (y + 0.5) * ibl::sh::PI / height;
+                for (size_t x = 0; x < width; x++) {
+                    const double phi = (x + 0.5) * 2 * ibl::sh::PI / width - ibl::sh::PI;
+                    const double3 n(std::sin(theta) * std::sin(phi), std::cos(theta), std::sin(theta) * std::cos(phi));
+                    const double v = env.radiance(n);
+                    Cubemap::writeAt(latLong.getPixelRef(x, y),
+                                     float3(float(v * CHANNELS[0]), float(v * CHANNELS[1]), float(v * CHANNELS[2])));
+                }
+            }
+
+            double irradianceSH[NUM_COEFS];
+            for (size_t l = 0; l <= ORDER; l++) {
+                for (size_t k = l * l; k < (l + 1) * (l + 1); k++) {
+                    irradianceSH[k] = env.sh[k] * getIrradianceScale(l);
+                    scale = std::max(scale, std::abs(env.sh[k]));
+                }
+            }
+            exactRadiance = toChannels(env.sh, NUM_COEFS);
+            exactIrradiance = toChannels(irradianceSH, NUM_COEFS);
+            exactIrradiance3Bands = toChannels(irradianceSH, 9);
+            ibl::preScaleSH3Bands(exactIrradiance3Bands.get());
+
+            const ibl::SimdLevel level = ibl::getSimdLevel();
+            ibl::setSimdLevel(ibl::SimdLevel::Scalar);
+            doubleRadiance = ibl::computeRadianceSH(cube, ORDER, pool);
+            doubleIrradiance = ibl::computeIrradianceSH(cube, ORDER, pool);
+            doubleIrradiance3Bands = copySH(doubleIrradiance, 9);
+            ibl::preScaleSH3Bands(doubleIrradiance3Bands.get());
+            doubleLatLongRadiance = ibl::computeRadianceSHLatLong(latLong, ORDER, pool);
+            doubleLatLongIrradiance = ibl::computeIrradianceSHLatLong(latLong, ORDER, pool);
+            doubleLatLongIrradiance3Bands = copySH(doubleLatLongIrradiance, 9);
+            ibl::preScaleSH3Bands(doubleLatLongIrradiance3Bands.get());
+            ibl::setSimdLevel(level);
+        }
+
+        using float3 = Cubemap::Texel;
+
+        Cubemap cube;
+        std::vector<ibl::Image> faces;
+        ibl::Image latLong;
+
+        double scale = 0;       // the largest coefficient of the radiance
+        double peak = 0;        // the largest texel of the radiance
+
+        // the closed form of the texels
+        std::vector<double> radiance;
+        std::vector<double> irradiance;
+        std::vector<double> irradiance3Bands;
+
+        SHArray exactRadiance;
+        SHArray exactIrradiance;
+        SHArray exactIrradiance3Bands;
+
+        SHArray doubleRadiance;
+        SHArray doubleIrradiance;
+        SHArray doubleIrradiance3Bands;
+        SHArray doubleLatLongRadiance;
+        SHArray doubleLatLongIrradiance;
+        SHArray doubleLatLongIrradiance3Bands;
+    };
+
+    template <typename P>
+    constexpr bool isDouble()
+    {
+        return std::is_same<typename P::Real, double>::value;
+    }
+
+    // the projections with the policy P
+    template <typename P>
+    void checkProjections(Report& report, const Environment& env, const Scene& scene, const std::string& policy,
+                          ThreadPool& pool)
+    {
+        const double bound = isDouble<P>() ? DOUBLE_BOUND : FLOAT_BOUND;
+        const double cubeBound = CUBE_BOUND + bound;
+        const double latLongBound = LATLONG_BOUND + bound;
+
+        auto add = [&](const std::string& name, const SHArray& sh, const SHArray& exact, const SHArray& reference,
+                       size_t count, double exactBound) {
+            report.add(name + " " + policy, env.name, compareSH(sh.get(), exact.get(), count, scene.scale), exactBound,
+                       compareSH(sh.get(), reference.get(), count, scene.scale), bound);
+        };
+
+        add("radiance<8>", ibl::computeRadianceSH<ORDER, P>(scene.cube, pool),
+            scene.exactRadiance, scene.doubleRadiance, NUM_COEFS, cubeBound);
+        add("irradiance<8>", ibl::computeIrradianceSH<ORDER, P>(scene.cube, pool),
+            scene.exactIrradiance, scene.doubleIrradiance, NUM_COEFS, cubeBound);
+        add("radiance", ibl::computeRadianceSH<P>(scene.cube, ORDER, pool),
+            scene.exactRadiance, scene.doubleRadiance, NUM_COEFS, cubeBound);
+        add("irradiance", ibl::computeIrradianceSH<P>(scene.cube, ORDER, pool),
+            scene.exactIrradiance, scene.doubleIrradiance, NUM_COEFS, cubeBound);
+        add("irradiance 3 bands", ibl::computeIrradianceSH3Bands<P>(scene.cube, pool),
+            scene.exactIrradiance3Bands, scene.doubleIrradiance3Bands, 9, cubeBound);
+
+        // the lower orders are the first bands of the higher ones
+        for (size_t order = 1; order < ORDER; order++) {
+            add("radiance 1-7", ibl::computeRadianceSH<P>(scene.cube, order, pool),
+                scene.exactRadiance, scene.doubleRadiance, ibl::sh::getCoefCount(order), cubeBound);
+        }
+
+        add("latlong radiance", ibl::computeRadianceSHLatLong<P>(scene.latLong, ORDER, pool),
+            scene.exactRadiance, scene.doubleLatLongRadiance, NUM_COEFS, latLongBound);
+        add("latlong irradiance", ibl::computeIrradianceSHLatLong<P>(scene.latLong, ORDER, pool),
+            scene.exactIrradiance, scene.doubleLatLongIrradiance, NUM_COEFS, latLongBound);
+        add("latlong irradiance 3 bands", ibl::computeIrradianceSH3BandsLatLong<P>(scene.latLong, pool),
+            scene.exactIrradiance3Bands, scene.doubleLatLongIrradiance3Bands, 9, latLongBound);
+
+        // a few rows at a time from the bottom up
+        {
+            ibl::StreamingProjector<P> projector(DIMENSIONS, ORDER, pool);
+            for (size_t f = 0; f < 6; f++) {
+                const ibl::Image& image = scene.faces[f];
+                for (size_t end = DIMENSIONS; end > 0; ) {
+                    const size_t count = std::min(end, size_t(5));
+                    end -= count;
+                    projector.addRows(Cubemap::Face(f), end, count, image.getPixelRef(0, end), image.getBytesPerRow());
+                }
+            }
+            add("streaming radiance", projector.getRadianceSH(),
+                scene.exactRadiance, scene.doubleRadiance, NUM_COEFS, cubeBound);
+            add("streaming irradiance", projector.getIrradianceSH(),
+                scene.exactIrradiance, scene.doubleIrradiance, NUM_COEFS, cubeBound);
+        }
+
+        // the tables of the cubemap are made again after those of the latlong image
+        {
+            ibl::ProjectionContext context(pool);
+            SHArray sh(new double3[NUM_COEFS]);
+            context.computeRadianceSH<P>(scene.cube, ORDER, sh.get());
+            add("context radiance", sh, scene.exactRadiance, scene.doubleRadiance, NUM_COEFS, cubeBound);
+            context.computeIrradianceSH<P>(scene.cube, ORDER, sh.get());
+            add("context irradiance", sh, scene.exactIrradiance, scene.doubleIrradiance, NUM_COEFS, cubeBound);
+            context.computeRadianceSHLatLong<P>(scene.latLong, ORDER, sh.get());
+            add("context latlong radiance", sh,
+                scene.exactRadiance, scene.doubleLatLongRadiance, NUM_COEFS, latLongBound);
+            context.computeIrradianceSHLatLong<P>(scene.latLong, ORDER, sh.get());
+            add("context latlong irradiance", sh,
+                scene.exactIrradiance, scene.doubleLatLongIrradiance, NUM_COEFS, latLongBound);
+            context.computeRadianceSH<P>(scene.cube, ORDER, sh.get());
+            add("context radiance", sh, scene.exactRadiance, scene.doubleRadiance, NUM_COEFS, cubeBound);
+        }
+
+        // the error of the selected level is relative to band 0, which only the positive environments have
+        if (env.sh[0] > 0) {
+            const ibl::MipChain mips(scene.cube, 1, pool);
+            for (double tolerance : {1e-2, 1e-3}) {
+                ibl::MipSelection selection;
+                const SHArray sh = ibl::computeIrradianceSH<P>(mips, 2, tolerance, &selection, pool);
+                char name[64];
+                snprintf(name, sizeof(name), "irradiance mips %.0e %s", tolerance, policy.c_str());
+                report.add(name, env.name + " level " + std::to_string(selection.level),
+                           compareSH(sh.get(), scene.exactIrradiance.get(), 9, scene.exactIrradiance[0][0]),
+                           tolerance + CUBE_BOUND);
+            }
+        }
+    }
+
+    // the changes from a constant to the environment. the update paths are double only, but
+    // the differences of the texels are float.
+    void checkUpdates(Report& report, const Environment& env, const Scene& scene, const Scene& base, ThreadPool& pool)
+    {
+        std::vector<ibl::DirtyRegion> regions;
+        for (size_t f = 0; f < 6; f++) {
+            regions.push_back({Cubemap::Face(f), 0, 0, DIMENSIONS, DIMENSIONS,
+                               static_cast<const Cubemap::Texel*>(base.faces[f].getData()),
+                               static_cast<const Cubemap::Texel*>(scene.faces[f].getData())});
+        }
+        const double bound = CUBE_BOUND + FLOAT_BOUND;
+
+        // from the projection of the constant, so that the result is that of the environment
+        SHArray sh = ibl::updateRadianceSH(scene.cube, ORDER, base.doubleRadiance, regions, pool);
+        report.add("update radiance", env.name, compareSH(sh.get(), scene.exactRadiance.get(), NUM_COEFS, scene.scale),
+                   bound, compareSH(sh.get(), scene.doubleRadiance.get(), NUM_COEFS, scene.scale), FLOAT_BOUND);
+        sh = ibl::updateIrradianceSH(scene.cube, ORDER, base.doubleIrradiance, regions, pool);
+        report.add("update irradiance", env.name, compareSH(sh.get(), scene.exactIrradiance.get(), NUM_COEFS, scene.scale),
+                   bound, compareSH(sh.get(), scene.doubleIrradiance.get(), NUM_COEFS, scene.scale), FLOAT_BOUND);
+        sh = ibl::updateIrradianceSH3Bands(scene.cube, base.doubleIrradiance3Bands, regions, pool);
+        report.add("update irradiance 3 bands", env.name,
+                   compareSH(sh.get(), scene.exactIrradiance3Bands.get(), 9, scene.scale), bound,
+                   compareSH(sh.get(), scene.doubleIrradiance3Bands.get(), 9, scene.scale), FLOAT_BOUND);
+    }
+
+    // the closed form coefficients rendered with the policy P
+    template <typename P>
+    void checkRenders(Report& report, const Environment& env, const Scene& scene, const std::string& policy,
+                      ThreadPool& pool)
+    {
+        Cubemap target(DIMENSIONS);
+        const std::vector<ibl::Image> faces = createFaces(target);
+        auto compare = [&](const std::vector<double>& ref) {
+            return compareTexels(ref, scene.peak, [&](size_t i, size_t ch) {
+                const size_t texels = DIMENSIONS * DIMENSIONS;
+                const ibl::Image& image = faces[i / texels];
+                return double(Cubemap::sampleAt(image.getPixelRef(i % DIMENSIONS, i % texels / DIMENSIONS))[ch]);
+            });
+        };
+
+        const double bound = isDouble<P>() ? DOUBLE_RENDER_BOUND : FLOAT_RENDER_BOUND;
+
+        ibl::renderSH<ORDER, P>(target, scene.exactRadiance, pool);
+        report.add("render radiance<8> " + policy, env.name, compare(scene.radiance), bound);
+        ibl::renderSH<P>(target, ORDER, scene.exactIrradiance, pool);
+        report.add("render irradiance " + policy, env.name, compare(scene.irradiance), bound);
+        ibl::renderPreScaledSH3Bands<P>(target, scene.exactIrradiance3Bands, pool);
+        report.add("render 3 bands " + policy, env.name, compare(scene.irradiance3Bands), bound);
+    }
+
+    // the renders into texel formats, always in float
+    void checkFormatRenders(Report& report, const Environment& env, const Scene& scene, ThreadPool& pool)
+    {
+        const size_t texels = 6 * DIMENSIONS * DIMENSIONS;
+        for (ibl::TexelFormat format : {ibl::TexelFormat::RGB32F, ibl::TexelFormat::RGBA16F}) {
+            const std::string suffix = format == ibl::TexelFormat::RGB32F ? " rgb32f" : " rgba16f";
+            const double bound = format == ibl::TexelFormat::RGB32F ? FLOAT_RENDER_BOUND : HALF_BOUND;
+            std::unique_ptr<uint8_t[]> data(new uint8_t[texels * ibl::getBytesPerTexel(format)]);
+
+            ibl::renderSH(DIMENSIONS, ORDER, scene.exactRadiance.get(), format, data.get(), pool);
+            report.add("render radiance" + suffix, env.name,
+                       compareTexels(scene.radiance, scene.peak, format, data.get()), bound);
+            ibl::renderSH(DIMENSIONS, ORDER, scene.exactIrradiance.get(), format, data.get(), pool);
+            report.add("render irradiance" + suffix, env.name,
+                       compareTexels(scene.irradiance, scene.peak, format, data.get()), bound);
+            ibl::renderPreScaledSH3Bands(DIMENSIONS, scene.exactIrradiance3Bands.get(), format, data.get(), pool);
+            report.add("render 3 bands" + suffix, env.name,
+                       compareTexels(scene.irradiance3Bands, scene.peak, format, data.get()), bound);
+        }
+    }
+
+    // the batch lookups at the centers of the texels, where nearest and bilinear read the texel itself
+    void checkLookups(Report& report, const Environment& env, const Scene& scene)
+    {
+        const std::vector<double3> directions = getTexelDirections(scene.cube);
+        const size_t count = directions.size();
+        std::vector<float> x(count), y(count), z(count), s(count), t(count), r(count), g(count), b(count);
+        std::vector<uint8_t> faces(count);
+        for (size_t i = 0; i < count; i++) {
+            x[i] = float(directions[i].x);
+            y[i] = float(directions[i].y);
+            z[i] = float(directions[i].z);
+        }
+
+        // in two calls, so that both end in a partial batch
+        const size_t first = 5;
+        ibl::getAddressesFor(x.data(), y.data(), z.data(), first, faces.data(), s.data(), t.data());
+        ibl::getAddressesFor(&x[first], &y[first], &z[first], count - first, &faces[first], &s[first], &t[first]);
+        double error = 0;
+        for (size_t i = 0; i < count; i++) {
+            const Cubemap::Address addr = Cubemap::getAddressFor(directions[i]);
+            error = std::max(error, faces[i] == uint8_t(addr.face) ? 0.0 : 1.0);
+            error = std::max(error, std::max(std::abs(s[i] - addr.s), std::abs(t[i] - addr.t)));
+        }
+        report.add("address batch", env.name, error, ADDRESS_BOUND);
+
+        const std::vector<double> ref(scene.radiance.size(), 0.0);
+        for (ibl::CubemapFilter filter : {ibl::CubemapFilter::Nearest, ibl::CubemapFilter::Bilinear}) {
+            const bool nearest = filter == ibl::CubemapFilter::Nearest;
+            ibl::sampleCubemap(scene.cube, filter, x.data(), y.data(), z.data(), first, r.data(), g.data(), b.data());
+            ibl::sampleCubemap(scene.cube, filter, &x[first], &y[first], &z[first], count - first,
+                               &r[first], &g[first], &b[first]);
+            error = compareTexels(ref, scene.peak, [&](size_t i, size_t ch) {
+                const size_t texels = DIMENSIONS * DIMENSIONS;
+                const ibl::Image& image = scene.faces[i / texels];
+                const Cubemap::Texel& texel = Cubemap::sampleAt(image.getPixelRef(i % DIMENSIONS, i % texels / DIMENSIONS));
+                const float* rgb[3] = {r.data(), g.data(), b.data()};
+                return double(rgb[ch][i]) - double(texel[ch]);
+            });
+            report.add(nearest ? "sample batch nearest" : "sample batch bilinear", env.name, error,
+                       nearest ? 0.0 : BILINEAR_BOUND);
+        }
+    }
+
+    // what a GGX lobe about n = v = r of roughness scales band l by, the average of P_l(n.l)
+    // weighted by n.l over the distribution of h that the prefilter samples, in u where
+    // cos^2 theta_h = (1 - u) / (1 + (a^2 - 1) u)
+    double getLobeScale(size_t l, double roughness)
+    {
+        const double a2 = roughness * roughness * roughness * roughness;
+        const size_t steps = 1 << 16;
+        double sum = 0;
+        double weights = 0;
+        for (size_t i = 0; i < steps; i++) {
+            const double u = (i + 0.5) / steps;
+            const double nl = 2 * (1 - u) / (1 + (a2 - 1) * u) - 1;
+            if (nl > 0) {
+                sum += legendre(l, nl) * nl;
+                weights += nl;
+            }
+        }
+        return sum / weights;
+    }
+
+    // every level of a constant is that constant, the mirror level reads the source itself and
+    // the rough levels scale a single band by getLobeScale(), see LOBE_BOUND
+    void checkPrefilter(Report& report, const Environment& env, const Scene& scene, ThreadPool& pool)
+    {
+        const ibl::MipChain source(scene.cube, 1, pool);
+        const ibl::SpecularPrefilter filter(DIMENSIONS, ibl::SpecularPrefilter::getDefaultLevelCount(DIMENSIONS));
+        for (size_t level = 0; level < filter.getLevelCount(); level++) {
+            const size_t dim = filter.getDimensions(level);
+            const std::vector<double3> directions = getTexelDirections(Cubemap(dim));
+            std::vector<double> ref(directions.size());
+            std::string name = "prefilter lobe";
+            double bound = LOBE_BOUND;
+            if (env.constant) {
+                std::fill(ref.begin(), ref.end(), scene.radiance[0]);
+                name = "prefilter constant";
+                bound = PREFILTER_BOUND;
+            } else if (level == 0) {
+                for (size_t i = 0; i < ref.size(); i++) {
+                    ref[i] = env.radiance(directions[i]);
+                }
+                name = "prefilter mirror";
+                bound = ADDRESS_BOUND;
+            } else if (env.band == 1 || env.band == 2) {
+                const double scale = getLobeScale(env.band, filter.getRoughness(level));
+                for (size_t i = 0; i < ref.size(); i++) {
+                    ref[i] = scale * env.radiance(directions[i]);
+                }
+            } else {
+                continue;
+            }
+            for (ibl::TexelFormat format : {ibl::TexelFormat::RGB32F, ibl::TexelFormat::RGBA16F}) {
+                std::unique_ptr<uint8_t[]> data(new uint8_t[ref.size() * ibl::getBytesPerTexel(format)]);
+                filter.render(source, level, format, data.get(), pool);
+                report.add(name + (format == ibl::TexelFormat::RGB32F ? " rgb32f" : " rgba16f"),
+                           env.name + " level " + std::to_string(level),
+                           compareTexels(ref, scene.peak, format, data.get()),
+                           format == ibl::TexelFormat::RGB32F ? bound : std::max(bound, HALF_BOUND));
+            }
+        }
+    }
+
+    shgen_image getLibraryImage(const ibl::Image& image)
+    {
+        return {static_cast<const float*>(image.getData()), image.getWidth(), image.getHeight(), image.getBytesPerRow()};
+    }
+
+    // the faces in the order of Direct3D
+    shgen_cubemap getLibraryCubemap(const Cubemap& cm)
+    {
+        const Cubemap::Face faces[6] = {
+            Cubemap::Face::PX, Cubemap::Face::NX, Cubemap::Face::PY,
+            Cubemap::Face::NY, Cubemap::Face::PZ, Cubemap::Face::NZ,
+        };
+        shgen_cubemap cubemap;
+        for (size_t i = 0; i < 6; i++) {
+            cubemap.faces[i] = getLibraryImage(cm.getImageForFace(faces[i]));
+        }
+        return cubemap;
+    }
+
+    // the C interface against the ibl:: functions it wraps, with the policy P. only the threads
+    // of the context differ, so does the order of the sums in float.
+    template <typename P>
+    void checkLibrary(Report& report, const Environment& env, const Scene& scene, shgen::Context& library,
+                      shgen_precision precision, const std::string& policy, ThreadPool& pool)
+    {
+        const double bound = isDouble<P>() ? DOUBLE_BOUND : FLOAT_BOUND;
+        const shgen_cubemap cubemap = getLibraryCubemap(scene.cube);
+        const shgen_image latLong = getLibraryImage(scene.latLong);
+
+        auto add = [&](const std::string& name, shgen_status status, const double* coefs, const SHArray& reference) {
+            const double error = status == SHGEN_OK
+                               ? compareSH(reinterpret_cast<const double3*>(coefs), reference.get(), NUM_COEFS, scene.scale)
+                               : std::numeric_limits<double>::quiet_NaN();
+            report.add(name + " " + policy, env.name, error, bound);
+        };
+
+        std::vector<double> coefs(3 * NUM_COEFS);
+        for (shgen_quantity quantity : {SHGEN_RADIANCE, SHGEN_IRRADIANCE}) {
+            const bool radiance = quantity == SHGEN_RADIANCE;
+            const shgen_options options = {unsigned(ORDER), precision, quantity};
+            add(radiance ? "library cubemap radiance" : "library cubemap irradiance",
+                library.projectCubemap(cubemap, options, coefs.data()), coefs.data(),
+                radiance ? ibl::computeRadianceSH<P>(scene.cube, ORDER, pool)
+                         : ibl::computeIrradianceSH<P>(scene.cube, ORDER, pool));
+            add(radiance ? "library latlong radiance" : "library latlong irradiance",
+                library.projectLatLong(latLong, options, coefs.data()), coefs.data(),
+                radiance ? ibl::computeRadianceSHLatLong<P>(scene.latLong, ORDER, pool)
+                         : ibl::computeIrradianceSHLatLong<P>(scene.latLong, ORDER, pool));
+        }
+    }
+
+    // the arguments that the C interface rejects rather than projecting
+    void checkLibraryArguments(Report& report, const Scene& scene, shgen::Context& library)
+    {
+        const shgen_cubemap cubemap = getLibraryCubemap(scene.cube);
+        const shgen_image latLong = getLibraryImage(scene.latLong);
+        const shgen_options valid = {unsigned(ORDER), SHGEN_PRECISION_DOUBLE, SHGEN_IRRADIANCE};
+        std::vector<double> coefs(3 * NUM_COEFS);
+
+        std::vector<shgen_options> options(5, valid);
+        options[0].order = 0;
+        options[1].order = unsigned(ORDER + 1);
+        options[2].precision = shgen_precision(SHGEN_PRECISION_PAIRWISE + 1);
+        options[3].precision = shgen_precision(-1);
+        options[4].quantity = shgen_quantity(SHGEN_RADIANCE + 1);
+
+        size_t misses = 0;
+        auto expect = [&misses](shgen_status status) { misses += status != SHGEN_INVALID_ARGUMENT ? 1 : 0; };
+        for (const shgen_options& o : options) {
+            expect(library.projectCubemap(cubemap, o, coefs.data()));
+            expect(library.projectLatLong(latLong, o, coefs.data()));
+        }
+        expect(library.projectCubemap(cubemap, valid, nullptr));
+        expect(shgen_project_cubemap(library.get(), &cubemap, nullptr, coefs.data()));
+        expect(shgen_project_latlong(nullptr, &latLong, &valid, coefs.data()));
+
+        shgen_cubemap mixed = cubemap;
+        mixed.faces[3].width--;
+        expect(library.projectCubemap(mixed, valid, coefs.data()));
+        shgen_image narrow = latLong;
+        narrow.bytes_per_row = narrow.width * 3 * sizeof(float) - 1;
+        expect(library.projectLatLong(narrow, valid, coefs.data()));
+        expect(shgen_irradiance_matrices(coefs.data(), 1, coefs.data()));
+
+        report.add("library invalid arguments", "-", double(misses), 0);
+    }
+
+    // the addition theorem, sum_m Y_lm(a) Y_lm(b) = (2l + 1) / 4pi P_l(a.b), of random directions
+    void checkBasis(Report& report)
+    {
+        std::mt19937 random(1);
+        std::normal_distribution<double> normal;
+        double error = 0;
+        for (size_t i = 0; i < 1000; i++) {
+            const double3 a = normalize(normal(random), normal(random), normal(random));
+            const double3 b = normalize(normal(random), normal(random), normal(random));
+            double Ya[NUM_COEFS];
+            double Yb[NUM_COEFS];
+            ibl::sh::Basis<ORDER>::evaluate(a.x, a.y, a.z, Ya);
+            ibl::sh::Basis<ORDER>::evaluate(b.x, b.y, b.z, Yb);
+            for (size_t l = 0; l <= ORDER; l++) {
+                double sum = 0;
+                for (size_t k = l * l; k < (l + 1) * (l + 1); k++) {
+                    sum += Ya[k] * Yb[k];
+                }
+                const double norm = (2 * l + 1) / (4 * ibl::sh::PI);
+                error = std::max(error, std::abs(sum - norm * legendre(l, dot(a, b))) / norm);
+            }
+        }
+        report.add("basis addition theorem", "-", error, DOUBLE_BOUND);
+    }
+
+    // the texel whose center a direction points to is the one that is read
+    void checkSampling(Report& report, const Scene& scene)
+    {
+        size_t misses = 0;
+        for (size_t f = 0; f < 6; f++) {
+            const ibl::Image& image = scene.cube.getImageForFace(Cubemap::Face(f));
+            for (size_t y = 0; y < DIMENSIONS; y++) {
+                for (size_t x = 0; x < DIMENSIONS; x++) {
+                    const Cubemap::Texel& texel = scene.cube.sampleAt(scene.cube.getDirectionFor(Cubemap::Face(f), x, y));
+                    misses += &texel != image.getPixelRef(x, y) ? 1 : 0;
+                }
+            }
+        }
+        report.add("sample at texel centers", "-", double(misses), 0);
+    }
+
+    // the files of the format checks are written here and removed afterwards
+    const char TEMP_PATH[] = "shgen_accuracy.tmp";
+
+    bool readAll(const std::string& path, std::vector<uint8_t>& data)
+    {
+        fs::FileHandle handle = fs::openFile(path, fs::FileMode::Open | fs::FileAccess::Read | fs::FileShare::Read);
+        if (handle.isInvalid()) {
+            return false;
+        }
+        data.resize(fs::fileSize(handle));
+        const bool ok = fs::readFile(handle, data.data(), data.size()) == data.size();
+        fs::closeFile(handle);
+        return ok;
+    }
+
+    bool writeAll(const std::string& path, const std::vector<uint8_t>& data)
+    {
+        fs::FileHandle handle = fs::openFile(path, fs::FileMode::Create | fs::FileAccess::Write);
+        if (handle.isInvalid()) {
+            return false;
+        }
+        const bool ok = fs::writeFile(handle, data.data(), data.size()) == data.size();
+        fs::closeFile(handle);
+        return ok;
+    }
+
+    void append(std::vector<uint8_t>& data, const std::string& text)
+    {
+        data.insert(data.end(), text.begin(), text.end());
+    }
+
+    // a channel of the texels as Radiance writes it, runs of 3 or more equal bytes and dumps
+    // of the rest
+    void encodeChannel(const uint8_t* rgbe, size_t width, size_t ch, std::vector<uint8_t>& data)
+    {
+        auto getRun = [&](size_t x) {
+            size_t count = 1;
+            while (x + count < width && count < 127 && rgbe[(x + count) * 4 + ch] == rgbe[x * 4 + ch]) {
+                count++;
+            }
+            return count;
+        };
+        for (size_t x = 0; x < width; ) {
+            const size_t run = getRun(x);
+            if (run >= 3) {
+                data.push_back(uint8_t(128 + run));
+                data.push_back(rgbe[x * 4 + ch]);
+                x += run;
+                continue;
+            }
+            size_t count = 0;
+            while (x + count < width && count < 128 && getRun(x + count) < 3) {
+                count++;
+            }
+            data.push_back(uint8_t(count));
+            for (size_t i = 0; i < count; i++) {
+                data.push_back(rgbe[(x + i) * 4 + ch]);
+            }
+            x += count;
+        }
+    }
+
+    // the texels as the old run length encoding writes them, the count of a repeat of the
+    // previous texel is split in bytes, the lowest first
+    void encodeRepeats(const uint8_t* rgbe, size_t width, std::vector<uint8_t>& data)
+    {
+        for (size_t x = 0; x < width; ) {
+            data.insert(data.end(), rgbe + x * 4, rgbe + x * 4 + 4);
+            size_t count = 0;
+            while (x + 1 + count < width && std::equal(rgbe + x * 4, rgbe + x * 4 + 4, rgbe + (x + 1 + count) * 4)) {
+                count++;
+            }
+            x += 1 + count;
+            for (; count > 0; count >>= 8) {
+                data.insert(data.end(), {1, 1, 1, uint8_t(count & 0xff)});
+            }
+        }
+    }
+
+    // random texels written flat, in the old and in the adaptive run length encoding, top down
+    // and bottom up, decode to m * 2^(e - 136) exactly
+    void checkHdr(Report& report)
+    {
+        enum class Encoding
+        {
+            Flat,
+            Repeats,    // 1 1 1 n
+            Adaptive,
+        };
+        struct Layout
+        {
+            const char* name;
+            size_t width;
+            Encoding encoding;
+            bool bottomUp;
+        };
+        const Layout layouts[] = {
+            {"flat -Y", 5, Encoding::Flat, false},
+            {"flat +Y", 7, Encoding::Flat, true},
+            {"repeats -Y", 600, Encoding::Repeats, false},
+            {"adaptive -Y", 300, Encoding::Adaptive, false},
+            {"adaptive +Y", 40, Encoding::Adaptive, true},
+        };
+        const size_t height = 3;
+
+        std::mt19937 random(1);
+        for (const Layout& layout : layouts) {
+            // some texels repeat the previous one and the exponents come in runs of 8, so that
+            // the adaptive encoding has both runs and dumps. the old one repeats runs of 300
+            // texels, which take 2 repeats, so that a scanline is much shorter than its width.
+            const size_t width = layout.width;
+            std::vector<uint8_t> rgbe(width * height * 4);
+            for (size_t i = 0; i < width * height; i++) {
+                uint8_t* texel = &rgbe[i * 4];
+                const bool repeat = layout.encoding == Encoding::Repeats ? i % 300 != 0
+                                                                          : i % width > 0 && random() % 4 == 0;
+                if (repeat) {
+                    std::copy(texel - 4, texel, texel);
+                    continue;
+                }
+                for (size_t ch = 0; ch < 3; ch++) {
+                    texel[ch] = uint8_t(random());
+                }
+                texel[3] = uint8_t(120 + (i / 8) % 16);
+            }
+
+            std::vector<uint8_t> data;
+            append(data, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n");
+            append(data, (layout.bottomUp ? "+Y " : "-Y ") + std::to_string(height) + " +X " + std::to_string(width) + "\n");
+            for (size_t y = 0; y < height; y++) {
+                const uint8_t* row = &rgbe[(layout.bottomUp ? height - 1 - y : y) * width * 4];
+                if (layout.encoding == Encoding::Adaptive) {
+                    data.insert(data.end(), {2, 2, uint8_t(width >> 8), uint8_t(width & 0xff)});
+                    for (size_t ch = 0; ch < 4; ch++) {
+                        encodeChannel(row, width, ch, data);
+                    }
+                } else if (layout.encoding == Encoding::Repeats) {
+                    encodeRepeats(row, width, data);
+                } else {
+                    data.insert(data.end(), row, row + width * 4);
+                }
+            }
+
+            ibl::Image image;
+            size_t misses = width * height;
+            if (writeAll(TEMP_PATH, data) && hdr::load(TEMP_PATH, image) && image.getWidth() == width &&
+                image.getHeight() == height)
+            {
+                misses = 0;
+                for (size_t i = 0; i < width * height; i++) {
+                    const float* texel = static_cast<const float*>(image.getPixelRef(i % width, i / width));
+                    for (size_t ch = 0; ch < 3; ch++) {
+                        misses += texel[ch] != std::ldexp(double(rgbe[i * 4 + ch]), rgbe[i * 4 + 3] - 136) ? 1 : 0;
+                    }
+                }
+            }
+            fs::removeFile(TEMP_PATH);
+            report.add("hdr round trip", layout.name, double(misses), 0);
+        }
+    }
+
+    // random floats written in either byte order, the rows bottom up
+    void checkPfm(Report& report)
+    {
+        struct Layout
+        {
+            const char* name;
+            size_t channels;
+            bool littleEndian;
+        };
+        const Layout layouts[] = {
+            {"PF little endian", 3, true},
+            {"Pf big endian", 1, false},
+        };
+        const size_t width = 5;
+        const size_t height = 4;
+
+        std::mt19937 random(1);
+        std::normal_distribution<float> normal;
+        for (const Layout& layout : layouts) {
+            std::vector<float> values(width * height * layout.channels);
+            for (float& v : values) {
+                v = normal(random);
+            }
+
+            std::vector<uint8_t> data;
+            append(data, std::string(layout.channels == 3 ? "PF" : "Pf") + "\n" + std::to_string(width) + " " +
+                         std::to_string(height) + "\n" + (layout.littleEndian ? "-1.0" : "1.0") + "\n");
+            for (size_t y = 0; y < height; y++) {
+                const size_t row = (height - 1 - y) * width * layout.channels;
+                for (size_t i = 0; i < width * layout.channels; i++) {
+                    uint32_t bits;
+                    std::memcpy(&bits, &values[row + i], sizeof(bits));
+                    for (size_t b = 0; b < 4; b++) {
+                        data.push_back(uint8_t(bits >> (layout.littleEndian ? 8 * b : 24 - 8 * b)));
+                    }
+                }
+            }
+
+            ibl::Image image;
+            size_t misses = width * height;
+            if (writeAll(TEMP_PATH, data) && pfm::load(TEMP_PATH, image) && image.getWidth() == width &&
+                image.getHeight() == height)
+            {
+                misses = 0;
+                for (size_t i = 0; i < width * height; i++) {
+                    const float* texel = static_cast<const float*>(image.getPixelRef(i % width, i / width));
+                    for (size_t ch = 0; ch < 3; ch++) {
+                        misses += texel[ch] != values[i * layout.channels + (layout.channels == 3 ? ch : 0)] ? 1 : 0;
+                    }
+                }
+            }
+            fs::removeFile(TEMP_PATH);
+            report.add("pfm round trip", layout.name, double(misses), 0);
+        }
+    }
+
+    // what a value reads back as once stored in format
+    double getStoredValue(shb::Format format, double value)
+    {
+        return format == shb::Format::Float16 ? ibl::halfToFloat(ibl::floatToHalf(float(value))) : float(value);
+    }
+
+    double readValue(shb::Format format, const uint8_t* src)
+    {
+        if (format == shb::Format::Float16) {
+            uint16_t half;
+            std::memcpy(&half, src, sizeof(half));
+            return ibl::halfToFloat(half);
+        }
+        float value;
+        std::memcpy(&value, src, sizeof(value));
+        return value;
+    }
+
+    // the coefficients of random probes through a .shb file, an archive and a volume
+    void checkShb(Report& report)
+    {
+        const size_t probeCount = 12;
+        const uint8_t flags = shb::PRE_SCALED;
+
+        std::mt19937 random(1);
+        std::normal_distribution<double> normal;
+        std::vector<std::vector<double3>> probes(probeCount, std::vector<double3>(NUM_COEFS));
+        for (std::vector<double3>& sh : probes) {
+            for (double3& c : sh) {
+                c = double3(normal(random), normal(random), normal(random));
+            }
+        }
+
+        for (shb::Format format : {shb::Format::Float32, shb::Format::Float16}) {
+            const char* name = format == shb::Format::Float32 ? "float32" : "float16";
+            const size_t bytesPerValue = shb::getBytesPerValue(format);
+            auto countMisses = [format, bytesPerValue](const uint8_t* src, const std::vector<double3>& sh, size_t stride) {
+                size_t misses = 0;
+                for (size_t k = 0; k < NUM_COEFS; k++) {
+                    for (size_t ch = 0; ch < 3; ch++) {
+                        misses += readValue(format, src + k * stride + ch * bytesPerValue) !=
+                                  getStoredValue(format, sh[k][ch]) ? 1 : 0;
+                    }
+                }
+                return misses;
+            };
+
+            // a single probe in memory
+            size_t misses = NUM_COEFS;
+            const std::vector<uint8_t> encoded = shb::encode(ORDER, flags, format, probes[0].data());
+            shb::Header header;
+            std::vector<double3> decoded;
+            if (shb::decode(encoded.data(), encoded.size(), header, decoded) && header.order == ORDER &&
+                header.flags == flags && header.format == uint8_t(format) && decoded.size() == NUM_COEFS)
+            {
+                misses = 0;
+                for (size_t k = 0; k < NUM_COEFS; k++) {
+                    for (size_t ch = 0; ch < 3; ch++) {
+                        misses += decoded[k][ch] != getStoredValue(format, probes[0][k][ch]) ? 1 : 0;
+                    }
+                }
+            }
+            report.add("shb round trip", name, double(misses), 0);
+
+            // the probes by name, and one that is not there
+            shb::ArchiveWriter archive(ORDER, flags, format);
+            for (size_t i = 0; i < probeCount; i++) {
+                archive.add("probe " + std::to_string(i), probes[i].data());
+            }
+            std::vector<uint8_t> data;
+            shb::ArchiveView archiveView;
+            misses = probeCount + 1;
+            if (archive.save(TEMP_PATH) && readAll(TEMP_PATH, data) &&
+                shb::parseArchive(data.data(), data.size(), archiveView) &&
+                archiveView.header->probeCount == probeCount && archiveView.header->flags == flags)
+            {
+                misses = shb::findProbe(archiveView, "probe") != probeCount ? 1 : 0;
+                for (size_t i = 0; i < probeCount; i++) {
+                    const uint32_t probe = shb::findProbe(archiveView, "probe " + std::to_string(i));
+                    misses += probe == probeCount ||
+                              countMisses(static_cast<const uint8_t*>(shb::getProbeData(archiveView, probe)),
+                                          probes[i], 3 * bytesPerValue) != 0 ? 1 : 0;
+                }
+            }
+            fs::removeFile(TEMP_PATH);
+            report.add("shb archive round trip", name, double(misses), 0);
+
+            // the probes of a grid, the last one is left 0
+            const size_t width = 3;
+            const size_t height = 2;
+            const size_t depth = 2;
+            shb::VolumeWriter volume(ORDER, flags, format, width, height, depth);
+            for (size_t i = 0; i + 1 < probeCount; i++) {
+                volume.set(i, probes[i].data());
+            }
+            shb::VolumeView volumeView;
+            misses = probeCount;
+            if (volume.save(TEMP_PATH) && readAll(TEMP_PATH, data) &&
+                shb::parseVolume(data.data(), data.size(), volumeView) && volumeView.header->width == width &&
+                volumeView.header->height == height && volumeView.header->depth == depth)
+            {
+                misses = 0;
+                const std::vector<double3> zero(NUM_COEFS, double3(0, 0, 0));
+                for (size_t i = 0; i < probeCount; i++) {
+                    const uint8_t* src = static_cast<const uint8_t*>(shb::getPlaneData(volumeView, 0)) + i * 4 * bytesPerValue;
+                    size_t wrong = countMisses(src, i + 1 < probeCount ? probes[i] : zero, size_t(volumeView.header->planeStride));
+                    for (size_t k = 0; k < NUM_COEFS; k++) {
+                        wrong += readValue(format, src + k * volumeView.header->planeStride + 3 * bytesPerValue) != 0 ? 1 : 0;
+                    }
+                    misses += wrong != 0 ? 1 : 0;
+                }
+            }
+            fs::removeFile(TEMP_PATH);
+            report.add("shb volume round trip", name, double(misses), 0);
+        }
+    }
+
+    // doubles of every magnitude are written with the fewest digits that read back the same,
+    // and the punctuation is that of the files shgen writes
+    void checkJson(Report& report)
+    {
+        std::mt19937_64 random(1);
+        std::vector<double> values = {0.1, 1.0 / 3, 1e300, -2.5e-310, std::numeric_limits<double>::min(),
+                                      std::numeric_limits<double>::max(), std::numeric_limits<double>::denorm_min()};
+        while (values.size() < 1000) {
+            const uint64_t bits = random();
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            if (std::isfinite(value)) {
+                values.push_back(value);
+            }
+        }
+
+        json::Writer shortest;
+        shortest.setPrecision(0);
+        shortest.beginArray();
+        for (double value : values) {
+            shortest.value(value);
+        }
+        shortest.endArray();
+        const std::string text = shortest.getString();
+        const char* s = text.c_str() + 1;
+        size_t misses = 0;
+        for (double value : values) {
+            char* next = nullptr;
+            misses += std::strtod(s, &next) != value ? 1 : 0;
+            s = next + (*next == ',' ? 2 : 0);
+        }
+        misses += std::strcmp(s, "]") != 0 ? 1 : 0;
+        report.add("json shortest round trip", "-", double(misses), 0);
+
+        json::Writer writer;
+        writer.beginObject();
+        writer.key("a");
+        writer.value(0.1);
+        writer.key("list");
+        writer.beginArray();
+        writer.value(42);
+        writer.value(true);
+        writer.null();
+        writer.value("q\"\\\n\t");
+        writer.beginArray();
+        writer.endArray();
+        writer.endArray();
+        writer.key("object");
+        writer.beginObject();
+        writer.endObject();
+        writer.endObject();
+        json::Writer rounded;
+        rounded.setPrecision(3);
+        rounded.beginArray();
+        rounded.value(3.14159);
+        rounded.value(1.0 / 3);
+        rounded.endArray();
+        const char* expected = "{\"a\": 0.1, \"list\": [42, true, null, \"q\\\"\\\\\\n\\t\", []], \"object\": {}}";
+        misses = writer.getString() != expected ? 1 : 0;
+        misses += rounded.getString() != "[3.14, 0.333]" ? 1 : 0;
+        report.add("json writer output", "-", double(misses), 0);
+    }
+}
+
+namespace accuracy
+{
+    size_t run(ThreadPool& pool)
+    {
+        const ibl::SimdLevel top = ibl::getSimdLevel();
+        const std::vector<Environment> environments = createEnvironments();
+        const Scene base(environments[0], pool);
+
+        Report report;
+        report.setSimd("-");
+        checkBasis(report);
+        checkSampling(report, base);
+        checkHdr(report);
+        checkPfm(report);
+        checkShb(report);
+        checkJson(report);
+
+        shgen::Context library;
+        checkLibraryArguments(report, base, library);
+
+        for (const Environment& env : environments) {
+            const Scene scene(env, pool);
+            for (int level = 0; level <= int(top); level++) {
+                ibl::setSimdLevel(ibl::SimdLevel(level));
+                report.setSimd(ibl::getSimdLevelName(ibl::SimdLevel(level)));
+                checkProjections<ibl::precision::Double>(report, env, scene, "double", pool);
+                checkProjections<ibl::precision::FloatKahan>(report, env, scene, "float kahan", pool);
+                checkProjections<ibl::precision::FloatPairwise>(report, env, scene, "float pairwise", pool);
+                checkUpdates(report, env, scene, base, pool);
+                checkRenders<ibl::precision::Double>(report, env, scene, "double", pool);
+                checkRenders<ibl::precision::FloatKahan>(report, env, scene, "float kahan", pool);
+                checkRenders<ibl::precision::FloatPairwise>(report, env, scene, "float pairwise", pool);
+                checkLibrary<ibl::precision::Double>(report, env, scene, library, SHGEN_PRECISION_DOUBLE, "double", pool);
+                checkLibrary<ibl::precision::FloatKahan>(report, env, scene, library, SHGEN_PRECISION_KAHAN,
+                                                         "float kahan", pool);
+                checkLibrary<ibl::precision::FloatPairwise>(report, env, scene, library, SHGEN_PRECISION_PAIRWISE,
+                                                            "float pairwise", pool);
+                checkFormatRenders(report, env, scene, pool);
+                checkLookups(report, env, scene);
+                checkPrefilter(report, env, scene, pool);
+            }
+        }
+        ibl::setSimdLevel(top);
+
+        return report.print();
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef ACCURACY_H__
+#define ACCURACY_H__
+#pragma once
+
+#include <cstdint>
+
+#include "ibl/thread_pool.h"
+
+namespace accuracy
+{
+    // Checks the projection and render paths against environments whose spherical harmonics
+    // are known in closed form: a constant, functions of a single band and clamped cosine
+    // lobes. Every variant runs at every SIMD level up to the current one, the coefficients
+    // and the texels have to stay within bounds relative to the magnitude of the environment.
+    // The .hdr and .pfm readers, the .shb files, archives and volumes and the JSON writer have
+    // to read back what was written.
+    // Prints one line per check and returns the number of those that failed.
+    size_t run(ibl::ThreadPool& pool = ibl::ThreadPool::getDefault());
+}
+
+#endif
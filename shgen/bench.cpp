@@ -0,0 +1,455 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ibl/cpu_features.h"
+#include "ibl/cubemap_lookup.h"
+#include "ibl/spherical_harmonics.h"
+#include "accuracy.h"
+#include "dds.h"
+#include "fsutil.h"
+#include "jsonwriter.h"
+
+#define VERSION "1.0.0"
+
+#define ABORT(msg) { puts(msg); return 1; }
+#define ARG_CASE(s) if (kv.first == s)
+#define CHECK_NUM_ARGS(p) if (kv.second.size() < p) continue;
+
+namespace
+{
+    const char helpText[] =
+        "\n"
+        "shgen_bench v" VERSION "\n"
+        "---------------------------------------------------------------------\n"
+        "  Usage: shgen_bench <options>\n"
+        "\n"
+        "  合成したキューブマップをメモリ上に作り、射影、放射照度の描画、方向からのテクセルの参照(一括参照を含む)、\n"
+        "  DDSの書き出しと読み込みの時間を、サイズとスレッド数ごとに計測します。\n"
+        "\n"
+        "OPTIONS\n"
+        "  -h, --help\n"
+            "\tこれを表示します。\n"
+        "  --sizes <face size>...\n"
+            "\t計測する面のサイズを指定します。初期値は64 256 1024 2048です。\n"
+            "\t8192の面は1枚あたり768MB、キューブマップ全体で4.5GBのメモリを使います。\n"
+        "  --threads <count>...\n"
+            "\t計測するスレッド数を指定します。初期値は1からハードウェアスレッド数までの2のべき乗です。\n"
+            "\tDDSの書き出しと読み込みは1スレッドでのみ計測します。\n"
+        "  --min-time <seconds>\n"
+            "\t1項目あたりの最短の計測時間です。初期値は0.25秒で、少なくとも3回は繰り返します。\n"
+        "  --simd <scalar|sse4|avx2|avx512>\n"
+            "\t使用する命令セットの上限を指定します。初期値はCPUが対応する最上位です。\n"
+        "  --temp <filename>\n"
+            "\tDDSの書き出しと読み込みに使う一時ファイルです。初期値は\"shgen_bench.dds\"です。\n"
+        "  --json <filename>\n"
+            "\t結果をJSON形式で出力します。コミット間の比較に使えます。\n"
+        "  --label <text>\n"
+            "\tJSONの出力に記録する任意の文字列です。コミットのハッシュなどを指定します。\n"
+        "  --accuracy\n"
+            "\t計測の代わりに、球面調和関数が解析的に求まる環境(定数、単一バンドの関数、余弦ローブ)で\n"
+            "\t射影と描画のすべての経路の誤差と、ファイル形式の読み書きを確かめます。\n"
+            "\t許容値を超えたものがあれば1を返します。\n"
+            "\t--simdで指定した命令セットまでのすべての段階で実行します。\n"
+        "\n";
+
+    struct Spec
+    {
+        std::vector<size_t> sizes = {64, 256, 1024, 2048};
+        std::vector<size_t> threads;
+        double minTime = 0.25;
+        std::string temp = "shgen_bench.dds";
+        std::string json;
+        std::string label;
+        bool accuracy = false;
+    };
+
+    // the time of a benchmark and what it went through per run
+    struct Result
+    {
+        std::string name;
+        size_t size = 0;
+        size_t threads = 0;
+        size_t runs = 0;
+        double best = 0;        // seconds
+        double median = 0;
+        double texels = 0;      // per run
+        double bytes = 0;
+    };
+
+    std::map<std::string, std::vector<std::string>> parseOptions(int argc, char* argv[])
+    {
+        std::map<std::string, std::vector<std::string>> options;
+        for (int argPos = 1; argPos < argc; argPos++) {
+            const char* arg = argv[argPos];
+            if (arg[0] != '-') {
+                printf("Unknown setting: %s\nUse --help for more information.\n", arg);
+                continue;
+            }
+            std::vector<std::string>& values = options[arg];
+            while (argPos + 1 < argc && argv[argPos + 1][0] != '-') {
+                values.push_back(argv[++argPos]);
+            }
+        }
+        return options;
+    }
+
+    int parseArgs(int argc, char* argv[], Spec& spec)
+    {
+        auto options = parseOptions(argc, argv);
+        for (const auto& kv : options) {
+            if (kv.first == "-h" || kv.first == "--help") {
+                printf("%s", helpText);
+                return -1;
+            }
+            ARG_CASE("--sizes") {
+                CHECK_NUM_ARGS(1);
+                spec.sizes.clear();
+                for (const std::string& value : kv.second) {
+                    const size_t size = std::strtoul(value.c_str(), nullptr, 10);
+                    if (size < 1 || size > 16384) ABORT("--sizes must be between 1 and 16384.");
+                    spec.sizes.push_back(size);
+                }
+                continue;
+            }
+            ARG_CASE("--threads") {
+                CHECK_NUM_ARGS(1);
+                for (const std::string& value : kv.second) {
+                    const size_t count = std::strtoul(value.c_str(), nullptr, 10);
+                    if (count < 1) ABORT("--threads must be positive.");
+                    spec.threads.push_back(count);
+                }
+                continue;
+            }
+            ARG_CASE("--min-time") {
+                CHECK_NUM_ARGS(1);
+                spec.minTime = std::strtod(kv.second[0].c_str(), nullptr);
+                continue;
+            }
+            ARG_CASE("--simd") {
+                CHECK_NUM_ARGS(1);
+                const std::string& name = kv.second[0];
+                ibl::SimdLevel level = ibl::SimdLevel::Scalar;
+                if (name == "sse4") level = ibl::SimdLevel::SSE4;
+                else if (name == "avx2") level = ibl::SimdLevel::AVX2;
+                else if (name == "avx512") level = ibl::SimdLevel::AVX512;
+                else if (name != "scalar") ABORT("--simd must be scalar, sse4, avx2 or avx512.");
+                ibl::setSimdLevel(level);
+                continue;
+            }
+            ARG_CASE("--temp") {
+                CHECK_NUM_ARGS(1);
+                spec.temp = kv.second[0];
+                continue;
+            }
+            ARG_CASE("--json") {
+                CHECK_NUM_ARGS(1);
+                spec.json = kv.second[0];
+                continue;
+            }
+            ARG_CASE("--label") {
+                CHECK_NUM_ARGS(1);
+                spec.label = kv.second[0];
+                continue;
+            }
+            ARG_CASE("--accuracy") {
+                spec.accuracy = true;
+                continue;
+            }
+        }
+
+        if (spec.threads.empty()) {
+            const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+            for (size_t count = 1; count < hardware; count *= 2) {
+                spec.threads.push_back(count);
+            }
+            spec.threads.push_back(hardware);
+        }
+        return 0;
+    }
+
+    // a sky with a sun and a ground, smooth but not of low order
+    ibl::Cubemap::Texel getSyntheticRadiance(const ibl::math::double3& r)
+    {
+        const double sun = std::pow(std::max(0.0, 0.48 * r.x + 0.8 * r.y + 0.36 * r.z), 64.0) * 50.0;
+        if (r.y < 0) {
+            return ibl::Cubemap::Texel(float(0.3 + sun), float(0.25 + sun), float(0.2 + sun));
+        }
+        return ibl::Cubemap::Texel(float(0.4 + 0.6 * r.y + sun), float(0.6 + 0.4 * r.y + sun), float(1.0 + sun));
+    }
+
+    // the faces of a cubemap of dim filled with the synthetic radiance, cm refers to them
+    std::vector<ibl::Image> createSyntheticCubemap(ibl::Cubemap& cm, ibl::ThreadPool& pool)
+    {
+        const size_t dim = cm.getDimensions();
+        std::vector<ibl::Image> faces;
+        for (size_t f = 0; f < 6; f++) {
+            faces.emplace_back(dim, dim);
+            cm.setImageForFace(ibl::Cubemap::Face(f), faces.back());
+        }
+        pool.parallelFor(6 * dim, pool.suggestGrain(6 * dim), [&](size_t, size_t begin, size_t end) {
+            for (size_t row = begin; row < end; row++) {
+                const ibl::Cubemap::Face face = ibl::Cubemap::Face(row / dim);
+                const size_t y = row % dim;
+                const ibl::Image& image = cm.getImageForFace(face);
+                for (size_t x = 0; x < dim; x++) {
+                    ibl::Cubemap::writeAt(image.getPixelRef(x, y), getSyntheticRadiance(cm.getDirectionFor(face, x, y)));
+                }
+            }
+        });
+        return faces;
+    }
+
+    double getSeconds()
+    {
+        using Clock = std::chrono::steady_clock;
+        return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+    }
+
+    // runs fn once to warm up, then at least 3 times and for at least minTime seconds
+    Result measure(const Spec& spec, const char* name, size_t size, size_t threads, double texels, double bytes,
+                   const std::function<bool()>& fn)
+    {
+        Result result;
+        result.name = name;
+        result.size = size;
+        result.threads = threads;
+        result.texels = texels;
+        result.bytes = bytes;
+        if (!fn()) {
+            printf("%-14s %6zu %4zu failed\n", name, size, threads);
+            return result;
+        }
+
+        std::vector<double> times;
+        double total = 0;
+        while (times.size() < 3 || total < spec.minTime) {
+            const double start = getSeconds();
+            fn();
+            times.push_back(getSeconds() - start);
+            total += times.back();
+        }
+        std::sort(times.begin(), times.end());
+        result.runs = times.size();
+        result.best = times.front();
+        result.median = times[times.size() / 2];
+
+        printf("%-14s %6zu %4zu %10.3f %10.3f %12.1f %10.2f\n", name, size, threads, result.best * 1e3,
+               result.median * 1e3, texels / result.best * 1e-6, bytes / result.best * 1e-9);
+        fflush(stdout);
+        return result;
+    }
+
+    bool saveResults(const Spec& spec, const std::vector<Result>& results)
+    {
+        json::Writer writer(spec.json);
+        writer.beginObject();
+        writer.key("version");
+        writer.value(VERSION);
+        writer.key("label");
+        writer.value(spec.label);
+        writer.key("simd");
+        writer.value(ibl::getSimdLevelName(ibl::getSimdLevel()));
+        writer.key("hardware_threads");
+        writer.value(std::thread::hardware_concurrency());
+        writer.key("results");
+        writer.beginArray();
+        for (const Result& result : results) {
+            writer.beginObject();
+            writer.key("name");
+            writer.value(result.name);
+            writer.key("size");
+            writer.value(result.size);
+            writer.key("threads");
+            writer.value(result.threads);
+            writer.key("runs");
+            writer.value(result.runs);
+            writer.key("best_seconds");
+            writer.value(result.best);
+            writer.key("median_seconds");
+            writer.value(result.median);
+            writer.key("texels_per_second");
+            writer.value(result.runs ? result.texels / result.best : 0.0);
+            writer.key("bytes_per_second");
+            writer.value(result.runs ? result.bytes / result.best : 0.0);
+            writer.endObject();
+        }
+        writer.endArray();
+        writer.endObject();
+        return writer.close();
+    }
+
+    // the benchmarks of a cubemap of size, for every thread count
+    void runBenchmarks(const Spec& spec, size_t size, std::vector<Result>& results)
+    {
+        const double texels = 6.0 * size * size;
+        const double bytes = texels * sizeof(ibl::Cubemap::Texel);
+
+        ibl::Cubemap cm(size);
+        std::vector<ibl::Image> faces = createSyntheticCubemap(cm, ibl::ThreadPool::getDefault());
+        ibl::Cubemap target(size);
+        std::vector<ibl::Image> targetFaces;
+        for (size_t f = 0; f < 6; f++) {
+            targetFaces.emplace_back(size, size);
+            target.setImageForFace(ibl::Cubemap::Face(f), targetFaces.back());
+        }
+        std::unique_ptr<uint8_t[]> half(new uint8_t[size_t(texels) * ibl::getBytesPerTexel(ibl::TexelFormat::RGBA16F)]);
+
+        // as many directions as texels, up to a table that stays out of the way of the caches of the faces
+        std::vector<ibl::math::double3> directions(std::min(size_t(texels), size_t(1) << 20));
+        std::mt19937 random(1);
+        std::normal_distribution<double> normal;
+        for (auto& d : directions) {
+            d = ibl::math::double3(normal(random), normal(random), normal(random));
+        }
+        const size_t numLookups = size_t(texels);
+
+        // the same directions as arrays of their coordinates for the batch lookups
+        std::vector<float> dx(directions.size()), dy(directions.size()), dz(directions.size());
+        for (size_t i = 0; i < directions.size(); i++) {
+            dx[i] = float(directions[i].x);
+            dy[i] = float(directions[i].y);
+            dz[i] = float(directions[i].z);
+        }
+        const ibl::simd::CubemapLevel level = ibl::simd::getCubemapLevel(cm);
+
+        for (size_t threads : spec.threads) {
+            ibl::ThreadPool pool(threads);
+            std::unique_ptr<ibl::math::double3[]> sh;
+
+            results.push_back(measure(spec, "project", size, threads, texels, bytes, [&]() {
+                sh = ibl::computeIrradianceSH3Bands(cm, pool);
+                return true;
+            }));
+            results.push_back(measure(spec, "render", size, threads, texels, bytes, [&]() {
+                ibl::renderPreScaledSH3Bands(target, sh, pool);
+                return true;
+            }));
+            results.push_back(measure(spec, "render_half", size, threads, texels,
+                                      texels * ibl::getBytesPerTexel(ibl::TexelFormat::RGBA16F), [&]() {
+                ibl::renderPreScaledSH3Bands(size, sh.get(), ibl::TexelFormat::RGBA16F, half.get(), pool);
+                return true;
+            }));
+
+            // getAddressFor() alone and with the read of the texel
+            std::vector<double> sums(pool.getSlotCount());
+            results.push_back(measure(spec, "address", size, threads, double(numLookups), 0, [&]() {
+                pool.parallelFor(numLookups, pool.suggestGrain(numLookups), [&](size_t slot, size_t begin, size_t end) {
+                    double sum = 0;
+                    size_t j = begin % directions.size();
+                    for (size_t i = begin; i < end; i++) {
+                        const ibl::Cubemap::Address addr = ibl::Cubemap::getAddressFor(directions[j]);
+                        sum += addr.s + addr.t + double(addr.face);
+                        if (++j == directions.size()) {
+                            j = 0;
+                        }
+                    }
+                    sums[slot] += sum;
+                });
+                return true;
+            }));
+            results.push_back(measure(spec, "sample", size, threads, double(numLookups), numLookups * sizeof(ibl::Cubemap::Texel), [&]() {
+                pool.parallelFor(numLookups, pool.suggestGrain(numLookups), [&](size_t slot, size_t begin, size_t end) {
+                    double sum = 0;
+                    size_t j = begin % directions.size();
+                    for (size_t i = begin; i < end; i++) {
+                        const ibl::Cubemap::Texel& texel = cm.sampleAt(directions[j]);
+                        sum += texel.x + texel.y + texel.z;
+                        if (++j == directions.size()) {
+                            j = 0;
+                        }
+                    }
+                    sums[slot] += sum;
+                });
+                return true;
+            }));
+
+            // the batch lookups, BATCH directions at a time
+            constexpr size_t BATCH = 256;
+            auto lookupBatches = [&](const std::function<void(size_t, size_t, float*, float*, float*)>& fn) {
+                pool.parallelFor(numLookups, pool.suggestGrain(numLookups), [&](size_t slot, size_t begin, size_t end) {
+                    float a[BATCH], b[BATCH], c[BATCH];
+                    double sum = 0;
+                    size_t j = begin % directions.size();
+                    for (size_t i = begin; i < end; ) {
+                        const size_t count = std::min(std::min(BATCH, end - i), directions.size() - j);
+                        fn(j, count, a, b, c);
+                        sum += a[0] + b[count - 1] + c[count / 2];
+                        i += count;
+                        j += count;
+                        if (j == directions.size()) {
+                            j = 0;
+                        }
+                    }
+                    sums[slot] += sum;
+                });
+            };
+            const ibl::simd::AddressBatchFn addressBatch = ibl::simd::getAddressBatch();
+            results.push_back(measure(spec, "address_batch", size, threads, double(numLookups), 0, [&]() {
+                lookupBatches([&](size_t j, size_t count, float* s, float* t, float*) {
+                    uint8_t faces[BATCH];
+                    addressBatch(&dx[j], &dy[j], &dz[j], count, faces, s, t);
+                });
+                return true;
+            }));
+            for (ibl::CubemapFilter filter : {ibl::CubemapFilter::Nearest, ibl::CubemapFilter::Bilinear}) {
+                const ibl::simd::SampleBatchFn sampleBatch = ibl::simd::getSampleBatch(filter);
+                const bool nearest = filter == ibl::CubemapFilter::Nearest;
+                results.push_back(measure(spec, nearest ? "sample_batch" : "bilinear", size, threads, double(numLookups),
+                                          numLookups * sizeof(ibl::Cubemap::Texel) * (nearest ? 1 : 4), [&]() {
+                    lookupBatches([&](size_t j, size_t count, float* r, float* g, float* b) {
+                        sampleBatch(level, &dx[j], &dy[j], &dz[j], count, r, g, b);
+                    });
+                    return true;
+                }));
+            }
+        }
+
+        // the bytes of the file with its header
+        fs::FileInfo info;
+        const double fileBytes = dds::save(spec.temp, cm) && fs::getFileInfo(spec.temp, info) ? double(info.size) : bytes;
+        results.push_back(measure(spec, "save", size, 1, texels, fileBytes, [&]() {
+            return dds::save(spec.temp, cm);
+        }));
+        results.push_back(measure(spec, "load", size, 1, texels, fileBytes, [&]() {
+            dds::Info info;
+            std::vector<ibl::Image> surfaces;
+            return dds::load(spec.temp, info, surfaces);
+        }));
+        std::remove(spec.temp.c_str());
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Spec spec;
+    int ret = parseArgs(argc, argv, spec);
+    if (ret != 0)
+        return ret < 0 ? 0 : ret;
+
+    if (spec.accuracy) {
+        return accuracy::run() == 0 ? 0 : 1;
+    }
+
+    printf("simd %s, %u hardware threads\n", ibl::getSimdLevelName(ibl::getSimdLevel()), std::thread::hardware_concurrency());
+    printf("%-14s %6s %4s %10s %10s %12s %10s\n", "benchmark", "size", "thr", "best ms", "median ms", "Mtexel/s", "GB/s");
+
+    std::vector<Result> results;
+    for (size_t size : spec.sizes) {
+        runBenchmarks(spec, size, results);
+    }
+
+    if (!spec.json.empty() && !saveResults(spec, results))
+        ABORT("Failed to write the results.");
+    return 0;
+}
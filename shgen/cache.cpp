@@ -0,0 +1,213 @@
+#include "cache.h"
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "fsutil.h"
+#include "hash.h"
+
+namespace
+{
+    const char INDEX_NAME[] = "index.txt";
+
+    bool readAll(const std::string& path, std::vector<uint8_t>& data)
+    {
+        fs::FileHandle handle = fs::openFile(path, fs::FileMode::Open | fs::FileAccess::Read | fs::FileShare::Read);
+        if (handle.isInvalid()) {
+            return false;
+        }
+        data.resize(fs::fileSize(handle));
+        const bool ok = fs::readFile(handle, data.data(), data.size()) == data.size();
+        fs::closeFile(handle);
+        return ok;
+    }
+
+    // a name next to path that no other thread or process writes to at the same time
+    std::string getTemporaryPath(const std::string& path)
+    {
+        static const uint64_t process = (uint64_t(std::random_device()()) << 32) | std::random_device()();
+        static std::atomic<uint64_t> counter(0);
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), ".%016" PRIx64 "-%" PRIu64 ".tmp", process, counter++);
+        return path + suffix;
+    }
+
+    // the file at path is replaced once the data has been written in full, so that a crash or
+    // another bake writing the same entry never leaves a truncated one behind
+    bool writeAll(const std::string& path, const void* data, size_t size)
+    {
+        const std::string temporary = getTemporaryPath(path);
+        fs::FileHandle handle = fs::openFile(temporary, fs::FileMode::Create | fs::FileAccess::Write);
+        if (handle.isInvalid()) {
+            return false;
+        }
+        bool ok = fs::writeFile(handle, data, size) == size;
+        fs::closeFile(handle);
+        ok = ok && fs::renameFile(temporary, path);
+        if (!ok) {
+            fs::removeFile(temporary);
+        }
+        return ok;
+    }
+
+    // one input per line: key size mtime options path, the path last as it may hold spaces
+    template <typename Record>
+    void parseIndex(std::vector<uint8_t>& data, std::map<std::string, Record>& index)
+    {
+        data.push_back('\0');
+        const char* s = reinterpret_cast<const char*>(data.data());
+        while (*s) {
+            Record record;
+            char* next = nullptr;
+            record.key = std::strtoull(s, &next, 16);
+            record.size = std::strtoull(next, &next, 10);
+            record.mtime = std::strtoull(next, &next, 10);
+            record.options = std::strtoull(next, &next, 16);
+            s = next;
+            if (*s == ' ') {
+                s++;
+            }
+            const char* end = s;
+            while (*end && *end != '\n') {
+                end++;
+            }
+            if (end > s) {
+                index[std::string(s, end)] = record;
+            }
+            s = *end ? end + 1 : end;
+        }
+    }
+
+    bool copyFile(const std::string& src, const std::string& dst)
+    {
+        std::vector<uint8_t> data;
+        return readAll(src, data) && writeAll(dst, data.data(), data.size());
+    }
+}
+
+namespace cache
+{
+    ResultCache::ResultCache(const std::string& directory)
+        : mDirectory(fs::standardizePath(directory, true))
+    {
+        fs::createDirectory(mDirectory);
+
+        std::vector<uint8_t> data;
+        if (readAll(mDirectory + INDEX_NAME, data)) {
+            parseIndex(data, mIndex);
+        }
+    }
+
+    ResultCache::~ResultCache()
+    {
+        saveIndex();
+    }
+
+    bool ResultCache::getKey(const std::string& path, const std::string& options, uint64_t& key)
+    {
+        fs::FileInfo info;
+        if (!fs::getFileInfo(path, info)) {
+            return false;
+        }
+        const uint64_t optionsHash = hash::xxh64(options.data(), options.size());
+
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            auto it = mIndex.find(info.abspath);
+            if (it != mIndex.end() && it->second.size == info.size && it->second.mtime == info.mtime &&
+                it->second.options == optionsHash)
+            {
+                key = it->second.key;
+                return true;
+            }
+        }
+
+        // the options seed the hash of the content, so that they change the key as much
+        if (info.size == 0) {
+            key = hash::xxh64(nullptr, 0, optionsHash);
+        } else {
+            fs::MappedFile file = fs::mapFile(path, fs::MapHint::Sequential);
+            if (file.isInvalid()) {
+                return false;
+            }
+            key = hash::xxh64(file.data, file.size, optionsHash);
+            fs::unmapFile(file);
+        }
+
+        Record record;
+        record.size = info.size;
+        record.mtime = info.mtime;
+        record.options = optionsHash;
+        record.key = key;
+
+        std::lock_guard<std::mutex> lock(mLock);
+        mIndex[info.abspath] = record;
+        mChanged.insert(info.abspath);
+        return true;
+    }
+
+    bool ResultCache::fetch(uint64_t key, const std::string& suffix, const std::string& path) const
+    {
+        return copyFile(getEntryPath(key, suffix), path);
+    }
+
+    bool ResultCache::store(uint64_t key, const std::string& suffix, const std::string& path)
+    {
+        return copyFile(path, getEntryPath(key, suffix));
+    }
+
+    bool ResultCache::read(uint64_t key, const std::string& suffix, std::vector<uint8_t>& data) const
+    {
+        return readAll(getEntryPath(key, suffix), data);
+    }
+
+    bool ResultCache::write(uint64_t key, const std::string& suffix, const void* data, size_t size)
+    {
+        return writeAll(getEntryPath(key, suffix), data, size);
+    }
+
+    void ResultCache::saveIndex()
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mChanged.empty()) {
+            return;
+        }
+
+        // the records of the other processes that use the directory since it was read are
+        // kept, those of the inputs seen here replace theirs
+        std::map<std::string, Record> index;
+        std::vector<uint8_t> data;
+        if (readAll(mDirectory + INDEX_NAME, data)) {
+            parseIndex(data, index);
+        }
+        for (const std::string& path : mChanged) {
+            index[path] = mIndex[path];
+        }
+
+        std::string text;
+        char line[128];
+        for (auto& kv : index) {
+            const Record& r = kv.second;
+            snprintf(line, sizeof(line), "%016" PRIx64 " %" PRIu64 " %" PRIu64 " %016" PRIx64 " ",
+                     r.key, r.size, r.mtime, r.options);
+            text += line;
+            text += kv.first;
+            text += '\n';
+        }
+        if (writeAll(mDirectory + INDEX_NAME, text.data(), text.size())) {
+            mIndex.swap(index);
+            mChanged.clear();
+        }
+    }
+
+    std::string ResultCache::getEntryPath(uint64_t key, const std::string& suffix) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016" PRIx64, key);
+        return mDirectory + name + suffix;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef CACHE_H__
+#define CACHE_H__
+#pragma once
+
+#include <cstdint>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace cache
+{
+    // Persistent cache of the outputs of shgen in a directory. An entry is keyed by the hash
+    // of the content of the input and of the options it was computed with, and holds one file
+    // per kind of output, e.g. <key>.json. An index remembers the key of every input by path,
+    // size and modification time, so an unchanged input is not even read to find its key.
+    // Files are written under a temporary name and renamed into place, and the index is merged
+    // with the one on disk when it is saved, so several bakes may share a directory.
+    // The methods may be called from several threads.
+    class ResultCache
+    {
+    public:
+        // the directory is created if needed, the index is read from it
+        explicit ResultCache(const std::string& directory);
+
+        ResultCache(const ResultCache&) = delete;
+        ResultCache& operator=(const ResultCache&) = delete;
+
+        // writes the index back
+        ~ResultCache();
+
+        // the key of the input at path with options, from the index if the input has the size
+        // and the modification time recorded there, from its content otherwise.
+        // false if the input cannot be read.
+        bool getKey(const std::string& path, const std::string& options, uint64_t& key);
+
+        // copies the file of kind suffix of the entry key to path, false if there is none
+        bool fetch(uint64_t key, const std::string& suffix, const std::string& path) const;
+
+        // copies the file at path into the entry key as its file of kind suffix
+        bool store(uint64_t key, const std::string& suffix, const std::string& path);
+
+        // same for data in memory
+        bool read(uint64_t key, const std::string& suffix, std::vector<uint8_t>& data) const;
+        bool write(uint64_t key, const std::string& suffix, const void* data, size_t size);
+
+        void saveIndex();
+
+    private:
+        struct Record
+        {
+            uint64_t size = 0;
+            uint64_t mtime = 0;
+            uint64_t options = 0;
+            uint64_t key = 0;
+        };
+
+        std::string getEntryPath(uint64_t key, const std::string& suffix) const;
+
+        std::string mDirectory;
+        std::mutex mLock;
+        std::map<std::string, Record> mIndex;     // by absolute path of the input
+        std::set<std::string> mChanged;           // the inputs whose records were added here
+    };
+}
+
+#endif
@@ -0,0 +1,354 @@
+#include "dds.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ibl/trace.h"
+
+namespace
+{
+    const uint32_t DDS_MAGIC = 0x20534444;     // "DDS "
+    const uint32_t DDS_FOURCC = 0x00000004;
+    const uint32_t DDSD_MIPMAPCOUNT = 0x00020000;
+    const uint32_t DDSCAPS2_CUBEMAP = 0x00000200;
+    const uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+    constexpr uint32_t makeFourCC(char c0, char c1, char c2, char c3)
+    {
+        return uint32_t(uint8_t(c0)) | (uint32_t(uint8_t(c1)) << 8) | (uint32_t(uint8_t(c2)) << 16) | (uint32_t(uint8_t(c3)) << 24);
+    }
+
+    // D3DFMT values some writers put in the FourCC instead of a DX10 header
+    const uint32_t D3DFMT_A16B16G16R16F = 113;
+    const uint32_t D3DFMT_A32B32G32R32F = 116;
+
+    struct PixelFormat
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t fourCC;
+        uint32_t rgbBitCount;
+        uint32_t rBitMask;
+        uint32_t gBitMask;
+        uint32_t bBitMask;
+        uint32_t aBitMask;
+    };
+
+    struct Header
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t height;
+        uint32_t width;
+        uint32_t pitchOrLinearSize;
+        uint32_t depth;
+        uint32_t mipMapCount;
+        uint32_t reserved1[11];
+        PixelFormat ddspf;
+        uint32_t caps;
+        uint32_t caps2;
+        uint32_t caps3;
+        uint32_t caps4;
+        uint32_t reserved2;
+    };
+
+    struct HeaderDXT10
+    {
+        uint32_t dxgiFormat;
+        uint32_t resourceDimension;
+        uint32_t miscFlag;
+        uint32_t arraySize;
+        uint32_t miscFlags2;
+    };
+
+    static_assert(sizeof(Header) == 124, "DDS_HEADER must be 124 bytes");
+    static_assert(sizeof(HeaderDXT10) == 20, "DDS_HEADER_DXT10 must be 20 bytes");
+
+    const size_t MAX_HEADER_SIZE = sizeof(uint32_t) + sizeof(Header) + sizeof(HeaderDXT10);
+
+    // beyond any texture of D3D, they keep the offsets of the surfaces far from overflowing
+    const uint32_t MAX_DIMENSION = 1 << 20;
+    const uint32_t MAX_ARRAY_SIZE = 2048;
+
+    // the mips down to 1x1
+    size_t getMaxMipLevels(size_t width, size_t height)
+    {
+        size_t levels = 1;
+        for (size_t size = std::max(width, height); size > 1; size >>= 1) {
+            levels++;
+        }
+        return levels;
+    }
+
+    bool getTexelFormat(dds::Format::Type format, ibl::TexelFormat& texelFormat)
+    {
+        switch (format) {
+        case dds::Format::R32G32B32_FLOAT:    texelFormat = ibl::TexelFormat::RGB32F; return true;
+        case dds::Format::R32G32B32A32_FLOAT: texelFormat = ibl::TexelFormat::RGBA32F; return true;
+        case dds::Format::R16G16B16A16_FLOAT: texelFormat = ibl::TexelFormat::RGBA16F; return true;
+        case dds::Format::R11G11B10_FLOAT:    texelFormat = ibl::TexelFormat::RG11B10F; return true;
+        case dds::Format::R9G9B9E5_SHAREDEXP: texelFormat = ibl::TexelFormat::RGB9E5; return true;
+        default:                              return false;
+        }
+    }
+
+    // rows read from the file at a time while loading
+    const size_t LOAD_CHUNK_BYTES = 1 << 20;
+
+    // the file with the headers of a cubemap of dim x dim faces and mipLevels mips written,
+    // invalid if it cannot be created
+    fs::FileHandle createFile(const std::string& path, size_t dim, size_t mipLevels, dds::Format::Type format,
+                              size_t rowPitch)
+    {
+        const uint32_t DDSD_CAPS_HEIGHT_WIDTH_PIXELFORMAT = 0x00001007;
+        const uint32_t DDSD_PITCH = 0x00000008;
+        const uint32_t DDSCAPS_COMPLEX = 0x00000008;
+        const uint32_t DDSCAPS_TEXTURE = 0x00001000;
+        const uint32_t DDSCAPS_MIPMAP = 0x00400000;
+        const uint32_t DDSCAPS2_CUBEMAP_ALLFACES = 0x0000fc00;
+        const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+        Header header = {};
+        header.size = sizeof(Header);
+        header.flags = DDSD_CAPS_HEIGHT_WIDTH_PIXELFORMAT | DDSD_PITCH;
+        header.height = uint32_t(dim);
+        header.width = uint32_t(dim);
+        header.pitchOrLinearSize = uint32_t(rowPitch);
+        header.ddspf.size = sizeof(PixelFormat);
+        header.ddspf.flags = DDS_FOURCC;
+        header.ddspf.fourCC = makeFourCC('D', 'X', '1', '0');
+        header.caps = DDSCAPS_COMPLEX | DDSCAPS_TEXTURE;
+        header.caps2 = DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALLFACES;
+        if (mipLevels > 1) {
+            header.flags |= DDSD_MIPMAPCOUNT;
+            header.mipMapCount = uint32_t(mipLevels);
+            header.caps |= DDSCAPS_MIPMAP;
+        }
+
+        HeaderDXT10 dx10 = {};
+        dx10.dxgiFormat = format;
+        dx10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+        dx10.miscFlag = DDS_RESOURCE_MISC_TEXTURECUBE;
+        dx10.arraySize = 1;
+
+        fs::FileHandle handle = fs::openFile(path, fs::FileMode::Create | fs::FileAccess::Write);
+        if (handle.isInvalid()) {
+            return handle;
+        }
+
+        if (fs::writeFile(handle, &DDS_MAGIC, sizeof(DDS_MAGIC)) != sizeof(DDS_MAGIC) ||
+            fs::writeFile(handle, &header, sizeof(header)) != sizeof(header) ||
+            fs::writeFile(handle, &dx10, sizeof(dx10)) != sizeof(dx10))
+        {
+            fs::closeFile(handle);
+            return fs::FileHandle();
+        }
+        return handle;
+    }
+}
+
+namespace dds
+{
+    bool parseInfo(const void* data, size_t size, Info& info)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        uint32_t magic = 0;
+        Header header = {};
+        if (size < sizeof(magic) + sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&magic, p, sizeof(magic));
+        std::memcpy(&header, p + sizeof(magic), sizeof(header));
+        if (magic != DDS_MAGIC || header.size != sizeof(Header)) {
+            return false;
+        }
+
+        info = Info();
+        info.width = header.width;
+        info.height = header.height;
+        info.mipLevels = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount ? header.mipMapCount : 1;
+        info.dataOffset = sizeof(magic) + sizeof(header);
+
+        if ((header.ddspf.flags & DDS_FOURCC) && header.ddspf.fourCC == makeFourCC('D', 'X', '1', '0')) {
+            HeaderDXT10 dx10 = {};
+            if (size < info.dataOffset + sizeof(dx10)) {
+                return false;
+            }
+            std::memcpy(&dx10, p + info.dataOffset, sizeof(dx10));
+            info.dataOffset += sizeof(dx10);
+            info.format = Format::Type(dx10.dxgiFormat);
+            info.isCubemap = (dx10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE) != 0;
+            if (dx10.arraySize > MAX_ARRAY_SIZE) {
+                return false;
+            }
+            info.arraySize = std::max(uint32_t(1), dx10.arraySize) * (info.isCubemap ? 6 : 1);
+        } else if (header.ddspf.flags & DDS_FOURCC) {
+            switch (header.ddspf.fourCC) {
+            case D3DFMT_A16B16G16R16F: info.format = Format::R16G16B16A16_FLOAT; break;
+            case D3DFMT_A32B32G32R32F: info.format = Format::R32G32B32A32_FLOAT; break;
+            default: return false;
+            }
+            info.isCubemap = (header.caps2 & DDSCAPS2_CUBEMAP) != 0;
+            info.arraySize = info.isCubemap ? 6 : 1;
+        } else {
+            return false;
+        }
+
+        if (!getTexelFormat(info.format, info.texelFormat)) {
+            return false;
+        }
+        info.bytesPerPixel = ibl::getBytesPerTexel(info.texelFormat);
+        return info.width && info.height && info.width <= MAX_DIMENSION && info.height <= MAX_DIMENSION &&
+               info.mipLevels <= getMaxMipLevels(info.width, info.height);
+    }
+
+    bool readInfo(fs::FileHandle handle, Info& info)
+    {
+        uint8_t header[MAX_HEADER_SIZE];
+        const size_t size = fs::readFile(handle, header, sizeof(header));
+        if (!parseInfo(header, size, info)) {
+            return false;
+        }
+        return fs::seekFile(handle, int64_t(info.dataOffset), fs::FileSeek::Begin) == info.dataOffset;
+    }
+
+    size_t getRowPitch(const Info& info, size_t mip)
+    {
+        return std::max(size_t(1), info.width >> mip) * info.bytesPerPixel;
+    }
+
+    size_t getSurfaceSize(const Info& info, size_t mip)
+    {
+        return getRowPitch(info, mip) * std::max(size_t(1), info.height >> mip);
+    }
+
+    size_t getSurfaceOffset(const Info& info, size_t item, size_t mip)
+    {
+        size_t itemSize = 0;
+        size_t mipOffset = 0;
+        for (size_t level = 0; level < info.mipLevels; level++) {
+            if (level == mip) {
+                mipOffset = itemSize;
+            }
+            itemSize += getSurfaceSize(info, level);
+        }
+        return info.dataOffset + item * itemSize + mipOffset;
+    }
+
+    ibl::Cubemap::Face getCubemapFace(size_t item)
+    {
+        const ibl::Cubemap::Face faces[6] = {
+            ibl::Cubemap::Face::PX, ibl::Cubemap::Face::NX,
+            ibl::Cubemap::Face::PY, ibl::Cubemap::Face::NY,
+            ibl::Cubemap::Face::PZ, ibl::Cubemap::Face::NZ,
+        };
+        return faces[item % 6];
+    }
+
+    bool load(const std::string& path, Info& info, std::vector<ibl::Image>& surfaces)
+    {
+        TRACE_SCOPE("load dds", path);
+        fs::FileHandle handle = fs::openFile(path, fs::FileMode::Open | fs::FileAccess::Read | fs::FileShare::Read);
+        if (handle.isInvalid()) {
+            return false;
+        }
+        // the header is not trusted with the size of the surfaces before they are allocated
+        if (!readInfo(handle, info) || fs::fileSize(handle) < getSurfaceOffset(info, info.arraySize, 0)) {
+            fs::closeFile(handle);
+            return false;
+        }
+
+        const ibl::simd::DecodeRowFn decodeRow = ibl::simd::getDecodeRow(info.texelFormat);
+        const bool isNative = info.texelFormat == ibl::TexelFormat::RGB32F;
+        std::vector<uint8_t> chunk;
+
+        // the surfaces are read in the order of the file
+        surfaces.clear();
+        surfaces.reserve(info.arraySize * info.mipLevels);
+        bool ok = true;
+        for (size_t item = 0; item < info.arraySize && ok; item++) {
+            for (size_t mip = 0; mip < info.mipLevels && ok; mip++) {
+                const size_t width = std::max(size_t(1), info.width >> mip);
+                const size_t height = std::max(size_t(1), info.height >> mip);
+                const size_t rowPitch = getRowPitch(info, mip);
+                surfaces.emplace_back(width, height);
+                ibl::Image& image = surfaces.back();
+
+                if (isNative) {
+                    ok = fs::readFile(handle, image.getData(), rowPitch * height) == rowPitch * height;
+                    continue;
+                }
+
+                const size_t rowsPerChunk = std::min(height, std::max(size_t(1), LOAD_CHUNK_BYTES / rowPitch));
+                chunk.resize(rowsPerChunk * rowPitch);
+                for (size_t y = 0; y < height && ok; y += rowsPerChunk) {
+                    const size_t count = std::min(rowsPerChunk, height - y);
+                    ok = fs::readFile(handle, chunk.data(), count * rowPitch) == count * rowPitch;
+                    for (size_t i = 0; i < count && ok; i++) {
+                        decodeRow(chunk.data() + i * rowPitch, width,
+                                  static_cast<ibl::Cubemap::Texel*>(image.getPixelRef(0, y + i)));
+                    }
+                }
+            }
+        }
+        fs::closeFile(handle);
+        return ok;
+    }
+
+    bool save(const std::string& path, const ibl::Cubemap& cm)
+    {
+        TRACE_SCOPE("save dds", path);
+        const size_t dim = cm.getDimensions();
+        const size_t rowPitch = dim * sizeof(ibl::Cubemap::Texel);
+
+        fs::FileHandle handle = createFile(path, dim, 1, Format::R32G32B32_FLOAT, rowPitch);
+        if (handle.isInvalid()) {
+            return false;
+        }
+
+        bool ok = true;
+        for (size_t item = 0; item < 6 && ok; item++) {
+            const ibl::Image& image = cm.getImageForFace(getCubemapFace(item));
+            for (size_t y = 0; y < dim && ok; y++) {
+                ok = fs::writeFile(handle, image.getPixelRef(0, y), rowPitch) == rowPitch;
+            }
+        }
+        fs::closeFile(handle);
+        return ok;
+    }
+
+    bool save(const std::string& path, size_t dim, ibl::TexelFormat texelFormat, const void* faces)
+    {
+        return save(path, dim, 1, texelFormat, &faces);
+    }
+
+    bool save(const std::string& path, size_t dim, size_t mipLevels, ibl::TexelFormat texelFormat,
+              const void* const* levels)
+    {
+        TRACE_SCOPE("save dds", path);
+        Format::Type format = Format::Unknown;
+        switch (texelFormat) {
+        case ibl::TexelFormat::RGB32F:  format = Format::R32G32B32_FLOAT; break;
+        case ibl::TexelFormat::RGBA16F: format = Format::R16G16B16A16_FLOAT; break;
+        default: return false;
+        }
+        const size_t bytesPerTexel = ibl::getBytesPerTexel(texelFormat);
+
+        fs::FileHandle handle = createFile(path, dim, mipLevels, format, dim * bytesPerTexel);
+        if (handle.isInvalid()) {
+            return false;
+        }
+
+        bool ok = true;
+        for (size_t item = 0; item < 6 && ok; item++) {
+            for (size_t mip = 0; mip < mipLevels && ok; mip++) {
+                const size_t mipDim = std::max(size_t(1), dim >> mip);
+                const size_t faceSize = mipDim * mipDim * bytesPerTexel;
+                const uint8_t* face = static_cast<const uint8_t*>(levels[mip]) + size_t(getCubemapFace(item)) * faceSize;
+                ok = fs::writeFile(handle, face, faceSize) == faceSize;
+            }
+        }
+        fs::closeFile(handle);
+        return ok;
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef DDS_H__
+#define DDS_H__
+#pragma once
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "ibl/cubemap.h"
+#include "ibl/texel_format.h"
+#include "fsutil.h"
+
+namespace dds
+{
+    // the DXGI_FORMAT values of the uncompressed formats understood here
+    struct Format
+    {
+        enum Type
+        {
+            Unknown             = 0,
+            R32G32B32A32_FLOAT  = 2,
+            R32G32B32_FLOAT     = 6,
+            R16G16B16A16_FLOAT  = 10,
+            R11G11B10_FLOAT     = 26,
+            R9G9B9E5_SHAREDEXP  = 67,
+        };
+    };
+
+    struct Info
+    {
+        size_t width = 0;
+        size_t height = 0;
+        size_t mipLevels = 1;
+        size_t arraySize = 1;       // number of surfaces of each mip, 6 per cube
+        bool isCubemap = false;
+        Format::Type format = Format::Unknown;
+        ibl::TexelFormat texelFormat = ibl::TexelFormat::RGB32F;
+        size_t bytesPerPixel = 0;
+        size_t dataOffset = 0;      // of the first surface from the start of the file
+    };
+
+    // parses the header at the start of data, e.g. a mapped file.
+    // returns false if it is not a DDS file or its format is not one of the above.
+    bool parseInfo(const void* data, size_t size, Info& info);
+
+    // same for an open file, the file pointer is left after the header
+    bool readInfo(fs::FileHandle handle, Info& info);
+
+    size_t getRowPitch(const Info& info, size_t mip);
+    size_t getSurfaceSize(const Info& info, size_t mip);
+
+    // the surfaces are stored item by item, all the mips of an item one after the other
+    size_t getSurfaceOffset(const Info& info, size_t item, size_t mip);
+
+    // the face of item of a cubemap, the faces are stored as +X -X +Y -Y +Z -Z
+    ibl::Cubemap::Face getCubemapFace(size_t item);
+
+    // reads every surface of the file decoded to texels, surface (item, mip) goes to
+    // surfaces[item * info.mipLevels + mip]
+    bool load(const std::string& path, Info& info, std::vector<ibl::Image>& surfaces);
+
+    // writes level 0 of cm as a R32G32B32_FLOAT cubemap
+    bool save(const std::string& path, const ibl::Cubemap& cm);
+
+    // writes faces of dim x dim packed texels of format, RGB32F or RGBA16F, in the order
+    // of ibl::Cubemap::Face, as rendered by ibl::renderSH()
+    bool save(const std::string& path, size_t dim, ibl::TexelFormat format, const void* faces);
+
+    // same with mipLevels mips, levels[mip] holds the faces of mip, of max(1, dim >> mip) texels
+    bool save(const std::string& path, size_t dim, size_t mipLevels, ibl::TexelFormat format, const void* const* levels);
+}
+
+#endif
@@ -1,333 +1,638 @@
-﻿#include "fsutil.h"
-
-#include <algorithm>
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <Windows.h>
-
-#define MAKE_QWORD(low,high) (uint64_t)(low|((uint64_t)high<<32))
-
-namespace
-{
-    std::vector<std::string> split(const std::string& str, const std::string& sep = " ", int maxSplits = -1)
-    {
-        std::vector<std::string> result;
-        result.reserve(maxSplits ? maxSplits+1 : 8);
-
-        int numSplits = 0;
-
-        size_t start = 0, pos;
-        do {
-            pos = str.find_first_of(sep, start);
-            if (pos == start) {
-                // 検索開始位置にデリミタが見つかった。
-                start = pos + 1;
-                result.push_back(std::string());
-            }
-            else if (pos == std::string::npos || (maxSplits >= 0 && numSplits == maxSplits)) {
-                // 残りを追加する。
-                result.push_back(str.substr(start));
-                break;
-            }
-            else {
-                // 区切られた範囲を追加する。
-                result.push_back(str.substr(start, pos - start));
-                start = pos + 1;
-            }
-
-            //start = str.find_first_not_of(sep, start);
-            ++numSplits;
-
-        } while (pos != std::string::npos);
-        return result;
-    }
-
-    void splitWithWildcard(const std::string& path, std::string& dirname, std::string& pattern)
-    {
-        auto tmp = path;
-        std::replace(tmp.begin(), tmp.end(), '\\', '/');
-        auto w = tmp.find_first_of('*');
-        auto i = tmp.find_last_of('/');
-        if (w != std::string::npos && w < i) {
-            i = tmp.substr(0, w).find_last_of('/');
-        }
-
-        if (i != std::string::npos) {
-            dirname = tmp.substr(0, i);
-            pattern = tmp.substr(i + 1);
-        }
-        else {
-            dirname.clear();
-            pattern = std::move(path);
-        }
-    }
-
-    bool match(const std::string& str, const std::string& pattern)
-    {
-        std::string tmpStr = str;
-        std::string tmpPattern = pattern;
-
-        auto strIt = tmpStr.begin();
-        auto patIt = tmpPattern.begin();
-        auto lastWildcardIt = tmpPattern.end();
-        while (strIt != tmpStr.end() && patIt != tmpPattern.end()) {
-            if (*patIt == '*') {
-                lastWildcardIt = patIt;
-                // ワイルドカードの次へ..
-                ++patIt;
-                if (patIt == tmpPattern.end()) {
-                    // 末尾まで飛ばす。
-                    strIt = tmpStr.end();
-                }
-                else {
-                    // ワイルドカードの次の文字と一致するまで走査する。
-                    while (strIt != tmpStr.end() && *strIt != *patIt) {
-                        ++strIt;
-                    }
-                }
-            }
-            else {
-                if (*patIt != *strIt) {
-                    if (lastWildcardIt != tmpPattern.end()) {
-                        // ワイルドカードの次の文字と文字列内の文字が一致している場合、
-                        // その文字はまだワイルドカードの範囲内の可能性があるので、
-                        // ワイルドカードのパターンを巻き戻して検索を続ける。
-                        patIt = lastWildcardIt;
-                        lastWildcardIt = tmpPattern.end();
-                    }
-                    else {
-                        return false;
-                    }
-                }
-                else {
-                    // 文字は一致している。
-                    ++patIt;
-                    ++strIt;
-                }
-            }
-        }
-        // 文字列もパターンも最後まで走査されていたら完全に一致。
-        return (patIt == tmpPattern.end() && strIt == tmpStr.end()) ? true : false;
-    }
-
-    std::wstring utf8ToUtf16(const std::string& u8str)
-    {
-        int u16strLen = ::MultiByteToWideChar(CP_UTF8, 0, u8str.c_str(), -1, NULL, 0);
-        if (u16strLen <= 0) return std::wstring();
-        std::wstring u16str;
-        u16str.resize(u16strLen-1);
-        ::MultiByteToWideChar(CP_UTF8, 0, u8str.c_str(), -1, &u16str[0], u16strLen);
-        return u16str;
-    }
-
-    std::string utf16ToUtf8(const std::wstring& u16str)
-    {
-        int u8strLen = ::WideCharToMultiByte(CP_UTF8, 0, u16str.c_str(), -1, NULL, 0, NULL, NULL);
-        if (u8strLen <= 0) return std::string();
-        std::string u8str;
-        u8str.resize(u8strLen - 1);
-        ::WideCharToMultiByte(CP_UTF8, 0, u16str.c_str(), -1, &u8str[0], u8strLen, NULL, NULL);
-        return u8str;
-    }
-
-    std::string getcwd()
-    {
-        WCHAR path[MAX_PATH];
-        DWORD ret = ::GetCurrentDirectoryW(MAX_PATH, path);
-        return ret == 0 ? std::string() : fs::standardizePath(utf16ToUtf8(path), true);
-    }
-
-    inline bool isReservedDir(const WCHAR* path)
-    {
-        return (path[0] == '.' && (path[1] == '\0' || (path[1] == '.' && path[2] == '\0')));
-    }
-
-    void findFilesRecursively(std::vector<fs::FileInfo>& v, const std::string& dirpath)
-    {
-        WIN32_FIND_DATAW fd;
-        HANDLE handle = ::FindFirstFileW(utf8ToUtf16(dirpath + '*').c_str(), &fd);
-        if (handle == INVALID_HANDLE_VALUE)
-            return;
-
-        for (BOOL res = TRUE; res == TRUE; res = ::FindNextFileW(handle, &fd)) {
-            DWORD attrs = fd.dwFileAttributes;
-            if (attrs & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM)) {
-                continue;
-            }
-            else if (attrs & FILE_ATTRIBUTE_DIRECTORY) {
-                if (isReservedDir(fd.cFileName))
-                    continue;
-                findFilesRecursively(v, dirpath + utf16ToUtf8(fd.cFileName) + '/');
-            }
-            else if (attrs & (FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_ARCHIVE)) {
-                std::string filename = dirpath + utf16ToUtf8(fd.cFileName);
-
-                uint64_t fsize = MAKE_QWORD(fd.nFileSizeLow, fd.nFileSizeHigh);
-                uint64_t mtime = MAKE_QWORD(fd.ftLastWriteTime.dwLowDateTime, fd.ftLastWriteTime.dwHighDateTime);
-                uint64_t atime = MAKE_QWORD(fd.ftLastAccessTime.dwLowDateTime, fd.ftLastAccessTime.dwHighDateTime);
-                uint64_t ctime = MAKE_QWORD(fd.ftCreationTime.dwLowDateTime, fd.ftCreationTime.dwHighDateTime);
-
-                fs::FileInfo info;
-                info.path = filename;
-                info.abspath = getcwd() + filename;
-                info.size = static_cast<size_t>(fsize);
-                info.mtime = mtime / 10000; // FILETIMEは100nsec単位。
-                info.atime = atime / 10000;
-                info.ctime = ctime / 10000;
-                v.push_back(std::move(info));
-            }
-        }
-        ::FindClose(handle);
-    }
-}
-
-namespace fs
-{
-    FileHandle openFile(const std::string& path, uint32_t mode)
-    {
-        DWORD desiredAccess = 0;
-        if (mode & FileAccess::Read)  desiredAccess |= GENERIC_READ;
-        if (mode & FileAccess::Write) desiredAccess |= GENERIC_WRITE;
-
-        DWORD shareMode = FILE_SHARE_READ;
-        if (mode & FileShare::Read)  shareMode |= FILE_SHARE_READ;
-        if (mode & FileShare::Write) shareMode |= FILE_SHARE_WRITE;
-
-        const uint32_t IO_MODE_MASK = 3;
-
-        DWORD creationDisposition = 0;
-        if ((mode & IO_MODE_MASK) == FileMode::Open)   creationDisposition = OPEN_EXISTING;
-        if ((mode & IO_MODE_MASK) == FileMode::Create) creationDisposition = CREATE_ALWAYS;
-        if ((mode & IO_MODE_MASK) == FileMode::Append) creationDisposition = OPEN_ALWAYS;
-
-        DWORD flagsAndAttributes = FILE_ATTRIBUTE_NORMAL;
-        std::wstring filename = utf8ToUtf16(path);
-        HANDLE handle = ::CreateFile(filename.c_str(), desiredAccess, shareMode, NULL, creationDisposition,
-                                     flagsAndAttributes, NULL);
-        if (handle == INVALID_HANDLE_VALUE) return FileHandle();
-        return FileHandle{uint64_t(handle)};
-    }
-
-    void closeFile(FileHandle handle)
-    {
-        if (handle.isInvalid()) return;
-        ::CloseHandle(HANDLE(handle.id));
-    }
-
-    size_t readFile(FileHandle handle, void* buf, size_t size)
-    {
-        if (handle.isInvalid()) return 0;
-
-        int64_t readSize = 0;
-        int64_t remain = (int64_t)std::min(size, uint64_t(INT64_MAX));
-        while (remain > 0) {
-            DWORD bytesToRead = (DWORD)std::min(remain, int64_t(UINT_MAX));
-            DWORD readBytes;
-            if (0 == ::ReadFile(HANDLE(handle.id), buf, bytesToRead, &readBytes, NULL)) {
-                return 0;
-            }
-            remain -= readBytes;
-            readSize += readBytes;
-            buf = (void*)(uintptr_t(buf) + readBytes);
-        }
-        return readSize;
-    }
-
-    size_t writeFile(FileHandle handle, const void* buf, size_t size)
-    {
-        if (handle.isInvalid()) return 0;
-
-        int64_t writtenSize = 0;
-        int64_t remain = (int64_t)std::min(size, uint64_t(INT64_MAX));
-        while (remain > 0) {
-            DWORD bytesToWrite = (DWORD)std::min(remain, int64_t(UINT_MAX));
-            DWORD writtenBytes;
-            if (0 == ::WriteFile(HANDLE(handle.id), buf, bytesToWrite, &writtenBytes, NULL)) {
-                DWORD err = ::GetLastError();
-                (void)err;
-                return 0;
-            }
-            remain -= writtenBytes;
-            writtenSize += writtenBytes;
-            buf = (void*)(uintptr_t(buf) + writtenBytes);
-        }
-        return writtenSize;
-    }
-
-    size_t seekFile(FileHandle handle, int64_t offset, FileSeek::Type origin)
-    {
-        if (handle.isInvalid()) return 0;
-
-        LARGE_INTEGER distanceToMove;
-        LARGE_INTEGER newFilePtr;
-        distanceToMove.QuadPart = offset;
-        if (0 == ::SetFilePointerEx(HANDLE(handle.id), distanceToMove, &newFilePtr, static_cast<DWORD>(origin))) {
-            return 0;
-        }
-        return size_t(newFilePtr.QuadPart);
-    }
-
-    size_t fileSize(FileHandle handle)
-    {
-        if (handle.isInvalid()) return 0;
-
-        LARGE_INTEGER size;
-        if (0 == ::GetFileSizeEx(HANDLE(handle.id), &size)) {
-            return 0;
-        }
-        return size_t(size.QuadPart);
-    }
-
-    void createDirectory(const std::string& path)
-    {
-        std::vector<std::string> dirs = ::split(path, "/");
-        std::string fullpath;
-        for (auto& dir : dirs) {
-            fullpath += dir + '/';
-            ::CreateDirectoryW(utf8ToUtf16(fullpath).c_str(), NULL);
-        }
-    }
-
-    std::string standardizePath(const std::string& path, bool appendLastSlash)
-    {
-        std::string tmp = path;
-        if (!tmp.empty()) {
-            std::replace(tmp.begin(), tmp.end(), '\\', '/');
-            if (appendLastSlash && tmp.back() != '/') tmp.append(1, '/');
-        }
-        return tmp;
-    }
-
-    void split(const std::string& path, std::string& dirname, std::string& basename)
-    {
-        auto tmp = path;
-        std::replace(tmp.begin(), tmp.end(), '\\', '/');
-        auto i = tmp.find_last_of('/');
-        if (i != std::string::npos) {
-            dirname = tmp.substr(0, i);
-            basename = tmp.substr(i + 1);
-        }
-        else {
-            dirname.clear();
-            basename = std::move(path);
-        }
-    }
-
-    std::vector<FileInfo> findFiles(const std::string& pattern)
-    {
-        std::vector<FileInfo> v;
-
-        std::string dirname, filename;
-        splitWithWildcard(pattern, dirname, filename);
-
-        dirname = standardizePath(dirname, true);
-        findFilesRecursively(v, dirname);
-
-        if (filename != "*") {
-            std::string filter = dirname + filename;
-            auto it = std::remove_if(v.begin(), v.end(), [&filter] (const FileInfo& f) { return !match(f.path, filter); });
-            v.erase(it, v.end());
-        }
-        return v;
-    }
-}
+#include "fsutil.h"
+
+#include <algorithm>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MAKE_QWORD(low,high) (uint64_t)(low|((uint64_t)high<<32))
+
+namespace
+{
+    std::vector<std::string> split(const std::string& str, const std::string& sep = " ", int maxSplits = -1)
+    {
+        std::vector<std::string> result;
+        result.reserve(maxSplits ? maxSplits+1 : 8);
+
+        int numSplits = 0;
+
+        size_t start = 0, pos;
+        do {
+            pos = str.find_first_of(sep, start);
+            if (pos == start) {
+                // 検索開始位置にデリミタが見つかった。
+                start = pos + 1;
+                result.push_back(std::string());
+            }
+            else if (pos == std::string::npos || (maxSplits >= 0 && numSplits == maxSplits)) {
+                // 残りを追加する。
+                result.push_back(str.substr(start));
+                break;
+            }
+            else {
+                // 区切られた範囲を追加する。
+                result.push_back(str.substr(start, pos - start));
+                start = pos + 1;
+            }
+
+            //start = str.find_first_not_of(sep, start);
+            ++numSplits;
+
+        } while (pos != std::string::npos);
+        return result;
+    }
+
+    void splitWithWildcard(const std::string& path, std::string& dirname, std::string& pattern)
+    {
+        auto tmp = path;
+        std::replace(tmp.begin(), tmp.end(), '\\', '/');
+        auto w = tmp.find_first_of('*');
+        auto i = tmp.find_last_of('/');
+        if (w != std::string::npos && w < i) {
+            i = tmp.substr(0, w).find_last_of('/');
+        }
+
+        if (i != std::string::npos) {
+            dirname = tmp.substr(0, i);
+            pattern = tmp.substr(i + 1);
+        }
+        else {
+            dirname.clear();
+            pattern = std::move(path);
+        }
+    }
+
+    bool match(const std::string& str, const std::string& pattern)
+    {
+        std::string tmpStr = str;
+        std::string tmpPattern = pattern;
+
+        auto strIt = tmpStr.begin();
+        auto patIt = tmpPattern.begin();
+        auto lastWildcardIt = tmpPattern.end();
+        while (strIt != tmpStr.end() && patIt != tmpPattern.end()) {
+            if (*patIt == '*') {
+                lastWildcardIt = patIt;
+                // ワイルドカードの次へ..
+                ++patIt;
+                if (patIt == tmpPattern.end()) {
+                    // 末尾まで飛ばす。
+                    strIt = tmpStr.end();
+                }
+                else {
+                    // ワイルドカードの次の文字と一致するまで走査する。
+                    while (strIt != tmpStr.end() && *strIt != *patIt) {
+                        ++strIt;
+                    }
+                }
+            }
+            else {
+                if (*patIt != *strIt) {
+                    if (lastWildcardIt != tmpPattern.end()) {
+                        // ワイルドカードの次の文字と文字列内の文字が一致している場合、
+                        // その文字はまだワイルドカードの範囲内の可能性があるので、
+                        // ワイルドカードのパターンを巻き戻して検索を続ける。
+                        patIt = lastWildcardIt;
+                        lastWildcardIt = tmpPattern.end();
+                    }
+                    else {
+                        return false;
+                    }
+                }
+                else {
+                    // 文字は一致している。
+                    ++patIt;
+                    ++strIt;
+                }
+            }
+        }
+        // 文字列もパターンも最後まで走査されていたら完全に一致。
+        return (patIt == tmpPattern.end() && strIt == tmpStr.end()) ? true : false;
+    }
+
+    // "/..." or "C:..."
+    inline bool isAbsolutePath(const std::string& path)
+    {
+        return (!path.empty() && path[0] == '/') || (path.size() > 1 && path[1] == ':');
+    }
+
+#ifdef _WIN32
+    std::wstring utf8ToUtf16(const std::string& u8str)
+    {
+        int u16strLen = ::MultiByteToWideChar(CP_UTF8, 0, u8str.c_str(), -1, NULL, 0);
+        if (u16strLen <= 0) return std::wstring();
+        std::wstring u16str;
+        u16str.resize(u16strLen-1);
+        ::MultiByteToWideChar(CP_UTF8, 0, u8str.c_str(), -1, &u16str[0], u16strLen);
+        return u16str;
+    }
+
+    std::string utf16ToUtf8(const std::wstring& u16str)
+    {
+        int u8strLen = ::WideCharToMultiByte(CP_UTF8, 0, u16str.c_str(), -1, NULL, 0, NULL, NULL);
+        if (u8strLen <= 0) return std::string();
+        std::string u8str;
+        u8str.resize(u8strLen - 1);
+        ::WideCharToMultiByte(CP_UTF8, 0, u16str.c_str(), -1, &u8str[0], u8strLen, NULL, NULL);
+        return u8str;
+    }
+
+    std::string getcwd()
+    {
+        WCHAR path[MAX_PATH];
+        DWORD ret = ::GetCurrentDirectoryW(MAX_PATH, path);
+        return ret == 0 ? std::string() : fs::standardizePath(utf16ToUtf8(path), true);
+    }
+
+    inline bool isReservedDir(const WCHAR* path)
+    {
+        return (path[0] == '.' && (path[1] == '\0' || (path[1] == '.' && path[2] == '\0')));
+    }
+
+    // the files under dirpath, cwd is the current directory with a trailing slash
+    void findFilesRecursively(std::vector<fs::FileInfo>& v, const std::string& dirpath, const std::string& cwd)
+    {
+        WIN32_FIND_DATAW fd;
+        HANDLE handle = ::FindFirstFileW(utf8ToUtf16(dirpath + '*').c_str(), &fd);
+        if (handle == INVALID_HANDLE_VALUE)
+            return;
+
+        for (BOOL res = TRUE; res == TRUE; res = ::FindNextFileW(handle, &fd)) {
+            DWORD attrs = fd.dwFileAttributes;
+            if (attrs & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM)) {
+                continue;
+            }
+            else if (attrs & FILE_ATTRIBUTE_DIRECTORY) {
+                if (isReservedDir(fd.cFileName))
+                    continue;
+                findFilesRecursively(v, dirpath + utf16ToUtf8(fd.cFileName) + '/', cwd);
+            }
+            else if (attrs & (FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_ARCHIVE)) {
+                std::string filename = dirpath + utf16ToUtf8(fd.cFileName);
+
+                uint64_t fsize = MAKE_QWORD(fd.nFileSizeLow, fd.nFileSizeHigh);
+                uint64_t mtime = MAKE_QWORD(fd.ftLastWriteTime.dwLowDateTime, fd.ftLastWriteTime.dwHighDateTime);
+                uint64_t atime = MAKE_QWORD(fd.ftLastAccessTime.dwLowDateTime, fd.ftLastAccessTime.dwHighDateTime);
+                uint64_t ctime = MAKE_QWORD(fd.ftCreationTime.dwLowDateTime, fd.ftCreationTime.dwHighDateTime);
+
+                fs::FileInfo info;
+                info.path = filename;
+                info.abspath = cwd + filename;
+                info.size = static_cast<size_t>(fsize);
+                info.mtime = mtime / 10000; // FILETIMEは100nsec単位。
+                info.atime = atime / 10000;
+                info.ctime = ctime / 10000;
+                v.push_back(std::move(info));
+            }
+        }
+        ::FindClose(handle);
+    }
+#else
+    std::string getcwd()
+    {
+        char path[PATH_MAX];
+        return ::getcwd(path, sizeof(path)) ? fs::standardizePath(path, true) : std::string();
+    }
+
+    inline uint64_t toMilliseconds(const struct timespec& t)
+    {
+        return uint64_t(t.tv_sec) * 1000 + uint64_t(t.tv_nsec) / 1000000;
+    }
+
+    // the files under dirpath, cwd is the current directory with a trailing slash
+    void findFilesRecursively(std::vector<fs::FileInfo>& v, const std::string& dirpath, const std::string& cwd)
+    {
+        DIR* dir = ::opendir(dirpath.empty() ? "." : dirpath.c_str());
+        if (dir == nullptr)
+            return;
+
+        while (const struct dirent* entry = ::readdir(dir)) {
+            // 隠しファイルと"."、".."は除く。
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            std::string filename = dirpath + entry->d_name;
+            struct stat st;
+            if (::stat(filename.c_str(), &st) != 0) {
+                continue;
+            }
+            else if (S_ISDIR(st.st_mode)) {
+                findFilesRecursively(v, filename + '/', cwd);
+            }
+            else if (S_ISREG(st.st_mode)) {
+                fs::FileInfo info;
+                info.path = filename;
+                info.abspath = cwd + filename;
+                info.size = static_cast<size_t>(st.st_size);
+                info.mtime = toMilliseconds(st.st_mtim);
+                info.atime = toMilliseconds(st.st_atim);
+                info.ctime = toMilliseconds(st.st_ctim);
+                v.push_back(std::move(info));
+            }
+        }
+        ::closedir(dir);
+    }
+#endif
+}
+
+namespace fs
+{
+#ifdef _WIN32
+    FileHandle openFile(const std::string& path, uint32_t mode)
+    {
+        DWORD desiredAccess = 0;
+        if (mode & FileAccess::Read)  desiredAccess |= GENERIC_READ;
+        if (mode & FileAccess::Write) desiredAccess |= GENERIC_WRITE;
+
+        DWORD shareMode = FILE_SHARE_READ;
+        if (mode & FileShare::Read)  shareMode |= FILE_SHARE_READ;
+        if (mode & FileShare::Write) shareMode |= FILE_SHARE_WRITE;
+
+        const uint32_t IO_MODE_MASK = 3;
+
+        DWORD creationDisposition = 0;
+        if ((mode & IO_MODE_MASK) == FileMode::Open)   creationDisposition = OPEN_EXISTING;
+        if ((mode & IO_MODE_MASK) == FileMode::Create) creationDisposition = CREATE_ALWAYS;
+        if ((mode & IO_MODE_MASK) == FileMode::Append) creationDisposition = OPEN_ALWAYS;
+
+        DWORD flagsAndAttributes = FILE_ATTRIBUTE_NORMAL;
+        std::wstring filename = utf8ToUtf16(path);
+        HANDLE handle = ::CreateFile(filename.c_str(), desiredAccess, shareMode, NULL, creationDisposition,
+                                     flagsAndAttributes, NULL);
+        if (handle == INVALID_HANDLE_VALUE) return FileHandle();
+        return FileHandle{uint64_t(handle)};
+    }
+
+    void closeFile(FileHandle handle)
+    {
+        if (handle.isInvalid()) return;
+        ::CloseHandle(HANDLE(handle.id));
+    }
+
+    size_t readFile(FileHandle handle, void* buf, size_t size)
+    {
+        if (handle.isInvalid()) return 0;
+
+        int64_t readSize = 0;
+        int64_t remain = (int64_t)std::min(size, uint64_t(INT64_MAX));
+        while (remain > 0) {
+            DWORD bytesToRead = (DWORD)std::min(remain, int64_t(UINT_MAX));
+            DWORD readBytes;
+            if (0 == ::ReadFile(HANDLE(handle.id), buf, bytesToRead, &readBytes, NULL)) {
+                return 0;
+            }
+            if (readBytes == 0) {
+                // 終端に達した。
+                break;
+            }
+            remain -= readBytes;
+            readSize += readBytes;
+            buf = (void*)(uintptr_t(buf) + readBytes);
+        }
+        return readSize;
+    }
+
+    size_t writeFile(FileHandle handle, const void* buf, size_t size)
+    {
+        if (handle.isInvalid()) return 0;
+
+        int64_t writtenSize = 0;
+        int64_t remain = (int64_t)std::min(size, uint64_t(INT64_MAX));
+        while (remain > 0) {
+            DWORD bytesToWrite = (DWORD)std::min(remain, int64_t(UINT_MAX));
+            DWORD writtenBytes;
+            if (0 == ::WriteFile(HANDLE(handle.id), buf, bytesToWrite, &writtenBytes, NULL)) {
+                DWORD err = ::GetLastError();
+                (void)err;
+                return 0;
+            }
+            remain -= writtenBytes;
+            writtenSize += writtenBytes;
+            buf = (void*)(uintptr_t(buf) + writtenBytes);
+        }
+        return writtenSize;
+    }
+
+    size_t seekFile(FileHandle handle, int64_t offset, FileSeek::Type origin)
+    {
+        if (handle.isInvalid()) return 0;
+
+        LARGE_INTEGER distanceToMove;
+        LARGE_INTEGER newFilePtr;
+        distanceToMove.QuadPart = offset;
+        if (0 == ::SetFilePointerEx(HANDLE(handle.id), distanceToMove, &newFilePtr, static_cast<DWORD>(origin))) {
+            return 0;
+        }
+        return size_t(newFilePtr.QuadPart);
+    }
+
+    size_t fileSize(FileHandle handle)
+    {
+        if (handle.isInvalid()) return 0;
+
+        LARGE_INTEGER size;
+        if (0 == ::GetFileSizeEx(HANDLE(handle.id), &size)) {
+            return 0;
+        }
+        return size_t(size.QuadPart);
+    }
+
+    MappedFile mapFile(const std::string& path, uint32_t hints)
+    {
+        MappedFile file;
+        DWORD flagsAndAttributes = FILE_ATTRIBUTE_NORMAL;
+        if (hints & MapHint::Sequential) flagsAndAttributes |= FILE_FLAG_SEQUENTIAL_SCAN;
+        HANDLE handle = ::CreateFileW(utf8ToUtf16(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                      flagsAndAttributes, NULL);
+        if (handle == INVALID_HANDLE_VALUE) return file;
+
+        LARGE_INTEGER size;
+        if (0 == ::GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+            ::CloseHandle(handle);
+            return file;
+        }
+
+        // large pages need SeLockMemoryPrivilege and cannot back a file view, so that hint is ignored here
+        HANDLE mapping = ::CreateFileMappingW(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        ::CloseHandle(handle);
+        if (mapping == NULL) return file;
+
+        void* data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data == NULL) {
+            ::CloseHandle(mapping);
+            return file;
+        }
+        file.data = data;
+        file.size = size_t(size.QuadPart);
+        file.mapping = uint64_t(mapping);
+        return file;
+    }
+
+    void unmapFile(MappedFile& file)
+    {
+        if (file.isInvalid()) return;
+        ::UnmapViewOfFile(file.data);
+        ::CloseHandle(HANDLE(file.mapping));
+        file = MappedFile();
+    }
+
+    void createDirectory(const std::string& path)
+    {
+        std::vector<std::string> dirs = ::split(path, "/");
+        std::string fullpath;
+        for (auto& dir : dirs) {
+            fullpath += dir + '/';
+            ::CreateDirectoryW(utf8ToUtf16(fullpath).c_str(), NULL);
+        }
+    }
+
+    bool getFileInfo(const std::string& path, FileInfo& info)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA fad;
+        if (!::GetFileAttributesExW(utf8ToUtf16(path).c_str(), GetFileExInfoStandard, &fad) ||
+            (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            return false;
+
+        info.path = standardizePath(path);
+        info.abspath = isAbsolutePath(info.path) ? info.path : getcwd() + info.path;
+        info.size = static_cast<size_t>(MAKE_QWORD(fad.nFileSizeLow, fad.nFileSizeHigh));
+        info.mtime = MAKE_QWORD(fad.ftLastWriteTime.dwLowDateTime, fad.ftLastWriteTime.dwHighDateTime) / 10000;
+        info.atime = MAKE_QWORD(fad.ftLastAccessTime.dwLowDateTime, fad.ftLastAccessTime.dwHighDateTime) / 10000;
+        info.ctime = MAKE_QWORD(fad.ftCreationTime.dwLowDateTime, fad.ftCreationTime.dwHighDateTime) / 10000;
+        return true;
+    }
+
+    bool isDirectory(const std::string& path)
+    {
+        DWORD attrs = ::GetFileAttributesW(utf8ToUtf16(path).c_str());
+        return attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY);
+    }
+
+    bool renameFile(const std::string& src, const std::string& dst)
+    {
+        return ::MoveFileExW(utf8ToUtf16(src).c_str(), utf8ToUtf16(dst).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+    }
+
+    bool removeFile(const std::string& path)
+    {
+        return ::DeleteFileW(utf8ToUtf16(path).c_str()) != 0;
+    }
+
+#else
+    FileHandle openFile(const std::string& path, uint32_t mode)
+    {
+        int flags = O_RDONLY;
+        if ((mode & FileAccess::RDRW) == FileAccess::RDRW) flags = O_RDWR;
+        else if (mode & FileAccess::Write)                 flags = O_WRONLY;
+
+        const uint32_t IO_MODE_MASK = 3;
+        if ((mode & IO_MODE_MASK) == FileMode::Create) flags |= O_CREAT | O_TRUNC;
+        if ((mode & IO_MODE_MASK) == FileMode::Append) flags |= O_CREAT;
+
+        // 共有モードはPOSIXにはないので無視する。
+        int fd = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+        if (fd < 0) return FileHandle();
+        return FileHandle{uint64_t(fd)};
+    }
+
+    void closeFile(FileHandle handle)
+    {
+        if (handle.isInvalid()) return;
+        ::close(int(handle.id));
+    }
+
+    size_t readFile(FileHandle handle, void* buf, size_t size)
+    {
+        if (handle.isInvalid()) return 0;
+
+        size_t readSize = 0;
+        while (readSize < size) {
+            ssize_t readBytes = ::read(int(handle.id), static_cast<uint8_t*>(buf) + readSize, size - readSize);
+            if (readBytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (readBytes < 0) {
+                return 0;
+            }
+            if (readBytes == 0) {
+                // 終端に達した。
+                break;
+            }
+            readSize += size_t(readBytes);
+        }
+        return readSize;
+    }
+
+    size_t writeFile(FileHandle handle, const void* buf, size_t size)
+    {
+        if (handle.isInvalid()) return 0;
+
+        size_t writtenSize = 0;
+        while (writtenSize < size) {
+            ssize_t writtenBytes = ::write(int(handle.id), static_cast<const uint8_t*>(buf) + writtenSize, size - writtenSize);
+            if (writtenBytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (writtenBytes <= 0) {
+                return 0;
+            }
+            writtenSize += size_t(writtenBytes);
+        }
+        return writtenSize;
+    }
+
+    size_t seekFile(FileHandle handle, int64_t offset, FileSeek::Type origin)
+    {
+        if (handle.isInvalid()) return 0;
+
+        const int whence[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+        off_t pos = ::lseek(int(handle.id), off_t(offset), whence[origin]);
+        return pos < 0 ? 0 : size_t(pos);
+    }
+
+    size_t fileSize(FileHandle handle)
+    {
+        if (handle.isInvalid()) return 0;
+
+        struct stat st;
+        if (::fstat(int(handle.id), &st) != 0) {
+            return 0;
+        }
+        return size_t(st.st_size);
+    }
+
+    MappedFile mapFile(const std::string& path, uint32_t hints)
+    {
+        MappedFile file;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return file;
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return file;
+        }
+
+        // the mapping keeps its own reference to the file
+        void* data = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) return file;
+
+        // only hints, a kernel without them leaves the mapping as it is
+        if (hints & MapHint::Sequential) {
+            ::madvise(data, size_t(st.st_size), MADV_SEQUENTIAL);
+        }
+#ifdef MADV_HUGEPAGE
+        if (hints & MapHint::HugePages) {
+            ::madvise(data, size_t(st.st_size), MADV_HUGEPAGE);
+        }
+#endif
+        file.data = data;
+        file.size = size_t(st.st_size);
+        return file;
+    }
+
+    void unmapFile(MappedFile& file)
+    {
+        if (file.isInvalid()) return;
+        ::munmap(file.data, file.size);
+        file = MappedFile();
+    }
+
+    void createDirectory(const std::string& path)
+    {
+        std::vector<std::string> dirs = ::split(path, "/");
+        std::string fullpath;
+        for (auto& dir : dirs) {
+            fullpath += dir + '/';
+            ::mkdir(fullpath.c_str(), 0755);
+        }
+    }
+
+    bool getFileInfo(const std::string& path, FileInfo& info)
+    {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            return false;
+
+        info.path = standardizePath(path);
+        info.abspath = isAbsolutePath(info.path) ? info.path : getcwd() + info.path;
+        info.size = static_cast<size_t>(st.st_size);
+        info.mtime = toMilliseconds(st.st_mtim);
+        info.atime = toMilliseconds(st.st_atim);
+        info.ctime = toMilliseconds(st.st_ctim);
+        return true;
+    }
+
+    bool isDirectory(const std::string& path)
+    {
+        struct stat st;
+        return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    bool renameFile(const std::string& src, const std::string& dst)
+    {
+        return ::rename(src.c_str(), dst.c_str()) == 0;
+    }
+
+    bool removeFile(const std::string& path)
+    {
+        return ::unlink(path.c_str()) == 0;
+    }
+
+#endif
+
+    std::string standardizePath(const std::string& path, bool appendLastSlash)
+    {
+        std::string tmp = path;
+        if (!tmp.empty()) {
+            std::replace(tmp.begin(), tmp.end(), '\\', '/');
+            if (appendLastSlash && tmp.back() != '/') tmp.append(1, '/');
+        }
+        return tmp;
+    }
+
+    void split(const std::string& path, std::string& dirname, std::string& basename)
+    {
+        auto tmp = path;
+        std::replace(tmp.begin(), tmp.end(), '\\', '/');
+        auto i = tmp.find_last_of('/');
+        if (i != std::string::npos) {
+            dirname = tmp.substr(0, i);
+            basename = tmp.substr(i + 1);
+        }
+        else {
+            dirname.clear();
+            basename = std::move(path);
+        }
+    }
+
+    std::vector<FileInfo> findFiles(const std::string& pattern)
+    {
+        std::vector<FileInfo> v;
+
+        std::string dirname, filename;
+        splitWithWildcard(pattern, dirname, filename);
+
+        dirname = standardizePath(dirname, true);
+        findFilesRecursively(v, dirname, getcwd());
+
+        if (filename != "*") {
+            std::string filter = dirname + filename;
+            auto it = std::remove_if(v.begin(), v.end(), [&filter] (const FileInfo& f) { return !match(f.path, filter); });
+            v.erase(it, v.end());
+        }
+        return v;
+    }
+}
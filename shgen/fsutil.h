@@ -1,83 +1,113 @@
-#ifndef FSUTIL_H__
-#define FSUTIL_H__
-#pragma once
-
-#include <cstdint>
-#include <string>
-#include <vector>
-
-namespace fs
-{
-    struct FileMode
-    {
-        enum Type
-        {
-            Open  	= 0x0000,
-            Create	= 0x0001,
-            Append	= 0x0002,
-        };
-    };
-
-    struct FileAccess
-    {
-        enum Type
-        {
-            Read    = 0x0010,
-            Write   = 0x0020,
-            RDRW    = 0x0030,
-        };
-    };
-
-    struct FileShare
-    {
-        enum Type
-        {
-            None    = 0x0000,
-            Read    = 0x0100,
-            Write   = 0x0200,
-            RDRW    = 0x0300,
-        };
-    };
-
-    struct FileSeek
-    {
-        enum Type
-        {
-            Begin,
-            Current,
-            End,
-        };
-    };
-
-    struct FileHandle
-    {
-        uint64_t id = UINT64_MAX;
-        bool isInvalid() const { return id == UINT64_MAX; }
-        operator uint64_t() const { return id; } 
-    };
-
-    struct FileInfo
-    {
-        std::string path;
-        std::string abspath;
-        size_t size;
-        uint64_t mtime;
-        uint64_t atime;
-        uint64_t ctime;
-    };
-
-    FileHandle openFile(const std::string& path, uint32_t mode);
-    void closeFile(FileHandle handle);
-    size_t readFile(FileHandle handle, void* buf, size_t size);
-    size_t writeFile(FileHandle handle, const void* buf, size_t size);
-    size_t seekFile(FileHandle handle, int64_t offset, FileSeek::Type origin);
-    size_t fileSize(FileHandle handle);
-
-    void createDirectory(const std::string& path);
-
-    std::string standardizePath(const std::string& path, bool appendLastSlash = false);
-    void split(const std::string& path, std::string& dirname, std::string& basename);
-    std::vector<FileInfo> findFiles(const std::string& pattern);
-}
-
-#endif
+#ifndef FSUTIL_H__
+#define FSUTIL_H__
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fs
+{
+    struct FileMode
+    {
+        enum Type
+        {
+            Open  	= 0x0000,
+            Create	= 0x0001,
+            Append	= 0x0002,
+        };
+    };
+
+    struct FileAccess
+    {
+        enum Type
+        {
+            Read    = 0x0010,
+            Write   = 0x0020,
+            RDRW    = 0x0030,
+        };
+    };
+
+    struct FileShare
+    {
+        enum Type
+        {
+            None    = 0x0000,
+            Read    = 0x0100,
+            Write   = 0x0200,
+            RDRW    = 0x0300,
+        };
+    };
+
+    struct FileSeek
+    {
+        enum Type
+        {
+            Begin,
+            Current,
+            End,
+        };
+    };
+
+    struct FileHandle
+    {
+        uint64_t id = UINT64_MAX;
+        bool isInvalid() const { return id == UINT64_MAX; }
+        operator uint64_t() const { return id; } 
+    };
+
+    struct MapHint
+    {
+        enum Type
+        {
+            None        = 0x0000,
+            Sequential  = 0x0001,   // read once from start to end
+            HugePages   = 0x0002,   // back the mapping with huge pages where the system can
+        };
+    };
+
+    // a read only view of a whole file, shared with the page cache
+    struct MappedFile
+    {
+        void* data = nullptr;
+        size_t size = 0;
+        uint64_t mapping = UINT64_MAX;  // the file mapping object on Windows
+        bool isInvalid() const { return data == nullptr; }
+    };
+
+    struct FileInfo
+    {
+        std::string path;
+        std::string abspath;
+        size_t size;
+        uint64_t mtime;
+        uint64_t atime;
+        uint64_t ctime;
+    };
+
+    FileHandle openFile(const std::string& path, uint32_t mode);
+    void closeFile(FileHandle handle);
+    size_t readFile(FileHandle handle, void* buf, size_t size);
+    size_t writeFile(FileHandle handle, const void* buf, size_t size);
+    size_t seekFile(FileHandle handle, int64_t offset, FileSeek::Type origin);
+    size_t fileSize(FileHandle handle);
+
+    MappedFile mapFile(const std::string& path, uint32_t hints = MapHint::None);
+    void unmapFile(MappedFile& file);
+
+    void createDirectory(const std::string& path);
+    bool isDirectory(const std::string& path);
+
+    // moves src to dst, replacing dst in one step if it exists
+    bool renameFile(const std::string& src, const std::string& dst);
+    bool removeFile(const std::string& path);
+
+    // the size and the times of a regular file, false if there is none at path
+    bool getFileInfo(const std::string& path, FileInfo& info);
+
+    std::string standardizePath(const std::string& path, bool appendLastSlash = false);
+    void split(const std::string& path, std::string& dirname, std::string& basename);
+    std::vector<FileInfo> findFiles(const std::string& pattern);
+}
+
+#endif
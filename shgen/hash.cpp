@@ -0,0 +1,101 @@
+#include "hash.h"
+
+#include <cstring>
+
+namespace
+{
+    const uint64_t PRIME1 = 0x9e3779b185ebca87ull;
+    const uint64_t PRIME2 = 0xc2b2ae3d27d4eb4full;
+    const uint64_t PRIME3 = 0x165667b19e3779f9ull;
+    const uint64_t PRIME4 = 0x85ebca77c2b2ae63ull;
+    const uint64_t PRIME5 = 0x27d4eb2f165667c5ull;
+
+    inline uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    // xxHash reads little endian words, which is the byte order of every target of shgen
+    inline uint64_t read64(const uint8_t* p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t read32(const uint8_t* p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t round64(uint64_t acc, uint64_t input)
+    {
+        acc += input * PRIME2;
+        acc = rotl(acc, 31);
+        return acc * PRIME1;
+    }
+
+    inline uint64_t mergeRound(uint64_t acc, uint64_t value)
+    {
+        acc ^= round64(0, value);
+        return acc * PRIME1 + PRIME4;
+    }
+}
+
+namespace hash
+{
+    uint64_t xxh64(const void* data, size_t size, uint64_t seed)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const uint8_t* end = p + size;
+        uint64_t h;
+
+        // 4 independent lanes over stripes of 32 bytes
+        if (size >= 32) {
+            uint64_t v1 = seed + PRIME1 + PRIME2;
+            uint64_t v2 = seed + PRIME2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - PRIME1;
+            const uint8_t* limit = end - 32;
+            do {
+                v1 = round64(v1, read64(p));
+                v2 = round64(v2, read64(p + 8));
+                v3 = round64(v3, read64(p + 16));
+                v4 = round64(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = mergeRound(h, v1);
+            h = mergeRound(h, v2);
+            h = mergeRound(h, v3);
+            h = mergeRound(h, v4);
+        } else {
+            h = seed + PRIME5;
+        }
+        h += uint64_t(size);
+
+        for (; p + 8 <= end; p += 8) {
+            h ^= round64(0, read64(p));
+            h = rotl(h, 27) * PRIME1 + PRIME4;
+        }
+        if (p + 4 <= end) {
+            h ^= uint64_t(read32(p)) * PRIME1;
+            h = rotl(h, 23) * PRIME2 + PRIME3;
+            p += 4;
+        }
+        for (; p < end; p++) {
+            h ^= uint64_t(*p) * PRIME5;
+            h = rotl(h, 11) * PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef HASH_H__
+#define HASH_H__
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hash
+{
+    // XXH64 of size bytes at data, compatible with the reference implementation of xxHash
+    uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "hdr.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "ibl/texel_format.h"
+#include "ibl/trace.h"
+#include "fsutil.h"
+
+namespace
+{
+    // the longest header line that is looked at, longer ones are skipped
+    const size_t MAX_LINE = 256;
+
+    // the largest width and height read, beyond the panoramas of any camera
+    const size_t MAX_DIMENSION = 1 << 16;
+
+    // the fewest bytes a scanline takes: a texel, the start of the adaptive encoding or a repeat
+    // of the old one, which holds any width in 4 bytes once the first texel is there
+    const size_t MIN_SCANLINE_SIZE = 4;
+
+    // the next line of the header without its end of line, false at the end of the data
+    bool readLine(const uint8_t*& p, const uint8_t* end, std::string& line)
+    {
+        line.clear();
+        while (p < end && *p != '\n') {
+            if (line.size() < MAX_LINE) {
+                line += char(*p);
+            }
+            p++;
+        }
+        if (p == end) {
+            return false;
+        }
+        p++;
+        return true;
+    }
+
+    // the scanline as r g b e bytes, in the adaptive run length encoding of Radiance if it
+    // starts with 2 2, flat or in the old run length encoding otherwise
+    bool readScanline(const uint8_t*& p, const uint8_t* end, size_t width, uint8_t* rgbe)
+    {
+        if (width >= 8 && width < 0x8000 && end - p >= 4 && p[0] == 2 && p[1] == 2 && !(p[2] & 0x80)) {
+            if (((size_t(p[2]) << 8) | p[3]) != width) {
+                return false;
+            }
+            p += 4;
+
+            // each channel is encoded separately, as runs and dumps of at most 128 bytes
+            for (size_t ch = 0; ch < 4; ch++) {
+                for (size_t x = 0; x < width; ) {
+                    if (p == end) {
+                        return false;
+                    }
+                    size_t count = *p++;
+                    if (count > 128) {
+                        count -= 128;
+                        if (x + count > width || p == end) {
+                            return false;
+                        }
+                        const uint8_t value = *p++;
+                        for (size_t i = 0; i < count; i++) {
+                            rgbe[(x + i) * 4 + ch] = value;
+                        }
+                    } else {
+                        if (count == 0 || x + count > width || size_t(end - p) < count) {
+                            return false;
+                        }
+                        for (size_t i = 0; i < count; i++) {
+                            rgbe[(x + i) * 4 + ch] = *p++;
+                        }
+                    }
+                    x += count;
+                }
+            }
+            return true;
+        }
+
+        // 1 1 1 n repeats the previous texel n times, consecutive repeats are the higher bytes of n
+        size_t shift = 0;
+        for (size_t x = 0; x < width; ) {
+            if (end - p < 4) {
+                return false;
+            }
+            if (p[0] == 1 && p[1] == 1 && p[2] == 1) {
+                const size_t count = size_t(p[3]) << shift;
+                if (x == 0 || shift > 16 || x + count > width) {
+                    return false;
+                }
+                for (size_t i = 0; i < count; i++) {
+                    std::memcpy(rgbe + (x + i) * 4, rgbe + (x - 1) * 4, 4);
+                }
+                x += count;
+                shift += 8;
+            } else {
+                std::memcpy(rgbe + x * 4, p, 4);
+                x++;
+                shift = 0;
+            }
+            p += 4;
+        }
+        return true;
+    }
+}
+
+namespace hdr
+{
+    bool load(const std::string& path, ibl::Image& image)
+    {
+        TRACE_SCOPE("load hdr", path);
+        fs::FileHandle handle = fs::openFile(path, fs::FileMode::Open | fs::FileAccess::Read | fs::FileShare::Read);
+        if (handle.isInvalid()) {
+            return false;
+        }
+        std::vector<uint8_t> data(fs::fileSize(handle));
+        const bool read = fs::readFile(handle, data.data(), data.size()) == data.size();
+        fs::closeFile(handle);
+        if (!read) {
+            return false;
+        }
+
+        const uint8_t* p = data.data();
+        const uint8_t* end = p + data.size();
+
+        // the header is made of lines up to an empty one, then comes the resolution
+        std::string line;
+        if (!readLine(p, end, line) || line.compare(0, 2, "#?") != 0) {
+            return false;
+        }
+        while (readLine(p, end, line) && !line.empty()) {
+            if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+                return false;
+            }
+        }
+        if (!readLine(p, end, line)) {
+            return false;
+        }
+
+        char sign[2] = {};
+        char axis[2] = {};
+        unsigned long size[2] = {};
+        const char* s = line.c_str();
+        for (size_t i = 0; i < 2; i++) {
+            while (*s == ' ') {
+                s++;
+            }
+            sign[i] = s[0];
+            axis[i] = s[0] ? s[1] : 0;
+            if ((sign[i] != '-' && sign[i] != '+') || !axis[i]) {
+                return false;
+            }
+            char* next = nullptr;
+            size[i] = std::strtoul(s + 2, &next, 10);
+            s = next;
+        }
+        if (axis[0] != 'Y' || axis[1] != 'X' || sign[1] != '+' || !size[0] || !size[1]) {
+            return false;
+        }
+        const size_t height = size[0];
+        const size_t width = size[1];
+        const bool bottomUp = sign[0] == '+';
+
+        // the scanlines have to fit in the rest of the file before the image is allocated, a
+        // truncated scanline is caught while decoding
+        if (width > MAX_DIMENSION || height > MAX_DIMENSION || height > size_t(end - p) / MIN_SCANLINE_SIZE) {
+            return false;
+        }
+
+        const ibl::simd::DecodeRowFn decodeRow = ibl::simd::getDecodeRow(ibl::TexelFormat::RGBE8);
+        std::vector<uint8_t> rgbe(width * 4);
+
+        ibl::Image decoded(width, height);
+        for (size_t y = 0; y < height; y++) {
+            if (!readScanline(p, end, width, rgbe.data())) {
+                return false;
+            }
+            const size_t row = bottomUp ? height - 1 - y : y;
+            decodeRow(rgbe.data(), width, static_cast<ibl::math::float3*>(decoded.getPixelRef(0, row)));
+        }
+        image = std::move(decoded);
+        return true;
+    }
+}
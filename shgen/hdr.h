@@ -0,0 +1,16 @@
+#ifndef HDR_H__
+#define HDR_H__
+#pragma once
+
+#include <string>
+
+#include "ibl/image.h"
+
+namespace hdr
+{
+    // reads a Radiance RGBE picture (.hdr), flat or run length encoded, decoded to texels with
+    // the first row at the top. only the -Y h +X w and +Y h +X w orientations are understood.
+    bool load(const std::string& path, ibl::Image& image);
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include "cpu_features.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace
+{
+    void cpuid(int leaf, int subleaf, uint32_t regs[4])
+    {
+#if defined(_MSC_VER)
+        int r[4];
+        __cpuidex(r, leaf, subleaf);
+        for (int i = 0; i < 4; i++) regs[i] = uint32_t(r[i]);
+#elif defined(__x86_64__) || defined(__i386__)
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+    }
+
+    uint64_t xgetbv()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#elif defined(__x86_64__) || defined(__i386__)
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (uint64_t(edx) << 32) | eax;
+#else
+        return 0;
+#endif
+    }
+
+    ibl::SimdLevel detect()
+    {
+        uint32_t regs[4];
+        cpuid(0, 0, regs);
+        const uint32_t maxLeaf = regs[0];
+        if (maxLeaf < 1) {
+            return ibl::SimdLevel::Scalar;
+        }
+
+        cpuid(1, 0, regs);
+        const bool sse41   = (regs[2] & (1u << 19)) != 0;
+        const bool fma     = (regs[2] & (1u << 12)) != 0;
+        const bool osxsave = (regs[2] & (1u << 27)) != 0;
+        const bool avx     = (regs[2] & (1u << 28)) != 0;
+        const bool f16c    = (regs[2] & (1u << 29)) != 0;
+        if (!sse41) {
+            return ibl::SimdLevel::Scalar;
+        }
+        if (!osxsave || !avx || !fma || !f16c || maxLeaf < 7) {
+            return ibl::SimdLevel::SSE4;
+        }
+
+        // the OS must save the YMM (and ZMM) state on context switches
+        const uint64_t xcr0 = xgetbv();
+        if ((xcr0 & 0x06) != 0x06) {
+            return ibl::SimdLevel::SSE4;
+        }
+
+        cpuid(7, 0, regs);
+        const bool avx2    = (regs[1] & (1u << 5)) != 0;
+        const bool avx512f = (regs[1] & (1u << 16)) != 0;
+        const bool avx512dq = (regs[1] & (1u << 17)) != 0;
+        const bool avx512bw = (regs[1] & (1u << 30)) != 0;
+        const bool avx512vl = (regs[1] & (1u << 31)) != 0;
+        if (!avx2) {
+            return ibl::SimdLevel::SSE4;
+        }
+        // the AVX-512 kernels are built with BW, DQ and VL as /arch:AVX512 does, which
+        // Knights Landing and Knights Mill lack
+        if (avx512f && avx512dq && avx512bw && avx512vl && (xcr0 & 0xe6) == 0xe6) {
+            return ibl::SimdLevel::AVX512;
+        }
+        return ibl::SimdLevel::AVX2;
+    }
+
+    std::atomic<int> activeLevel{-1};
+}
+
+namespace ibl
+{
+    SimdLevel detectSimdLevel()
+    {
+        static const SimdLevel level = detect();
+        return level;
+    }
+
+    SimdLevel getSimdLevel()
+    {
+        int level = activeLevel.load(std::memory_order_relaxed);
+        if (level < 0) {
+            level = int(detectSimdLevel());
+            activeLevel.store(level, std::memory_order_relaxed);
+        }
+        return SimdLevel(level);
+    }
+
+    void setSimdLevel(SimdLevel level)
+    {
+        level = std::min(level, detectSimdLevel());
+        activeLevel.store(int(level), std::memory_order_relaxed);
+    }
+
+    const char* getSimdLevelName(SimdLevel level)
+    {
+        switch (level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE4:   return "sse4";
+        case SimdLevel::AVX2:   return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+        }
+        return "unknown";
+    }
+}
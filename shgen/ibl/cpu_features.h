@@ -0,0 +1,28 @@
+#ifndef CPUFEATURES_H__
+#define CPUFEATURES_H__
+
+#include <cstdint>
+
+namespace ibl
+{
+    enum class SimdLevel : uint8_t
+    {
+        Scalar = 0,
+        SSE4,
+        AVX2,       // AVX2 + FMA + F16C
+        AVX512,     // AVX-512F, BW, DQ and VL
+    };
+
+    // the best level supported by both the CPU and the OS
+    SimdLevel detectSimdLevel();
+
+    // the level used by the dispatching kernels. defaults to detectSimdLevel().
+    SimdLevel getSimdLevel();
+
+    // limits the level used by the dispatching kernels, clamped to detectSimdLevel().
+    void setSimdLevel(SimdLevel level);
+
+    const char* getSimdLevelName(SimdLevel level);
+}
+
+#endif
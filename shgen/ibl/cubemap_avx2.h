@@ -0,0 +1,83 @@
+#ifndef CUBEMAPAVX2_H__
+#define CUBEMAPAVX2_H__
+
+#include <cstdint>
+
+#include <immintrin.h>
+
+#include "cubemap_lookup.h"
+
+// Lookups of 8 directions at once shared by the AVX2 kernels, only to be included by the
+// translation units built with AVX2 and FMA.
+namespace ibl
+{
+namespace avx2
+{
+    inline __m256 select(__m256 mask, __m256 a, __m256 b)
+    {
+        return _mm256_blendv_ps(b, a, mask);
+    }
+
+    // the face of every lane and its coordinates in [0, 1], as simd::getAddress() without
+    // branches. the face is the index of Cubemap::Face.
+    inline void getAddress(__m256 x, __m256 y, __m256 z, __m256i& face, __m256& s, __m256& t)
+    {
+        const __m256 signMask = _mm256_set1_ps(-0.0f);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 ax = _mm256_andnot_ps(signMask, x);
+        const __m256 ay = _mm256_andnot_ps(signMask, y);
+        const __m256 az = _mm256_andnot_ps(signMask, z);
+
+        const __m256 isX = _mm256_and_ps(_mm256_cmp_ps(ax, ay, _CMP_GE_OQ), _mm256_cmp_ps(ax, az, _CMP_GE_OQ));
+        const __m256 isY = _mm256_andnot_ps(isX, _mm256_cmp_ps(ay, az, _CMP_GE_OQ));
+        const __m256 ma = select(isX, ax, select(isY, ay, az));
+        const __m256 major = select(isX, x, select(isY, y, z));
+        const __m256 positive = _mm256_cmp_ps(major, zero, _CMP_GE_OQ);
+
+        // NX PX NY PY NZ PZ
+        const __m256i base = _mm256_castps_si256(select(isX, zero, select(isY, _mm256_castsi256_ps(_mm256_set1_epi32(2)),
+                                                                                _mm256_castsi256_ps(_mm256_set1_epi32(4)))));
+        face = _mm256_sub_epi32(base, _mm256_castps_si256(positive));
+
+        // X: +-z, Y: x, Z: +-x for s and X: -y, Y: +-z, Z: -y for t
+        const __m256 nx = _mm256_xor_ps(x, signMask);
+        const __m256 ny = _mm256_xor_ps(y, signMask);
+        const __m256 nz = _mm256_xor_ps(z, signMask);
+        const __m256 sc = select(isX, select(positive, nz, z), select(isY, x, select(positive, x, nx)));
+        const __m256 tc = select(isY, select(positive, z, nz), ny);
+
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 scale = _mm256_div_ps(half, ma);
+        s = _mm256_fmadd_ps(sc, scale, half);
+        t = _mm256_fmadd_ps(tc, scale, half);
+    }
+
+    using simd::GatherTable;
+
+    // the byte offsets of the texels (x, y) of the faces of 4 lanes
+    inline __m256i getTexelOffsets(const GatherTable& table, __m128i face, __m128i x, __m128i y)
+    {
+        const __m256i f = _mm256_cvtepu32_epi64(face);
+        const __m256i faceOffset = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(table.faceOffsets), f, 8);
+        const __m256i bytesPerRow = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(table.bytesPerRow), f, 8);
+        const __m256i row = _mm256_mul_epu32(_mm256_cvtepu32_epi64(y), bytesPerRow);
+        const __m256i column = _mm256_mul_epu32(_mm256_cvtepu32_epi64(x), _mm256_set1_epi64x(sizeof(Cubemap::Texel)));
+        return _mm256_add_epi64(faceOffset, _mm256_add_epi64(row, column));
+    }
+
+    // the channels of the texels (x, y) of the faces of the 8 lanes
+    inline void gatherTexels(const GatherTable& table, __m256i face, __m256i x, __m256i y,
+                             __m256& r, __m256& g, __m256& b)
+    {
+        const __m256i lo = getTexelOffsets(table, _mm256_castsi256_si128(face), _mm256_castsi256_si128(x),
+                                           _mm256_castsi256_si128(y));
+        const __m256i hi = getTexelOffsets(table, _mm256_extracti128_si256(face, 1), _mm256_extracti128_si256(x, 1),
+                                           _mm256_extracti128_si256(y, 1));
+        r = _mm256_set_m128(_mm256_i64gather_ps(table.base, hi, 1), _mm256_i64gather_ps(table.base, lo, 1));
+        g = _mm256_set_m128(_mm256_i64gather_ps(table.base + 1, hi, 1), _mm256_i64gather_ps(table.base + 1, lo, 1));
+        b = _mm256_set_m128(_mm256_i64gather_ps(table.base + 2, hi, 1), _mm256_i64gather_ps(table.base + 2, lo, 1));
+    }
+}
+}
+
+#endif
@@ -0,0 +1,120 @@
+#include "cubemap_lookup.h"
+
+namespace
+{
+    using namespace ibl;
+
+    // the 4 texels of level around the address, clamped to the edges of the face
+    inline void sampleBilinear(const simd::CubemapLevel& level, uint32_t face, float s, float t, float* rgb)
+    {
+        const float dim = float(level.dim);
+        const float u = s * dim - 0.5f;
+        const float v = t * dim - 0.5f;
+        const float fu = std::floor(u);
+        const float fv = std::floor(v);
+        const float wx = u - fu;
+        const float wy = v - fv;
+
+        const int32_t maxIndex = int32_t(level.dim - 1);
+        const size_t x0 = size_t(std::min(std::max(int32_t(fu), 0), maxIndex));
+        const size_t x1 = size_t(std::min(std::max(int32_t(fu) + 1, 0), maxIndex));
+        const size_t y0 = size_t(std::min(std::max(int32_t(fv), 0), maxIndex));
+        const size_t y1 = size_t(std::min(std::max(int32_t(fv) + 1, 0), maxIndex));
+
+        const uint8_t* row0 = level.faces[face] + y0 * level.bytesPerRow[face];
+        const uint8_t* row1 = level.faces[face] + y1 * level.bytesPerRow[face];
+        const float* t00 = reinterpret_cast<const float*>(row0 + x0 * sizeof(Cubemap::Texel));
+        const float* t10 = reinterpret_cast<const float*>(row0 + x1 * sizeof(Cubemap::Texel));
+        const float* t01 = reinterpret_cast<const float*>(row1 + x0 * sizeof(Cubemap::Texel));
+        const float* t11 = reinterpret_cast<const float*>(row1 + x1 * sizeof(Cubemap::Texel));
+        for (size_t ch = 0; ch < 3; ch++) {
+            const float top = t00[ch] + (t10[ch] - t00[ch]) * wx;
+            const float bottom = t01[ch] + (t11[ch] - t01[ch]) * wx;
+            rgb[ch] = top + (bottom - top) * wy;
+        }
+    }
+}
+
+namespace ibl
+{
+    void getAddressesFor(const float* x, const float* y, const float* z, size_t count,
+                         uint8_t* face, float* s, float* t)
+    {
+        simd::getAddressBatch()(x, y, z, count, face, s, t);
+    }
+
+    void sampleCubemap(const Cubemap& cm, CubemapFilter filter, const float* x, const float* y, const float* z,
+                       size_t count, float* r, float* g, float* b)
+    {
+        simd::getSampleBatch(filter)(simd::getCubemapLevel(cm), x, y, z, count, r, g, b);
+    }
+
+namespace simd
+{
+    CubemapLevel getCubemapLevel(const Cubemap& cm)
+    {
+        CubemapLevel level;
+        for (size_t f = 0; f < 6; f++) {
+            const Image& image = cm.getImageForFace(Cubemap::Face(f));
+            level.faces[f] = static_cast<const uint8_t*>(image.getData());
+            level.bytesPerRow[f] = image.getBytesPerRow();
+        }
+        level.dim = uint32_t(cm.getDimensions());
+        return level;
+    }
+
+    void getAddressesScalar(const float* x, const float* y, const float* z, size_t count,
+                            uint8_t* face, float* s, float* t)
+    {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t f;
+            getAddress(x[i], y[i], z[i], f, s[i], t[i]);
+            face[i] = uint8_t(f);
+        }
+    }
+
+    void sampleNearestScalar(const CubemapLevel& level, const float* x, const float* y, const float* z,
+                             size_t count, float* r, float* g, float* b)
+    {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t face;
+            float s, t;
+            getAddress(x[i], y[i], z[i], face, s, t);
+            const float* texel = getTexel(level, face, s, t);
+            r[i] = texel[0];
+            g[i] = texel[1];
+            b[i] = texel[2];
+        }
+    }
+
+    void sampleBilinearScalar(const CubemapLevel& level, const float* x, const float* y, const float* z,
+                              size_t count, float* r, float* g, float* b)
+    {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t face;
+            float s, t;
+            getAddress(x[i], y[i], z[i], face, s, t);
+            float rgb[3];
+            sampleBilinear(level, face, s, t, rgb);
+            r[i] = rgb[0];
+            g[i] = rgb[1];
+            b[i] = rgb[2];
+        }
+    }
+
+    AddressBatchFn getAddressBatch(SimdLevel level)
+    {
+        return level >= SimdLevel::AVX2 ? getAddressesAVX2 : getAddressesScalar;
+    }
+
+    SampleBatchFn getSampleBatch(CubemapFilter filter, SimdLevel level)
+    {
+        const bool avx2 = level >= SimdLevel::AVX2;
+        switch (filter) {
+        case CubemapFilter::Nearest:    return avx2 ? sampleNearestAVX2 : sampleNearestScalar;
+        case CubemapFilter::Bilinear:   return avx2 ? sampleBilinearAVX2 : sampleBilinearScalar;
+        }
+        return nullptr;
+    }
+}
+}
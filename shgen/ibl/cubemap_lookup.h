@@ -0,0 +1,128 @@
+#ifndef CUBEMAPLOOKUP_H__
+#define CUBEMAPLOOKUP_H__
+
+#include <cstdint>
+
+#include <algorithm>
+#include <cmath>
+
+#include "cpu_features.h"
+#include "cubemap.h"
+
+namespace ibl
+{
+    enum class CubemapFilter : uint8_t
+    {
+        Nearest,    // the texel the direction points into, as Cubemap::sampleAt()
+        Bilinear,   // the 4 texels around it, clamped to the edges of the face
+    };
+
+    // Cubemap::getAddressFor() of count directions, given as arrays of their coordinates and
+    // computed in float. the directions need not be unit vectors but must not be null.
+    // face[i] is the index of Cubemap::Face.
+    void getAddressesFor(const float* x, const float* y, const float* z, size_t count,
+                         uint8_t* face, float* s, float* t);
+
+    // the texels of cm in count directions as above, r[i], g[i] and b[i] for direction i
+    void sampleCubemap(const Cubemap& cm, CubemapFilter filter, const float* x, const float* y, const float* z,
+                       size_t count, float* r, float* g, float* b);
+
+namespace simd
+{
+    // the faces of a cubemap as read by the kernels, in the order of Cubemap::Face
+    struct CubemapLevel
+    {
+        const uint8_t* faces[6];
+        size_t bytesPerRow[6];
+        uint32_t dim;
+    };
+
+    CubemapLevel getCubemapLevel(const Cubemap& cm);
+
+    // the faces of a level as byte offsets from the first one, so that the AVX2 kernels can
+    // gather the texels of every face with 64 bit indices
+    struct GatherTable
+    {
+        explicit GatherTable(const CubemapLevel& level)
+            : base(reinterpret_cast<const float*>(level.faces[0]))
+        {
+            for (size_t f = 0; f < 6; f++) {
+                faceOffsets[f] = int64_t(uintptr_t(level.faces[f]) - uintptr_t(level.faces[0]));
+                bytesPerRow[f] = int64_t(level.bytesPerRow[f]);
+            }
+        }
+
+        const float* base;
+        alignas(32) int64_t faceOffsets[8] = {};
+        alignas(32) int64_t bytesPerRow[8] = {};   // below 4 GB
+    };
+
+    // the address of one direction in float, Cubemap::getAddressFor() without the doubles.
+    // the AVX2 kernels use FMA, so s and t may differ in the last bit from the scalar ones.
+    inline void getAddress(float x, float y, float z, uint32_t& face, float& s, float& t)
+    {
+        const float ax = std::abs(x);
+        const float ay = std::abs(y);
+        const float az = std::abs(z);
+        float sc, tc, ma;
+        if (ax >= ay && ax >= az) {
+            ma = ax;
+            face = uint32_t(x >= 0 ? Cubemap::Face::PX : Cubemap::Face::NX);
+            sc = x >= 0 ? -z : z;
+            tc = -y;
+        } else if (ay >= az) {
+            ma = ay;
+            face = uint32_t(y >= 0 ? Cubemap::Face::PY : Cubemap::Face::NY);
+            sc = x;
+            tc = y >= 0 ? z : -z;
+        } else {
+            ma = az;
+            face = uint32_t(z >= 0 ? Cubemap::Face::PZ : Cubemap::Face::NZ);
+            sc = z >= 0 ? x : -x;
+            tc = -y;
+        }
+        const float scale = 0.5f / ma;
+        s = sc * scale + 0.5f;
+        t = tc * scale + 0.5f;
+    }
+
+    // the texel of level at the address
+    inline const float* getTexel(const CubemapLevel& level, uint32_t face, float s, float t)
+    {
+        const float dim = float(level.dim);
+        const uint32_t x = std::min(uint32_t(s * dim), level.dim - 1);
+        const uint32_t y = std::min(uint32_t(t * dim), level.dim - 1);
+        return reinterpret_cast<const float*>(level.faces[face] + y * level.bytesPerRow[face] + x * sizeof(Cubemap::Texel));
+    }
+
+    using AddressBatchFn = void (*)(const float* x, const float* y, const float* z, size_t count,
+                                    uint8_t* face, float* s, float* t);
+
+    void getAddressesScalar(const float* x, const float* y, const float* z, size_t count,
+                            uint8_t* face, float* s, float* t);
+
+    // needs AVX2
+    void getAddressesAVX2(const float* x, const float* y, const float* z, size_t count,
+                          uint8_t* face, float* s, float* t);
+
+    AddressBatchFn getAddressBatch(SimdLevel level = getSimdLevel());
+
+    using SampleBatchFn = void (*)(const CubemapLevel& level, const float* x, const float* y, const float* z,
+                                   size_t count, float* r, float* g, float* b);
+
+    void sampleNearestScalar(const CubemapLevel& level, const float* x, const float* y, const float* z,
+                             size_t count, float* r, float* g, float* b);
+    void sampleBilinearScalar(const CubemapLevel& level, const float* x, const float* y, const float* z,
+                              size_t count, float* r, float* g, float* b);
+
+    // need AVX2, the texels are gathered
+    void sampleNearestAVX2(const CubemapLevel& level, const float* x, const float* y, const float* z,
+                           size_t count, float* r, float* g, float* b);
+    void sampleBilinearAVX2(const CubemapLevel& level, const float* x, const float* y, const float* z,
+                            size_t count, float* r, float* g, float* b);
+
+    SampleBatchFn getSampleBatch(CubemapFilter filter, SimdLevel level = getSimdLevel());
+}
+}
+
+#endif
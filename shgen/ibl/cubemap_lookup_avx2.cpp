@@ -0,0 +1,109 @@
+#include "cubemap_lookup.h"
+
+#include <cstring>
+
+#include "cubemap_avx2.h"
+
+namespace
+{
+    using namespace ibl;
+    using avx2::gatherTexels;
+
+    inline __m256i clampIndex(__m256i i, __m256i maxIndex)
+    {
+        return _mm256_max_epi32(_mm256_min_epi32(i, maxIndex), _mm256_setzero_si256());
+    }
+
+    inline __m256 lerp(__m256 a, __m256 b, __m256 w)
+    {
+        return _mm256_fmadd_ps(_mm256_sub_ps(b, a), w, a);
+    }
+}
+
+namespace ibl
+{
+namespace simd
+{
+    void getAddressesAVX2(const float* x, const float* y, const float* z, size_t count,
+                          uint8_t* face, float* s, float* t)
+    {
+        const size_t batched = count / 8 * 8;
+        for (size_t i = 0; i < batched; i += 8) {
+            __m256i f;
+            __m256 ls, lt;
+            avx2::getAddress(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), _mm256_loadu_ps(z + i), f, ls, lt);
+            _mm256_storeu_ps(s + i, ls);
+            _mm256_storeu_ps(t + i, lt);
+
+            // the low byte of every lane
+            const __m256i bytes = _mm256_shuffle_epi8(f, _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                                          0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+            const uint64_t packed = uint64_t(uint32_t(_mm256_extract_epi32(bytes, 0))) |
+                                    uint64_t(uint32_t(_mm256_extract_epi32(bytes, 4))) << 32;
+            memcpy(face + i, &packed, sizeof(packed));
+        }
+        getAddressesScalar(x + batched, y + batched, z + batched, count - batched, face + batched, s + batched, t + batched);
+    }
+
+    void sampleNearestAVX2(const CubemapLevel& level, const float* x, const float* y, const float* z,
+                           size_t count, float* r, float* g, float* b)
+    {
+        const avx2::GatherTable table(level);
+        const __m256 dim = _mm256_set1_ps(float(level.dim));
+        const __m256i maxIndex = _mm256_set1_epi32(int32_t(level.dim - 1));
+        const size_t batched = count / 8 * 8;
+        for (size_t i = 0; i < batched; i += 8) {
+            __m256i face;
+            __m256 s, t;
+            avx2::getAddress(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), _mm256_loadu_ps(z + i), face, s, t);
+            const __m256i tx = _mm256_min_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(s, dim)), maxIndex);
+            const __m256i ty = _mm256_min_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(t, dim)), maxIndex);
+
+            __m256 tr, tg, tb;
+            gatherTexels(table, face, tx, ty, tr, tg, tb);
+            _mm256_storeu_ps(r + i, tr);
+            _mm256_storeu_ps(g + i, tg);
+            _mm256_storeu_ps(b + i, tb);
+        }
+        sampleNearestScalar(level, x + batched, y + batched, z + batched, count - batched, r + batched, g + batched, b + batched);
+    }
+
+    void sampleBilinearAVX2(const CubemapLevel& level, const float* x, const float* y, const float* z,
+                            size_t count, float* r, float* g, float* b)
+    {
+        const avx2::GatherTable table(level);
+        const __m256 dim = _mm256_set1_ps(float(level.dim));
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256i maxIndex = _mm256_set1_epi32(int32_t(level.dim - 1));
+        const __m256i one = _mm256_set1_epi32(1);
+        const size_t batched = count / 8 * 8;
+        for (size_t i = 0; i < batched; i += 8) {
+            __m256i face;
+            __m256 s, t;
+            avx2::getAddress(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), _mm256_loadu_ps(z + i), face, s, t);
+            const __m256 u = _mm256_fmsub_ps(s, dim, half);
+            const __m256 v = _mm256_fmsub_ps(t, dim, half);
+            const __m256 fu = _mm256_floor_ps(u);
+            const __m256 fv = _mm256_floor_ps(v);
+            const __m256 wx = _mm256_sub_ps(u, fu);
+            const __m256 wy = _mm256_sub_ps(v, fv);
+            const __m256i iu = _mm256_cvttps_epi32(fu);
+            const __m256i iv = _mm256_cvttps_epi32(fv);
+            const __m256i x0 = clampIndex(iu, maxIndex);
+            const __m256i x1 = clampIndex(_mm256_add_epi32(iu, one), maxIndex);
+            const __m256i y0 = clampIndex(iv, maxIndex);
+            const __m256i y1 = clampIndex(_mm256_add_epi32(iv, one), maxIndex);
+
+            __m256 r00, g00, b00, r10, g10, b10, r01, g01, b01, r11, g11, b11;
+            gatherTexels(table, face, x0, y0, r00, g00, b00);
+            gatherTexels(table, face, x1, y0, r10, g10, b10);
+            gatherTexels(table, face, x0, y1, r01, g01, b01);
+            gatherTexels(table, face, x1, y1, r11, g11, b11);
+            _mm256_storeu_ps(r + i, lerp(lerp(r00, r10, wx), lerp(r01, r11, wx), wy));
+            _mm256_storeu_ps(g + i, lerp(lerp(g00, g10, wx), lerp(g01, g11, wx), wy));
+            _mm256_storeu_ps(b + i, lerp(lerp(b00, b10, wx), lerp(b01, b11, wx), wy));
+        }
+        sampleBilinearScalar(level, x + batched, y + batched, z + batched, count - batched, r + batched, g + batched, b + batched);
+    }
+}
+}
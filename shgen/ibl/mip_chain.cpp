@@ -0,0 +1,93 @@
+#include "mip_chain.h"
+
+#include <cmath>
+#include <memory>
+
+#include "trace.h"
+
+namespace
+{
+    using namespace ibl;
+
+    // the solid angle of a texel is 4 / dim^2 / (1 + x^2 + y^2)^(3/2) at its center, only the
+    // ratio between the 2x2 texels matters here, so the constant factor is left out
+    inline double relativeSolidAngle(double cx, double cy)
+    {
+        const double il = 1 / std::sqrt(cx * cx + cy * cy + 1);
+        return il * il * il;
+    }
+
+    void downsample(const Cubemap& src, Cubemap& dst, ThreadPool& pool)
+    {
+        TRACE_SCOPE("downsample");
+        const size_t dim = dst.getDimensions();
+        const double scale = 1.0 / dim;
+
+        const size_t numRows = 6 * dim;
+        pool.parallelFor(numRows, pool.suggestGrain(numRows), [&](size_t, size_t begin, size_t end) {
+            // weights of the two source rows
+            std::unique_ptr<double[]> weights(new double[4 * dim]);
+            double* w0 = weights.get();
+            double* w1 = w0 + 2 * dim;
+
+            for (size_t row = begin; row < end; row++) {
+                const Cubemap::Face f = Cubemap::Face(row / dim);
+                const size_t y = row % dim;
+                const Image& image = src.getImageForFace(f);
+                const Cubemap::Texel* in0 = static_cast<const Cubemap::Texel*>(image.getPixelRef(0, 2 * y));
+                const Cubemap::Texel* in1 = static_cast<const Cubemap::Texel*>(image.getPixelRef(0, 2 * y + 1));
+                Cubemap::Texel* out = static_cast<Cubemap::Texel*>(dst.getImageForFace(f).getPixelRef(0, y));
+
+                const double cy0 = (2 * y + 0.5) * scale - 1;
+                const double cy1 = (2 * y + 1.5) * scale - 1;
+                for (size_t x = 0; x < 2 * dim; x++) {
+                    const double cx = (x + 0.5) * scale - 1;
+                    w0[x] = relativeSolidAngle(cx, cy0);
+                    w1[x] = relativeSolidAngle(cx, cy1);
+                }
+
+                for (size_t x = 0; x < dim; x++) {
+                    const size_t i = 2 * x;
+                    math::double3 sum = math::double3(in0[i]) * w0[i];
+                    sum += math::double3(in0[i + 1]) * w0[i + 1];
+                    sum += math::double3(in1[i]) * w1[i];
+                    sum += math::double3(in1[i + 1]) * w1[i + 1];
+                    Cubemap::writeAt(out + x, Cubemap::Texel(sum * (1 / (w0[i] + w0[i + 1] + w1[i] + w1[i + 1]))));
+                }
+            }
+        });
+    }
+}
+
+namespace ibl
+{
+    MipChain::MipChain(const Cubemap& base, size_t minDim, ThreadPool& pool)
+    {
+        size_t numLevels = 1;
+        for (size_t dim = base.getDimensions(); dim % 2 == 0 && dim / 2 >= std::max(size_t(1), minDim); dim /= 2) {
+            numLevels++;
+        }
+        mLevels.reserve(numLevels);
+        mImages.reserve(6 * (numLevels - 1));
+
+        mLevels.emplace_back(base.getDimensions());
+        for (size_t f = 0; f < 6; f++) {
+            mLevels[0].setImageForFace(Cubemap::Face(f), base.getImageForFace(Cubemap::Face(f)));
+        }
+
+        for (size_t level = 1; level < numLevels; level++) {
+            const size_t dim = mLevels[level - 1].getDimensions() / 2;
+            mLevels.emplace_back(dim);
+            for (size_t f = 0; f < 6; f++) {
+                mImages.emplace_back(dim, dim);
+                mLevels[level].setImageForFace(Cubemap::Face(f), mImages.back());
+            }
+            downsample(mLevels[level - 1], mLevels[level], pool);
+        }
+    }
+
+    MipChain::MipChain(std::vector<Cubemap> levels)
+        : mLevels(std::move(levels))
+    {
+    }
+}
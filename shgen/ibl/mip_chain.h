@@ -0,0 +1,39 @@
+#ifndef MIPCHAIN_H__
+#define MIPCHAIN_H__
+
+#include <cstdint>
+
+#include <vector>
+
+#include "cubemap.h"
+#include "thread_pool.h"
+
+namespace ibl
+{
+    // Levels of a cubemap from the finest to the coarsest. A built level is the solid angle
+    // weighted average of 2x2 texels of the level above, so every level keeps the energy
+    // of the base.
+    class MipChain
+    {
+    public:
+        // builds the levels below base while the dimensions are even and not below minDim.
+        // level 0 refers to the images of base, which must outlive the chain.
+        explicit MipChain(const Cubemap& base, size_t minDim = 1, ThreadPool& pool = ThreadPool::getDefault());
+
+        // uses existing levels, e.g. the mips stored in a file, finest first
+        explicit MipChain(std::vector<Cubemap> levels);
+
+        MipChain(MipChain&&) = default;
+        MipChain& operator=(MipChain&&) = default;
+
+        size_t getLevelCount() const { return mLevels.size(); }
+
+        const Cubemap& getLevel(size_t level) const { return mLevels[level]; }
+
+    private:
+        std::vector<Cubemap> mLevels;
+        std::vector<Image> mImages;
+    };
+}
+
+#endif
@@ -0,0 +1,207 @@
+#include "prefilter.h"
+
+#include <cmath>
+
+#include "render_texels.h"
+#include "trace.h"
+
+namespace
+{
+    using namespace ibl;
+
+    constexpr double PI = 3.14159265358979323846;
+
+    // van der Corput sequence, the second coordinate of the Hammersley points
+    inline double radicalInverse(uint32_t bits)
+    {
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return bits * (1.0 / 4294967296.0);
+    }
+
+    // t and b complete the unit vector n to an orthonormal basis
+    inline void getTangentFrame(float nx, float ny, float nz, float* t, float* b)
+    {
+        // up is +Z unless n is close to it, +X then
+        if (std::abs(nz) < 0.999f) {
+            t[0] = -ny; t[1] = nx; t[2] = 0;
+        } else {
+            t[0] = 0; t[1] = -nz; t[2] = ny;
+        }
+        const float l = 1 / std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+        t[0] *= l;
+        t[1] *= l;
+        t[2] *= l;
+        b[0] = ny * t[2] - nz * t[1];
+        b[1] = nz * t[0] - nx * t[2];
+        b[2] = nx * t[1] - ny * t[0];
+    }
+
+    // the texel of level in the direction (x, y, z), as Cubemap::sampleAt() in float
+    inline const float* fetchTexel(const simd::PrefilterLevel& level, float x, float y, float z)
+    {
+        uint32_t face;
+        float s, t;
+        simd::getAddress(x, y, z, face, s, t);
+        return simd::getTexel(level, face, s, t);
+    }
+}
+
+namespace ibl
+{
+    SpecularPrefilter::SpecularPrefilter(size_t dim, size_t numLevels, size_t numSamples)
+        : mDimensions(std::max(size_t(1), dim))
+    {
+        size_t maxLevels = 1;
+        while (mDimensions >> maxLevels) {
+            maxLevels++;
+        }
+        mTables.resize(std::max(size_t(1), std::min(numLevels, maxLevels)));
+        numSamples = std::max(size_t(1), numSamples);
+
+        for (size_t level = 0; level < mTables.size(); level++) {
+            Table& table = mTables[level];
+            const double roughness = getRoughness(level);
+            if (roughness == 0) {
+                // the mirror, a single sample along n from the mip of the dimensions of the level
+                table.x.push_back(0);
+                table.y.push_back(0);
+                table.z.push_back(1);
+                table.weight.push_back(1);
+                table.lod.push_back(float(-std::log2(double(getDimensions(level)))));
+                continue;
+            }
+
+            const double a2 = roughness * roughness * roughness * roughness;
+            double sum = 0;
+            for (size_t i = 0; i < numSamples; i++) {
+                // h from the GGX distribution of alpha^2 = a2, and l = reflect(-n, h)
+                const double phi = 2 * PI * double(i) / double(numSamples);
+                const double u = radicalInverse(uint32_t(i));
+                const double cosTheta = std::sqrt((1 - u) / (1 + (a2 - 1) * u));
+                const double sinTheta = std::sqrt(1 - cosTheta * cosTheta);
+                const double nl = 2 * cosTheta * cosTheta - 1;
+                if (nl <= 0) {
+                    continue;
+                }
+
+                // the pdf of l is D(h) / 4 as n = v, the mip is the one whose texels cover
+                // the solid angle of the sample, one level coarser to smooth the result
+                const double d = a2 / (PI * std::pow(cosTheta * cosTheta * (a2 - 1) + 1, 2));
+                const double omegaS = 4 / (double(numSamples) * d);
+                const double lod = 0.5 * std::log2(omegaS * 6 / (4 * PI)) + 1;
+
+                table.x.push_back(float(2 * cosTheta * sinTheta * std::cos(phi)));
+                table.y.push_back(float(2 * cosTheta * sinTheta * std::sin(phi)));
+                table.z.push_back(float(nl));
+                table.weight.push_back(float(nl));
+                table.lod.push_back(float(lod));
+                sum += nl;
+            }
+            for (float& w : table.weight) {
+                w = float(w / sum);
+            }
+        }
+    }
+
+    size_t SpecularPrefilter::getDefaultLevelCount(size_t dim)
+    {
+        size_t numLevels = 1;
+        while ((dim >> numLevels) >= 8) {
+            numLevels++;
+        }
+        return numLevels;
+    }
+
+    double SpecularPrefilter::getRoughness(size_t level) const
+    {
+        return mTables.size() > 1 ? double(level) / double(mTables.size() - 1) : 0.0;
+    }
+
+    void SpecularPrefilter::render(const MipChain& source, size_t level, TexelFormat format, void* data,
+                                   ThreadPool& pool) const
+    {
+        TRACE_SCOPE("prefilter");
+        std::vector<simd::PrefilterLevel> levels;
+        levels.reserve(source.getLevelCount());
+        for (size_t i = 0; i < source.getLevelCount(); i++) {
+            levels.emplace_back(simd::getCubemapLevel(source.getLevel(i)));
+        }
+
+        // the lods of the table are relative to the dimensions of the source
+        const Table& table = mTables[level];
+        const size_t numSamples = table.weight.size();
+        const float maxLod = float(levels.size() - 1);
+        const float lodBias = float(std::log2(double(source.getLevel(0).getDimensions())));
+        std::vector<float> weightLo(numSamples);
+        std::vector<float> weightHi(numSamples);
+        std::vector<uint32_t> lo(numSamples);
+        std::vector<uint32_t> hi(numSamples);
+        for (size_t i = 0; i < numSamples; i++) {
+            const float lod = std::min(std::max(table.lod[i] + lodBias, 0.0f), maxLod);
+            lo[i] = uint32_t(lod);
+            hi[i] = std::min(lo[i] + 1, uint32_t(maxLod));
+            const float blend = lod - float(lo[i]);
+            weightLo[i] = table.weight[i] * (1 - blend);
+            weightHi[i] = table.weight[i] * blend;
+        }
+
+        simd::PrefilterSamples samples;
+        samples.x = table.x.data();
+        samples.y = table.y.data();
+        samples.z = table.z.data();
+        samples.weightLo = weightLo.data();
+        samples.weightHi = weightHi.data();
+        samples.lo = lo.data();
+        samples.hi = hi.data();
+        samples.count = numSamples;
+
+        constexpr size_t N = RENDER_BATCH;
+        const simd::PrefilterBatchFn prefilterBatch = simd::getPrefilterBatch();
+        renderTexels(getDimensions(level), format, data, pool,
+                     [&](const float* dx, const float* dy, const float* dz, float (*c)[N]) {
+            prefilterBatch(dx, dy, dz, N, samples, levels.data(), c[0], c[1], c[2]);
+        });
+    }
+
+namespace simd
+{
+    void prefilterBatchScalar(const float* dx, const float* dy, const float* dz, size_t count,
+                              const PrefilterSamples& samples, const PrefilterLevel* levels,
+                              float* r, float* g, float* b)
+    {
+        for (size_t i = 0; i < count; i++) {
+            float t[3], bt[3];
+            getTangentFrame(dx[i], dy[i], dz[i], t, bt);
+
+            float sum[3] = {};
+            for (size_t k = 0; k < samples.count; k++) {
+                const float x = t[0] * samples.x[k] + bt[0] * samples.y[k] + dx[i] * samples.z[k];
+                const float y = t[1] * samples.x[k] + bt[1] * samples.y[k] + dy[i] * samples.z[k];
+                const float z = t[2] * samples.x[k] + bt[2] * samples.y[k] + dz[i] * samples.z[k];
+                const float* texel = fetchTexel(levels[samples.lo[k]], x, y, z);
+                for (size_t ch = 0; ch < 3; ch++) {
+                    sum[ch] += samples.weightLo[k] * texel[ch];
+                }
+                if (samples.weightHi[k] != 0) {
+                    texel = fetchTexel(levels[samples.hi[k]], x, y, z);
+                    for (size_t ch = 0; ch < 3; ch++) {
+                        sum[ch] += samples.weightHi[k] * texel[ch];
+                    }
+                }
+            }
+            r[i] = sum[0];
+            g[i] = sum[1];
+            b[i] = sum[2];
+        }
+    }
+
+    PrefilterBatchFn getPrefilterBatch(SimdLevel level)
+    {
+        return level >= SimdLevel::AVX2 ? prefilterBatchAVX2 : prefilterBatchScalar;
+    }
+}
+}
@@ -0,0 +1,106 @@
+#ifndef PREFILTER_H__
+#define PREFILTER_H__
+
+#include <cstdint>
+
+#include <algorithm>
+#include <vector>
+
+#include "cpu_features.h"
+#include "cubemap.h"
+#include "cubemap_lookup.h"
+#include "mip_chain.h"
+#include "texel_format.h"
+#include "thread_pool.h"
+
+namespace ibl
+{
+    // Radiance prefiltered with the GGX distribution for image based specular lighting, one
+    // roughness per mip. Level i of the chain has faces of dim >> i texels and the perceptual
+    // roughness i / (numLevels - 1), i.e. alpha = roughness^2, and assumes n = v = r.
+    // Every level has a table of importance samples in the tangent space of n, made once
+    // here. Each sample reads the mip of the source whose texels cover about its solid angle
+    // given by the pdf, so that few samples are needed even for wide lobes.
+    class SpecularPrefilter
+    {
+    public:
+        static constexpr size_t DEFAULT_SAMPLE_COUNT = 128;
+
+        // numLevels is clamped to the mips of dim down to 1x1, numSamples is per texel of the rough levels
+        SpecularPrefilter(size_t dim, size_t numLevels, size_t numSamples = DEFAULT_SAMPLE_COUNT);
+
+        // down to faces of 8x8 texels
+        static size_t getDefaultLevelCount(size_t dim);
+
+        size_t getLevelCount() const { return mTables.size(); }
+
+        size_t getDimensions(size_t level) const { return std::max(size_t(1), mDimensions >> level); }
+
+        double getRoughness(size_t level) const;
+
+        // renders level from the mips of source into faces of getDimensions(level)^2 packed
+        // texels of format, RGB32F or RGBA16F, in the order of Cubemap::Face
+        void render(const MipChain& source, size_t level, TexelFormat format, void* data,
+                    ThreadPool& pool = ThreadPool::getDefault()) const;
+
+    private:
+        // unit directions in the tangent space of n, z along n. lod is the mip to read
+        // minus log2 of the dimensions of the source.
+        struct Table
+        {
+            std::vector<float> x;
+            std::vector<float> y;
+            std::vector<float> z;
+            std::vector<float> weight;      // n.l, normalized to a sum of 1
+            std::vector<float> lod;
+        };
+
+        size_t mDimensions;
+        std::vector<Table> mTables;
+    };
+
+namespace simd
+{
+    // a mip of the source as read by the kernels, with the gather table of the AVX2 one built
+    // once per render rather than per batch
+    struct PrefilterLevel : CubemapLevel
+    {
+        explicit PrefilterLevel(const CubemapLevel& level) : CubemapLevel(level), gather(level) {}
+
+        GatherTable gather;
+    };
+
+    // the samples of a level resolved against a source. sample i reads levels lo[i] and
+    // hi[i] of the source with the weights weightLo[i] and weightHi[i].
+    struct PrefilterSamples
+    {
+        const float* x;
+        const float* y;
+        const float* z;
+        const float* weightLo;
+        const float* weightHi;
+        const uint32_t* lo;
+        const uint32_t* hi;
+        size_t count;
+    };
+
+    // r[i], g[i], b[i] = sum of the samples around the unit direction i for i in [0, count),
+    // count a multiple of 8
+    using PrefilterBatchFn = void (*)(const float* dx, const float* dy, const float* dz, size_t count,
+                                      const PrefilterSamples& samples, const PrefilterLevel* levels,
+                                      float* r, float* g, float* b);
+
+    void prefilterBatchScalar(const float* dx, const float* dy, const float* dz, size_t count,
+                              const PrefilterSamples& samples, const PrefilterLevel* levels,
+                              float* r, float* g, float* b);
+
+    // needs AVX2 and FMA
+    void prefilterBatchAVX2(const float* dx, const float* dy, const float* dz, size_t count,
+                            const PrefilterSamples& samples, const PrefilterLevel* levels,
+                            float* r, float* g, float* b);
+
+    PrefilterBatchFn getPrefilterBatch(SimdLevel level = getSimdLevel());
+}
+}
+
+#endif
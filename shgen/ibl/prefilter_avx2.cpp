@@ -0,0 +1,81 @@
+#include "prefilter.h"
+
+#include "cubemap_avx2.h"
+
+namespace
+{
+    using namespace ibl;
+    using avx2::select;
+
+    // adds weight times the texels of level at the addresses of the lanes to r, g and b
+    inline void accumulate(const simd::PrefilterLevel& level, __m256i face, __m256 s, __m256 t,
+                           float weight, __m256& r, __m256& g, __m256& b)
+    {
+        const __m256 dim = _mm256_set1_ps(float(level.dim));
+        const __m256i maxIndex = _mm256_set1_epi32(int32_t(level.dim - 1));
+        const __m256i x = _mm256_min_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(s, dim)), maxIndex);
+        const __m256i y = _mm256_min_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(t, dim)), maxIndex);
+
+        __m256 tr, tg, tb;
+        avx2::gatherTexels(level.gather, face, x, y, tr, tg, tb);
+        const __m256 w = _mm256_set1_ps(weight);
+        r = _mm256_fmadd_ps(w, tr, r);
+        g = _mm256_fmadd_ps(w, tg, g);
+        b = _mm256_fmadd_ps(w, tb, b);
+    }
+}
+
+namespace ibl
+{
+namespace simd
+{
+    void prefilterBatchAVX2(const float* dx, const float* dy, const float* dz, size_t count,
+                            const PrefilterSamples& samples, const PrefilterLevel* levels,
+                            float* r, float* g, float* b)
+    {
+        const __m256 signMask = _mm256_set1_ps(-0.0f);
+        const __m256 zero = _mm256_setzero_ps();
+        for (size_t i = 0; i < count; i += 8) {
+            const __m256 nx = _mm256_loadu_ps(dx + i);
+            const __m256 ny = _mm256_loadu_ps(dy + i);
+            const __m256 nz = _mm256_loadu_ps(dz + i);
+
+            // the tangent frame of getTangentFrame(), up is +Z unless n is close to it
+            const __m256 useZ = _mm256_cmp_ps(_mm256_andnot_ps(signMask, nz), _mm256_set1_ps(0.999f), _CMP_LT_OQ);
+            __m256 tx = select(useZ, _mm256_xor_ps(ny, signMask), zero);
+            __m256 ty = select(useZ, nx, _mm256_xor_ps(nz, signMask));
+            __m256 tz = select(useZ, zero, ny);
+            const __m256 l = _mm256_div_ps(_mm256_set1_ps(1.0f),
+                                           _mm256_sqrt_ps(_mm256_fmadd_ps(tx, tx, _mm256_fmadd_ps(ty, ty, _mm256_mul_ps(tz, tz)))));
+            tx = _mm256_mul_ps(tx, l);
+            ty = _mm256_mul_ps(ty, l);
+            tz = _mm256_mul_ps(tz, l);
+            const __m256 bx = _mm256_fmsub_ps(ny, tz, _mm256_mul_ps(nz, ty));
+            const __m256 by = _mm256_fmsub_ps(nz, tx, _mm256_mul_ps(nx, tz));
+            const __m256 bz = _mm256_fmsub_ps(nx, ty, _mm256_mul_ps(ny, tx));
+
+            __m256 sr = zero, sg = zero, sb = zero;
+            for (size_t k = 0; k < samples.count; k++) {
+                const __m256 sx = _mm256_set1_ps(samples.x[k]);
+                const __m256 sy = _mm256_set1_ps(samples.y[k]);
+                const __m256 sz = _mm256_set1_ps(samples.z[k]);
+                const __m256 x = _mm256_fmadd_ps(tx, sx, _mm256_fmadd_ps(bx, sy, _mm256_mul_ps(nx, sz)));
+                const __m256 y = _mm256_fmadd_ps(ty, sx, _mm256_fmadd_ps(by, sy, _mm256_mul_ps(ny, sz)));
+                const __m256 z = _mm256_fmadd_ps(tz, sx, _mm256_fmadd_ps(bz, sy, _mm256_mul_ps(nz, sz)));
+
+                __m256i face;
+                __m256 s, t;
+                avx2::getAddress(x, y, z, face, s, t);
+
+                accumulate(levels[samples.lo[k]], face, s, t, samples.weightLo[k], sr, sg, sb);
+                if (samples.weightHi[k] != 0) {
+                    accumulate(levels[samples.hi[k]], face, s, t, samples.weightHi[k], sr, sg, sb);
+                }
+            }
+            _mm256_storeu_ps(r + i, sr);
+            _mm256_storeu_ps(g + i, sg);
+            _mm256_storeu_ps(b + i, sb);
+        }
+    }
+}
+}
@@ -0,0 +1,76 @@
+#ifndef RENDERTEXELS_H__
+#define RENDERTEXELS_H__
+
+#include <cstdint>
+
+#include <cmath>
+#include <memory>
+
+#include "cubemap.h"
+#include "texel_format.h"
+#include "thread_pool.h"
+
+namespace ibl
+{
+    // the unit directions of the centers of the texels [x, x + N) of row cy of face,
+    // as Cubemap::getDirectionFor() in float
+    template <size_t N>
+    void getTexelDirections(Cubemap::Face face, size_t x, float cy, float scale, float* dx, float* dy, float* dz)
+    {
+        float cx[N];
+        for (size_t i = 0; i < N; i++) {
+            cx[i] = float(x + i) * scale + (0.5f * scale - 1);
+        }
+        switch (face) {
+        case Cubemap::Face::PX: for (size_t i = 0; i < N; i++) { dx[i] =  1;     dy[i] = cy; dz[i] = -cx[i]; } break;
+        case Cubemap::Face::NX: for (size_t i = 0; i < N; i++) { dx[i] = -1;     dy[i] = cy; dz[i] =  cx[i]; } break;
+        case Cubemap::Face::PY: for (size_t i = 0; i < N; i++) { dx[i] = cx[i];  dy[i] =  1; dz[i] = -cy;    } break;
+        case Cubemap::Face::NY: for (size_t i = 0; i < N; i++) { dx[i] = cx[i];  dy[i] = -1; dz[i] =  cy;    } break;
+        case Cubemap::Face::PZ: for (size_t i = 0; i < N; i++) { dx[i] = cx[i];  dy[i] = cy; dz[i] =  1;     } break;
+        case Cubemap::Face::NZ: for (size_t i = 0; i < N; i++) { dx[i] = -cx[i]; dy[i] = cy; dz[i] = -1;     } break;
+        }
+        for (size_t i = 0; i < N; i++) {
+            const float l = 1 / std::sqrt(cx[i] * cx[i] + cy * cy + 1);
+            dx[i] *= l;
+            dy[i] *= l;
+            dz[i] *= l;
+        }
+    }
+
+    // texels evaluated together by renderTexels(), a multiple of the widest SIMD lanes
+    constexpr size_t RENDER_BATCH = 16;
+
+    // rows of texels are evaluated in batches into texels of the row, then encoded to data.
+    // evaluate(dx, dy, dz, c) writes channel ch of direction i of the batch to c[ch][i].
+    template <typename EvaluateFn>
+    void renderTexels(size_t dim, TexelFormat format, void* data, ThreadPool& pool, const EvaluateFn& evaluate)
+    {
+        constexpr size_t N = RENDER_BATCH;
+
+        const simd::EncodeRowFn encodeRow = simd::getEncodeRow(format);
+        const size_t bytesPerRow = dim * getBytesPerTexel(format);
+        const size_t padded = (dim + N - 1) / N * N;
+        const float scale = 2.0f / float(dim);
+        const size_t numRows = 6 * dim;
+
+        pool.parallelFor(numRows, pool.suggestGrain(numRows), [&](size_t, size_t begin, size_t end) {
+            std::unique_ptr<Cubemap::Texel[]> texels(new Cubemap::Texel[padded]);
+            alignas(64) float dx[N], dy[N], dz[N];
+            for (size_t row = begin; row < end; row++) {
+                const Cubemap::Face f = Cubemap::Face(row / dim);
+                const float cy = 1 - (float(row % dim) + 0.5f) * scale;
+                for (size_t x = 0; x < dim; x += N) {
+                    getTexelDirections<N>(f, x, cy, scale, dx, dy, dz);
+                    float c[3][N];
+                    evaluate(dx, dy, dz, c);
+                    for (size_t i = 0; i < N; i++) {
+                        texels[x + i] = Cubemap::Texel(c[0][i], c[1][i], c[2][i]);
+                    }
+                }
+                encodeRow(texels.get(), dim, static_cast<uint8_t*>(data) + row * bytesPerRow);
+            }
+        });
+    }
+}
+
+#endif
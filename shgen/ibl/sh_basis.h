@@ -0,0 +1,193 @@
+#ifndef SHBASIS_H__
+#define SHBASIS_H__
+
+#include <cstdint>
+
+namespace ibl
+{
+namespace sh
+{
+    constexpr double PI = 3.1415926535897932384626433832795;
+
+    constexpr size_t MAX_ORDER = 8;
+
+    // number of coefficients of bands 0..order, coefficient (l, m) is at l * (l + 1) + m
+    constexpr size_t getCoefCount(size_t order) { return (order + 1) * (order + 1); }
+
+    constexpr double factorial(size_t n, size_t d = 1)
+    {
+        d = d > 1 ? d : 1;
+        n = n > 1 ? n : 1;
+        double r = 1.0;
+        if (n == d) {
+            // intentionally left blank
+        } else if (n > d) {
+            for ( ; n > d; n--) {
+                r *= n;
+            }
+        } else {
+            for ( ; d > n; d--) {
+                r *= d;
+            }
+            r = 1.0 / r;
+        }
+        return r;
+    }
+
+    // band l of the clamped cosine lobe, the irradiance of band l is this times the radiance
+    constexpr double computeTruncatedCosSh(size_t l)
+    {
+        if (l == 0) {
+            return PI;
+        } else if (l == 1) {
+            return 2 * PI / 3;
+        } else if (l & 1) {
+            return 0;
+        }
+        const size_t l_2 = l / 2;
+        const double A0 = ((l_2 & 1) ? 1.0 : -1.0) / double((l + 2) * (l - 1));
+        const double A1 = factorial(l, l_2) / (factorial(l_2) * double(size_t(1) << l));
+        return 2 * PI * A0 * A1;
+    }
+
+    constexpr double sqrtNewton(double x)
+    {
+        double r = x > 1 ? x : 1;
+        for (int i = 0; i < 64; i++) {
+            r = 0.5 * (r + x / r);
+        }
+        return r;
+    }
+
+    // Normalization and associated Legendre recurrence constants of the real spherical
+    // harmonics (without the Condon-Shortley phase) up to the given order.
+    //   P(m, m)   = (2m-1)!!
+    //   P(m+1, m) = (2m+1) z P(m, m)
+    //   P(l, m)   = ((2l-1) z P(l-1, m) - (l+m-1) P(l-2, m)) / (l-m)
+    // P(l, m) is multiplied by Re or Im of (x + iy)^m, so no square root is needed.
+    template <size_t L>
+    struct Tables
+    {
+        double K[getCoefCount(L)] = {};
+        double Pmm[L + 1] = {};
+        double A[L + 1][L + 1] = {};
+        double B[L + 1][L + 1] = {};
+
+        constexpr Tables()
+        {
+            for (size_t l = 0; l <= L; l++) {
+                for (size_t m = 0; m <= l; m++) {
+                    const double k2 = (2 * l + 1) / (4 * PI) * factorial(l - m, l + m);
+                    const double k = sqrtNewton(k2) * (m ? sqrtNewton(2.0) : 1.0);
+                    K[l * (l + 1) + m] = k;
+                    K[l * (l + 1) - m] = k;
+                    if (l >= m + 2) {
+                        A[l][m] = double(2 * l - 1) / double(l - m);
+                        B[l][m] = double(l + m - 1) / double(l - m);
+                    }
+                }
+            }
+            double pmm = 1;
+            for (size_t m = 0; m <= L; m++) {
+                Pmm[m] = pmm;
+                pmm *= double(2 * m + 1);
+            }
+        }
+    };
+
+    template <size_t L>
+    struct Basis
+    {
+        static constexpr size_t NUM_COEFS = getCoefCount(L);
+        static constexpr Tables<L> tables{};
+
+        // evaluates the orthonormal basis for the unit direction (x, y, z).
+        // fully unrolled, every table lookup is a compile time constant.
+        template <typename T>
+        static inline void evaluate(T x, T y, T z, T* Y)
+        {
+            const T w = 1;
+            evaluateSoA<1>(&x, &y, &z, &w, Y, 1);
+        }
+
+        // same for N directions at once, scaled by w. the basis k of direction i goes to
+        // Y[k * stride + i]. every step is a plain loop over the N directions, which the
+        // compiler vectorizes. the recurrence is linear, so w only scales its seeds.
+        template <size_t N, typename T>
+        static inline void evaluateSoA(const T* x, const T* y, const T* z, const T* w, T* Y, size_t stride)
+        {
+            T lx[N], ly[N], lz[N], lw[N], c[N], s[N];
+            for (size_t i = 0; i < N; i++) {
+                lx[i] = x[i];
+                ly[i] = y[i];
+                lz[i] = z[i];
+                lw[i] = w[i];
+                c[i] = 1;
+                s[i] = 0;
+            }
+            order<0, N>(lx, ly, lz, lw, c, s, Y, stride);
+        }
+
+    private:
+        // c and s are cos(m phi) and sin(m phi) scaled by sin(theta)^m,
+        // i.e. the real and imaginary parts of (x + iy)^m
+        template <size_t m, size_t N, typename T>
+        static inline void order(const T* x, const T* y, const T* z, const T* w, T* c, T* s, T* Y, size_t stride)
+        {
+            if constexpr (m <= L) {
+                T p0[N], p1[N];
+                for (size_t i = 0; i < N; i++) {
+                    p0[i] = T(tables.Pmm[m]) * w[i];
+                }
+                store<m, m, N>(p0, c, s, Y, stride);
+                if constexpr (m + 1 <= L) {
+                    for (size_t i = 0; i < N; i++) {
+                        p1[i] = z[i] * T(2 * m + 1) * p0[i];
+                    }
+                    store<m + 1, m, N>(p1, c, s, Y, stride);
+                    band<m + 2, m, N>(z, p1, p0, c, s, Y, stride);
+                }
+                if constexpr (m + 1 <= L) {
+                    for (size_t i = 0; i < N; i++) {
+                        const T cm = c[i];
+                        c[i] = x[i] * cm - y[i] * s[i];
+                        s[i] = x[i] * s[i] + y[i] * cm;
+                    }
+                    order<m + 1, N>(x, y, z, w, c, s, Y, stride);
+                }
+            }
+        }
+
+        // p0 is overwritten with P(l, m), which becomes p1 of the next band
+        template <size_t l, size_t m, size_t N, typename T>
+        static inline void band(const T* z, T* p1, T* p0, const T* c, const T* s, T* Y, size_t stride)
+        {
+            if constexpr (l <= L) {
+                for (size_t i = 0; i < N; i++) {
+                    p0[i] = T(tables.A[l][m]) * z[i] * p1[i] - T(tables.B[l][m]) * p0[i];
+                }
+                store<l, m, N>(p0, c, s, Y, stride);
+                band<l + 1, m, N>(z, p0, p1, c, s, Y, stride);
+            }
+        }
+
+        template <size_t l, size_t m, size_t N, typename T>
+        static inline void store(const T* p, const T* c, const T* s, T* Y, size_t stride)
+        {
+            constexpr size_t k = l * (l + 1);
+            if constexpr (m == 0) {
+                for (size_t i = 0; i < N; i++) {
+                    Y[k * stride + i] = T(tables.K[k]) * p[i];
+                }
+            } else {
+                for (size_t i = 0; i < N; i++) {
+                    Y[(k + m) * stride + i] = T(tables.K[k + m]) * p[i] * c[i];
+                    Y[(k - m) * stride + i] = T(tables.K[k - m]) * p[i] * s[i];
+                }
+            }
+        }
+    };
+}
+}
+
+#endif
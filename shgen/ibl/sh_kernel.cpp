@@ -0,0 +1,312 @@
+#include "sh_kernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <map>
+#include <mutex>
+
+namespace
+{
+    inline double sphereQuadrantArea(double x, double y)
+    {
+        return std::atan2(x * y, std::sqrt(x * x + y * y + 1));
+    }
+
+    double solidAngle(size_t dim, size_t u, size_t v)
+    {
+        const double iDim = 1.0f / dim;
+        double s = ((u + 0.5) * 2 * iDim) - 1;
+        double t = ((v + 0.5) * 2 * iDim) - 1;
+        const double x0 = s - iDim;
+        const double y0 = t - iDim;
+        const double x1 = s + iDim;
+        const double y1 = t + iDim;
+        double solidAngle = sphereQuadrantArea(x0, y0)
+                          - sphereQuadrantArea(x0, y1)
+                          - sphereQuadrantArea(x1, y0)
+                          + sphereQuadrantArea(x1, y1);
+        return solidAngle;
+    }
+
+    // maps the face local direction (cx, cy, 1) to the world axes, see Cubemap::getDirectionFor()
+    template <ibl::Cubemap::Face F, typename T>
+    inline void toWorld(T lx, T ly, T lz, T& x, T& y, T& z)
+    {
+        using Face = ibl::Cubemap::Face;
+        switch (F) {
+        case Face::PX: x =  lz; y = ly; z = -lx; break;
+        case Face::NX: x = -lz; y = ly; z =  lx; break;
+        case Face::PY: x =  lx; y = lz; z = -ly; break;
+        case Face::NY: x =  lx; y = -lz; z = ly; break;
+        case Face::PZ: x =  lx; y = ly; z =  lz; break;
+        case Face::NZ: x = -lx; y = ly; z = -lz; break;
+        }
+    }
+
+    // the first row of weights holds the solid angles on entry
+    template <size_t L, ibl::Cubemap::Face F, typename T>
+    void expandRow(const double* coords, double cy, size_t dim, size_t stride, T* weights)
+    {
+        using Basis = ibl::sh::Basis<L>;
+        constexpr size_t N = ibl::SHKernel::BATCH;
+
+        const T ty = T(cy);
+        for (size_t base = 0; base < dim; base += N) {
+            T da[N], sx[N], sy[N], sz[N];
+            for (size_t i = 0; i < N; i++) {
+                const T tx = T(coords[base + i]);
+                const T il = 1 / std::sqrt(tx * tx + ty * ty + 1);
+                da[i] = weights[base + i];
+                toWorld<F>(tx * il, ty * il, il, sx[i], sy[i], sz[i]);
+            }
+            Basis::template evaluateSoA<N>(sx, sy, sz, da, weights + base, stride);
+        }
+    }
+
+    template <size_t L, typename T>
+    void expandRow(ibl::Cubemap::Face face, const double* coords, double cy, size_t dim, size_t stride, T* weights)
+    {
+        using Face = ibl::Cubemap::Face;
+        switch (face) {
+        case Face::NX: expandRow<L, Face::NX>(coords, cy, dim, stride, weights); break;
+        case Face::PX: expandRow<L, Face::PX>(coords, cy, dim, stride, weights); break;
+        case Face::NY: expandRow<L, Face::NY>(coords, cy, dim, stride, weights); break;
+        case Face::PY: expandRow<L, Face::PY>(coords, cy, dim, stride, weights); break;
+        case Face::NZ: expandRow<L, Face::NZ>(coords, cy, dim, stride, weights); break;
+        case Face::PZ: expandRow<L, Face::PZ>(coords, cy, dim, stride, weights); break;
+        }
+    }
+
+    // the weights of a row past count are null
+    template <typename T>
+    void padRow(size_t count, T* weights)
+    {
+        constexpr size_t N = ibl::SHKernel::BATCH;
+        const size_t padded = (count + N - 1) / N * N;
+        for (size_t x = count; x < padded; x++) {
+            weights[x] = 0;
+        }
+    }
+
+    size_t getPaddedStride(size_t width)
+    {
+        constexpr size_t N = ibl::SHKernel::BATCH;
+        const size_t stride = (width + N - 1) / N * N;
+        return stride % 256 == 0 ? stride + N : stride;
+    }
+
+    template <size_t L, typename T>
+    void expandLatLongRow(const double* sinPhi, const double* cosPhi, double sinTheta, double cosTheta,
+                          double solidAngle, size_t width, size_t stride, T* weights)
+    {
+        using Basis = ibl::sh::Basis<L>;
+        constexpr size_t N = ibl::LatLongKernel::BATCH;
+
+        const T st = T(sinTheta);
+        const T ct = T(cosTheta);
+        const T da = T(solidAngle);
+        for (size_t base = 0; base < width; base += N) {
+            T w[N], sx[N], sy[N], sz[N];
+            for (size_t i = 0; i < N; i++) {
+                // the padding of the tables past width gets null weights
+                w[i] = base + i < width ? da : T(0);
+                sx[i] = st * T(sinPhi[base + i]);
+                sy[i] = ct;
+                sz[i] = st * T(cosPhi[base + i]);
+            }
+            Basis::template evaluateSoA<N>(sx, sy, sz, w, weights + base, stride);
+        }
+    }
+
+    // the kernels of the sizes used last, a table of 8k faces holds 134 MB
+    constexpr size_t MAX_CACHED_KERNELS = 4;
+
+    struct CacheEntry
+    {
+        std::shared_future<std::shared_ptr<const ibl::SHKernel>> kernel;
+        uint64_t lastUse = 0;
+    };
+
+    std::mutex cacheLock;
+    std::map<size_t, CacheEntry> cache;
+    uint64_t cacheClock = 0;
+}
+
+namespace ibl
+{
+    SHKernel::SHKernel(size_t dim)
+        : mDimensions(dim)
+        , mStride(getPaddedStride(dim))
+        , mHalf((dim + 1) / 2)
+        , mCoords(dim + BATCH)
+        , mSolidAngles(mHalf * mHalf)
+    {
+        // the coordinates past dim only feed the padding of a last batch
+        const double scale = 2.0 / dim;
+        for (size_t i = 0; i < mCoords.size(); i++) {
+            mCoords[i] = ((i + 0.5) * scale) - 1;
+        }
+
+        // the quadrant is also symmetric under transposition
+        for (size_t i = 0; i < mHalf; i++) {
+            for (size_t j = 0; j <= i; j++) {
+                const double da = solidAngle(dim, i, j);
+                mSolidAngles[i * mHalf + j] = da;
+                mSolidAngles[j * mHalf + i] = da;
+            }
+        }
+    }
+
+    template <size_t L, typename T>
+    void SHKernel::buildRow(Cubemap::Face face, size_t y, size_t begin, size_t end, T* weights) const
+    {
+        const size_t count = end - begin;
+        const size_t stride = mStride;
+        T* solidAngles = weights;
+
+        const double* row = &mSolidAngles[fold(y) * mHalf];
+        for (size_t x = begin; x < end; x++) {
+            solidAngles[x - begin] = T(row[fold(x)]);
+        }
+        padRow(count, solidAngles);
+
+        expandRow<L>(face, mCoords.data() + begin, -mCoords[y], count, stride, weights);
+    }
+
+    SHRowKernel::SHRowKernel(size_t dim)
+        : mDimensions(dim)
+        , mStride(getPaddedStride(std::min(dim, TILE_WIDTH)))
+        , mCoords(dim + BATCH)
+        , mCorners(dim + 1)
+    {
+        const double scale = 2.0 / dim;
+        for (size_t i = 0; i < mCoords.size(); i++) {
+            mCoords[i] = ((i + 0.5) * scale) - 1;
+        }
+        for (size_t i = 0; i < mCorners.size(); i++) {
+            mCorners[i] = i * scale - 1;
+        }
+    }
+
+    template <size_t L, typename T>
+    void SHRowKernel::buildRow(size_t row, size_t begin, size_t end, T* weights) const
+    {
+        const size_t dim = mDimensions;
+        const size_t y = row % dim;
+        const double y0 = mCorners[y];
+        const double y1 = mCorners[y + 1];
+
+        // the solid angle of a texel is the difference of the strips of the quadrant area
+        // between its rows at its two corner columns
+        double left = sphereQuadrantArea(mCorners[begin], y1) - sphereQuadrantArea(mCorners[begin], y0);
+        for (size_t x = begin; x < end; x++) {
+            const double right = sphereQuadrantArea(mCorners[x + 1], y1) - sphereQuadrantArea(mCorners[x + 1], y0);
+            weights[x - begin] = T(right - left);
+            left = right;
+        }
+        padRow(end - begin, weights);
+
+        expandRow<L>(Cubemap::Face(row / dim), mCoords.data() + begin, -mCoords[y], end - begin, mStride, weights);
+    }
+
+    LatLongKernel::LatLongKernel(size_t width, size_t height)
+        : mWidth(width)
+        , mHeight(height)
+        , mStride(getPaddedStride(width))
+        , mSinPhi(width + BATCH)
+        , mCosPhi(width + BATCH)
+        , mSinTheta(height)
+        , mCosTheta(height)
+        , mSolidAngles(height)
+    {
+
+        const double dPhi = 2 * sh::PI / width;
+        for (size_t x = 0; x < mSinPhi.size(); x++) {
+            const double phi = (x + 0.5) * dPhi - sh::PI;
+            mSinPhi[x] = std::sin(phi);
+            mCosPhi[x] = std::cos(phi);
+        }
+
+        const double dTheta = sh::PI / height;
+        for (size_t y = 0; y < height; y++) {
+            const double theta = (y + 0.5) * dTheta;
+            mSinTheta[y] = std::sin(theta);
+            mCosTheta[y] = std::cos(theta);
+            mSolidAngles[y] = dPhi * (std::cos(y * dTheta) - std::cos((y + 1) * dTheta));
+        }
+    }
+
+    template <size_t L, typename T>
+    void LatLongKernel::buildRow(size_t y, size_t begin, size_t end, T* weights) const
+    {
+        expandLatLongRow<L>(mSinPhi.data() + begin, mCosPhi.data() + begin, mSinTheta[y], mCosTheta[y],
+                            mSolidAngles[y], end - begin, mStride, weights);
+    }
+
+#define INSTANTIATE_BUILD_ROW(L) \
+    template void SHKernel::buildRow<L, float>(Cubemap::Face, size_t, size_t, size_t, float*) const; \
+    template void SHKernel::buildRow<L, double>(Cubemap::Face, size_t, size_t, size_t, double*) const; \
+    template void SHRowKernel::buildRow<L, float>(size_t, size_t, size_t, float*) const; \
+    template void SHRowKernel::buildRow<L, double>(size_t, size_t, size_t, double*) const; \
+    template void LatLongKernel::buildRow<L, float>(size_t, size_t, size_t, float*) const; \
+    template void LatLongKernel::buildRow<L, double>(size_t, size_t, size_t, double*) const;
+
+    INSTANTIATE_BUILD_ROW(1)
+    INSTANTIATE_BUILD_ROW(2)
+    INSTANTIATE_BUILD_ROW(3)
+    INSTANTIATE_BUILD_ROW(4)
+    INSTANTIATE_BUILD_ROW(5)
+    INSTANTIATE_BUILD_ROW(6)
+    INSTANTIATE_BUILD_ROW(7)
+    INSTANTIATE_BUILD_ROW(8)
+
+#undef INSTANTIATE_BUILD_ROW
+
+    std::shared_ptr<const SHKernel> SHKernel::get(size_t dim)
+    {
+        // the kernel is built outside of the lock, the other threads that want the same size
+        // wait for it and the other sizes do not wait at all
+        std::promise<std::shared_ptr<const SHKernel>> promise;
+        std::shared_future<std::shared_ptr<const SHKernel>> kernel;
+        {
+            std::lock_guard<std::mutex> lock(cacheLock);
+            auto it = cache.find(dim);
+            if (it != cache.end()) {
+                it->second.lastUse = ++cacheClock;
+                kernel = it->second.kernel;
+            } else {
+                while (cache.size() >= MAX_CACHED_KERNELS) {
+                    auto oldest = cache.begin();
+                    for (auto i = cache.begin(); i != cache.end(); ++i) {
+                        oldest = i->second.lastUse < oldest->second.lastUse ? i : oldest;
+                    }
+                    cache.erase(oldest);
+                }
+                CacheEntry& entry = cache[dim];
+                entry.kernel = promise.get_future().share();
+                entry.lastUse = ++cacheClock;
+            }
+        }
+        if (kernel.valid()) {
+            return kernel.get();
+        }
+
+        try {
+            std::shared_ptr<const SHKernel> built = std::make_shared<SHKernel>(dim);
+            promise.set_value(built);
+            return built;
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            std::lock_guard<std::mutex> lock(cacheLock);
+            cache.erase(dim);
+            throw;
+        }
+    }
+
+    void SHKernel::purgeCache()
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        cache.clear();
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef SHKERNEL_H__
+#define SHKERNEL_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cubemap.h"
+#include "sh_basis.h"
+
+namespace ibl
+{
+    // Projection weights of a cubemap face grid. They only depend on the dimensions,
+    // so they are computed once and shared through a cache of the last sizes used. The face
+    // grid is symmetric under mirroring, so only the solid angles of one quadrant of one face
+    // are stored, row by row so that a row of weights is a contiguous read.
+    class SHKernel
+    {
+    public:
+        explicit SHKernel(size_t dim);
+
+        // directions evaluated together by buildRow()
+        static constexpr size_t BATCH = 16;
+
+        size_t getDimensions() const { return mDimensions; }
+
+        // distance between the coefficient rows of the weights, padded to whole batches and
+        // away from multiples of 4k bytes so that the rows do not alias in the cache
+        size_t getRowStride() const { return mStride; }
+
+        double getSolidAngle(size_t x, size_t y) const { return mSolidAngles[fold(y) * mHalf + fold(x)]; }
+
+        // writes the basis of bands 0..L for the texels [begin, end) of row y, premultiplied by
+        // the solid angle, to weights[k * getRowStride() + x - begin]. instantiated for
+        // L = 1..sh::MAX_ORDER and T = float, double.
+        template <size_t L, typename T>
+        void buildRow(Cubemap::Face face, size_t y, size_t begin, size_t end, T* weights) const;
+
+        template <size_t L, typename T>
+        void buildRow(Cubemap::Face face, size_t y, T* weights) const { buildRow<L>(face, y, 0, mDimensions, weights); }
+
+        // the rows of all the faces one after the other, row is face * dim + y. the weights of
+        // a row are built getTileWidth() texels at a time, here all of them.
+        size_t getRowCount() const { return 6 * mDimensions; }
+        size_t getRowWidth() const { return mDimensions; }
+        size_t getTileWidth() const { return mDimensions; }
+
+        template <size_t L, typename T>
+        void buildRow(size_t row, size_t begin, size_t end, T* weights) const
+        {
+            buildRow<L>(Cubemap::Face(row / mDimensions), row % mDimensions, begin, end, weights);
+        }
+
+        // the kernel of dim from the cache, built on a miss without blocking the other sizes.
+        // the least recently used sizes are dropped from the cache past a few of them.
+        static std::shared_ptr<const SHKernel> get(size_t dim);
+
+        static void purgeCache();
+
+    private:
+        size_t fold(size_t i) const { return i < mHalf ? i : mDimensions - 1 - i; }
+
+        size_t mDimensions;
+        size_t mStride;
+        size_t mHalf;
+        std::vector<double> mCoords;
+        std::vector<double> mSolidAngles;
+    };
+
+    // The weights of SHKernel without its table of solid angles, for the streaming projection
+    // whose memory must not grow with the faces. The solid angles of a row are computed when
+    // it is built, from the quadrant areas at the corners of its texels, 2 * (dim + 1) atan2
+    // per row. Not cached, it holds O(dim) values, and the weights of a row are built in tiles
+    // of TILE_WIDTH texels so that the buffers of the threads do not grow with the faces either.
+    class SHRowKernel
+    {
+    public:
+        explicit SHRowKernel(size_t dim);
+
+        static constexpr size_t BATCH = SHKernel::BATCH;
+        static constexpr size_t TILE_WIDTH = 32 * BATCH;
+
+        size_t getDimensions() const { return mDimensions; }
+
+        // the stride of the weights of a tile
+        size_t getRowStride() const { return mStride; }
+
+        size_t getRowCount() const { return 6 * mDimensions; }
+        size_t getRowWidth() const { return mDimensions; }
+        size_t getTileWidth() const { return std::min(mDimensions, TILE_WIDTH); }
+
+        // as SHKernel::buildRow(), row is face * dim + y and [begin, end) at most a tile
+        template <size_t L, typename T>
+        void buildRow(size_t row, size_t begin, size_t end, T* weights) const;
+
+    private:
+        size_t mDimensions;
+        size_t mStride;
+        std::vector<double> mCoords;
+        std::vector<double> mCorners;   // the dim + 1 edges of the texels, in [-1, 1]
+    };
+
+    // Projection weights of an equirectangular image of width x height texels. Row y spans
+    // the polar angles [y, y + 1) * pi / height down from +Y, column x the azimuths
+    // [x, x + 1) * 2pi / width - pi around +Y, so the middle column faces +Z and the
+    // column at three quarters +X. A texel of row y covers the solid angle
+    // 2pi / width * (cos(theta0) - cos(theta1)), the integral of sin(theta) over the row.
+    // The sines and cosines of the rows and of the columns are tabulated, so a row of
+    // weights is the basis evaluated from the table without any trigonometry.
+    class LatLongKernel
+    {
+    public:
+        LatLongKernel(size_t width, size_t height);
+
+        static constexpr size_t BATCH = SHKernel::BATCH;
+
+        size_t getWidth() const { return mWidth; }
+        size_t getHeight() const { return mHeight; }
+
+        size_t getRowStride() const { return mStride; }
+
+        double getSolidAngle(size_t y) const { return mSolidAngles[y]; }
+
+        size_t getRowCount() const { return mHeight; }
+        size_t getRowWidth() const { return mWidth; }
+        size_t getTileWidth() const { return mWidth; }
+
+        // writes the basis of bands 0..L for the texels [begin, end) of row y, premultiplied by
+        // the solid angle, to weights[k * getRowStride() + x - begin]. instantiated as
+        // SHKernel::buildRow().
+        template <size_t L, typename T>
+        void buildRow(size_t y, size_t begin, size_t end, T* weights) const;
+
+    private:
+        size_t mWidth;
+        size_t mHeight;
+        size_t mStride;
+        std::vector<double> mSinPhi;
+        std::vector<double> mCosPhi;
+        std::vector<double> mSinTheta;
+        std::vector<double> mCosTheta;
+        std::vector<double> mSolidAngles;
+    };
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include "sh_project.h"
+
+#include <algorithm>
+
+namespace ibl
+{
+namespace simd
+{
+    void projectRowScalar(const Cubemap::Texel* texels, const double* weights, size_t count,
+                          size_t stride, size_t numCoefs, math::double3* sh)
+    {
+        for (size_t x = 0; x < count; ++x) {
+            math::double3 color(Cubemap::sampleAt(texels + x));
+            for (size_t k = 0; k < numCoefs; k++) {
+                sh[k] += color * weights[k * stride + x];
+            }
+        }
+    }
+
+    void projectRowFloatScalar(const Cubemap::Texel* texels, const float* weights, size_t count,
+                               size_t stride, size_t numCoefs, Summation summation, math::float3* sums)
+    {
+        for (size_t k = 0; k < numCoefs; k++) {
+            const float* w = weights + k * stride;
+            float total[3] = {}, comp[3] = {};
+            for (size_t begin = 0; begin < count; begin += SUM_BLOCK) {
+                const size_t end = std::min(count, begin + SUM_BLOCK);
+                float acc[3] = {};
+                for (size_t x = begin; x < end; x++) {
+                    const Cubemap::Texel& t = Cubemap::sampleAt(texels + x);
+                    acc[0] += t.r * w[x];
+                    acc[1] += t.g * w[x];
+                    acc[2] += t.b * w[x];
+                }
+                for (size_t ch = 0; ch < 3; ch++) {
+                    if (summation == Summation::Kahan) {
+                        const float y = acc[ch] - comp[ch];
+                        const float t = total[ch] + y;
+                        comp[ch] = (t - total[ch]) - y;
+                        total[ch] = t;
+                    } else {
+                        total[ch] += acc[ch];
+                    }
+                }
+            }
+            sums[k] += math::float3(total[0] - comp[0], total[1] - comp[1], total[2] - comp[2]);
+        }
+    }
+
+    ProjectRowFn getProjectRow(SimdLevel level)
+    {
+        switch (level) {
+        case SimdLevel::AVX512: return projectRowAVX512;
+        case SimdLevel::AVX2:   return projectRowAVX2;
+        case SimdLevel::SSE4:   return projectRowSSE4;
+        default:                return projectRowScalar;
+        }
+    }
+
+    ProjectRowFloatFn getProjectRowFloat(SimdLevel level)
+    {
+        switch (level) {
+        case SimdLevel::AVX512: return projectRowFloatAVX512;
+        case SimdLevel::AVX2:   return projectRowFloatAVX2;
+        case SimdLevel::SSE4:   return projectRowFloatSSE4;
+        default:                return projectRowFloatScalar;
+        }
+    }
+}
+}
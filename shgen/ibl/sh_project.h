@@ -0,0 +1,56 @@
+#ifndef SHPROJECT_H__
+#define SHPROJECT_H__
+
+#include <cstdint>
+
+#include "cpu_features.h"
+#include "cubemap.h"
+#include "precision.h"
+
+namespace ibl
+{
+namespace simd
+{
+    // sh[k] += sum(weights[k * stride + x] * texels[x]) for x in [0, count) and k in [0, numCoefs)
+    using ProjectRowFn = void (*)(const Cubemap::Texel* texels, const double* weights, size_t count,
+                                  size_t stride, size_t numCoefs, math::double3* sh);
+
+    void projectRowScalar(const Cubemap::Texel* texels, const double* weights, size_t count,
+                          size_t stride, size_t numCoefs, math::double3* sh);
+
+    void projectRowSSE4(const Cubemap::Texel* texels, const double* weights, size_t count,
+                        size_t stride, size_t numCoefs, math::double3* sh);
+
+    void projectRowAVX2(const Cubemap::Texel* texels, const double* weights, size_t count,
+                        size_t stride, size_t numCoefs, math::double3* sh);
+
+    void projectRowAVX512(const Cubemap::Texel* texels, const double* weights, size_t count,
+                          size_t stride, size_t numCoefs, math::double3* sh);
+
+    ProjectRowFn getProjectRow(SimdLevel level = getSimdLevel());
+
+    // texels summed into one set of float lanes before they are added to the row total
+    constexpr size_t SUM_BLOCK = 256;
+
+    // same as ProjectRowFn with float weights and lanes. the lanes are reset every SUM_BLOCK
+    // texels and added to the row total as summation says, which is then added to sums.
+    using ProjectRowFloatFn = void (*)(const Cubemap::Texel* texels, const float* weights, size_t count,
+                                       size_t stride, size_t numCoefs, Summation summation, math::float3* sums);
+
+    void projectRowFloatScalar(const Cubemap::Texel* texels, const float* weights, size_t count,
+                               size_t stride, size_t numCoefs, Summation summation, math::float3* sums);
+
+    void projectRowFloatSSE4(const Cubemap::Texel* texels, const float* weights, size_t count,
+                             size_t stride, size_t numCoefs, Summation summation, math::float3* sums);
+
+    void projectRowFloatAVX2(const Cubemap::Texel* texels, const float* weights, size_t count,
+                             size_t stride, size_t numCoefs, Summation summation, math::float3* sums);
+
+    void projectRowFloatAVX512(const Cubemap::Texel* texels, const float* weights, size_t count,
+                               size_t stride, size_t numCoefs, Summation summation, math::float3* sums);
+
+    ProjectRowFloatFn getProjectRowFloat(SimdLevel level = getSimdLevel());
+}
+}
+
+#endif
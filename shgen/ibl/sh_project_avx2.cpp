@@ -0,0 +1,180 @@
+#include "sh_project.h"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+namespace
+{
+    inline __m256 load2x128(const float* lo, const float* hi)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(hi), 1);
+    }
+
+    // 8 interleaved RGB texels to r0..r7, g0..g7, b0..b7. the 128-bit lanes hold texels 0-3 and 4-7.
+    inline void loadTexels(const float* p, __m256& r, __m256& g, __m256& b)
+    {
+        const __m256 a0 = load2x128(p,     p + 12);
+        const __m256 a1 = load2x128(p + 4, p + 16);
+        const __m256 a2 = load2x128(p + 8, p + 20);
+        const __m256 tr = _mm256_blend_ps(_mm256_blend_ps(a0, a1, 0x44), a2, 0x22);
+        const __m256 tg = _mm256_blend_ps(_mm256_blend_ps(a0, a1, 0x99), a2, 0x44);
+        const __m256 tb = _mm256_blend_ps(_mm256_blend_ps(a0, a1, 0x22), a2, 0x99);
+        r = _mm256_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 2, 3, 0));
+        g = _mm256_shuffle_ps(tg, tg, _MM_SHUFFLE(2, 3, 0, 1));
+        b = _mm256_shuffle_ps(tb, tb, _MM_SHUFFLE(3, 0, 1, 2));
+    }
+
+    inline double reduce(__m256d v)
+    {
+        const __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+
+    template <size_t N>
+    void projectGroup(const float* src, const double* weights, size_t count, size_t stride, ibl::math::double3* sh)
+    {
+        __m256d acc[N][3];
+        for (size_t i = 0; i < N; i++) {
+            acc[i][0] = acc[i][1] = acc[i][2] = _mm256_setzero_pd();
+        }
+
+        for (size_t x = 0; x < count; x += 8, src += 24) {
+            __m256 r, g, b;
+            loadTexels(src, r, g, b);
+            const __m256d c[3][2] = {
+                { _mm256_cvtps_pd(_mm256_castps256_ps128(r)), _mm256_cvtps_pd(_mm256_extractf128_ps(r, 1)) },
+                { _mm256_cvtps_pd(_mm256_castps256_ps128(g)), _mm256_cvtps_pd(_mm256_extractf128_ps(g, 1)) },
+                { _mm256_cvtps_pd(_mm256_castps256_ps128(b)), _mm256_cvtps_pd(_mm256_extractf128_ps(b, 1)) },
+            };
+            for (size_t i = 0; i < N; i++) {
+                const __m256d w0 = _mm256_loadu_pd(weights + i * stride + x);
+                const __m256d w1 = _mm256_loadu_pd(weights + i * stride + x + 4);
+                for (size_t ch = 0; ch < 3; ch++) {
+                    acc[i][ch] = _mm256_fmadd_pd(w0, c[ch][0], acc[i][ch]);
+                    acc[i][ch] = _mm256_fmadd_pd(w1, c[ch][1], acc[i][ch]);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < N; i++) {
+            sh[i] += ibl::math::double3(reduce(acc[i][0]), reduce(acc[i][1]), reduce(acc[i][2]));
+        }
+    }
+
+    inline float reduce(__m256 v)
+    {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_movehdup_ps(s)));
+    }
+
+    template <ibl::Summation S>
+    inline void accumulate(__m256& total, __m256& comp, __m256 acc)
+    {
+        if (S == ibl::Summation::Kahan) {
+            const __m256 y = _mm256_sub_ps(acc, comp);
+            const __m256 t = _mm256_add_ps(total, y);
+            comp = _mm256_sub_ps(_mm256_sub_ps(t, total), y);
+            total = t;
+        } else {
+            total = _mm256_add_ps(total, acc);
+        }
+    }
+
+    // float lanes reset every SUM_BLOCK texels, see ProjectRowFloatFn
+    template <size_t N, ibl::Summation S>
+    void projectGroupFloat(const float* src, const float* weights, size_t count, size_t stride, ibl::math::float3* sums)
+    {
+        __m256 total[N][3], comp[N][3];
+        for (size_t i = 0; i < N; i++) {
+            for (size_t ch = 0; ch < 3; ch++) {
+                total[i][ch] = comp[i][ch] = _mm256_setzero_ps();
+            }
+        }
+
+        for (size_t begin = 0; begin < count; begin += ibl::simd::SUM_BLOCK) {
+            const size_t end = std::min(count, begin + ibl::simd::SUM_BLOCK);
+            __m256 acc[N][3];
+            for (size_t i = 0; i < N; i++) {
+                acc[i][0] = acc[i][1] = acc[i][2] = _mm256_setzero_ps();
+            }
+            for (size_t x = begin; x < end; x += 8) {
+                __m256 c[3];
+                loadTexels(src + 3 * x, c[0], c[1], c[2]);
+                for (size_t i = 0; i < N; i++) {
+                    const __m256 w = _mm256_loadu_ps(weights + i * stride + x);
+                    for (size_t ch = 0; ch < 3; ch++) {
+                        acc[i][ch] = _mm256_fmadd_ps(w, c[ch], acc[i][ch]);
+                    }
+                }
+            }
+            for (size_t i = 0; i < N; i++) {
+                for (size_t ch = 0; ch < 3; ch++) {
+                    accumulate<S>(total[i][ch], comp[i][ch], acc[i][ch]);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < N; i++) {
+            sums[i] += ibl::math::float3(reduce(_mm256_sub_ps(total[i][0], comp[i][0])),
+                                         reduce(_mm256_sub_ps(total[i][1], comp[i][1])),
+                                         reduce(_mm256_sub_ps(total[i][2], comp[i][2])));
+        }
+    }
+
+    template <ibl::Summation S>
+    void projectRowFloat(const float* src, const float* weights, size_t count, size_t stride, size_t numCoefs,
+                         ibl::math::float3* sums)
+    {
+        size_t k = 0;
+        for ( ; k + 3 <= numCoefs; k += 3) {
+            projectGroupFloat<3, S>(src, weights + k * stride, count, stride, sums + k);
+        }
+        switch (numCoefs - k) {
+        case 2: projectGroupFloat<2, S>(src, weights + k * stride, count, stride, sums + k); break;
+        case 1: projectGroupFloat<1, S>(src, weights + k * stride, count, stride, sums + k); break;
+        }
+    }
+}
+
+namespace ibl
+{
+namespace simd
+{
+    void projectRowAVX2(const Cubemap::Texel* texels, const double* weights, size_t count,
+                        size_t stride, size_t numCoefs, math::double3* sh)
+    {
+        const float* src = reinterpret_cast<const float*>(texels);
+        const size_t blocked = count & ~size_t(7);
+
+        size_t k = 0;
+        for ( ; k + 3 <= numCoefs; k += 3) {
+            projectGroup<3>(src, weights + k * stride, blocked, stride, sh + k);
+        }
+        switch (numCoefs - k) {
+        case 2: projectGroup<2>(src, weights + k * stride, blocked, stride, sh + k); break;
+        case 1: projectGroup<1>(src, weights + k * stride, blocked, stride, sh + k); break;
+        }
+
+        // leftover texels
+        projectRowScalar(texels + blocked, weights + blocked, count - blocked, stride, numCoefs, sh);
+    }
+
+    void projectRowFloatAVX2(const Cubemap::Texel* texels, const float* weights, size_t count,
+                             size_t stride, size_t numCoefs, Summation summation, math::float3* sums)
+    {
+        const float* src = reinterpret_cast<const float*>(texels);
+        const size_t blocked = count & ~size_t(7);
+
+        if (summation == Summation::Kahan) {
+            projectRowFloat<Summation::Kahan>(src, weights, blocked, stride, numCoefs, sums);
+        } else {
+            projectRowFloat<Summation::Pairwise>(src, weights, blocked, stride, numCoefs, sums);
+        }
+
+        // leftover texels
+        projectRowFloatScalar(texels + blocked, weights + blocked, count - blocked, stride, numCoefs, summation, sums);
+    }
+}
+}
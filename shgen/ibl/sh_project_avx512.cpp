@@ -0,0 +1,183 @@
+#include "sh_project.h"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+namespace
+{
+    inline __m512 load4x128(const float* p)
+    {
+        __m512 v = _mm512_castps128_ps512(_mm_loadu_ps(p));
+        v = _mm512_insertf32x4(v, _mm_loadu_ps(p + 12), 1);
+        v = _mm512_insertf32x4(v, _mm_loadu_ps(p + 24), 2);
+        v = _mm512_insertf32x4(v, _mm_loadu_ps(p + 36), 3);
+        return v;
+    }
+
+    // 16 interleaved RGB texels to r0..r15, g0..g15, b0..b15. each 128-bit lane holds 4 texels.
+    inline void loadTexels(const float* p, __m512& r, __m512& g, __m512& b)
+    {
+        const __m512 a0 = load4x128(p);
+        const __m512 a1 = load4x128(p + 4);
+        const __m512 a2 = load4x128(p + 8);
+        const __m512 tr = _mm512_mask_blend_ps(0x2222, _mm512_mask_blend_ps(0x4444, a0, a1), a2);
+        const __m512 tg = _mm512_mask_blend_ps(0x4444, _mm512_mask_blend_ps(0x9999, a0, a1), a2);
+        const __m512 tb = _mm512_mask_blend_ps(0x9999, _mm512_mask_blend_ps(0x2222, a0, a1), a2);
+        r = _mm512_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 2, 3, 0));
+        g = _mm512_shuffle_ps(tg, tg, _MM_SHUFFLE(2, 3, 0, 1));
+        b = _mm512_shuffle_ps(tb, tb, _MM_SHUFFLE(3, 0, 1, 2));
+    }
+
+    inline __m512d lowerToDouble(__m512 v)
+    {
+        return _mm512_cvtps_pd(_mm512_castps512_ps256(v));
+    }
+
+    inline __m512d upperToDouble(__m512 v)
+    {
+        return _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1)));
+    }
+
+    template <size_t N>
+    void projectGroup(const float* src, const double* weights, size_t count, size_t stride, ibl::math::double3* sh)
+    {
+        __m512d acc[N][3];
+        for (size_t i = 0; i < N; i++) {
+            acc[i][0] = acc[i][1] = acc[i][2] = _mm512_setzero_pd();
+        }
+
+        for (size_t x = 0; x < count; x += 16, src += 48) {
+            __m512 r, g, b;
+            loadTexels(src, r, g, b);
+            const __m512d c[3][2] = {
+                { lowerToDouble(r), upperToDouble(r) },
+                { lowerToDouble(g), upperToDouble(g) },
+                { lowerToDouble(b), upperToDouble(b) },
+            };
+            for (size_t i = 0; i < N; i++) {
+                const __m512d w0 = _mm512_loadu_pd(weights + i * stride + x);
+                const __m512d w1 = _mm512_loadu_pd(weights + i * stride + x + 8);
+                for (size_t ch = 0; ch < 3; ch++) {
+                    acc[i][ch] = _mm512_fmadd_pd(w0, c[ch][0], acc[i][ch]);
+                    acc[i][ch] = _mm512_fmadd_pd(w1, c[ch][1], acc[i][ch]);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < N; i++) {
+            sh[i] += ibl::math::double3(_mm512_reduce_add_pd(acc[i][0]),
+                                        _mm512_reduce_add_pd(acc[i][1]),
+                                        _mm512_reduce_add_pd(acc[i][2]));
+        }
+    }
+
+    template <ibl::Summation S>
+    inline void accumulate(__m512& total, __m512& comp, __m512 acc)
+    {
+        if (S == ibl::Summation::Kahan) {
+            const __m512 y = _mm512_sub_ps(acc, comp);
+            const __m512 t = _mm512_add_ps(total, y);
+            comp = _mm512_sub_ps(_mm512_sub_ps(t, total), y);
+            total = t;
+        } else {
+            total = _mm512_add_ps(total, acc);
+        }
+    }
+
+    // float lanes reset every SUM_BLOCK texels, see ProjectRowFloatFn
+    template <size_t N, ibl::Summation S>
+    void projectGroupFloat(const float* src, const float* weights, size_t count, size_t stride, ibl::math::float3* sums)
+    {
+        __m512 total[N][3], comp[N][3];
+        for (size_t i = 0; i < N; i++) {
+            for (size_t ch = 0; ch < 3; ch++) {
+                total[i][ch] = comp[i][ch] = _mm512_setzero_ps();
+            }
+        }
+
+        for (size_t begin = 0; begin < count; begin += ibl::simd::SUM_BLOCK) {
+            const size_t end = std::min(count, begin + ibl::simd::SUM_BLOCK);
+            __m512 acc[N][3];
+            for (size_t i = 0; i < N; i++) {
+                acc[i][0] = acc[i][1] = acc[i][2] = _mm512_setzero_ps();
+            }
+            for (size_t x = begin; x < end; x += 16) {
+                __m512 c[3];
+                loadTexels(src + 3 * x, c[0], c[1], c[2]);
+                for (size_t i = 0; i < N; i++) {
+                    const __m512 w = _mm512_loadu_ps(weights + i * stride + x);
+                    for (size_t ch = 0; ch < 3; ch++) {
+                        acc[i][ch] = _mm512_fmadd_ps(w, c[ch], acc[i][ch]);
+                    }
+                }
+            }
+            for (size_t i = 0; i < N; i++) {
+                for (size_t ch = 0; ch < 3; ch++) {
+                    accumulate<S>(total[i][ch], comp[i][ch], acc[i][ch]);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < N; i++) {
+            sums[i] += ibl::math::float3(_mm512_reduce_add_ps(_mm512_sub_ps(total[i][0], comp[i][0])),
+                                         _mm512_reduce_add_ps(_mm512_sub_ps(total[i][1], comp[i][1])),
+                                         _mm512_reduce_add_ps(_mm512_sub_ps(total[i][2], comp[i][2])));
+        }
+    }
+
+    template <ibl::Summation S>
+    void projectRowFloat(const float* src, const float* weights, size_t count, size_t stride, size_t numCoefs,
+                         ibl::math::float3* sums)
+    {
+        size_t k = 0;
+        for ( ; k + 3 <= numCoefs; k += 3) {
+            projectGroupFloat<3, S>(src, weights + k * stride, count, stride, sums + k);
+        }
+        switch (numCoefs - k) {
+        case 2: projectGroupFloat<2, S>(src, weights + k * stride, count, stride, sums + k); break;
+        case 1: projectGroupFloat<1, S>(src, weights + k * stride, count, stride, sums + k); break;
+        }
+    }
+}
+
+namespace ibl
+{
+namespace simd
+{
+    void projectRowAVX512(const Cubemap::Texel* texels, const double* weights, size_t count,
+                          size_t stride, size_t numCoefs, math::double3* sh)
+    {
+        const float* src = reinterpret_cast<const float*>(texels);
+        const size_t blocked = count & ~size_t(15);
+
+        size_t k = 0;
+        for ( ; k + 3 <= numCoefs; k += 3) {
+            projectGroup<3>(src, weights + k * stride, blocked, stride, sh + k);
+        }
+        switch (numCoefs - k) {
+        case 2: projectGroup<2>(src, weights + k * stride, blocked, stride, sh + k); break;
+        case 1: projectGroup<1>(src, weights + k * stride, blocked, stride, sh + k); break;
+        }
+
+        // leftover texels
+        projectRowScalar(texels + blocked, weights + blocked, count - blocked, stride, numCoefs, sh);
+    }
+
+    void projectRowFloatAVX512(const Cubemap::Texel* texels, const float* weights, size_t count,
+                               size_t stride, size_t numCoefs, Summation summation, math::float3* sums)
+    {
+        const float* src = reinterpret_cast<const float*>(texels);
+        const size_t blocked = count & ~size_t(15);
+
+        if (summation == Summation::Kahan) {
+            projectRowFloat<Summation::Kahan>(src, weights, blocked, stride, numCoefs, sums);
+        } else {
+            projectRowFloat<Summation::Pairwise>(src, weights, blocked, stride, numCoefs, sums);
+        }
+
+        // leftover texels
+        projectRowFloatScalar(texels + blocked, weights + blocked, count - blocked, stride, numCoefs, summation, sums);
+    }
+}
+}
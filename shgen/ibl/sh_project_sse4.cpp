@@ -0,0 +1,174 @@
+#include "sh_project.h"
+
+#include <algorithm>
+
+#include <smmintrin.h>
+
+namespace
+{
+    // r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3  ->  r0 r1 r2 r3, g0 g1 g2 g3, b0 b1 b2 b3
+    inline void loadTexels(const float* p, __m128& r, __m128& g, __m128& b)
+    {
+        const __m128 a0 = _mm_loadu_ps(p);
+        const __m128 a1 = _mm_loadu_ps(p + 4);
+        const __m128 a2 = _mm_loadu_ps(p + 8);
+        const __m128 tr = _mm_blend_ps(_mm_blend_ps(a0, a1, 0x4), a2, 0x2);
+        const __m128 tg = _mm_blend_ps(_mm_blend_ps(a0, a1, 0x9), a2, 0x4);
+        const __m128 tb = _mm_blend_ps(_mm_blend_ps(a0, a1, 0x2), a2, 0x9);
+        r = _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 2, 3, 0));
+        g = _mm_shuffle_ps(tg, tg, _MM_SHUFFLE(2, 3, 0, 1));
+        b = _mm_shuffle_ps(tb, tb, _MM_SHUFFLE(3, 0, 1, 2));
+    }
+
+    inline double reduce(__m128d v)
+    {
+        return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+    }
+
+    // projects 4 texels at a time onto N coefficients, keeping all accumulators in registers
+    template <size_t N>
+    void projectGroup(const float* src, const double* weights, size_t count, size_t stride, ibl::math::double3* sh)
+    {
+        __m128d acc[N][3];
+        for (size_t i = 0; i < N; i++) {
+            acc[i][0] = acc[i][1] = acc[i][2] = _mm_setzero_pd();
+        }
+
+        for (size_t x = 0; x < count; x += 4, src += 12) {
+            __m128 r, g, b;
+            loadTexels(src, r, g, b);
+            const __m128d c[3][2] = {
+                { _mm_cvtps_pd(r), _mm_cvtps_pd(_mm_movehl_ps(r, r)) },
+                { _mm_cvtps_pd(g), _mm_cvtps_pd(_mm_movehl_ps(g, g)) },
+                { _mm_cvtps_pd(b), _mm_cvtps_pd(_mm_movehl_ps(b, b)) },
+            };
+            for (size_t i = 0; i < N; i++) {
+                const __m128d w0 = _mm_loadu_pd(weights + i * stride + x);
+                const __m128d w1 = _mm_loadu_pd(weights + i * stride + x + 2);
+                for (size_t ch = 0; ch < 3; ch++) {
+                    acc[i][ch] = _mm_add_pd(acc[i][ch], _mm_mul_pd(w0, c[ch][0]));
+                    acc[i][ch] = _mm_add_pd(acc[i][ch], _mm_mul_pd(w1, c[ch][1]));
+                }
+            }
+        }
+
+        for (size_t i = 0; i < N; i++) {
+            sh[i] += ibl::math::double3(reduce(acc[i][0]), reduce(acc[i][1]), reduce(acc[i][2]));
+        }
+    }
+
+    inline float reduce(__m128 v)
+    {
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        return _mm_cvtss_f32(_mm_add_ss(v, _mm_movehdup_ps(v)));
+    }
+
+    template <ibl::Summation S>
+    inline void accumulate(__m128& total, __m128& comp, __m128 acc)
+    {
+        if (S == ibl::Summation::Kahan) {
+            const __m128 y = _mm_sub_ps(acc, comp);
+            const __m128 t = _mm_add_ps(total, y);
+            comp = _mm_sub_ps(_mm_sub_ps(t, total), y);
+            total = t;
+        } else {
+            total = _mm_add_ps(total, acc);
+        }
+    }
+
+    // float lanes reset every SUM_BLOCK texels, see ProjectRowFloatFn
+    template <size_t N, ibl::Summation S>
+    void projectGroupFloat(const float* src, const float* weights, size_t count, size_t stride, ibl::math::float3* sums)
+    {
+        __m128 total[N][3], comp[N][3];
+        for (size_t i = 0; i < N; i++) {
+            for (size_t ch = 0; ch < 3; ch++) {
+                total[i][ch] = comp[i][ch] = _mm_setzero_ps();
+            }
+        }
+
+        for (size_t begin = 0; begin < count; begin += ibl::simd::SUM_BLOCK) {
+            const size_t end = std::min(count, begin + ibl::simd::SUM_BLOCK);
+            __m128 acc[N][3];
+            for (size_t i = 0; i < N; i++) {
+                acc[i][0] = acc[i][1] = acc[i][2] = _mm_setzero_ps();
+            }
+            for (size_t x = begin; x < end; x += 4) {
+                __m128 c[3];
+                loadTexels(src + 3 * x, c[0], c[1], c[2]);
+                for (size_t i = 0; i < N; i++) {
+                    const __m128 w = _mm_loadu_ps(weights + i * stride + x);
+                    for (size_t ch = 0; ch < 3; ch++) {
+                        acc[i][ch] = _mm_add_ps(acc[i][ch], _mm_mul_ps(w, c[ch]));
+                    }
+                }
+            }
+            for (size_t i = 0; i < N; i++) {
+                for (size_t ch = 0; ch < 3; ch++) {
+                    accumulate<S>(total[i][ch], comp[i][ch], acc[i][ch]);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < N; i++) {
+            sums[i] += ibl::math::float3(reduce(_mm_sub_ps(total[i][0], comp[i][0])),
+                                         reduce(_mm_sub_ps(total[i][1], comp[i][1])),
+                                         reduce(_mm_sub_ps(total[i][2], comp[i][2])));
+        }
+    }
+
+    template <ibl::Summation S>
+    void projectRowFloat(const float* src, const float* weights, size_t count, size_t stride, size_t numCoefs,
+                         ibl::math::float3* sums)
+    {
+        size_t k = 0;
+        for ( ; k + 3 <= numCoefs; k += 3) {
+            projectGroupFloat<3, S>(src, weights + k * stride, count, stride, sums + k);
+        }
+        switch (numCoefs - k) {
+        case 2: projectGroupFloat<2, S>(src, weights + k * stride, count, stride, sums + k); break;
+        case 1: projectGroupFloat<1, S>(src, weights + k * stride, count, stride, sums + k); break;
+        }
+    }
+}
+
+namespace ibl
+{
+namespace simd
+{
+    void projectRowSSE4(const Cubemap::Texel* texels, const double* weights, size_t count,
+                        size_t stride, size_t numCoefs, math::double3* sh)
+    {
+        const float* src = reinterpret_cast<const float*>(texels);
+        const size_t blocked = count & ~size_t(3);
+
+        size_t k = 0;
+        for ( ; k + 3 <= numCoefs; k += 3) {
+            projectGroup<3>(src, weights + k * stride, blocked, stride, sh + k);
+        }
+        switch (numCoefs - k) {
+        case 2: projectGroup<2>(src, weights + k * stride, blocked, stride, sh + k); break;
+        case 1: projectGroup<1>(src, weights + k * stride, blocked, stride, sh + k); break;
+        }
+
+        // leftover texels
+        projectRowScalar(texels + blocked, weights + blocked, count - blocked, stride, numCoefs, sh);
+    }
+
+    void projectRowFloatSSE4(const Cubemap::Texel* texels, const float* weights, size_t count,
+                             size_t stride, size_t numCoefs, Summation summation, math::float3* sums)
+    {
+        const float* src = reinterpret_cast<const float*>(texels);
+        const size_t blocked = count & ~size_t(3);
+
+        if (summation == Summation::Kahan) {
+            projectRowFloat<Summation::Kahan>(src, weights, blocked, stride, numCoefs, sums);
+        } else {
+            projectRowFloat<Summation::Pairwise>(src, weights, blocked, stride, numCoefs, sums);
+        }
+
+        // leftover texels
+        projectRowFloatScalar(texels + blocked, weights + blocked, count - blocked, stride, numCoefs, summation, sums);
+    }
+}
+}
@@ -1,192 +1,980 @@
-﻿#include "spherical_harmonics.h"
-
-#include <future>
-
-constexpr auto PI     = 3.1415926535897932384626433832795;
-constexpr auto INV_PI = 1.0 / PI;
-
-namespace
-{
-    double factorial(size_t n, size_t d = 1)
-    {
-        d = std::max(size_t(1), d);
-        n = std::max(size_t(1), n);
-        double r = 1.0;
-        if (n == d) {
-            // intentionally left blank
-        } else if (n > d) {
-            for ( ; n > d; n--) {
-                r *= n;
-            }
-        } else {
-            for ( ; d > n; d--) {
-                r *= d;
-            }
-            r = 1.0 / r;
-        }
-        return r;
-    }
-
-    double computeTruncatedCosSh(size_t l)
-    {
-        if (l == 0) {
-            return PI;
-        } else if (l == 1) {
-            return 2 * PI / 3;
-        } else if (l & 1) {
-            return 0;
-        }
-        const size_t l_2 = l / 2;
-        double A0 = ((l_2 & 1) ? 1.0 : -1.0) / ((l + 2) * (l - 1));
-        double A1 = factorial(l, l_2) / (factorial(l_2) * (1 << l));
-        return 2 * PI * A0 * A1;
-    }
-
-    inline double sphereQuadrantArea(double x, double y)
-    {
-        return std::atan2(x * y, std::sqrt(x * x + y * y + 1));
-    }
-
-    double solidAngle(size_t dim, size_t u, size_t v)
-    {
-        const double iDim = 1.0f / dim;
-        double s = ((u + 0.5) * 2 * iDim) - 1;
-        double t = ((v + 0.5) * 2 * iDim) - 1;
-        const double x0 = s - iDim;
-        const double y0 = t - iDim;
-        const double x1 = s + iDim;
-        const double y1 = t + iDim;
-        double solidAngle = sphereQuadrantArea(x0, y0)
-                          - sphereQuadrantArea(x0, y1)
-                          - sphereQuadrantArea(x1, y0)
-                          + sphereQuadrantArea(x1, y1);
-        return solidAngle;
-    }
-}
-
-namespace ibl
-{
-    std::unique_ptr<math::double3[]> computeIrradianceSH3Bands(const Cubemap& cm)
-    {
-        const size_t numCoefs = 9;
-
-        std::unique_ptr<math::double3[]> SH(new math::double3[numCoefs]{});
-        std::unique_ptr<double[]> A(new double[numCoefs]{});
-
-        const double c0 = computeTruncatedCosSh(0);
-        const double c1 = computeTruncatedCosSh(1);
-        const double c2 = computeTruncatedCosSh(2);
-        A[0] = (INV_PI * INV_PI / 4)       * c0;
-        A[1] = (INV_PI * INV_PI / 4) * 3   * c1;
-        A[2] = (INV_PI * INV_PI / 4) * 3   * c1;
-        A[3] = (INV_PI * INV_PI / 4) * 3   * c1;
-        A[4] = (INV_PI * INV_PI / 4) * 15  * c2;
-        A[5] = (INV_PI * INV_PI / 4) * 15  * c2;
-        A[6] = (INV_PI * INV_PI /16) * 5   * c2;
-        A[7] = (INV_PI * INV_PI / 4) * 15  * c2;
-        A[8] = (INV_PI * INV_PI /16) * 15  * c2;
-
-        struct State {
-            math::double3 SH[9] = {};
-        };
-
-        auto proc = [&](State& state, size_t y, Cubemap::Face f, const Cubemap::Texel* data, size_t dim)
-        {
-            for (size_t x = 0 ; x < dim; ++x, ++data)
-            {
-                math::double3 s(cm.getDirectionFor(f, x, y));
-
-                // sample a color
-                math::double3 color(Cubemap::sampleAt(data));
-
-                // take solid angle into account
-                color *= solidAngle(dim, x, y);
-
-                state.SH[0] += color * A[0];
-                state.SH[1] += color * A[1] * s.y;
-                state.SH[2] += color * A[2] * s.z;
-                state.SH[3] += color * A[3] * s.x;
-                state.SH[4] += color * A[4] * s.y * s.x;
-                state.SH[5] += color * A[5] * s.y * s.z;
-                state.SH[6] += color * A[6] * (3 * s.z * s.z - 1);
-                state.SH[7] += color * A[7] * s.z * s.x;
-                state.SH[8] += color * A[8] * (s.x * s.x - s.y * s.y);
-            }
-        };
-
-        const size_t dim = cm.getDimensions();
-
-        State states[6];
-
-        std::future<void> results[6];
-
-        for (size_t faceIndex = 0; faceIndex < 6; faceIndex++) {
-            const Cubemap::Face f = (Cubemap::Face)faceIndex;
-
-            results[faceIndex] = std::async(std::launch::async, [&cm, &states, f, &dim, &proc] {
-                State& s = states[size_t(f)];
-                Image& image(const_cast<Cubemap&>(cm).getImageForFace(f));
-
-                for (size_t y = 0; y < dim; y++) {
-                    Cubemap::Texel* data = static_cast<Cubemap::Texel*>(image.getPixelRef(0, y));
-                    proc(s, y, f, data, dim);
-                }
-            });
-        }
-
-        // wait for all our threads to finish
-        for (auto& ret : results) {
-            ret.wait();
-        }
-
-        for (State& s : states) {
-            for (size_t i = 0 ; i < numCoefs ; i++) {
-                SH[i] += s.SH[i];
-            }
-        }
-        return SH;
-    }
-
-    void renderPreScaledSH3Bands(Cubemap& cm, const std::unique_ptr<math::double3[]>& sh)
-    {
-        auto proc = [&](size_t y, Cubemap::Face f, Cubemap::Texel* data, size_t dim)
-        {
-            for (size_t x = 0 ; x < dim ; ++x, ++data) {
-                math::double3 s(cm.getDirectionFor(f, x, y));
-                math::double3 c = 0;
-                c += sh[0];
-                c += sh[1] * s.y;
-                c += sh[2] * s.z;
-                c += sh[3] * s.x;
-                c += sh[4] * s.y * s.x;
-                c += sh[5] * s.y * s.z;
-                c += sh[6] * (3 * s.z * s.z - 1);
-                c += sh[7] * s.z * s.x;
-                c += sh[8] * (s.x * s.x - s.y * s.y);
-                Cubemap::writeAt(data, Cubemap::Texel(c));
-            }
-        };
-
-        const size_t dim = cm.getDimensions();
-
-        std::future<void> results[6];
-
-        for (size_t faceIndex = 0; faceIndex < 6; faceIndex++) {
-            const Cubemap::Face f = (Cubemap::Face)faceIndex;
-
-            results[faceIndex] = std::async(std::launch::async, [&cm, f, &dim, &proc] {
-                Image& image(const_cast<Cubemap&>(cm).getImageForFace(f));
-
-                for (size_t y = 0; y < dim; y++) {
-                    Cubemap::Texel* data = static_cast<Cubemap::Texel*>(image.getPixelRef(0, y));
-                    proc(y, f, data, dim);
-                }
-            });
-        }
-
-        // wait for all our threads to finish
-        for (auto& ret : results) {
-            ret.wait();
-        }
-    }
-}
+#include "spherical_harmonics.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <new>
+#include <type_traits>
+
+#include "render_texels.h"
+#include "sh_kernel.h"
+#include "sh_project.h"
+#include "trace.h"
+
+namespace
+{
+    using namespace ibl;
+
+    // normalization of the pre-scaled polynomials of the 3 bands API, Y = K * P
+    constexpr double SQRT_INV_PI = 0.56418958354775628695;   // 1 / sqrt(pi)
+    const double legacyK[9] = {
+        SQRT_INV_PI / 2,
+        SQRT_INV_PI * 1.7320508075688772 / 2,   // sqrt(3)
+        SQRT_INV_PI * 1.7320508075688772 / 2,
+        SQRT_INV_PI * 1.7320508075688772 / 2,
+        SQRT_INV_PI * 3.8729833462074170 / 2,   // sqrt(15)
+        SQRT_INV_PI * 3.8729833462074170 / 2,
+        SQRT_INV_PI * 2.2360679774997897 / 4,   // sqrt(5)
+        SQRT_INV_PI * 3.8729833462074170 / 2,
+        SQRT_INV_PI * 3.8729833462074170 / 4,
+    };
+
+    // inside a face of dim x dim texels, with the texels of its rows
+    bool isValidRegion(const DirtyRegion& r, size_t dim)
+    {
+        if (size_t(r.face) >= 6 || r.x > dim || r.width > dim - r.x || r.y > dim || r.height > dim - r.y) {
+            return false;
+        }
+        return (r.width == 0 || r.height == 0) || (r.oldTexels && r.newTexels);
+    }
+
+    // projection of new - old over the dirty regions, scaled per band, nullptr if one of them
+    // is not valid
+    template <size_t L>
+    std::unique_ptr<math::double3[]> projectRegions(const Cubemap& cm, const std::vector<DirtyRegion>& regions,
+                                                    const double* bandScale, ThreadPool& pool)
+    {
+        TRACE_SCOPE("project regions");
+        constexpr size_t numCoefs = sh::Basis<L>::NUM_COEFS;
+
+        for (const DirtyRegion& r : regions) {
+            if (!isValidRegion(r, cm.getDimensions())) {
+                return nullptr;
+            }
+        }
+
+        std::unique_ptr<math::double3[]> SH(new math::double3[numCoefs]{});
+
+        struct alignas(64) State {
+            math::double3 SH[numCoefs] = {};
+            std::unique_ptr<double[]> weights;
+            std::unique_ptr<Cubemap::Texel[]> delta;
+        };
+
+        const simd::ProjectRowFn projectRow = simd::getProjectRow();
+
+        std::shared_ptr<const SHKernel> kernel = SHKernel::get(cm.getDimensions());
+        const size_t stride = kernel->getRowStride();
+
+        // the rows of all the regions one after the other
+        std::vector<size_t> firstRows(regions.size() + 1, 0);
+        for (size_t i = 0; i < regions.size(); i++) {
+            firstRows[i + 1] = firstRows[i] + regions[i].height;
+        }
+        const size_t numRows = firstRows.back();
+
+        std::unique_ptr<State[]> states(new State[pool.getSlotCount()]);
+
+        pool.parallelFor(numRows, pool.suggestGrain(numRows), [&](size_t slot, size_t begin, size_t end) {
+            State& s = states[slot];
+            if (!s.weights) {
+                s.weights.reset(new double[numCoefs * stride]);
+                s.delta.reset(new Cubemap::Texel[cm.getDimensions()]);
+            }
+
+            size_t region = std::upper_bound(firstRows.begin(), firstRows.end(), begin) - firstRows.begin() - 1;
+            for (size_t row = begin; row < end; row++) {
+                while (row >= firstRows[region + 1]) {
+                    region++;
+                }
+                const DirtyRegion& r = regions[region];
+                const size_t y = row - firstRows[region];
+                const Cubemap::Texel* oldTexels = r.oldTexels + y * r.width;
+                const Cubemap::Texel* newTexels = r.newTexels + y * r.width;
+                for (size_t x = 0; x < r.width; x++) {
+                    s.delta[x] = Cubemap::Texel(newTexels[x].r - oldTexels[x].r,
+                                                newTexels[x].g - oldTexels[x].g,
+                                                newTexels[x].b - oldTexels[x].b);
+                }
+                kernel->buildRow<L>(r.face, r.y + y, r.x, r.x + r.width, s.weights.get());
+                projectRow(s.delta.get(), s.weights.get(), r.width, stride, numCoefs, s.SH);
+            }
+        });
+
+        for (size_t slot = 0; slot < pool.getSlotCount(); slot++) {
+            for (size_t i = 0 ; i < numCoefs ; i++) {
+                SH[i] += states[slot].SH[i];
+            }
+        }
+        for (size_t l = 0; l <= L; l++) {
+            for (size_t i = l * l; i < (l + 1) * (l + 1); i++) {
+                SH[i] *= bandScale[l];
+            }
+        }
+        return SH;
+    }
+
+    // coarsest level considered by the mip selection
+    constexpr size_t MIN_MIP_DIMENSIONS = 8;
+
+    // largest share of the energy of a channel held by a single texel
+    double computePeakShare(const Cubemap& cm, ThreadPool& pool)
+    {
+        TRACE_SCOPE("peak share");
+        struct alignas(64) State {
+            double total[3] = {};
+            double peak[3] = {};
+        };
+
+        const size_t dim = cm.getDimensions();
+
+        std::shared_ptr<const SHKernel> kernel = SHKernel::get(dim);
+
+        std::unique_ptr<State[]> states(new State[pool.getSlotCount()]);
+
+        const size_t numRows = 6 * dim;
+
+        pool.parallelFor(numRows, pool.suggestGrain(numRows), [&](size_t slot, size_t begin, size_t end) {
+            State& s = states[slot];
+            for (size_t row = begin; row < end; row++) {
+                const Cubemap::Face f = Cubemap::Face(row / dim);
+                const size_t y = row % dim;
+                const Cubemap::Texel* data = static_cast<const Cubemap::Texel*>(cm.getImageForFace(f).getPixelRef(0, y));
+                for (size_t x = 0; x < dim; x++) {
+                    const double da = kernel->getSolidAngle(x, y);
+                    for (size_t ch = 0; ch < 3; ch++) {
+                        const double e = da * std::abs(data[x][ch]);
+                        s.total[ch] += e;
+                        s.peak[ch] = std::max(s.peak[ch], e);
+                    }
+                }
+            }
+        });
+
+        double share = 0;
+        for (size_t ch = 0; ch < 3; ch++) {
+            double total = 0;
+            double peak = 0;
+            for (size_t slot = 0; slot < pool.getSlotCount(); slot++) {
+                total += states[slot].total[ch];
+                peak = std::max(peak, states[slot].peak[ch]);
+            }
+            if (total > 0) {
+                share = std::max(share, peak / total);
+            }
+        }
+        return share;
+    }
+
+    // rows added up in float per tile before they go to the double sum of the slot
+    constexpr size_t TILE_ROWS = 64;
+
+    // Buffers of every slot of a pool for the projections, kept by a ProjectionContext so that
+    // a projection of the same order and size as the previous one allocates nothing. a slot is
+    // only touched by the thread that runs it.
+    class ProjectionScratch
+    {
+    public:
+        explicit ProjectionScratch(size_t slotCount) : mSlots(new Slot[slotCount]) {}
+
+        // at least size bytes aligned to a cache line, the contents are kept while size does not grow
+        void* getState(size_t slot, size_t size) { return mSlots[slot].state.reserve(size); }
+        void* getWeights(size_t slot, size_t size) { return mSlots[slot].weights.reserve(size); }
+
+    private:
+        struct Buffer
+        {
+            void* reserve(size_t size)
+            {
+                if (size > capacity) {
+                    data.reset(new uint8_t[size + CACHE_LINE - 1]);
+                    capacity = size;
+                }
+                return reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(data.get()) + CACHE_LINE - 1) & ~uintptr_t(CACHE_LINE - 1));
+            }
+
+            std::unique_ptr<uint8_t[]> data;
+            size_t capacity = 0;
+        };
+
+        struct Slot
+        {
+            Buffer state;
+            Buffer weights;
+        };
+
+        static constexpr size_t CACHE_LINE = 64;
+
+        std::unique_ptr<Slot[]> mSlots;
+    };
+
+    // accumulates the projection of the rows of a kernel, SHKernel or LatLongKernel,
+    // in any order and any number of calls
+    template <size_t L, typename P, typename Kernel = SHKernel>
+    class Projector
+    {
+    public:
+        using Real = typename P::Real;
+        static constexpr bool isDouble = std::is_same<Real, double>::value;
+        static constexpr size_t numCoefs = sh::Basis<L>::NUM_COEFS;
+
+        // the partial sums and the weights live in scratch if given, which has to be for pool
+        Projector(std::shared_ptr<const Kernel> kernel, ThreadPool& pool, ProjectionScratch* scratch = nullptr)
+            : mPool(pool), mKernel(std::move(kernel)), mScratch(scratch)
+        {
+            if (!mScratch) {
+                mOwnedScratch.reset(new ProjectionScratch(pool.getSlotCount()));
+                mScratch = mOwnedScratch.get();
+            }
+            for (size_t slot = 0; slot < pool.getSlotCount(); slot++) {
+                new (mScratch->getState(slot, sizeof(State))) State();
+            }
+        }
+
+        // rows [begin, end) as numbered by Kernel::getRowCount(), e.g. face * dim + y of
+        // a cubemap. getRow(row) returns the texels of that row.
+        template <typename RowFn>
+        void add(size_t begin, size_t end, const RowFn& getRow)
+        {
+            TRACE_SCOPE("project");
+            // SoA kernels for the best instruction set of this CPU, the scalar ones otherwise
+            const simd::ProjectRowFn projectRow = simd::getProjectRow();
+            const simd::ProjectRowFloatFn projectRowFloat = simd::getProjectRowFloat();
+
+            const size_t width = mKernel->getRowWidth();
+            const size_t tileWidth = mKernel->getTileWidth();
+            const size_t stride = mKernel->getRowStride();
+            const size_t numRows = end - begin;
+
+            mPool.parallelFor(numRows, mPool.suggestGrain(numRows), [&](size_t slot, size_t first, size_t last) {
+                State& s = getState(slot);
+                Real* weights = static_cast<Real*>(mScratch->getWeights(slot, numCoefs * stride * sizeof(Real)));
+
+                auto flush = [&]() {
+                    for (size_t i = 0; i < numCoefs; i++) {
+                        s.SH[i] += math::double3(double(s.sum[i][0]) - s.comp[i][0],
+                                                 double(s.sum[i][1]) - s.comp[i][1],
+                                                 double(s.sum[i][2]) - s.comp[i][2]);
+                        for (size_t ch = 0; ch < 3; ch++) {
+                            s.sum[i][ch] = s.comp[i][ch] = 0;
+                        }
+                    }
+                };
+
+                for (size_t row = begin + first; row < begin + last; row++) {
+                    const Cubemap::Texel* data = getRow(row);
+
+                    // the weights of a tile are projected before those of the next are built
+                    math::float3 rowSums[numCoefs] = {};
+                    for (size_t tile = 0; tile < width; tile += tileWidth) {
+                        const size_t tileEnd = std::min(width, tile + tileWidth);
+                        mKernel->template buildRow<L>(row, tile, tileEnd, weights);
+                        if constexpr (isDouble) {
+                            projectRow(data + tile, weights, tileEnd - tile, stride, numCoefs, s.SH);
+                        } else {
+                            projectRowFloat(data + tile, weights, tileEnd - tile, stride, numCoefs, P::summation, rowSums);
+                        }
+                    }
+
+                    if constexpr (!isDouble) {
+                        for (size_t i = 0; i < numCoefs; i++) {
+                            for (size_t ch = 0; ch < 3; ch++) {
+                                if (P::summation == Summation::Kahan) {
+                                    const float y = rowSums[i][ch] - s.comp[i][ch];
+                                    const float t = s.sum[i][ch] + y;
+                                    s.comp[i][ch] = (t - s.sum[i][ch]) - y;
+                                    s.sum[i][ch] = t;
+                                } else {
+                                    s.sum[i][ch] += rowSums[i][ch];
+                                }
+                            }
+                        }
+                        if (P::summation == Summation::Pairwise && (row + 1 - begin - first) % TILE_ROWS == 0) {
+                            flush();
+                        }
+                    }
+                }
+                if constexpr (!isDouble) {
+                    flush();
+                }
+            });
+        }
+
+        // writes the numCoefs coefficients to SH
+        void get(const double* bandScale, math::double3* SH) const
+        {
+            for (size_t i = 0 ; i < numCoefs ; i++) {
+                SH[i] = 0;
+            }
+            for (size_t slot = 0; slot < mPool.getSlotCount(); slot++) {
+                for (size_t i = 0 ; i < numCoefs ; i++) {
+                    SH[i] += getState(slot).SH[i];
+                }
+            }
+
+            // the projection is linear, so the bands are scaled once at the end
+            for (size_t l = 0; l <= L; l++) {
+                for (size_t i = l * l; i < (l + 1) * (l + 1); i++) {
+                    SH[i] *= bandScale[l];
+                }
+            }
+        }
+
+        std::unique_ptr<math::double3[]> get(const double* bandScale) const
+        {
+            std::unique_ptr<math::double3[]> SH(new math::double3[numCoefs]);
+            get(bandScale, SH.get());
+            return SH;
+        }
+
+    private:
+        // one partial sum per slot of the pool, on their own cache lines. the float policies
+        // add the rows to sum first, comp is the compensation of the Kahan policy.
+        struct alignas(64) State {
+            math::double3 SH[numCoefs] = {};
+            float sum[numCoefs][3] = {};
+            float comp[numCoefs][3] = {};
+        };
+
+        State& getState(size_t slot) const { return *static_cast<State*>(mScratch->getState(slot, sizeof(State))); }
+
+        ThreadPool& mPool;
+        std::shared_ptr<const Kernel> mKernel;
+        ProjectionScratch* mScratch;
+        std::unique_ptr<ProjectionScratch> mOwnedScratch;
+    };
+
+    // a Projector of any order behind the interface of StreamingProjector
+    struct ProjectorFns
+    {
+        // rows [begin, end) as in Projector::add(), row begin is at rows
+        std::function<void(size_t begin, size_t end, const uint8_t* rows, size_t bytesPerRow)> add;
+        std::function<std::unique_ptr<math::double3[]>(const double* bandScale)> get;
+    };
+
+    template <size_t L, typename P>
+    ProjectorFns bindProjector(size_t dim, ThreadPool& pool)
+    {
+        // the rows build their own solid angles, the table of SHKernel would be O(dim^2)
+        auto projector = std::make_shared<Projector<L, P, SHRowKernel>>(std::make_shared<SHRowKernel>(dim), pool);
+        ProjectorFns fns;
+        fns.add = [projector](size_t begin, size_t end, const uint8_t* rows, size_t bytesPerRow) {
+            projector->add(begin, end, [=](size_t row) {
+                return reinterpret_cast<const Cubemap::Texel*>(rows + (row - begin) * bytesPerRow);
+            });
+        };
+        fns.get = [projector](const double* bandScale) {
+            return projector->get(bandScale);
+        };
+        return fns;
+    }
+
+    template <size_t L, typename P>
+    void project(const Cubemap& cm, std::shared_ptr<const SHKernel> kernel, const double* bandScale,
+                 ThreadPool& pool, ProjectionScratch* scratch, math::double3* SH)
+    {
+        const size_t dim = cm.getDimensions();
+
+        Projector<L, P> projector(std::move(kernel), pool, scratch);
+
+        // all the faces are split into bands of rows
+        projector.add(0, 6 * dim, [&cm, dim](size_t row) {
+            const Cubemap::Face f = Cubemap::Face(row / dim);
+            return static_cast<const Cubemap::Texel*>(cm.getImageForFace(f).getPixelRef(0, row % dim));
+        });
+        projector.get(bandScale, SH);
+    }
+
+    template <size_t L, typename P>
+    std::unique_ptr<math::double3[]> project(const Cubemap& cm, const double* bandScale, ThreadPool& pool)
+    {
+        std::unique_ptr<math::double3[]> SH(new math::double3[sh::Basis<L>::NUM_COEFS]);
+        project<L, P>(cm, SHKernel::get(cm.getDimensions()), bandScale, pool, nullptr, SH.get());
+        return SH;
+    }
+
+    // the rows of the image are projected straight, without resampling it to a cubemap
+    template <size_t L, typename P>
+    void projectLatLong(const Image& image, std::shared_ptr<const LatLongKernel> kernel, const double* bandScale,
+                        ThreadPool& pool, ProjectionScratch* scratch, math::double3* SH)
+    {
+        Projector<L, P, LatLongKernel> projector(std::move(kernel), pool, scratch);
+
+        projector.add(0, image.getHeight(), [&image](size_t y) {
+            return static_cast<const Cubemap::Texel*>(image.getPixelRef(0, y));
+        });
+        projector.get(bandScale, SH);
+    }
+
+    template <size_t L, typename P>
+    std::unique_ptr<math::double3[]> projectLatLong(const Image& image, const double* bandScale, ThreadPool& pool)
+    {
+        std::unique_ptr<math::double3[]> SH(new math::double3[sh::Basis<L>::NUM_COEFS]);
+        projectLatLong<L, P>(image, std::make_shared<LatLongKernel>(image.getWidth(), image.getHeight()),
+                             bandScale, pool, nullptr, SH.get());
+        return SH;
+    }
+
+    template <size_t L>
+    void renderSHTexels(size_t dim, const math::double3* sh, TexelFormat format, void* data, ThreadPool& pool)
+    {
+        TRACE_SCOPE("render");
+        using Basis = sh::Basis<L>;
+        constexpr size_t N = RENDER_BATCH;
+
+        float coefs[3][Basis::NUM_COEFS];
+        for (size_t k = 0; k < Basis::NUM_COEFS; k++) {
+            for (size_t ch = 0; ch < 3; ch++) {
+                coefs[ch][k] = float(sh[k][ch]);
+            }
+        }
+
+        renderTexels(dim, format, data, pool, [&coefs](const float* dx, const float* dy, const float* dz, float (*c)[N]) {
+            alignas(64) float w[N], Y[Basis::NUM_COEFS * N];
+            for (size_t i = 0; i < N; i++) {
+                w[i] = 1;
+            }
+            Basis::template evaluateSoA<N>(dx, dy, dz, w, Y, N);
+            for (size_t ch = 0; ch < 3; ch++) {
+                for (size_t i = 0; i < N; i++) {
+                    c[ch][i] = 0;
+                }
+            }
+            for (size_t k = 0; k < Basis::NUM_COEFS; k++) {
+                for (size_t ch = 0; ch < 3; ch++) {
+                    for (size_t i = 0; i < N; i++) {
+                        c[ch][i] += coefs[ch][k] * Y[k * N + i];
+                    }
+                }
+            }
+        });
+    }
+
+    // (n, 1)^T M (n, 1) as the dot product of (n, 1) with M (n, 1)
+    template <typename T>
+    inline T evaluateQuadraticForm(const T (&M)[4][4], T x, T y, T z)
+    {
+        const T n[4] = { x, y, z, 1 };
+        T e = 0;
+        for (size_t row = 0; row < 4; row++) {
+            e += n[row] * (M[row][0] * x + M[row][1] * y + M[row][2] * z + M[row][3]);
+        }
+        return e;
+    }
+
+    template <typename T>
+    void convertMatrices(const IrradianceMatrices& matrices, T (&M)[3][4][4])
+    {
+        for (size_t ch = 0; ch < 3; ch++) {
+            for (size_t row = 0; row < 4; row++) {
+                for (size_t col = 0; col < 4; col++) {
+                    M[ch][row][col] = T(matrices.M[ch][row][col]);
+                }
+            }
+        }
+    }
+}
+
+namespace ibl
+{
+    template <size_t L, typename P>
+    std::unique_ptr<math::double3[]> computeRadianceSH(const Cubemap& cm, ThreadPool& pool)
+    {
+        double bandScale[L + 1];
+        for (size_t l = 0; l <= L; l++) {
+            bandScale[l] = 1;
+        }
+        return project<L, P>(cm, bandScale, pool);
+    }
+
+    template <size_t L, typename P>
+    std::unique_ptr<math::double3[]> computeIrradianceSH(const Cubemap& cm, ThreadPool& pool)
+    {
+        double bandScale[L + 1];
+        for (size_t l = 0; l <= L; l++) {
+            bandScale[l] = sh::computeTruncatedCosSh(l) / sh::PI;
+        }
+        return project<L, P>(cm, bandScale, pool);
+    }
+
+    template <size_t L, typename P>
+    void renderSH(Cubemap& cm, const std::unique_ptr<math::double3[]>& sh, ThreadPool& pool)
+    {
+        TRACE_SCOPE("render");
+        using Basis = sh::Basis<L>;
+        using Real = typename P::Real;
+
+        math::vec3<Real> coefs[Basis::NUM_COEFS];
+        for (size_t k = 0; k < Basis::NUM_COEFS; k++) {
+            coefs[k] = sh[k];
+        }
+
+        auto proc = [&](size_t y, Cubemap::Face f, Cubemap::Texel* data, size_t dim)
+        {
+            Real Y[Basis::NUM_COEFS];
+            for (size_t x = 0 ; x < dim ; ++x, ++data) {
+                math::vec3<Real> s(cm.getDirectionFor(f, x, y));
+                Basis::evaluate(s.x, s.y, s.z, Y);
+                math::vec3<Real> c = 0;
+                for (size_t k = 0; k < Basis::NUM_COEFS; k++) {
+                    c += coefs[k] * Y[k];
+                }
+                Cubemap::writeAt(data, Cubemap::Texel(c));
+            }
+        };
+
+        const size_t dim = cm.getDimensions();
+
+        const size_t numRows = 6 * dim;
+
+        pool.parallelFor(numRows, pool.suggestGrain(numRows), [&](size_t, size_t begin, size_t end) {
+            for (size_t row = begin; row < end; row++) {
+                const Cubemap::Face f = Cubemap::Face(row / dim);
+                const size_t y = row % dim;
+                Cubemap::Texel* data = static_cast<Cubemap::Texel*>(cm.getImageForFace(f).getPixelRef(0, y));
+                proc(y, f, data, dim);
+            }
+        });
+    }
+
+#define DISPATCH_ORDER(order, call) \
+    switch (order) { \
+    case 1: call(1); case 2: call(2); case 3: call(3); case 4: call(4); \
+    case 5: call(5); case 6: call(6); case 7: call(7); case 8: call(8); \
+    }
+
+    template <typename P>
+    std::unique_ptr<math::double3[]> computeRadianceSH(const Cubemap& cm, size_t order, ThreadPool& pool)
+    {
+#define CALL(L) return computeRadianceSH<L, P>(cm, pool)
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+        return nullptr;
+    }
+
+    template <typename P>
+    std::unique_ptr<math::double3[]> computeIrradianceSH(const Cubemap& cm, size_t order, ThreadPool& pool)
+    {
+#define CALL(L) return computeIrradianceSH<L, P>(cm, pool)
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+        return nullptr;
+    }
+
+    template <typename P>
+    void renderSH(Cubemap& cm, size_t order, const std::unique_ptr<math::double3[]>& sh, ThreadPool& pool)
+    {
+#define CALL(L) return renderSH<L, P>(cm, sh, pool)
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+    }
+
+    void renderSH(size_t dim, size_t order, const math::double3* sh, TexelFormat format, void* data, ThreadPool& pool)
+    {
+        assert(simd::getEncodeRow(format));
+#define CALL(L) return renderSHTexels<L>(dim, sh, format, data, pool)
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+    }
+
+    template <typename P>
+    std::unique_ptr<math::double3[]> computeRadianceSHLatLong(const Image& image, size_t order, ThreadPool& pool)
+    {
+        double bandScale[sh::MAX_ORDER + 1];
+        for (size_t l = 0; l <= order; l++) {
+            bandScale[l] = 1;
+        }
+#define CALL(L) return projectLatLong<L, P>(image, bandScale, pool)
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+        return nullptr;
+    }
+
+    template <typename P>
+    std::unique_ptr<math::double3[]> computeIrradianceSHLatLong(const Image& image, size_t order, ThreadPool& pool)
+    {
+        double bandScale[sh::MAX_ORDER + 1];
+        for (size_t l = 0; l <= order; l++) {
+            bandScale[l] = sh::computeTruncatedCosSh(l) / sh::PI;
+        }
+#define CALL(L) return projectLatLong<L, P>(image, bandScale, pool)
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+        return nullptr;
+    }
+
+    template <typename P>
+    std::unique_ptr<math::double3[]> computeIrradianceSH(const MipChain& mips, size_t order, double tolerance,
+                                                         MipSelection* selection, ThreadPool& pool)
+    {
+        const size_t numCoefs = sh::getCoefCount(order);
+
+        // moving the energy e of a texel by the angle d changes a coefficient of band l by at most
+        // e * d * |grad Y|, and sum_m |grad Y_lm|^2 = l (l + 1) (2l + 1) / 4pi
+        double gradient = 0;
+        for (size_t l = 1; l <= order; l++) {
+            const double g = std::sqrt(l * (l + 1) * (2 * l + 1) / (4 * sh::PI));
+            gradient = std::max(gradient, std::abs(sh::computeTruncatedCosSh(l)) / sh::PI * g);
+        }
+        const double Y00 = sh::Basis<0>::tables.K[0];
+
+        size_t level = mips.getLevelCount() - 1;
+        while (level > 0 && mips.getLevel(level).getDimensions() < MIN_MIP_DIMENSIONS) {
+            level--;
+        }
+
+        std::unique_ptr<math::double3[]> SH = computeIrradianceSH<P>(mips.getLevel(level), order, pool);
+        double error = 0;
+        while (level > 0) {
+            std::unique_ptr<math::double3[]> finer = computeIrradianceSH<P>(mips.getLevel(level - 1), order, pool);
+
+            double scale = 0;
+            double diff = 0;
+            for (size_t ch = 0; ch < 3; ch++) {
+                scale = std::max(scale, std::abs(finer[0][ch]));
+            }
+            for (size_t i = 0; i < numCoefs; i++) {
+                for (size_t ch = 0; ch < 3; ch++) {
+                    diff = std::max(diff, std::abs(finer[i][ch] - SH[i][ch]));
+                }
+            }
+
+            level--;
+            SH = std::move(finer);
+
+            // the energy of a texel is off by at most half its diagonal
+            const Cubemap& cm = mips.getLevel(level);
+            const double displacement = std::sqrt(2.0) / cm.getDimensions();
+            const double compact = computePeakShare(cm, pool) * gradient * displacement / Y00;
+
+            error = std::max(scale > 0 ? diff / scale : 0, compact);
+            if (error <= tolerance) {
+                break;
+            }
+        }
+
+        if (selection) {
+            selection->level = level;
+            selection->error = error;
+        }
+        return SH;
+    }
+
+    template <typename P>
+    class StreamingProjector<P>::Impl : public ProjectorFns
+    {
+    };
+
+    template <typename P>
+    StreamingProjector<P>::StreamingProjector(size_t dim, size_t order, ThreadPool& pool)
+        : mDimensions(dim), mOrder(order), mImpl(new Impl)
+    {
+#define CALL(L) static_cast<ProjectorFns&>(*mImpl) = bindProjector<L, P>(dim, pool); break
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+    }
+
+    template <typename P>
+    StreamingProjector<P>::~StreamingProjector() = default;
+
+    template <typename P>
+    void StreamingProjector<P>::addRows(Cubemap::Face face, size_t y, size_t count, const void* rows, size_t bytesPerRow)
+    {
+        assert(y + count <= mDimensions);
+        const size_t begin = size_t(face) * mDimensions + y;
+        mImpl->add(begin, begin + count, static_cast<const uint8_t*>(rows), bytesPerRow);
+    }
+
+    template <typename P>
+    std::unique_ptr<math::double3[]> StreamingProjector<P>::getRadianceSH() const
+    {
+        double bandScale[sh::MAX_ORDER + 1];
+        for (size_t l = 0; l <= mOrder; l++) {
+            bandScale[l] = 1;
+        }
+        return mImpl->get(bandScale);
+    }
+
+    template <typename P>
+    std::unique_ptr<math::double3[]> StreamingProjector<P>::getIrradianceSH() const
+    {
+        double bandScale[sh::MAX_ORDER + 1];
+        for (size_t l = 0; l <= mOrder; l++) {
+            bandScale[l] = sh::computeTruncatedCosSh(l) / sh::PI;
+        }
+        return mImpl->get(bandScale);
+    }
+
+    class ProjectionContext::Impl
+    {
+    public:
+        explicit Impl(ThreadPool& pool) : mScratch(pool.getSlotCount()) {}
+
+        ProjectionScratch* getScratch() { return &mScratch; }
+
+        // the kernel of the previous projection if it has the same size. built here rather than
+        // taken from SHKernel::get(), so that it goes away with the context
+        const std::shared_ptr<const SHKernel>& getKernel(size_t dim)
+        {
+            if (!mKernel || mKernel->getDimensions() != dim) {
+                mKernel.reset();
+                mKernel = std::make_shared<SHKernel>(dim);
+            }
+            return mKernel;
+        }
+
+        const std::shared_ptr<const LatLongKernel>& getKernel(size_t width, size_t height)
+        {
+            if (!mLatLongKernel || mLatLongKernel->getWidth() != width || mLatLongKernel->getHeight() != height) {
+                mLatLongKernel = std::make_shared<LatLongKernel>(width, height);
+            }
+            return mLatLongKernel;
+        }
+
+    private:
+        ProjectionScratch mScratch;
+        std::shared_ptr<const SHKernel> mKernel;
+        std::shared_ptr<const LatLongKernel> mLatLongKernel;
+    };
+
+    ProjectionContext::ProjectionContext(ThreadPool& pool)
+        : mPool(pool), mImpl(new Impl(pool))
+    {
+    }
+
+    ProjectionContext::~ProjectionContext() = default;
+
+    template <typename P>
+    void ProjectionContext::computeRadianceSH(const Cubemap& cm, size_t order, math::double3* sh)
+    {
+        double bandScale[sh::MAX_ORDER + 1];
+        for (size_t l = 0; l <= order; l++) {
+            bandScale[l] = 1;
+        }
+#define CALL(L) return project<L, P>(cm, mImpl->getKernel(cm.getDimensions()), bandScale, mPool, mImpl->getScratch(), sh)
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+    }
+
+    template <typename P>
+    void ProjectionContext::computeIrradianceSH(const Cubemap& cm, size_t order, math::double3* sh)
+    {
+        double bandScale[sh::MAX_ORDER + 1];
+        for (size_t l = 0; l <= order; l++) {
+            bandScale[l] = sh::computeTruncatedCosSh(l) / sh::PI;
+        }
+#define CALL(L) return project<L, P>(cm, mImpl->getKernel(cm.getDimensions()), bandScale, mPool, mImpl->getScratch(), sh)
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+    }
+
+    template <typename P>
+    void ProjectionContext::computeRadianceSHLatLong(const Image& image, size_t order, math::double3* sh)
+    {
+        double bandScale[sh::MAX_ORDER + 1];
+        for (size_t l = 0; l <= order; l++) {
+            bandScale[l] = 1;
+        }
+#define CALL(L) return projectLatLong<L, P>(image, mImpl->getKernel(image.getWidth(), image.getHeight()), \
+                                            bandScale, mPool, mImpl->getScratch(), sh)
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+    }
+
+    template <typename P>
+    void ProjectionContext::computeIrradianceSHLatLong(const Image& image, size_t order, math::double3* sh)
+    {
+        double bandScale[sh::MAX_ORDER + 1];
+        for (size_t l = 0; l <= order; l++) {
+            bandScale[l] = sh::computeTruncatedCosSh(l) / sh::PI;
+        }
+#define CALL(L) return projectLatLong<L, P>(image, mImpl->getKernel(image.getWidth(), image.getHeight()), \
+                                            bandScale, mPool, mImpl->getScratch(), sh)
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+    }
+
+    std::unique_ptr<math::double3[]> updateRadianceSH(const Cubemap& cm, size_t order,
+                                                      const std::unique_ptr<math::double3[]>& sh,
+                                                      const std::vector<DirtyRegion>& regions, ThreadPool& pool)
+    {
+        double bandScale[sh::MAX_ORDER + 1];
+        for (size_t l = 0; l <= order; l++) {
+            bandScale[l] = 1;
+        }
+        std::unique_ptr<math::double3[]> SH;
+#define CALL(L) SH = projectRegions<L>(cm, regions, bandScale, pool); break
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+        if (!SH) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < sh::getCoefCount(order); i++) {
+            SH[i] += sh[i];
+        }
+        return SH;
+    }
+
+    std::unique_ptr<math::double3[]> updateIrradianceSH(const Cubemap& cm, size_t order,
+                                                        const std::unique_ptr<math::double3[]>& sh,
+                                                        const std::vector<DirtyRegion>& regions, ThreadPool& pool)
+    {
+        double bandScale[sh::MAX_ORDER + 1];
+        for (size_t l = 0; l <= order; l++) {
+            bandScale[l] = sh::computeTruncatedCosSh(l) / sh::PI;
+        }
+        std::unique_ptr<math::double3[]> SH;
+#define CALL(L) SH = projectRegions<L>(cm, regions, bandScale, pool); break
+        DISPATCH_ORDER(order, CALL);
+#undef CALL
+        if (!SH) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < sh::getCoefCount(order); i++) {
+            SH[i] += sh[i];
+        }
+        return SH;
+    }
+
+    std::unique_ptr<math::double3[]> updateIrradianceSH3Bands(const Cubemap& cm,
+                                                              const std::unique_ptr<math::double3[]>& sh,
+                                                              const std::vector<DirtyRegion>& regions,
+                                                              ThreadPool& pool)
+    {
+        const double bandScale[3] = {
+            sh::computeTruncatedCosSh(0) / sh::PI,
+            sh::computeTruncatedCosSh(1) / sh::PI,
+            sh::computeTruncatedCosSh(2) / sh::PI,
+        };
+        std::unique_ptr<math::double3[]> SH = projectRegions<2>(cm, regions, bandScale, pool);
+        if (!SH) {
+            return nullptr;
+        }
+        preScaleSH3Bands(SH.get());
+        for (size_t i = 0; i < 9; i++) {
+            SH[i] += sh[i];
+        }
+        return SH;
+    }
+
+    void preScaleSH3Bands(math::double3* sh)
+    {
+        for (size_t i = 0 ; i < 9 ; i++) {
+            sh[i] *= legacyK[i];
+        }
+    }
+
+    template <typename P>
+    std::unique_ptr<math::double3[]> computeIrradianceSH3Bands(const Cubemap& cm, ThreadPool& pool)
+    {
+        auto SH = computeIrradianceSH<2, P>(cm, pool);
+        preScaleSH3Bands(SH.get());
+        return SH;
+    }
+
+    template <typename P>
+    std::unique_ptr<math::double3[]> computeIrradianceSH3BandsLatLong(const Image& image, ThreadPool& pool)
+    {
+        auto SH = computeIrradianceSHLatLong<P>(image, 2, pool);
+        preScaleSH3Bands(SH.get());
+        return SH;
+    }
+
+    IrradianceMatrices computeIrradianceMatrices(const math::double3* sh)
+    {
+        // the polynomials 1, y, z, x, yx, yz, 3z^2-1, zx, x^2-y^2 as quadratic forms of (x, y, z, 1),
+        // with 1 = x^2 + y^2 + z^2 left in the constant term
+        IrradianceMatrices matrices;
+        for (size_t ch = 0; ch < 3; ch++) {
+            double (&M)[4][4] = matrices.M[ch];
+            M[0][0] =  sh[8][ch];
+            M[1][1] = -sh[8][ch];
+            M[2][2] =  3 * sh[6][ch];
+            M[3][3] =  sh[0][ch] - sh[6][ch];
+            M[0][1] = M[1][0] = sh[4][ch] / 2;
+            M[0][2] = M[2][0] = sh[7][ch] / 2;
+            M[1][2] = M[2][1] = sh[5][ch] / 2;
+            M[0][3] = M[3][0] = sh[3][ch] / 2;
+            M[1][3] = M[3][1] = sh[1][ch] / 2;
+            M[2][3] = M[3][2] = sh[2][ch] / 2;
+        }
+        return matrices;
+    }
+
+    template <typename P>
+    void renderPreScaledSH3Bands(Cubemap& cm, const std::unique_ptr<math::double3[]>& sh, ThreadPool& pool)
+    {
+        TRACE_SCOPE("render");
+        using Real = typename P::Real;
+
+        Real M[3][4][4];
+        convertMatrices(computeIrradianceMatrices(sh.get()), M);
+
+        const size_t dim = cm.getDimensions();
+        const size_t numRows = 6 * dim;
+
+        pool.parallelFor(numRows, pool.suggestGrain(numRows), [&](size_t, size_t begin, size_t end) {
+            for (size_t row = begin; row < end; row++) {
+                const Cubemap::Face f = Cubemap::Face(row / dim);
+                const size_t y = row % dim;
+                Cubemap::Texel* data = static_cast<Cubemap::Texel*>(cm.getImageForFace(f).getPixelRef(0, y));
+                for (size_t x = 0 ; x < dim ; ++x, ++data) {
+                    math::vec3<Real> s(cm.getDirectionFor(f, x, y));
+                    Cubemap::writeAt(data, Cubemap::Texel(evaluateQuadraticForm(M[0], s.x, s.y, s.z),
+                                                          evaluateQuadraticForm(M[1], s.x, s.y, s.z),
+                                                          evaluateQuadraticForm(M[2], s.x, s.y, s.z)));
+                }
+            }
+        });
+    }
+
+    void renderPreScaledSH3Bands(size_t dim, const math::double3* sh, TexelFormat format, void* data, ThreadPool& pool)
+    {
+        TRACE_SCOPE("render");
+        constexpr size_t N = RENDER_BATCH;
+
+        assert(simd::getEncodeRow(format));
+        float M[3][4][4];
+        convertMatrices(computeIrradianceMatrices(sh), M);
+
+        renderTexels(dim, format, data, pool, [&M](const float* dx, const float* dy, const float* dz, float (*c)[N]) {
+            for (size_t ch = 0; ch < 3; ch++) {
+                for (size_t i = 0; i < N; i++) {
+                    c[ch][i] = evaluateQuadraticForm(M[ch], dx[i], dy[i], dz[i]);
+                }
+            }
+        });
+    }
+
+#define INSTANTIATE_SH(L, P) \
+    template std::unique_ptr<math::double3[]> computeRadianceSH<L, P>(const Cubemap&, ThreadPool&); \
+    template std::unique_ptr<math::double3[]> computeIrradianceSH<L, P>(const Cubemap&, ThreadPool&); \
+    template void renderSH<L, P>(Cubemap&, const std::unique_ptr<math::double3[]>&, ThreadPool&);
+
+#define INSTANTIATE_POLICY(P) \
+    INSTANTIATE_SH(1, P) INSTANTIATE_SH(2, P) INSTANTIATE_SH(3, P) INSTANTIATE_SH(4, P) \
+    INSTANTIATE_SH(5, P) INSTANTIATE_SH(6, P) INSTANTIATE_SH(7, P) INSTANTIATE_SH(8, P) \
+    template std::unique_ptr<math::double3[]> computeRadianceSH<P>(const Cubemap&, size_t, ThreadPool&); \
+    template std::unique_ptr<math::double3[]> computeIrradianceSH<P>(const Cubemap&, size_t, ThreadPool&); \
+    template void renderSH<P>(Cubemap&, size_t, const std::unique_ptr<math::double3[]>&, ThreadPool&); \
+    template std::unique_ptr<math::double3[]> computeRadianceSHLatLong<P>(const Image&, size_t, ThreadPool&); \
+    template std::unique_ptr<math::double3[]> computeIrradianceSHLatLong<P>(const Image&, size_t, ThreadPool&); \
+    template std::unique_ptr<math::double3[]> computeIrradianceSH<P>(const MipChain&, size_t, double, MipSelection*, ThreadPool&); \
+    template std::unique_ptr<math::double3[]> computeIrradianceSH3Bands<P>(const Cubemap&, ThreadPool&); \
+    template std::unique_ptr<math::double3[]> computeIrradianceSH3BandsLatLong<P>(const Image&, ThreadPool&); \
+    template void renderPreScaledSH3Bands<P>(Cubemap&, const std::unique_ptr<math::double3[]>&, ThreadPool&); \
+    template class StreamingProjector<P>; \
+    template void ProjectionContext::computeRadianceSH<P>(const Cubemap&, size_t, math::double3*); \
+    template void ProjectionContext::computeIrradianceSH<P>(const Cubemap&, size_t, math::double3*); \
+    template void ProjectionContext::computeRadianceSHLatLong<P>(const Image&, size_t, math::double3*); \
+    template void ProjectionContext::computeIrradianceSHLatLong<P>(const Image&, size_t, math::double3*);
+
+    INSTANTIATE_POLICY(precision::Double)
+    INSTANTIATE_POLICY(precision::FloatKahan)
+    INSTANTIATE_POLICY(precision::FloatPairwise)
+
+#undef INSTANTIATE_POLICY
+#undef INSTANTIATE_SH
+#undef DISPATCH_ORDER
+}
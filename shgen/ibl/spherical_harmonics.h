@@ -1,16 +1,214 @@
-#ifndef SPHERICALHARMONICS_H__
-#define SPHERICALHARMONICS_H__
-
-#include <cstdint>
-#include <memory>
-
-#include "cubemap.h"
-
-namespace ibl
-{
-    std::unique_ptr<math::double3[]> computeIrradianceSH3Bands(const Cubemap& cm);
-
-    void renderPreScaledSH3Bands(Cubemap& cm, const std::unique_ptr<math::double3[]>& sh);
-}
-
-#endif
+#ifndef SPHERICALHARMONICS_H__
+#define SPHERICALHARMONICS_H__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cubemap.h"
+#include "mip_chain.h"
+#include "precision.h"
+#include "sh_basis.h"
+#include "texel_format.h"
+#include "thread_pool.h"
+
+namespace ibl
+{
+    // Coefficients of bands 0..L of the orthonormal real spherical harmonics, (l, m) is
+    // at index l * (l + 1) + m. Instantiated for L = 1..sh::MAX_ORDER and the policies of
+    // precision.h, P selects the arithmetic of the projection and of the rendering.
+
+    // projection of the radiance
+    template <size_t L, typename P = precision::Double>
+    std::unique_ptr<math::double3[]> computeRadianceSH(const Cubemap& cm, ThreadPool& pool = ThreadPool::getDefault());
+
+    // projection of the irradiance divided by pi, i.e. the radiance convolved with the clamped cosine lobe
+    template <size_t L, typename P = precision::Double>
+    std::unique_ptr<math::double3[]> computeIrradianceSH(const Cubemap& cm, ThreadPool& pool = ThreadPool::getDefault());
+
+    // reconstructs the coefficients into every texel of cm
+    template <size_t L, typename P = precision::Double>
+    void renderSH(Cubemap& cm, const std::unique_ptr<math::double3[]>& sh, ThreadPool& pool = ThreadPool::getDefault());
+
+    // same as above with the order chosen at runtime, 1 <= order <= sh::MAX_ORDER
+    template <typename P = precision::Double>
+    std::unique_ptr<math::double3[]> computeRadianceSH(const Cubemap& cm, size_t order,
+                                                       ThreadPool& pool = ThreadPool::getDefault());
+
+    template <typename P = precision::Double>
+    std::unique_ptr<math::double3[]> computeIrradianceSH(const Cubemap& cm, size_t order,
+                                                         ThreadPool& pool = ThreadPool::getDefault());
+
+    template <typename P = precision::Double>
+    void renderSH(Cubemap& cm, size_t order, const std::unique_ptr<math::double3[]>& sh,
+                  ThreadPool& pool = ThreadPool::getDefault());
+
+    // Evaluates the coefficients of bands 0..order at the centers of the texels of a cubemap
+    // with faces of dim x dim texels, 16 directions at a time in float, and writes them to
+    // data in format, RGB32F or RGBA16F. The rows are packed and the faces are in the order of
+    // Cubemap::Face, so data holds 6 * dim * dim * getBytesPerTexel(format) bytes. Meant for
+    // irradiance, which is smooth enough to be rendered at a fraction of the input size.
+    void renderSH(size_t dim, size_t order, const math::double3* sh, TexelFormat format, void* data,
+                  ThreadPool& pool = ThreadPool::getDefault());
+
+    // Projection of an equirectangular image without resampling it to a cubemap. row y spans
+    // the polar angles [y, y + 1) * pi / height down from +Y, column x the azimuths
+    // [x, x + 1) * 2pi / width - pi around +Y, so that the middle column faces +Z.
+    template <typename P = precision::Double>
+    std::unique_ptr<math::double3[]> computeRadianceSHLatLong(const Image& image, size_t order,
+                                                              ThreadPool& pool = ThreadPool::getDefault());
+
+    template <typename P = precision::Double>
+    std::unique_ptr<math::double3[]> computeIrradianceSHLatLong(const Image& image, size_t order,
+                                                                ThreadPool& pool = ThreadPool::getDefault());
+
+    // Projection of a cubemap that arrives a few rows at a time, e.g. straight from a file,
+    // so that the whole cubemap never has to be in memory. the rows may come in any order,
+    // every row of every face has to be added exactly once before the coefficients are read.
+    template <typename P = precision::Double>
+    class StreamingProjector
+    {
+    public:
+        StreamingProjector(size_t dim, size_t order, ThreadPool& pool = ThreadPool::getDefault());
+
+        StreamingProjector(const StreamingProjector&) = delete;
+        StreamingProjector& operator=(const StreamingProjector&) = delete;
+
+        ~StreamingProjector();
+
+        // projects count rows of face starting at row y, the texels of a row are contiguous
+        // and the rows are bytesPerRow apart. blocks until they have been projected.
+        void addRows(Cubemap::Face face, size_t y, size_t count, const void* rows, size_t bytesPerRow);
+
+        std::unique_ptr<math::double3[]> getRadianceSH() const;
+        std::unique_ptr<math::double3[]> getIrradianceSH() const;
+
+        size_t getDimensions() const { return mDimensions; }
+        size_t getOrder() const { return mOrder; }
+
+    private:
+        class Impl;
+
+        const size_t mDimensions;
+        const size_t mOrder;
+        std::unique_ptr<Impl> mImpl;
+    };
+
+    // Kernels and per-thread buffers kept from one projection to the next, so that projecting
+    // an image of the same size and order as the previous one, e.g. a probe captured every
+    // frame, neither rebuilds tables nor allocates. The coefficients of bands 0..order are
+    // written to sh, which holds sh::getCoefCount(order) of them. A context is used by one
+    // thread at a time, several contexts may share a pool.
+    class ProjectionContext
+    {
+    public:
+        explicit ProjectionContext(ThreadPool& pool = ThreadPool::getDefault());
+
+        ProjectionContext(const ProjectionContext&) = delete;
+        ProjectionContext& operator=(const ProjectionContext&) = delete;
+
+        ~ProjectionContext();
+
+        template <typename P = precision::Double>
+        void computeRadianceSH(const Cubemap& cm, size_t order, math::double3* sh);
+
+        template <typename P = precision::Double>
+        void computeIrradianceSH(const Cubemap& cm, size_t order, math::double3* sh);
+
+        template <typename P = precision::Double>
+        void computeRadianceSHLatLong(const Image& image, size_t order, math::double3* sh);
+
+        template <typename P = precision::Double>
+        void computeIrradianceSHLatLong(const Image& image, size_t order, math::double3* sh);
+
+        ThreadPool& getPool() const { return mPool; }
+
+    private:
+        class Impl;
+
+        ThreadPool& mPool;
+        std::unique_ptr<Impl> mImpl;
+    };
+
+    // a rectangle of a face whose texels changed from oldTexels to newTexels,
+    // both hold width * height texels row by row
+    struct DirtyRegion
+    {
+        Cubemap::Face face;
+        size_t x;
+        size_t y;
+        size_t width;
+        size_t height;
+        const Cubemap::Texel* oldTexels;
+        const Cubemap::Texel* newTexels;
+    };
+
+    // the coefficients of cm after the changes in regions, given sh, its coefficients of bands
+    // 0..order before them. the projection is linear, so only the changed texels are projected.
+    // nullptr if a region does not lie inside a face of cm or has no texels. the texels shared
+    // by overlapping regions are counted once per region.
+    std::unique_ptr<math::double3[]> updateRadianceSH(const Cubemap& cm, size_t order,
+                                                      const std::unique_ptr<math::double3[]>& sh,
+                                                      const std::vector<DirtyRegion>& regions,
+                                                      ThreadPool& pool = ThreadPool::getDefault());
+
+    std::unique_ptr<math::double3[]> updateIrradianceSH(const Cubemap& cm, size_t order,
+                                                        const std::unique_ptr<math::double3[]>& sh,
+                                                        const std::vector<DirtyRegion>& regions,
+                                                        ThreadPool& pool = ThreadPool::getDefault());
+
+    struct MipSelection
+    {
+        size_t level = 0;
+        double error = 0;   // estimated, relative to band 0 of the brightest channel
+    };
+
+    // irradiance of the coarsest level of mips whose estimated error is below tolerance,
+    // relative to band 0 of the brightest channel. the levels are projected from coarse to
+    // fine, the error of a level is estimated from the difference with the level below it
+    // and from the largest share of the energy held by one of its texels, which catches
+    // compact bright sources such as a sun disk.
+    template <typename P = precision::Double>
+    std::unique_ptr<math::double3[]> computeIrradianceSH(const MipChain& mips, size_t order, double tolerance,
+                                                         MipSelection* selection = nullptr,
+                                                         ThreadPool& pool = ThreadPool::getDefault());
+
+    // 9 irradiance coefficients pre-scaled for the polynomials
+    //   1, y, z, x, yx, yz, 3z^2-1, zx, x^2-y^2
+    template <typename P = precision::Double>
+    std::unique_ptr<math::double3[]> computeIrradianceSH3Bands(const Cubemap& cm, ThreadPool& pool = ThreadPool::getDefault());
+
+    template <typename P = precision::Double>
+    std::unique_ptr<math::double3[]> computeIrradianceSH3BandsLatLong(const Image& image,
+                                                                      ThreadPool& pool = ThreadPool::getDefault());
+
+    // converts the orthonormal coefficients of bands 0..2 to the pre-scaled ones above
+    void preScaleSH3Bands(math::double3* sh);
+
+    // same as updateIrradianceSH() for the coefficients of computeIrradianceSH3Bands()
+    std::unique_ptr<math::double3[]> updateIrradianceSH3Bands(const Cubemap& cm,
+                                                              const std::unique_ptr<math::double3[]>& sh,
+                                                              const std::vector<DirtyRegion>& regions,
+                                                              ThreadPool& pool = ThreadPool::getDefault());
+
+    // The pre-scaled coefficients as a quadratic form: the irradiance of the unit direction n is
+    // (n, 1)^T M (n, 1) for one symmetric 4x4 matrix M per channel, 16 multiply-adds instead of
+    // the 9 polynomials. M[ch][row][col], the rows and the columns are x, y, z and 1.
+    struct IrradianceMatrices
+    {
+        double M[3][4][4];
+    };
+
+    IrradianceMatrices computeIrradianceMatrices(const math::double3* sh);
+
+    // both evaluate IrradianceMatrices
+    template <typename P = precision::Double>
+    void renderPreScaledSH3Bands(Cubemap& cm, const std::unique_ptr<math::double3[]>& sh,
+                                 ThreadPool& pool = ThreadPool::getDefault());
+
+    // same as renderSH() for the texels of a cubemap of its own
+    void renderPreScaledSH3Bands(size_t dim, const math::double3* sh, TexelFormat format, void* data,
+                                 ThreadPool& pool = ThreadPool::getDefault());
+}
+
+#endif
@@ -0,0 +1,198 @@
+#include "texel_format.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    inline float fromBits(uint32_t bits)
+    {
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    inline uint32_t load32(const uint8_t* p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint16_t load16(const uint8_t* p)
+    {
+        uint16_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t toBits(float f)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+
+    inline void store16(uint8_t* p, uint16_t v)
+    {
+        std::memcpy(p, &v, sizeof(v));
+    }
+}
+
+namespace ibl
+{
+    float halfToFloat(uint16_t h)
+    {
+        const uint32_t sign = uint32_t(h & 0x8000) << 16;
+        const uint32_t exponent = (h >> 10) & 0x1f;
+        const uint32_t mantissa = h & 0x3ff;
+        if (exponent == 0) {
+            // zero or denormal, mantissa * 2^-24
+            const float f = float(mantissa) * (1.0f / 16777216.0f);
+            return sign ? -f : f;
+        }
+        if (exponent == 31) {
+            return fromBits(sign | 0x7f800000 | (mantissa << 13));
+        }
+        return fromBits(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+    }
+
+    // rounded to nearest even, as F16C does
+    uint16_t floatToHalf(float f)
+    {
+        uint32_t bits = toBits(f);
+        const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+        bits &= 0x7fffffff;
+        if (bits >= 0x7f800000) {
+            // infinity or nan, quiet with the top of its payload
+            return sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 | ((bits >> 13) & 0x3ff) : 0);
+        }
+        if (bits >= 0x477ff000) {
+            // 65520 and above round to infinity
+            return sign | 0x7c00;
+        }
+        if (bits < 0x38800000) {
+            // below the smallest normal half, f * 2^24 is exact and its rounding is the denormal
+            return sign | uint16_t(std::nearbyint(fromBits(bits) * 16777216.0f));
+        }
+        // rebiases the exponent and rounds the 13 dropped bits of the mantissa
+        bits += 0xc8000fff + ((bits >> 13) & 1);
+        return sign | uint16_t(bits >> 13);
+    }
+
+    size_t getBytesPerTexel(TexelFormat format)
+    {
+        switch (format) {
+        case TexelFormat::RGB32F:   return 12;
+        case TexelFormat::RGBA32F:  return 16;
+        case TexelFormat::RGBA16F:  return 8;
+        case TexelFormat::RG11B10F: return 4;
+        case TexelFormat::RGB9E5:   return 4;
+        case TexelFormat::RGBE8:    return 4;
+        }
+        return 0;
+    }
+
+namespace simd
+{
+    void decodeRowRGB32F(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        std::memcpy(dst, src, count * sizeof(Cubemap::Texel));
+    }
+
+    void decodeRowRGBA32FScalar(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        const float* p = static_cast<const float*>(src);
+        for (size_t x = 0; x < count; x++, p += 4) {
+            dst[x] = Cubemap::Texel(p[0], p[1], p[2]);
+        }
+    }
+
+    void decodeRowRGBA16FScalar(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(src);
+        for (size_t x = 0; x < count; x++, p += 8) {
+            dst[x] = Cubemap::Texel(halfToFloat(load16(p)), halfToFloat(load16(p + 2)), halfToFloat(load16(p + 4)));
+        }
+    }
+
+    // the 11 and 10 bit floats are halves without sign and with a shorter mantissa
+    void decodeRowRG11B10FScalar(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(src);
+        for (size_t x = 0; x < count; x++, p += 4) {
+            const uint32_t v = load32(p);
+            dst[x] = Cubemap::Texel(halfToFloat(uint16_t((v & 0x7ff) << 4)),
+                                    halfToFloat(uint16_t(((v >> 11) & 0x7ff) << 4)),
+                                    halfToFloat(uint16_t(((v >> 22) & 0x3ff) << 5)));
+        }
+    }
+
+    // 9 bit mantissas without implicit one, scaled by 2^(exponent - 15 - 9)
+    void decodeRowRGB9E5Scalar(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(src);
+        for (size_t x = 0; x < count; x++, p += 4) {
+            const uint32_t v = load32(p);
+            const float scale = fromBits(((v >> 27) + 127 - 24) << 23);
+            dst[x] = Cubemap::Texel(float(v & 0x1ff) * scale,
+                                    float((v >> 9) & 0x1ff) * scale,
+                                    float((v >> 18) & 0x1ff) * scale);
+        }
+    }
+
+    // m * 2^(exponent - 136) as m / 256 * 2^(exponent - 128), exponent 0 stands for black.
+    // exponent 1 is flushed to 0 too, it only gives values below the smallest normal float.
+    void decodeRowRGBE8Scalar(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(src);
+        for (size_t x = 0; x < count; x++, p += 4) {
+            const uint32_t exponent = p[3];
+            const float scale = exponent > 1 ? fromBits((exponent - 1) << 23) : 0.0f;
+            dst[x] = Cubemap::Texel(float(p[0]) * (1.0f / 256.0f) * scale,
+                                    float(p[1]) * (1.0f / 256.0f) * scale,
+                                    float(p[2]) * (1.0f / 256.0f) * scale);
+        }
+    }
+
+    void encodeRowRGB32F(const Cubemap::Texel* src, size_t count, void* dst)
+    {
+        std::memcpy(dst, src, count * sizeof(Cubemap::Texel));
+    }
+
+    void encodeRowRGBA16FScalar(const Cubemap::Texel* src, size_t count, void* dst)
+    {
+        const uint16_t one = 0x3c00;
+        uint8_t* p = static_cast<uint8_t*>(dst);
+        for (size_t x = 0; x < count; x++, p += 8) {
+            store16(p, floatToHalf(src[x].r));
+            store16(p + 2, floatToHalf(src[x].g));
+            store16(p + 4, floatToHalf(src[x].b));
+            store16(p + 6, one);
+        }
+    }
+
+    DecodeRowFn getDecodeRow(TexelFormat format, SimdLevel level)
+    {
+        const bool avx2 = level >= SimdLevel::AVX2;
+        switch (format) {
+        case TexelFormat::RGB32F:   return decodeRowRGB32F;
+        case TexelFormat::RGBA32F:  return avx2 ? decodeRowRGBA32FAVX2 : decodeRowRGBA32FScalar;
+        case TexelFormat::RGBA16F:  return avx2 ? decodeRowRGBA16FAVX2 : decodeRowRGBA16FScalar;
+        case TexelFormat::RG11B10F: return avx2 ? decodeRowRG11B10FAVX2 : decodeRowRG11B10FScalar;
+        case TexelFormat::RGB9E5:   return avx2 ? decodeRowRGB9E5AVX2 : decodeRowRGB9E5Scalar;
+        case TexelFormat::RGBE8:    return avx2 ? decodeRowRGBE8AVX2 : decodeRowRGBE8Scalar;
+        }
+        return nullptr;
+    }
+
+    EncodeRowFn getEncodeRow(TexelFormat format, SimdLevel level)
+    {
+        switch (format) {
+        case TexelFormat::RGB32F:   return encodeRowRGB32F;
+        case TexelFormat::RGBA16F:  return level >= SimdLevel::AVX2 ? encodeRowRGBA16FAVX2 : encodeRowRGBA16FScalar;
+        default:                    return nullptr;
+        }
+    }
+}
+}
@@ -0,0 +1,65 @@
+#ifndef TEXELFORMAT_H__
+#define TEXELFORMAT_H__
+
+#include <cstdint>
+
+#include "cpu_features.h"
+#include "cubemap.h"
+
+namespace ibl
+{
+    // uncompressed HDR formats that are decoded to Cubemap::Texel
+    enum class TexelFormat : uint8_t
+    {
+        RGB32F,     // R32G32B32_FLOAT, the layout of Cubemap::Texel
+        RGBA32F,    // R32G32B32A32_FLOAT
+        RGBA16F,    // R16G16B16A16_FLOAT
+        RG11B10F,   // R11G11B10_FLOAT
+        RGB9E5,     // R9G9B9E5_SHAREDEXP
+        RGBE8,      // Radiance RGBE, 8 bit mantissas scaled by 2^(exponent - 136)
+    };
+
+    size_t getBytesPerTexel(TexelFormat format);
+
+    // IEEE half precision, the conversion to half rounds to nearest even as F16C does
+    float halfToFloat(uint16_t h);
+    uint16_t floatToHalf(float f);
+
+namespace simd
+{
+    // dst[x] = src[x] for x in [0, count), the alpha of the source is dropped
+    using DecodeRowFn = void (*)(const void* src, size_t count, Cubemap::Texel* dst);
+
+    void decodeRowRGB32F(const void* src, size_t count, Cubemap::Texel* dst);
+
+    void decodeRowRGBA32FScalar(const void* src, size_t count, Cubemap::Texel* dst);
+    void decodeRowRGBA16FScalar(const void* src, size_t count, Cubemap::Texel* dst);
+    void decodeRowRG11B10FScalar(const void* src, size_t count, Cubemap::Texel* dst);
+    void decodeRowRGB9E5Scalar(const void* src, size_t count, Cubemap::Texel* dst);
+    void decodeRowRGBE8Scalar(const void* src, size_t count, Cubemap::Texel* dst);
+
+    // need AVX2 and F16C
+    void decodeRowRGBA32FAVX2(const void* src, size_t count, Cubemap::Texel* dst);
+    void decodeRowRGBA16FAVX2(const void* src, size_t count, Cubemap::Texel* dst);
+    void decodeRowRG11B10FAVX2(const void* src, size_t count, Cubemap::Texel* dst);
+    void decodeRowRGB9E5AVX2(const void* src, size_t count, Cubemap::Texel* dst);
+    void decodeRowRGBE8AVX2(const void* src, size_t count, Cubemap::Texel* dst);
+
+    DecodeRowFn getDecodeRow(TexelFormat format, SimdLevel level = getSimdLevel());
+
+    // the other way round, the alpha of the destination is set to 1
+    using EncodeRowFn = void (*)(const Cubemap::Texel* src, size_t count, void* dst);
+
+    void encodeRowRGB32F(const Cubemap::Texel* src, size_t count, void* dst);
+
+    void encodeRowRGBA16FScalar(const Cubemap::Texel* src, size_t count, void* dst);
+
+    // needs AVX2 and F16C
+    void encodeRowRGBA16FAVX2(const Cubemap::Texel* src, size_t count, void* dst);
+
+    // RGB32F and RGBA16F, nullptr for the other formats
+    EncodeRowFn getEncodeRow(TexelFormat format, SimdLevel level = getSimdLevel());
+}
+}
+
+#endif
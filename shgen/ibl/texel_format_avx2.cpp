@@ -0,0 +1,152 @@
+#include "texel_format.h"
+
+#include <immintrin.h>
+
+namespace
+{
+    // a, b, c, d hold the texels 0-1, 2-3, 4-5 and 6-7 as r g b x r g b x,
+    // stores the 8 texels as 24 packed floats
+    inline void storeTexels(float* dst, __m256 a, __m256 b, __m256 c, __m256 d)
+    {
+        const __m256 out0 = _mm256_blend_ps(_mm256_permutevar8x32_ps(a, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 0, 0)),
+                                            _mm256_permutevar8x32_ps(b, _mm256_setr_epi32(0, 0, 0, 0, 0, 0, 0, 1)), 0xc0);
+        const __m256 out1 = _mm256_blend_ps(_mm256_permutevar8x32_ps(b, _mm256_setr_epi32(2, 4, 5, 6, 0, 0, 0, 0)),
+                                            _mm256_permutevar8x32_ps(c, _mm256_setr_epi32(0, 0, 0, 0, 0, 1, 2, 4)), 0xf0);
+        const __m256 out2 = _mm256_blend_ps(_mm256_permutevar8x32_ps(c, _mm256_setr_epi32(5, 6, 0, 0, 0, 0, 0, 0)),
+                                            _mm256_permutevar8x32_ps(d, _mm256_setr_epi32(0, 0, 0, 1, 2, 4, 5, 6)), 0xfc);
+        _mm256_storeu_ps(dst, out0);
+        _mm256_storeu_ps(dst + 8, out1);
+        _mm256_storeu_ps(dst + 16, out2);
+    }
+
+    // r, g and b hold one channel of 8 texels each
+    inline void storePlanar(float* dst, __m256 r, __m256 g, __m256 b)
+    {
+        // r g b x per texel, texels 0 | 4, 1 | 5, 2 | 6 and 3 | 7
+        const __m256 rgLo = _mm256_unpacklo_ps(r, g);
+        const __m256 rgHi = _mm256_unpackhi_ps(r, g);
+        const __m256 bxLo = _mm256_unpacklo_ps(b, b);
+        const __m256 bxHi = _mm256_unpackhi_ps(b, b);
+        const __m256 t04 = _mm256_castpd_ps(_mm256_unpacklo_pd(_mm256_castps_pd(rgLo), _mm256_castps_pd(bxLo)));
+        const __m256 t15 = _mm256_castpd_ps(_mm256_unpackhi_pd(_mm256_castps_pd(rgLo), _mm256_castps_pd(bxLo)));
+        const __m256 t26 = _mm256_castpd_ps(_mm256_unpacklo_pd(_mm256_castps_pd(rgHi), _mm256_castps_pd(bxHi)));
+        const __m256 t37 = _mm256_castpd_ps(_mm256_unpackhi_pd(_mm256_castps_pd(rgHi), _mm256_castps_pd(bxHi)));
+        storeTexels(dst,
+                    _mm256_permute2f128_ps(t04, t15, 0x20), _mm256_permute2f128_ps(t26, t37, 0x20),
+                    _mm256_permute2f128_ps(t04, t15, 0x31), _mm256_permute2f128_ps(t26, t37, 0x31));
+    }
+
+    // 8 halves, i.e. 2 texels of 4 channels, to floats
+    inline __m256 halfToFloat8(__m128i h)
+    {
+        return _mm256_cvtph_ps(h);
+    }
+}
+
+namespace ibl
+{
+namespace simd
+{
+    void decodeRowRGBA32FAVX2(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        const float* p = static_cast<const float*>(src);
+        const size_t blocked = count & ~size_t(7);
+        for (size_t x = 0; x < blocked; x += 8, p += 32) {
+            storeTexels(reinterpret_cast<float*>(dst + x),
+                        _mm256_loadu_ps(p), _mm256_loadu_ps(p + 8), _mm256_loadu_ps(p + 16), _mm256_loadu_ps(p + 24));
+        }
+        decodeRowRGBA32FScalar(p, count - blocked, dst + blocked);
+    }
+
+    void decodeRowRGBA16FAVX2(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(src);
+        const size_t blocked = count & ~size_t(7);
+        for (size_t x = 0; x < blocked; x += 8, p += 64) {
+            const __m256i h01 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            const __m256i h23 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+            storeTexels(reinterpret_cast<float*>(dst + x),
+                        halfToFloat8(_mm256_castsi256_si128(h01)), halfToFloat8(_mm256_extracti128_si256(h01, 1)),
+                        halfToFloat8(_mm256_castsi256_si128(h23)), halfToFloat8(_mm256_extracti128_si256(h23, 1)));
+        }
+        decodeRowRGBA16FScalar(p, count - blocked, dst + blocked);
+    }
+
+    // the channels are shifted into halves, packed as r g b 0 per texel and converted with F16C
+    void decodeRowRG11B10FAVX2(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(src);
+        const size_t blocked = count & ~size_t(7);
+        const __m256i mask11 = _mm256_set1_epi32(0x7ff);
+        const __m256i mask10 = _mm256_set1_epi32(0x3ff);
+        for (size_t x = 0; x < blocked; x += 8, p += 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            const __m256i r = _mm256_slli_epi32(_mm256_and_si256(v, mask11), 4);
+            const __m256i g = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(v, 11), mask11), 4);
+            const __m256i b = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(v, 22), mask10), 5);
+            const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(g, 16));
+            // texels 0 1 | 4 5 and 2 3 | 6 7
+            const __m256i lo = _mm256_unpacklo_epi32(rg, b);
+            const __m256i hi = _mm256_unpackhi_epi32(rg, b);
+            storeTexels(reinterpret_cast<float*>(dst + x),
+                        halfToFloat8(_mm256_castsi256_si128(lo)), halfToFloat8(_mm256_castsi256_si128(hi)),
+                        halfToFloat8(_mm256_extracti128_si256(lo, 1)), halfToFloat8(_mm256_extracti128_si256(hi, 1)));
+        }
+        decodeRowRG11B10FScalar(p, count - blocked, dst + blocked);
+    }
+
+    void decodeRowRGB9E5AVX2(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(src);
+        const size_t blocked = count & ~size_t(7);
+        const __m256i mask9 = _mm256_set1_epi32(0x1ff);
+        const __m256i bias = _mm256_set1_epi32(127 - 24);
+        for (size_t x = 0; x < blocked; x += 8, p += 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            const __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_srli_epi32(v, 27), bias), 23));
+            const __m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v, mask9)), scale);
+            const __m256 g = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 9), mask9)), scale);
+            const __m256 b = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 18), mask9)), scale);
+            storePlanar(reinterpret_cast<float*>(dst + x), r, g, b);
+        }
+        decodeRowRGB9E5Scalar(p, count - blocked, dst + blocked);
+    }
+
+    // the exponent minus one goes straight to the exponent field of the scale, see the scalar version
+    void decodeRowRGBE8AVX2(const void* src, size_t count, Cubemap::Texel* dst)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(src);
+        const size_t blocked = count & ~size_t(7);
+        const __m256i mask8 = _mm256_set1_epi32(0xff);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256 norm = _mm256_set1_ps(1.0f / 256.0f);
+        for (size_t x = 0; x < blocked; x += 8, p += 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            const __m256i exponent = _mm256_srli_epi32(v, 24);
+            const __m256i scaleBits = _mm256_slli_epi32(_mm256_sub_epi32(exponent, one), 23);
+            const __m256 scale = _mm256_castsi256_ps(_mm256_and_si256(scaleBits, _mm256_cmpgt_epi32(exponent, one)));
+            const __m256 r = _mm256_mul_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v, mask8)), norm), scale);
+            const __m256 g = _mm256_mul_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 8), mask8)), norm), scale);
+            const __m256 b = _mm256_mul_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 16), mask8)), norm), scale);
+            storePlanar(reinterpret_cast<float*>(dst + x), r, g, b);
+        }
+        decodeRowRGBE8Scalar(p, count - blocked, dst + blocked);
+    }
+
+    // two texels per conversion, the loads of a texel read the red of the next one
+    void encodeRowRGBA16FAVX2(const Cubemap::Texel* src, size_t count, void* dst)
+    {
+        const float* p = reinterpret_cast<const float*>(src);
+        uint8_t* q = static_cast<uint8_t*>(dst);
+        const __m128 one = _mm_set1_ps(1.0f);
+        size_t x = 0;
+        for (; x + 2 < count; x += 2, p += 6, q += 16) {
+            const __m128 t0 = _mm_blend_ps(_mm_loadu_ps(p), one, 0x8);
+            const __m128 t1 = _mm_blend_ps(_mm_loadu_ps(p + 3), one, 0x8);
+            const __m128i h = _mm256_cvtps_ph(_mm256_set_m128(t1, t0), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(q), h);
+        }
+        encodeRowRGBA16FScalar(src + x, count - x, q);
+    }
+}
+}
@@ -0,0 +1,181 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <string>
+
+#include "trace.h"
+
+namespace
+{
+    // the pool and worker index of the current thread, if it is a worker
+    thread_local const ibl::ThreadPool* tlsPool = nullptr;
+    thread_local size_t tlsIndex = 0;
+}
+
+namespace ibl
+{
+    ThreadPool::ThreadPool(size_t numThreads)
+        : mNumWorkers((numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency())) - 1)
+    {
+        mQueues.reset(new Queue[std::max(size_t(1), mNumWorkers)]);
+        mWorkers.reserve(mNumWorkers);
+        for (size_t i = 0; i < mNumWorkers; i++) {
+            mWorkers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mSleepLock);
+            mStop = true;
+        }
+        mWakeUp.notify_all();
+        for (auto& worker : mWorkers) {
+            worker.join();
+        }
+    }
+
+    size_t ThreadPool::suggestGrain(size_t count, size_t rangesPerSlot) const
+    {
+        return std::max(size_t(1), count / (getSlotCount() * rangesPerSlot));
+    }
+
+    void ThreadPool::parallelFor(size_t count, size_t grain, const RangeFn& fn)
+    {
+        if (count == 0) {
+            return;
+        }
+
+        grain = std::max(size_t(1), grain);
+        const bool isWorker = (tlsPool == this);
+        const size_t slot = isWorker ? tlsIndex : mNumWorkers;
+        const size_t numTasks = (count + grain - 1) / grain;
+
+        // the tasks are traced under the scope of the caller
+        const char* name = trace::getScopeName();
+        if (!name) {
+            name = "task";
+        }
+
+        if (mNumWorkers == 0 || numTasks == 1) {
+            for (size_t begin = 0; begin < count; begin += grain) {
+                TRACE_SCOPE(name);
+                fn(slot, begin, std::min(count, begin + grain));
+            }
+            return;
+        }
+
+        Job job;
+        job.fn = &fn;
+        job.name = name;
+        job.remaining = numTasks;
+
+        // a worker keeps its tasks local and lets the others steal them,
+        // outside threads spread them over all the queues
+        const size_t numQueues = mNumWorkers;
+        size_t queue = isWorker ? tlsIndex : mNextQueue.fetch_add(1) % numQueues;
+        for (size_t begin = 0; begin < count; begin += grain) {
+            Queue& q = mQueues[queue];
+            {
+                std::lock_guard<std::mutex> lock(q.lock);
+                q.tasks.push_back({&job, begin, std::min(count, begin + grain)});
+            }
+            if (!isWorker) {
+                queue = (queue + 1) % numQueues;
+            }
+        }
+
+        mPending.fetch_add(numTasks);
+        {
+            std::lock_guard<std::mutex> lock(mSleepLock);
+        }
+        mWakeUp.notify_all();
+
+        // help with our own job only, so that the state of the caller's slot is never
+        // touched by an unrelated job while we are waiting
+        Task task;
+        while (job.remaining.load() > 0 && stealTask(slot, task, &job)) {
+            runTask(task, slot);
+        }
+
+        // the remaining tasks are running on other threads
+        std::unique_lock<std::mutex> lock(job.lock);
+        job.done.wait(lock, [&job] { return job.remaining.load() == 0; });
+    }
+
+    void ThreadPool::workerLoop(size_t index)
+    {
+        tlsPool = this;
+        tlsIndex = index;
+        trace::setThreadName("worker " + std::to_string(index + 1));
+
+        Task task;
+        for (;;) {
+            if (popTask(index, task) || stealTask(index, task, nullptr)) {
+                runTask(task, index);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mSleepLock);
+            mWakeUp.wait(lock, [this] { return mStop || mPending.load() > 0; });
+            if (mStop && mPending.load() == 0) {
+                return;
+            }
+        }
+    }
+
+    bool ThreadPool::popTask(size_t index, Task& task)
+    {
+        Queue& q = mQueues[index];
+        std::lock_guard<std::mutex> lock(q.lock);
+        if (q.tasks.empty()) {
+            return false;
+        }
+        task = q.tasks.back();
+        q.tasks.pop_back();
+        mPending.fetch_sub(1);
+        return true;
+    }
+
+    bool ThreadPool::stealTask(size_t thief, Task& task, const Job* job)
+    {
+        const size_t numQueues = mNumWorkers;
+        for (size_t i = 0; i < numQueues; i++) {
+            Queue& q = mQueues[(thief + i) % numQueues];
+            std::lock_guard<std::mutex> lock(q.lock);
+            auto it = q.tasks.begin();
+            if (job) {
+                it = std::find_if(q.tasks.begin(), q.tasks.end(), [job](const Task& t) { return t.job == job; });
+            }
+            if (it != q.tasks.end()) {
+                task = *it;
+                q.tasks.erase(it);
+                mPending.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::runTask(const Task& task, size_t slot)
+    {
+        Job* job = task.job;
+        {
+            TRACE_SCOPE(job->name);
+            (*job->fn)(slot, task.begin, task.end);
+        }
+
+        // the waiting thread may destroy the job as soon as the lock is released
+        std::lock_guard<std::mutex> lock(job->lock);
+        if (job->remaining.fetch_sub(1) == 1) {
+            job->done.notify_all();
+        }
+    }
+
+    ThreadPool& ThreadPool::getDefault()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+}
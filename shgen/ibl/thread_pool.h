@@ -0,0 +1,84 @@
+#ifndef THREADPOOL_H__
+#define THREADPOOL_H__
+
+#include <cstdint>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ibl
+{
+    // Persistent pool of worker threads with one task deque per worker. Idle workers
+    // steal from the other deques, and a thread waiting for its own job helps with it.
+    class ThreadPool
+    {
+    public:
+        // called with the slot of the executing thread and a range of indices
+        using RangeFn = std::function<void(size_t slot, size_t begin, size_t end)>;
+
+        // numThreads includes the calling thread, 0 means one per hardware thread
+        explicit ThreadPool(size_t numThreads = 0);
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool();
+
+        // number of distinct slots passed to a RangeFn, i.e. the size of per-thread state
+        size_t getSlotCount() const { return mNumWorkers + 1; }
+
+        // splits [0, count) into ranges of at most grain indices and blocks until all of them
+        // have been processed. may be called from inside a RangeFn.
+        void parallelFor(size_t count, size_t grain, const RangeFn& fn);
+
+        // a grain that gives every slot several ranges to balance uneven work
+        size_t suggestGrain(size_t count, size_t rangesPerSlot = 8) const;
+
+        static ThreadPool& getDefault();
+
+    private:
+        struct Job
+        {
+            const RangeFn* fn;
+            const char* name;       // of the trace of the tasks
+            std::atomic<size_t> remaining;
+            std::mutex lock;
+            std::condition_variable done;
+        };
+
+        struct Task
+        {
+            Job* job;
+            size_t begin;
+            size_t end;
+        };
+
+        struct alignas(64) Queue
+        {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        void workerLoop(size_t index);
+        bool popTask(size_t index, Task& task);
+        bool stealTask(size_t thief, Task& task, const Job* job);
+        void runTask(const Task& task, size_t slot);
+
+        const size_t mNumWorkers;
+        std::vector<std::thread> mWorkers;
+        std::unique_ptr<Queue[]> mQueues;
+        std::mutex mSleepLock;
+        std::condition_variable mWakeUp;
+        std::atomic<size_t> mPending{0};
+        std::atomic<size_t> mNextQueue{0};
+        bool mStop = false;
+    };
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include "trace.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+    using namespace ibl::trace;
+
+    struct Buffer
+    {
+        std::mutex lock;    // against collect() from another thread
+        ThreadEvents events;
+    };
+
+    std::mutex gBuffersLock;
+    std::vector<std::unique_ptr<Buffer>> gBuffers;
+    std::chrono::steady_clock::time_point gStart;
+
+    thread_local Buffer* tlsBuffer = nullptr;
+    thread_local const char* tlsScope = nullptr;
+
+    Buffer& getBuffer()
+    {
+        if (!tlsBuffer) {
+            std::lock_guard<std::mutex> lock(gBuffersLock);
+            gBuffers.emplace_back(new Buffer);
+            tlsBuffer = gBuffers.back().get();
+            tlsBuffer->events.id = uint32_t(gBuffers.size());
+            tlsBuffer->events.name = "thread " + std::to_string(gBuffers.size());
+        }
+        return *tlsBuffer;
+    }
+
+    uint64_t getTime()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - gStart).count());
+    }
+}
+
+namespace ibl
+{
+namespace trace
+{
+    std::atomic<bool> gEnabled{false};
+
+    void enable()
+    {
+        gStart = std::chrono::steady_clock::now();
+        gEnabled.store(true);
+    }
+
+    void setThreadName(const std::string& name)
+    {
+        if (!isEnabled()) {
+            return;
+        }
+        Buffer& buffer = getBuffer();
+        std::lock_guard<std::mutex> lock(buffer.lock);
+        buffer.events.name = name;
+    }
+
+    const char* getScopeName()
+    {
+        return tlsScope;
+    }
+
+    std::vector<ThreadEvents> collect()
+    {
+        std::vector<ThreadEvents> threads;
+        std::lock_guard<std::mutex> lock(gBuffersLock);
+        for (auto& buffer : gBuffers) {
+            std::lock_guard<std::mutex> bufferLock(buffer->lock);
+            threads.push_back(buffer->events);
+        }
+        return threads;
+    }
+
+    void Scope::begin(const char* name)
+    {
+        mName = name;
+        mParent = tlsScope;
+        tlsScope = name;
+        mBegin = getTime();
+    }
+
+    void Scope::end()
+    {
+        const uint64_t time = getTime();
+        tlsScope = mParent;
+        Buffer& buffer = getBuffer();
+        std::lock_guard<std::mutex> lock(buffer.lock);
+        buffer.events.events.push_back({mName, std::move(mDetail), mBegin, time});
+    }
+}
+}
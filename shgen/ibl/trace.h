@@ -0,0 +1,95 @@
+#ifndef TRACE_H__
+#define TRACE_H__
+
+#include <cstdint>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace ibl
+{
+namespace trace
+{
+    // Timings of the stages of a run and of the tasks of the thread pool. Every thread records
+    // into a buffer of its own, which lives until the end of the process so that it can be
+    // collected after the thread has exited. Nothing is recorded until enable() is called,
+    // a Scope then costs a load of a flag.
+    struct Event
+    {
+        const char* name;       // a literal
+        std::string detail;     // e.g. the file of the stage, may be empty
+        uint64_t begin;         // nanoseconds since enable()
+        uint64_t end;
+    };
+
+    struct ThreadEvents
+    {
+        uint32_t id;            // in the order the threads first recorded
+        std::string name;
+        std::vector<Event> events;
+    };
+
+    extern std::atomic<bool> gEnabled;
+
+    inline bool isEnabled() { return gEnabled.load(std::memory_order_relaxed); }
+
+    void enable();
+
+    // the name of the current thread in the trace, ignored until enable()
+    void setThreadName(const std::string& name);
+
+    // the name of the innermost Scope of the current thread, nullptr if there is none
+    const char* getScopeName();
+
+    // the events recorded so far by every thread
+    std::vector<ThreadEvents> collect();
+
+    // records the time from its construction to its destruction as an event of the current thread
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name)
+        {
+            if (isEnabled()) {
+                begin(name);
+            }
+        }
+
+        Scope(const char* name, const std::string& detail)
+        {
+            if (isEnabled()) {
+                begin(name);
+                mDetail = detail;
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope()
+        {
+            if (mName) {
+                end();
+            }
+        }
+
+    private:
+        void begin(const char* name);
+        void end();
+
+        const char* mName = nullptr;
+        const char* mParent = nullptr;
+        uint64_t mBegin = 0;
+        std::string mDetail;
+    };
+}
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// a Scope until the end of the block
+#define TRACE_SCOPE(...) ibl::trace::Scope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+
+#endif
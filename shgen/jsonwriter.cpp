@@ -0,0 +1,174 @@
+#include "jsonwriter.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace json
+{
+    Writer::Writer()
+    {
+    }
+
+    Writer::Writer(const std::string& path)
+        : mToFile(true)
+    {
+        mFile = fs::openFile(path, fs::FileMode::Create | fs::FileAccess::Write);
+        mFailed = mFile.isInvalid();
+        mBuffer.reserve(BUFFER_SIZE);
+    }
+
+    Writer::~Writer()
+    {
+        close();
+    }
+
+    void Writer::beginArray()
+    {
+        if (mNeedSeparator) {
+            write(", ", 2);
+        }
+        write('[');
+        mNeedSeparator = false;
+    }
+
+    void Writer::endArray()
+    {
+        write(']');
+        mNeedSeparator = true;
+    }
+
+    void Writer::beginObject()
+    {
+        if (mNeedSeparator) {
+            write(", ", 2);
+        }
+        write('{');
+        mNeedSeparator = false;
+    }
+
+    void Writer::endObject()
+    {
+        write('}');
+        mNeedSeparator = true;
+    }
+
+    void Writer::key(const std::string& name)
+    {
+        if (mNeedSeparator) {
+            write(", ", 2);
+        }
+        writeString(name);
+        write(": ", 2);
+        mNeedSeparator = false;
+    }
+
+    void Writer::value(double v)
+    {
+        if (!std::isfinite(v)) {
+            null();
+            return;
+        }
+        char buf[32];
+        const std::to_chars_result r = mDigits > 0
+            ? std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::general, mDigits)
+            : std::to_chars(buf, buf + sizeof(buf), v);
+        writeValue(buf, size_t(r.ptr - buf));
+    }
+
+    void Writer::value(bool v)
+    {
+        writeValue(v ? "true" : "false", v ? 4 : 5);
+    }
+
+    void Writer::value(const char* v)
+    {
+        value(std::string(v));
+    }
+
+    void Writer::value(const std::string& v)
+    {
+        if (mNeedSeparator) {
+            write(", ", 2);
+        }
+        writeString(v);
+        mNeedSeparator = true;
+    }
+
+    void Writer::null()
+    {
+        writeValue("null", 4);
+    }
+
+    void Writer::raw(const std::string& json)
+    {
+        writeValue(json.data(), json.size());
+    }
+
+    bool Writer::close()
+    {
+        if (mToFile && !mFile.isInvalid()) {
+            flush();
+            fs::closeFile(mFile);
+            mFile = fs::FileHandle();
+        }
+        return !mFailed;
+    }
+
+    void Writer::write(const char* s, size_t size)
+    {
+        mBuffer.append(s, size);
+        if (mToFile && mBuffer.size() >= BUFFER_SIZE) {
+            flush();
+        }
+    }
+
+    void Writer::writeValue(const char* s, size_t size)
+    {
+        if (mNeedSeparator) {
+            write(", ", 2);
+        }
+        write(s, size);
+        mNeedSeparator = true;
+    }
+
+    // escaped as json11 does
+    void Writer::writeString(const std::string& s)
+    {
+        write('"');
+        for (size_t i = 0; i < s.size(); i++) {
+            const char c = s[i];
+            switch (c) {
+            case '\\': write("\\\\", 2); break;
+            case '"': write("\\\"", 2); break;
+            case '\b': write("\\b", 2); break;
+            case '\f': write("\\f", 2); break;
+            case '\n': write("\\n", 2); break;
+            case '\r': write("\\r", 2); break;
+            case '\t': write("\\t", 2); break;
+            default:
+                if (uint8_t(c) <= 0x1f) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    write(buf, 6);
+                } else if (uint8_t(c) == 0xe2 && i + 2 < s.size() && uint8_t(s[i + 1]) == 0x80 &&
+                           (uint8_t(s[i + 2]) == 0xa8 || uint8_t(s[i + 2]) == 0xa9)) {
+                    // U+2028 and U+2029 end lines in JavaScript
+                    write(uint8_t(s[i + 2]) == 0xa8 ? "\\u2028" : "\\u2029", 6);
+                    i += 2;
+                } else {
+                    write(c);
+                }
+                break;
+            }
+        }
+        write('"');
+    }
+
+    void Writer::flush()
+    {
+        if (!mFailed && !mBuffer.empty() && fs::writeFile(mFile, mBuffer.data(), mBuffer.size()) != mBuffer.size()) {
+            mFailed = true;
+        }
+        mBuffer.clear();
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef JSONWRITER_H__
+#define JSONWRITER_H__
+#pragma once
+
+#include <cstdint>
+
+#include <charconv>
+#include <string>
+#include <type_traits>
+
+#include "fsutil.h"
+
+namespace json
+{
+    // Writes JSON as it is given, without building a tree, into a file through a buffer or
+    // into a string. The separators are those of json11::Json::dump(). Doubles are written
+    // with the fewest digits that read back the same value, or with a fixed number of
+    // significant digits, and those that are not finite as null as json11 does.
+    class Writer
+    {
+    public:
+        static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+        // into a string, see getString()
+        Writer();
+
+        // into the file at path, created or truncated. see isValid()
+        explicit Writer(const std::string& path);
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        // closes the file
+        ~Writer();
+
+        // false if the file could not be opened or written
+        bool isValid() const { return !mFailed; }
+
+        // significant digits of the doubles, 0 for the shortest round trip
+        void setPrecision(int digits) { mDigits = digits; }
+
+        void beginArray();
+        void endArray();
+        void beginObject();
+        void endObject();
+
+        // the name of the next value of an object
+        void key(const std::string& name);
+
+        void value(double v);
+        void value(bool v);
+        void value(const char* v);
+        void value(const std::string& v);
+        void null();
+
+        template <typename T, typename = std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value>>
+        void value(T v)
+        {
+            char buf[24];
+            const std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), v);
+            writeValue(buf, size_t(r.ptr - buf));
+        }
+
+        // a value serialized elsewhere, e.g. by json11
+        void raw(const std::string& json);
+
+        // the values of v as an array
+        template <typename T>
+        void array(const T* v, size_t count)
+        {
+            beginArray();
+            for (size_t i = 0; i < count; i++) {
+                value(v[i]);
+            }
+            endArray();
+        }
+
+        // writes out what is buffered and closes the file, false if anything failed
+        bool close();
+
+        // what was written into a string
+        const std::string& getString() const { return mBuffer; }
+
+    private:
+        void write(const char* s, size_t size);
+        void write(char c) { write(&c, 1); }
+        void writeValue(const char* s, size_t size);
+        void writeString(const std::string& s);
+        void flush();
+
+        fs::FileHandle mFile;
+        bool mToFile = false;
+        bool mFailed = false;
+        bool mNeedSeparator = false;    // a value was written at the current level
+        int mDigits = 0;
+        std::string mBuffer;
+    };
+}
+
+#endif
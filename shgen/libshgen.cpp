@@ -0,0 +1,158 @@
+#include "libshgen.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <new>
+
+#include "ibl/spherical_harmonics.h"
+
+struct shgen_context
+{
+    explicit shgen_context(unsigned numThreads) : pool(numThreads), projection(pool) {}
+
+    ibl::ThreadPool pool;
+    ibl::ProjectionContext projection;
+};
+
+namespace
+{
+    static_assert(sizeof(ibl::math::double3) == 3 * sizeof(double), "the coefficients are written as triples");
+
+    // faces of shgen_cubemap in the order of Direct3D
+    const ibl::Cubemap::Face faces[6] = {
+        ibl::Cubemap::Face::PX, ibl::Cubemap::Face::NX,
+        ibl::Cubemap::Face::PY, ibl::Cubemap::Face::NY,
+        ibl::Cubemap::Face::PZ, ibl::Cubemap::Face::NZ,
+    };
+
+    bool isValid(const shgen_options* options)
+    {
+        return options && options->order >= 1 && options->order <= ibl::sh::MAX_ORDER &&
+               (options->quantity == SHGEN_IRRADIANCE || options->quantity == SHGEN_RADIANCE);
+    }
+
+    bool isValid(const shgen_image& image)
+    {
+        return image.pixels && image.width && image.height &&
+               (!image.bytes_per_row || image.bytes_per_row >= image.width * 3 * sizeof(float));
+    }
+
+    // the pixels are read in place, the image never writes to them
+    ibl::Image wrapImage(const shgen_image& image)
+    {
+        return ibl::Image(const_cast<float*>(image.pixels), image.width, image.height, image.bytes_per_row);
+    }
+
+    template <typename P>
+    void projectAs(shgen_context* context, const ibl::Cubemap& cm, const shgen_options& options, double* coefs)
+    {
+        ibl::math::double3* sh = reinterpret_cast<ibl::math::double3*>(coefs);
+        if (options.quantity == SHGEN_RADIANCE) {
+            context->projection.computeRadianceSH<P>(cm, options.order, sh);
+        } else {
+            context->projection.computeIrradianceSH<P>(cm, options.order, sh);
+        }
+    }
+
+    template <typename P>
+    void projectAs(shgen_context* context, const ibl::Image& image, const shgen_options& options, double* coefs)
+    {
+        ibl::math::double3* sh = reinterpret_cast<ibl::math::double3*>(coefs);
+        if (options.quantity == SHGEN_RADIANCE) {
+            context->projection.computeRadianceSHLatLong<P>(image, options.order, sh);
+        } else {
+            context->projection.computeIrradianceSHLatLong<P>(image, options.order, sh);
+        }
+    }
+
+    template <typename Source>
+    shgen_status project(shgen_context* context, const Source& source, const shgen_options& options, double* coefs)
+    {
+        try {
+            switch (options.precision) {
+            case SHGEN_PRECISION_DOUBLE:
+                projectAs<ibl::precision::Double>(context, source, options, coefs);
+                return SHGEN_OK;
+            case SHGEN_PRECISION_KAHAN:
+                projectAs<ibl::precision::FloatKahan>(context, source, options, coefs);
+                return SHGEN_OK;
+            case SHGEN_PRECISION_PAIRWISE:
+                projectAs<ibl::precision::FloatPairwise>(context, source, options, coefs);
+                return SHGEN_OK;
+            }
+        } catch (const std::bad_alloc&) {
+            return SHGEN_OUT_OF_MEMORY;
+        } catch (...) {
+            // nothing may unwind through the C interface
+            return SHGEN_INTERNAL_ERROR;
+        }
+        return SHGEN_INVALID_ARGUMENT;
+    }
+}
+
+extern "C"
+{
+    size_t shgen_coef_count(unsigned order)
+    {
+        return ibl::sh::getCoefCount(order);
+    }
+
+    shgen_context* shgen_create_context(unsigned num_threads)
+    {
+        try {
+            return new shgen_context(num_threads);
+        } catch (...) {
+            return nullptr;
+        }
+    }
+
+    void shgen_destroy_context(shgen_context* context)
+    {
+        delete context;
+    }
+
+    shgen_status shgen_project_cubemap(shgen_context* context, const shgen_cubemap* cubemap,
+                                       const shgen_options* options, double* coefs)
+    {
+        if (!context || !cubemap || !coefs || !isValid(options)) {
+            return SHGEN_INVALID_ARGUMENT;
+        }
+        const size_t dim = cubemap->faces[0].width;
+        for (const shgen_image& face : cubemap->faces) {
+            if (!isValid(face) || face.width != dim || face.height != dim) {
+                return SHGEN_INVALID_ARGUMENT;
+            }
+        }
+
+        ibl::Cubemap cm(dim);
+        for (size_t item = 0; item < 6; item++) {
+            cm.setImageForFace(faces[item], wrapImage(cubemap->faces[item]));
+        }
+        return project(context, cm, *options, coefs);
+    }
+
+    shgen_status shgen_project_latlong(shgen_context* context, const shgen_image* image,
+                                       const shgen_options* options, double* coefs)
+    {
+        if (!context || !image || !coefs || !isValid(options) || !isValid(*image)) {
+            return SHGEN_INVALID_ARGUMENT;
+        }
+        return project(context, wrapImage(*image), *options, coefs);
+    }
+
+    shgen_status shgen_irradiance_matrices(const double* coefs, unsigned order, double* matrices)
+    {
+        if (!coefs || !matrices || order < 2 || order > ibl::sh::MAX_ORDER) {
+            return SHGEN_INVALID_ARGUMENT;
+        }
+        const ibl::math::double3* sh = reinterpret_cast<const ibl::math::double3*>(coefs);
+        ibl::math::double3 preScaled[9];
+        std::copy(sh, sh + 9, preScaled);
+        ibl::preScaleSH3Bands(preScaled);
+
+        const ibl::IrradianceMatrices m = ibl::computeIrradianceMatrices(preScaled);
+        std::memcpy(matrices, m.M, sizeof(m.M));
+        return SHGEN_OK;
+    }
+}
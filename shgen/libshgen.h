@@ -0,0 +1,131 @@
+#ifndef LIBSHGEN_H__
+#define LIBSHGEN_H__
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Projection of environment maps to spherical harmonics inside the calling process.
+ *
+ * A context owns the worker threads, the projection kernels of the last sizes it saw and
+ * the per-thread buffers, so that projecting a capture of the same size every frame
+ * allocates nothing once warm. The pixels are read where the caller keeps them and the
+ * coefficients are written to memory of the caller. A context is used by one thread at a
+ * time, several contexts may be used at the same time.
+ */
+typedef struct shgen_context shgen_context;
+
+typedef enum shgen_status
+{
+    SHGEN_OK = 0,
+    SHGEN_INVALID_ARGUMENT,     /* a null pointer, an order out of range or inconsistent sizes */
+    SHGEN_OUT_OF_MEMORY,
+    SHGEN_INTERNAL_ERROR,       /* any other failure, e.g. the threads could not be started */
+} shgen_status;
+
+typedef enum shgen_precision
+{
+    SHGEN_PRECISION_DOUBLE = 0,
+    SHGEN_PRECISION_KAHAN,      /* float, compensated summation */
+    SHGEN_PRECISION_PAIRWISE,   /* float, tiled summation */
+} shgen_precision;
+
+typedef enum shgen_quantity
+{
+    SHGEN_IRRADIANCE = 0,       /* the radiance convolved with the clamped cosine lobe, divided by pi */
+    SHGEN_RADIANCE,
+} shgen_quantity;
+
+/* width x height texels of 3 floats r g b, rows bytes_per_row apart, packed if 0 */
+typedef struct shgen_image
+{
+    const float* pixels;
+    size_t width;
+    size_t height;
+    size_t bytes_per_row;
+} shgen_image;
+
+/* square faces in the order +X, -X, +Y, -Y, +Z, -Z of Direct3D, the same size each */
+typedef struct shgen_cubemap
+{
+    shgen_image faces[6];
+} shgen_cubemap;
+
+typedef struct shgen_options
+{
+    unsigned order;             /* bands 0..order, 1..8 */
+    shgen_precision precision;
+    shgen_quantity quantity;
+} shgen_options;
+
+/* number of coefficients of bands 0..order, i.e. (order + 1)^2 */
+size_t shgen_coef_count(unsigned order);
+
+/* num_threads includes the calling thread, 0 means one per hardware thread. null if out of memory. */
+shgen_context* shgen_create_context(unsigned num_threads);
+
+void shgen_destroy_context(shgen_context* context);
+
+/*
+ * The coefficients of bands 0..order of the orthonormal real spherical harmonics, (l, m) at
+ * index l * (l + 1) + m, written to coefs as shgen_coef_count(order) triples r g b.
+ */
+shgen_status shgen_project_cubemap(shgen_context* context, const shgen_cubemap* cubemap,
+                                   const shgen_options* options, double* coefs);
+
+/*
+ * Same for an equirectangular image, the top row faces +Y and the middle column +Z.
+ */
+shgen_status shgen_project_latlong(shgen_context* context, const shgen_image* image,
+                                   const shgen_options* options, double* coefs);
+
+/*
+ * The irradiance of bands 0..2 as 4x4 symmetric matrices M per channel r g b, so that the
+ * irradiance towards the unit normal n is (n, 1)^T M (n, 1), rows and columns in the order
+ * x y z 1. coefs are the irradiance coefficients of bands 0..order written by the functions
+ * above, order 2 or more, the bands above 2 are ignored. matrices receives 3 * 16 doubles,
+ * [channel][row][column].
+ */
+shgen_status shgen_irradiance_matrices(const double* coefs, unsigned order, double* matrices);
+
+#ifdef __cplusplus
+}
+
+namespace shgen
+{
+    // owns a shgen_context
+    class Context
+    {
+    public:
+        explicit Context(unsigned numThreads = 0) : mContext(shgen_create_context(numThreads)) {}
+
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+        ~Context() { shgen_destroy_context(mContext); }
+
+        bool isValid() const { return mContext != nullptr; }
+
+        shgen_status projectCubemap(const shgen_cubemap& cubemap, const shgen_options& options, double* coefs)
+        {
+            return shgen_project_cubemap(mContext, &cubemap, &options, coefs);
+        }
+
+        shgen_status projectLatLong(const shgen_image& image, const shgen_options& options, double* coefs)
+        {
+            return shgen_project_latlong(mContext, &image, &options, coefs);
+        }
+
+        shgen_context* get() const { return mContext; }
+
+    private:
+        shgen_context* mContext;
+    };
+}
+#endif
+
+#endif
@@ -0,0 +1,117 @@
+#include "pfm.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "ibl/trace.h"
+#include "fsutil.h"
+
+namespace
+{
+    // the header is three tokens after the magic, this is plenty
+    const size_t MAX_HEADER_SIZE = 128;
+
+    inline bool isLittleEndian()
+    {
+        const uint16_t one = 1;
+        uint8_t first;
+        std::memcpy(&first, &one, 1);
+        return first == 1;
+    }
+
+    inline uint32_t swapBytes(uint32_t v)
+    {
+        return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+    }
+
+    // the next token of the header as a number, skipping the whitespace before it
+    bool readNumber(const char*& s, double& value)
+    {
+        while (std::isspace(uint8_t(*s))) {
+            s++;
+        }
+        char* next = nullptr;
+        value = std::strtod(s, &next);
+        if (next == s) {
+            return false;
+        }
+        s = next;
+        return true;
+    }
+}
+
+namespace pfm
+{
+    bool load(const std::string& path, ibl::Image& image)
+    {
+        TRACE_SCOPE("load pfm", path);
+        fs::FileHandle handle = fs::openFile(path, fs::FileMode::Open | fs::FileAccess::Read | fs::FileShare::Read);
+        if (handle.isInvalid()) {
+            return false;
+        }
+
+        char header[MAX_HEADER_SIZE + 1] = {};
+        const size_t headerSize = fs::readFile(handle, header, MAX_HEADER_SIZE);
+
+        // PF or Pf, then the width, the height and the scale, whose sign is the byte order.
+        // a single whitespace separates the header from the rows.
+        size_t channels = 0;
+        if (headerSize >= 3 && header[0] == 'P' && (header[1] == 'F' || header[1] == 'f')) {
+            channels = header[1] == 'F' ? 3 : 1;
+        }
+        const char* s = header + 2;
+        double width = 0;
+        double height = 0;
+        double scale = 0;
+        if (!channels || !readNumber(s, width) || !readNumber(s, height) || !readNumber(s, scale) ||
+            width < 1 || height < 1 || scale == 0 || !std::isspace(uint8_t(*s)))
+        {
+            fs::closeFile(handle);
+            return false;
+        }
+        const size_t dataOffset = size_t(s + 1 - header);
+
+        // the rows have to be in the file before the image is allocated. the dimensions are
+        // compared as doubles, so that huge ones are rejected before they are converted.
+        const size_t fileSize = fs::fileSize(handle);
+        if (fileSize < dataOffset || width * height * double(channels * sizeof(float)) > double(fileSize - dataOffset)) {
+            fs::closeFile(handle);
+            return false;
+        }
+
+        const size_t w = size_t(width);
+        const size_t h = size_t(height);
+        const bool swap = (scale < 0) != isLittleEndian();
+        const size_t rowBytes = w * channels * sizeof(float);
+
+        ibl::Image decoded(w, h);
+        std::vector<uint32_t> row(w * channels);
+        bool ok = fs::seekFile(handle, int64_t(dataOffset), fs::FileSeek::Begin) == dataOffset;
+
+        // the rows are stored from the bottom up
+        for (size_t y = 0; y < h && ok; y++) {
+            ok = fs::readFile(handle, row.data(), rowBytes) == rowBytes;
+            if (swap) {
+                for (uint32_t& v : row) {
+                    v = swapBytes(v);
+                }
+            }
+            float* dst = static_cast<float*>(decoded.getPixelRef(0, h - 1 - y));
+            if (channels == 3) {
+                std::memcpy(dst, row.data(), rowBytes);
+            } else {
+                for (size_t x = 0; x < w; x++) {
+                    std::memcpy(dst + x * 3, &row[x], sizeof(float));
+                    dst[x * 3 + 1] = dst[x * 3 + 2] = dst[x * 3];
+                }
+            }
+        }
+        fs::closeFile(handle);
+        if (ok) {
+            image = std::move(decoded);
+        }
+        return ok;
+    }
+}
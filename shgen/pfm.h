@@ -0,0 +1,15 @@
+#ifndef PFM_H__
+#define PFM_H__
+#pragma once
+
+#include <string>
+
+#include "ibl/image.h"
+
+namespace pfm
+{
+    // reads a portable float map, color (PF) or grayscale (Pf), with the first row at the top
+    bool load(const std::string& path, ibl::Image& image);
+}
+
+#endif
@@ -0,0 +1,159 @@
+#include "serve.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <system_error>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace serve
+{
+    Channel::Channel(FILE* in, FILE* out, bool owned)
+        : mIn(in), mOut(out), mOwned(owned)
+    {
+    }
+
+    Channel::~Channel()
+    {
+        if (mOwned) {
+            fclose(mIn);
+            fclose(mOut);
+        }
+    }
+
+    bool Channel::readLine(std::string& line)
+    {
+        line.clear();
+        char buf[4096];
+        while (fgets(buf, sizeof(buf), mIn)) {
+            line += buf;
+            if (line.back() == '\n') {
+                line.pop_back();
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                return true;
+            }
+        }
+        // the last line may have no end of line
+        return !line.empty();
+    }
+
+    bool Channel::writeLine(const std::string& line)
+    {
+        std::lock_guard<std::mutex> lock(mWriteLock);
+        return fputs(line.c_str(), mOut) >= 0 && fputc('\n', mOut) != EOF && fflush(mOut) == 0;
+    }
+
+#ifdef _WIN32
+    bool listen(const std::string&, const ConnectionFn&)
+    {
+        return false;
+    }
+#else
+    // the clients served at the same time, the next ones wait in the backlog of the socket
+    constexpr size_t MAX_CONNECTIONS = 64;
+
+    // the connections still open, waited on before accepting one more
+    struct Connections
+    {
+        std::mutex lock;
+        std::condition_variable closed;
+        size_t count = 0;
+    };
+
+    bool listen(const std::string& path, const ConnectionFn& onConnection)
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            return false;
+        }
+        path.copy(addr.sun_path, path.size());
+
+        const int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server < 0) {
+            return false;
+        }
+        ::unlink(path.c_str());
+        if (::bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(server, SOMAXCONN) != 0) {
+            ::close(server);
+            return false;
+        }
+
+        // a client that goes away must not take the server with it
+        ::signal(SIGPIPE, SIG_IGN);
+
+        std::shared_ptr<Connections> connections = std::make_shared<Connections>();
+        std::chrono::milliseconds backoff(0);
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(connections->lock);
+                connections->closed.wait(lock, [&] { return connections->count < MAX_CONNECTIONS; });
+            }
+
+            const int client = ::accept(server, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO) {
+                    continue;
+                }
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                    // out of descriptors or memory until some connections close, retrying at
+                    // once would only spin
+                    backoff = std::min(std::max(backoff * 2, std::chrono::milliseconds(10)), std::chrono::milliseconds(1000));
+                    std::this_thread::sleep_for(backoff);
+                    continue;
+                }
+                ::close(server);
+                return false;
+            }
+            backoff = std::chrono::milliseconds(0);
+
+            // the reading and the writing stream each own a descriptor of the connection
+            const int writer = ::dup(client);
+            FILE* in = ::fdopen(client, "r");
+            FILE* out = writer >= 0 ? ::fdopen(writer, "w") : nullptr;
+            if (!in || !out) {
+                if (in) {
+                    fclose(in);
+                } else {
+                    ::close(client);
+                }
+                if (out) {
+                    fclose(out);
+                } else if (writer >= 0) {
+                    ::close(writer);
+                }
+                continue;
+            }
+            std::shared_ptr<Channel> channel = std::make_shared<Channel>(in, out, true);
+            {
+                std::lock_guard<std::mutex> lock(connections->lock);
+                connections->count++;
+            }
+            try {
+                std::thread([onConnection, channel, connections]() mutable {
+                    onConnection(std::move(channel));
+                    {
+                        std::lock_guard<std::mutex> lock(connections->lock);
+                        connections->count--;
+                    }
+                    connections->closed.notify_one();
+                }).detach();
+            } catch (const std::system_error&) {
+                // no thread for the client, it is dropped with the channel
+                std::lock_guard<std::mutex> lock(connections->lock);
+                connections->count--;
+            }
+        }
+    }
+#endif
+}
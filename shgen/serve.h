@@ -0,0 +1,49 @@
+#ifndef SERVE_H__
+#define SERVE_H__
+#pragma once
+
+#include <cstdio>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace serve
+{
+    // A line oriented, two way stream, the standard input and output or a client of a socket.
+    // Lines are read by one thread and may be written by several.
+    class Channel
+    {
+    public:
+        // owned streams are closed with the channel
+        Channel(FILE* in, FILE* out, bool owned);
+
+        Channel(const Channel&) = delete;
+        Channel& operator=(const Channel&) = delete;
+
+        ~Channel();
+
+        // the next line without its end of line, false at the end of the stream
+        bool readLine(std::string& line);
+
+        // writes line and an end of line and flushes them, false if the stream is closed
+        bool writeLine(const std::string& line);
+
+    private:
+        FILE* mIn;
+        FILE* mOut;
+        bool mOwned;
+        std::mutex mWriteLock;
+    };
+
+    using ConnectionFn = std::function<void(std::shared_ptr<Channel> channel)>;
+
+    // listens on a Unix domain socket at path, replacing a stale one, and calls onConnection
+    // in a thread of its own for every client, up to 64 clients at a time. returns false if
+    // the socket cannot be created or fails for good, does not return otherwise. not
+    // supported on Windows.
+    bool listen(const std::string& path, const ConnectionFn& onConnection);
+}
+
+#endif
@@ -0,0 +1,305 @@
+#include "shb.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ibl/texel_format.h"
+#include "fsutil.h"
+#include "hash.h"
+
+namespace
+{
+    inline size_t alignTo16(size_t size)
+    {
+        return (size + 15) & ~size_t(15);
+    }
+
+    // returns the end of the value
+    uint8_t* encodeValue(shb::Format format, double value, uint8_t* dst)
+    {
+        if (format == shb::Format::Float16) {
+            const uint16_t half = ibl::floatToHalf(float(value));
+            std::memcpy(dst, &half, sizeof(half));
+            return dst + sizeof(half);
+        }
+        const float single = float(value);
+        std::memcpy(dst, &single, sizeof(single));
+        return dst + sizeof(single);
+    }
+
+    void encodeValues(shb::Format format, const ibl::math::double3* sh, size_t numCoefs, uint8_t* dst)
+    {
+        for (size_t k = 0; k < numCoefs; k++) {
+            for (size_t ch = 0; ch < 3; ch++) {
+                dst = encodeValue(format, sh[k][ch], dst);
+            }
+        }
+    }
+
+    void decodeValues(shb::Format format, const uint8_t* src, size_t numCoefs, ibl::math::double3* sh)
+    {
+        for (size_t k = 0; k < numCoefs; k++) {
+            for (size_t ch = 0; ch < 3; ch++) {
+                if (format == shb::Format::Float16) {
+                    uint16_t half;
+                    std::memcpy(&half, src, sizeof(half));
+                    sh[k][ch] = ibl::halfToFloat(half);
+                    src += sizeof(half);
+                } else {
+                    float value;
+                    std::memcpy(&value, src, sizeof(value));
+                    sh[k][ch] = value;
+                    src += sizeof(value);
+                }
+            }
+        }
+    }
+
+    bool writeAll(const std::string& path, const void* data, size_t size)
+    {
+        fs::FileHandle handle = fs::openFile(path, fs::FileMode::Create | fs::FileAccess::Write);
+        if (handle.isInvalid()) {
+            return false;
+        }
+        const bool ok = fs::writeFile(handle, data, size) == size;
+        fs::closeFile(handle);
+        return ok;
+    }
+}
+
+namespace shb
+{
+    size_t getBytesPerValue(Format format)
+    {
+        return format == Format::Float16 ? sizeof(uint16_t) : sizeof(float);
+    }
+
+    std::vector<uint8_t> encode(size_t order, uint8_t flags, Format format, const ibl::math::double3* sh)
+    {
+        const size_t numCoefs = (order + 1) * (order + 1);
+
+        Header header = {};
+        header.magic = SHB_MAGIC;
+        header.version = VERSION;
+        header.format = uint8_t(format);
+        header.flags = flags;
+        header.order = uint16_t(order);
+        header.numCoefs = uint16_t(numCoefs);
+
+        std::vector<uint8_t> data(sizeof(header) + numCoefs * 3 * getBytesPerValue(format));
+        std::memcpy(data.data(), &header, sizeof(header));
+        encodeValues(format, sh, numCoefs, data.data() + sizeof(header));
+        return data;
+    }
+
+    bool decode(const void* data, size_t size, Header& header, std::vector<ibl::math::double3>& sh)
+    {
+        if (size < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (header.magic != SHB_MAGIC || header.version != VERSION || header.format > uint8_t(Format::Float16) ||
+            header.numCoefs != (header.order + 1) * (header.order + 1) ||
+            size < sizeof(header) + header.numCoefs * 3 * getBytesPerValue(Format(header.format)))
+        {
+            return false;
+        }
+        sh.resize(header.numCoefs);
+        decodeValues(Format(header.format), static_cast<const uint8_t*>(data) + sizeof(header), header.numCoefs, sh.data());
+        return true;
+    }
+
+    bool save(const std::string& path, size_t order, uint8_t flags, Format format, const ibl::math::double3* sh)
+    {
+        const std::vector<uint8_t> data = encode(order, flags, format, sh);
+        return writeAll(path, data.data(), data.size());
+    }
+
+    ArchiveWriter::ArchiveWriter(size_t order, uint8_t flags, Format format)
+        : mOrder(order)
+        , mFlags(flags)
+        , mFormat(format)
+    {
+    }
+
+    void ArchiveWriter::add(const std::string& name, const ibl::math::double3* sh)
+    {
+        const size_t numCoefs = (mOrder + 1) * (mOrder + 1);
+        std::vector<uint8_t> values(numCoefs * 3 * getBytesPerValue(mFormat));
+        encodeValues(mFormat, sh, numCoefs, values.data());
+        mProbes.emplace_back(name, std::move(values));
+    }
+
+    bool ArchiveWriter::save(const std::string& path)
+    {
+        std::sort(mProbes.begin(), mProbes.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        const size_t numCoefs = (mOrder + 1) * (mOrder + 1);
+        const size_t stride = alignTo16(numCoefs * 3 * getBytesPerValue(mFormat));
+
+        std::string names;
+        std::vector<IndexEntry> index(mProbes.size());
+        for (size_t i = 0; i < mProbes.size(); i++) {
+            const std::string& name = mProbes[i].first;
+            index[i].nameHash = hash::xxh64(name.data(), name.size());
+            index[i].nameOffset = uint32_t(names.size());
+            index[i].nameLength = uint32_t(name.size());
+            index[i].probe = uint32_t(i);
+            index[i].reserved = 0;
+            names += name;
+        }
+        std::sort(index.begin(), index.end(), [](const IndexEntry& a, const IndexEntry& b) {
+            return a.nameHash < b.nameHash || (a.nameHash == b.nameHash && a.probe < b.probe);
+        });
+
+        ArchiveHeader header = {};
+        header.magic = ARCHIVE_MAGIC;
+        header.version = VERSION;
+        header.format = uint8_t(mFormat);
+        header.flags = mFlags;
+        header.order = uint16_t(mOrder);
+        header.numCoefs = uint16_t(numCoefs);
+        header.probeCount = uint32_t(mProbes.size());
+        header.probeStride = uint32_t(stride);
+        header.indexOffset = sizeof(header);
+        header.namesOffset = header.indexOffset + index.size() * sizeof(IndexEntry);
+        header.dataOffset = alignTo16(header.namesOffset + names.size());
+
+        std::vector<uint8_t> data(header.dataOffset + mProbes.size() * stride);
+        std::memcpy(data.data(), &header, sizeof(header));
+        if (!index.empty()) {
+            std::memcpy(data.data() + header.indexOffset, index.data(), index.size() * sizeof(IndexEntry));
+        }
+        std::memcpy(data.data() + header.namesOffset, names.data(), names.size());
+        for (size_t i = 0; i < mProbes.size(); i++) {
+            const std::vector<uint8_t>& values = mProbes[i].second;
+            std::memcpy(data.data() + header.dataOffset + i * stride, values.data(), values.size());
+        }
+        return writeAll(path, data.data(), data.size());
+    }
+
+    bool parseArchive(const void* data, size_t size, ArchiveView& view)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        if (size < sizeof(ArchiveHeader)) {
+            return false;
+        }
+        const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(bytes);
+        if (header->magic != ARCHIVE_MAGIC || header->version != VERSION || header->format > uint8_t(Format::Float16) ||
+            header->numCoefs != (header->order + 1) * (header->order + 1) ||
+            header->probeStride < header->numCoefs * 3 * getBytesPerValue(Format(header->format)))
+        {
+            return false;
+        }
+
+        // the parts follow each other inside the file, every difference is taken after the
+        // order is known so that nothing wraps
+        if (header->indexOffset < sizeof(ArchiveHeader) || header->indexOffset % alignof(IndexEntry) != 0 ||
+            header->indexOffset > header->namesOffset || header->namesOffset > header->dataOffset ||
+            header->dataOffset > size ||
+            uint64_t(header->probeCount) * sizeof(IndexEntry) > header->namesOffset - header->indexOffset ||
+            uint64_t(header->probeCount) * header->probeStride > size - header->dataOffset)
+        {
+            return false;
+        }
+
+        // the names and the probes of the index, findProbe() relies on them
+        const IndexEntry* index = reinterpret_cast<const IndexEntry*>(bytes + header->indexOffset);
+        const uint64_t namesSize = header->dataOffset - header->namesOffset;
+        for (uint32_t i = 0; i < header->probeCount; i++) {
+            if (index[i].probe >= header->probeCount ||
+                uint64_t(index[i].nameOffset) + index[i].nameLength > namesSize)
+            {
+                return false;
+            }
+        }
+
+        view.header = header;
+        view.index = index;
+        view.names = reinterpret_cast<const char*>(bytes + header->namesOffset);
+        view.data = bytes + header->dataOffset;
+        return true;
+    }
+
+    uint32_t findProbe(const ArchiveView& view, const std::string& name)
+    {
+        const uint64_t nameHash = hash::xxh64(name.data(), name.size());
+        const IndexEntry* end = view.index + view.header->probeCount;
+        const IndexEntry* it = std::lower_bound(view.index, end, nameHash, [](const IndexEntry& e, uint64_t h) {
+            return e.nameHash < h;
+        });
+        for (; it != end && it->nameHash == nameHash; ++it) {
+            if (it->nameLength == name.size() && std::memcmp(view.names + it->nameOffset, name.data(), name.size()) == 0) {
+                return it->probe;
+            }
+        }
+        return view.header->probeCount;
+    }
+
+    VolumeWriter::VolumeWriter(size_t order, uint8_t flags, Format format, size_t width, size_t height, size_t depth)
+        : mNumCoefs((order + 1) * (order + 1))
+        , mFormat(format)
+        , mProbeCount(width * height * depth)
+        , mPlaneStride(alignTo16(width * height * depth * 4 * getBytesPerValue(format)))
+    {
+        VolumeHeader header = {};
+        header.magic = VOLUME_MAGIC;
+        header.version = VERSION;
+        header.format = uint8_t(format);
+        header.flags = flags;
+        header.order = uint16_t(order);
+        header.numCoefs = uint16_t(mNumCoefs);
+        header.width = uint32_t(width);
+        header.height = uint32_t(height);
+        header.depth = uint32_t(depth);
+        header.planeStride = mPlaneStride;
+        header.dataOffset = alignTo16(sizeof(header));
+
+        mData.resize(header.dataOffset + mNumCoefs * mPlaneStride);
+        std::memcpy(mData.data(), &header, sizeof(header));
+    }
+
+    void VolumeWriter::set(size_t probe, const ibl::math::double3* sh)
+    {
+        const size_t texelBytes = 4 * getBytesPerValue(mFormat);
+        uint8_t* texel = mData.data() + alignTo16(sizeof(VolumeHeader)) + probe * texelBytes;
+        for (size_t k = 0; k < mNumCoefs; k++, texel += mPlaneStride) {
+            uint8_t* dst = texel;
+            for (size_t ch = 0; ch < 3; ch++) {
+                dst = encodeValue(mFormat, sh[k][ch], dst);
+            }
+        }
+    }
+
+    bool VolumeWriter::save(const std::string& path) const
+    {
+        return writeAll(path, mData.data(), mData.size());
+    }
+
+    bool parseVolume(const void* data, size_t size, VolumeView& view)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        if (size < sizeof(VolumeHeader)) {
+            return false;
+        }
+        const VolumeHeader* header = reinterpret_cast<const VolumeHeader*>(bytes);
+        if (header->magic != VOLUME_MAGIC || header->version != VERSION || header->format > uint8_t(Format::Float16) ||
+            header->numCoefs != (header->order + 1) * (header->order + 1))
+        {
+            return false;
+        }
+
+        // the sizes are compared by division, the products of the header may wrap
+        const uint64_t probeSize = 4 * getBytesPerValue(Format(header->format));
+        const uint64_t probesPerSlice = uint64_t(header->width) * header->height;
+        if ((probesPerSlice != 0 && header->depth > header->planeStride / probeSize / probesPerSlice) ||
+            header->dataOffset < sizeof(VolumeHeader) || header->dataOffset > size ||
+            header->planeStride > (size - header->dataOffset) / header->numCoefs)
+        {
+            return false;
+        }
+        view.header = header;
+        view.data = bytes + header->dataOffset;
+        return true;
+    }
+}
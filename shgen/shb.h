@@ -0,0 +1,190 @@
+#ifndef SHB_H__
+#define SHB_H__
+#pragma once
+
+#include <cstdint>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ibl/vec3.h"
+
+// Binary files of spherical harmonics coefficients, little endian.
+//
+// A .shb file is a Header followed by the numCoefs triples r g b of the coefficients.
+//
+// An archive holds the coefficients of many probes of the same layout. The ArchiveHeader is
+// followed by the index, the names and the coefficients. The coefficients of probe i are at
+// dataOffset + i * probeStride, so a mapped archive is addressed without parsing. The index
+// is sorted by the hash of the names to find a probe by name with a binary search.
+//
+// A volume holds the coefficients of a grid of probes as planes, one per coefficient. The
+// VolumeHeader is followed by numCoefs planes at dataOffset + k * planeStride, plane k holds
+// r g b 0 of coefficient k for every probe, x first then y then z. A plane is the texels of
+// a 3D texture of width x height x depth in R32G32B32A32 or R16G16B16A16 and is uploaded as is.
+namespace shb
+{
+    const uint32_t SHB_MAGIC = 0x31424853;       // "SHB1"
+    const uint32_t ARCHIVE_MAGIC = 0x31414853;   // "SHA1"
+    const uint32_t VOLUME_MAGIC = 0x31564853;    // "SHV1"
+    const uint16_t VERSION = 1;
+
+    enum class Format : uint8_t
+    {
+        Float32 = 0,
+        Float16,        // IEEE half
+    };
+
+    enum Flags : uint8_t
+    {
+        PRE_SCALED = 1,     // bands 0..2 pre-scaled as ibl::computeIrradianceSH3Bands() does
+    };
+
+    struct Header
+    {
+        uint32_t magic;         // SHB_MAGIC
+        uint16_t version;
+        uint8_t format;         // Format
+        uint8_t flags;          // Flags
+        uint16_t order;         // bands 0..order
+        uint16_t numCoefs;      // (order + 1)^2
+        uint32_t reserved;
+    };
+
+    struct ArchiveHeader
+    {
+        uint32_t magic;         // ARCHIVE_MAGIC
+        uint16_t version;
+        uint8_t format;
+        uint8_t flags;
+        uint16_t order;
+        uint16_t numCoefs;
+        uint32_t probeCount;
+        uint32_t probeStride;   // bytes, a multiple of 16
+        uint32_t reserved;
+        uint64_t indexOffset;   // probeCount IndexEntry
+        uint64_t namesOffset;   // the names, not terminated
+        uint64_t dataOffset;    // aligned to 16 bytes
+    };
+
+    struct IndexEntry
+    {
+        uint64_t nameHash;      // hash::xxh64() of the name
+        uint32_t nameOffset;    // from namesOffset
+        uint32_t nameLength;
+        uint32_t probe;
+        uint32_t reserved;
+    };
+
+    struct VolumeHeader
+    {
+        uint32_t magic;         // VOLUME_MAGIC
+        uint16_t version;
+        uint8_t format;
+        uint8_t flags;
+        uint16_t order;
+        uint16_t numCoefs;
+        uint32_t width;         // probes along x
+        uint32_t height;        // along y
+        uint32_t depth;         // along z
+        uint64_t planeStride;   // bytes, a multiple of 16
+        uint64_t dataOffset;    // aligned to 16 bytes
+    };
+
+    static_assert(sizeof(Header) == 16, "the layout of Header is fixed");
+    static_assert(sizeof(ArchiveHeader) == 48, "the layout of ArchiveHeader is fixed");
+    static_assert(sizeof(IndexEntry) == 24, "the layout of IndexEntry is fixed");
+    static_assert(sizeof(VolumeHeader) == 40, "the layout of VolumeHeader is fixed");
+
+    size_t getBytesPerValue(Format format);
+
+    // the coefficients of bands 0..order as a .shb file
+    std::vector<uint8_t> encode(size_t order, uint8_t flags, Format format, const ibl::math::double3* sh);
+
+    // parses a .shb file, false if it is not one
+    bool decode(const void* data, size_t size, Header& header, std::vector<ibl::math::double3>& sh);
+
+    bool save(const std::string& path, size_t order, uint8_t flags, Format format, const ibl::math::double3* sh);
+
+    // collects the coefficients of the probes and writes them as an archive, sorted by name
+    class ArchiveWriter
+    {
+    public:
+        ArchiveWriter(size_t order, uint8_t flags, Format format);
+
+        void add(const std::string& name, const ibl::math::double3* sh);
+
+        size_t getProbeCount() const { return mProbes.size(); }
+
+        bool save(const std::string& path);
+
+    private:
+        size_t mOrder;
+        uint8_t mFlags;
+        Format mFormat;
+        std::vector<std::pair<std::string, std::vector<uint8_t>>> mProbes;  // name and values
+    };
+
+    // an archive in memory, e.g. mapped
+    struct ArchiveView
+    {
+        const ArchiveHeader* header = nullptr;
+        const IndexEntry* index = nullptr;
+        const char* names = nullptr;
+        const uint8_t* data = nullptr;
+    };
+
+    // checks that the parts of the archive, the names and the probes of its index are inside
+    // size bytes, false if it is not an archive
+    bool parseArchive(const void* data, size_t size, ArchiveView& view);
+
+    // the probe of name, header->probeCount if there is none
+    uint32_t findProbe(const ArchiveView& view, const std::string& name);
+
+    // the values of probe, numCoefs triples of format
+    inline const void* getProbeData(const ArchiveView& view, uint32_t probe)
+    {
+        return view.data + size_t(probe) * view.header->probeStride;
+    }
+
+    // holds the whole volume in memory, the probes that are not set are 0
+    class VolumeWriter
+    {
+    public:
+        VolumeWriter(size_t order, uint8_t flags, Format format, size_t width, size_t height, size_t depth);
+
+        size_t getProbeCount() const { return mProbeCount; }
+
+        // the coefficients of the probe x + width * (y + height * z). different probes may be
+        // set from different threads at the same time.
+        void set(size_t probe, const ibl::math::double3* sh);
+
+        bool save(const std::string& path) const;
+
+    private:
+        size_t mNumCoefs;
+        Format mFormat;
+        size_t mProbeCount;
+        size_t mPlaneStride;
+        std::vector<uint8_t> mData;     // the file
+    };
+
+    // a volume in memory, e.g. mapped
+    struct VolumeView
+    {
+        const VolumeHeader* header = nullptr;
+        const uint8_t* data = nullptr;
+    };
+
+    // checks that the planes are inside size bytes, false if it is not a volume
+    bool parseVolume(const void* data, size_t size, VolumeView& view);
+
+    // the texels of the plane of coefficient k, 4 values of format per probe
+    inline const void* getPlaneData(const VolumeView& view, size_t k)
+    {
+        return view.data + k * view.header->planeStride;
+    }
+}
+
+#endif
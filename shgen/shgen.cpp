@@ -1,234 +1,1639 @@
-﻿#include <cassert>
-#include <cstdint>
-
-#include <map>
-#include <memory>
-#include <string>
-
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <Windows.h>
-
-#include "DirectXTex.h"
-
-#include "ibl/spherical_harmonics.h"
-#include "json11/json11.hpp"
-#include "fsutil.h"
-
-#define VERSION "1.0.0"
-
-#define ABORT(msg) { puts(msg); return 1; }
-#define ARG_CASE(s) if (kv.first == s)
-#define ARG_CASE2(s1, s2) if (kv.first == s1 || kv.first == s2)
-#define CHECK_NUM_ARGS(p) if (kv.second.size() < p) continue;
-
-namespace
-{
-    const char helpText[] =
-        "\n"
-        "shgen v" VERSION "\n"
-        "---------------------------------------------------------------------\n"
-        "  Usage: shgen <input specification> <options>\n"
-        "\n"
-        "INPUT SPECIFICATION\n"
-        "  -i, --input <filename>\n"
-            "\t入力ファイルパスを指定します。\n"
-        "\n"
-        "OPTIONS\n"
-        "  -h, --help\n"
-            "\tこれを表示します。\n"
-        "  -o, --output <filename>\n"
-            "\t出力ファイルパスを指定します。初期値は\"diffuse.json\"です。\n"
-        "  -v, --verbose\n"
-            "\t詳細な出力を行います。\n"
-        "\n";
-
-    struct Spec
-    {
-        std::string source;
-        std::string output = "diffuse.json";
-        std::string diffuse = "diffuse.dds";
-        bool verboseSpecified = false;
-    };
-
-    std::wstring utf8ToUtf16(const std::string& u8str)
-    {
-        int u16strLen = ::MultiByteToWideChar(CP_UTF8, 0, u8str.c_str(), -1, NULL, 0);
-        if (u16strLen <= 0) return std::wstring();
-        std::wstring u16str;
-        u16str.resize(u16strLen-1);
-        ::MultiByteToWideChar(CP_UTF8, 0, u8str.c_str(), -1, &u16str[0], u16strLen);
-        return u16str;
-    }
-
-    std::string utf16ToUtf8(const std::wstring& u16str)
-    {
-        int u8strLen = ::WideCharToMultiByte(CP_UTF8, 0, u16str.c_str(), -1, NULL, 0, NULL, NULL);
-        if (u8strLen <= 0) return std::string();
-        std::string u8str;
-        u8str.resize(u8strLen - 1);
-        ::WideCharToMultiByte(CP_UTF8, 0, u16str.c_str(), -1, &u8str[0], u8strLen, NULL, NULL);
-        return u8str;
-    }
-
-    std::map<std::string, std::vector<std::string>> parseOptions(int argc, char* argv[])
-    {
-        std::map<std::string, std::vector<std::string>> options;
-        int argPos = 1;
-        bool suggestHelp = false;
-        while (argPos < argc) {
-            const char* arg = argv[argPos];
-            if (arg[0] != '-') {
-                printf("Unknown setting or insufficient parameters: %s\n", arg);
-                suggestHelp = true;
-            }
-            else {
-                int pos = argPos;
-                while (pos+1 < argc) {
-                    if (argv[pos+1][0] == '-') break;
-                    ++pos;
-                }
-                int count = pos - argPos;
-                if (count <= 0) {
-                    options[arg].clear();
-                    ++argPos;
-                }
-                else {
-                    for (int i = argPos+1, end = i+count; i < end; ++i)
-                        options[arg].push_back(argv[i]);
-                    argPos += 1 + count;
-                }
-            }
-        }
-        if (suggestHelp) printf("Use --help for more information.\n");
-        return options;
-    }
-
-    int parseArguments(Spec& spec, int argc, char* argv[])
-    {
-        auto options = parseOptions(argc, argv);
-        bool inputSpecified = false;
-        bool outputSpecified = false;
-        for (auto& kv : options) {
-            ARG_CASE2("-i", "--input") {
-                CHECK_NUM_ARGS(1);
-                inputSpecified = true;
-                spec.source = kv.second[0];
-                continue;
-            }
-            ARG_CASE2("-o", "--output") {
-                CHECK_NUM_ARGS(1);
-                outputSpecified = true;
-                spec.output = kv.second[0];
-                continue;
-            }
-            ARG_CASE2("-v", "--verbose") {
-                spec.verboseSpecified = true;
-                continue;
-            }
-            ARG_CASE2("-h", "--help") {
-                ABORT(helpText);
-            }
-        }
-        if (!inputSpecified) ABORT("No input source specified! Use --input <filename/folder>, or see --help");
-        return 0;
-    }
-
-    std::unique_ptr<DirectX::ScratchImage> loadImageFromFile(const std::string& filename)
-    {
-        auto images = std::make_unique<DirectX::ScratchImage>();
-        DirectX::TexMetadata meta;
-        HRESULT hr = DirectX::LoadFromDDSFile(utf8ToUtf16(filename).c_str(), DirectX::DDS_FLAGS_NONE, &meta, *images);
-        if (FAILED(hr)) {
-            return nullptr;
-        }
-        return images;
-    }
-
-    ibl::Cubemap createCubemap(const DirectX::ScratchImage* images)
-    {
-        enum {
-            DDS_CUBEMAP_FACE_PX,
-            DDS_CUBEMAP_FACE_NX,
-            DDS_CUBEMAP_FACE_PY,
-            DDS_CUBEMAP_FACE_NY,
-            DDS_CUBEMAP_FACE_PZ,
-            DDS_CUBEMAP_FACE_NZ,
-        };
-
-        auto setFaceFromImage = [](ibl::Cubemap& cm, ibl::Cubemap::Face face, const DirectX::Image* image)
-        {
-            ibl::Image subImage(image->pixels, image->width, image->height);
-            assert(subImage.getBytesPerRow() == image->rowPitch);
-            cm.setImageForFace(face, subImage);
-        };
-
-        size_t dim = images->GetMetadata().width;
-
-        ibl::Cubemap cm(dim);
-
-        setFaceFromImage(cm, ibl::Cubemap::Face::NX, images->GetImage(0, DDS_CUBEMAP_FACE_NX, 0));
-        setFaceFromImage(cm, ibl::Cubemap::Face::PX, images->GetImage(0, DDS_CUBEMAP_FACE_PX, 0));
-        setFaceFromImage(cm, ibl::Cubemap::Face::NY, images->GetImage(0, DDS_CUBEMAP_FACE_NY, 0));
-        setFaceFromImage(cm, ibl::Cubemap::Face::PY, images->GetImage(0, DDS_CUBEMAP_FACE_PY, 0));
-        setFaceFromImage(cm, ibl::Cubemap::Face::NZ, images->GetImage(0, DDS_CUBEMAP_FACE_NZ, 0));
-        setFaceFromImage(cm, ibl::Cubemap::Face::PZ, images->GetImage(0, DDS_CUBEMAP_FACE_PZ, 0));
-        return cm;
-    }
-
-    bool saveSphericalHarmonics(const Spec& spec, const std::unique_ptr<ibl::math::double3[]>& sh)
-    {
-        json11::Json::array jsonSH;
-        jsonSH.resize(9);
-
-        for (size_t i = 0; i < jsonSH.size(); ++i) {
-            jsonSH[i] = json11::Json::array{sh[i].x, sh[i].y, sh[i].z};
-        }
-
-        std::string str = json11::Json(jsonSH).dump();
-
-        fs::FileHandle f = fs::openFile(spec.output, fs::FileMode::Create | fs::FileAccess::Write);
-        if (f.isInvalid()) {
-            return false;
-        }
-
-        fs::writeFile(f, str.c_str(), str.length());
-        fs::closeFile(f);
-        return true;
-    }
-}
-
-int main(int argc, char* argv[])
-{
-    if (FAILED(CoInitializeEx(NULL, COINIT_MULTITHREADED)))
-        return 1;
-
-    Spec spec;
-    if (parseArguments(spec, argc, argv) != 0)
-        return 1;
-
-    auto images = loadImageFromFile(spec.source);
-    if (!images)
-        ABORT("DirectX::LoadFromXXXFile failed.");
-
-    if (images->GetMetadata().format != DXGI_FORMAT_R32G32B32_FLOAT)
-        ABORT("Given cubemap format must be DXGI_FORMAT_R32G32B32_FLOAT");
-
-    ibl::Cubemap cm = createCubemap(images.get());
-
-    auto sh = ibl::computeIrradianceSH3Bands(cm);
-
-    saveSphericalHarmonics(spec, sh);
-
-    if (spec.verboseSpecified) {
-        ibl::renderPreScaledSH3Bands(cm, sh);
-        if (FAILED(DirectX::SaveToDDSFile(images->GetImages(), images->GetImageCount(), images->GetMetadata(),
-                                          DirectX::DDS_FLAGS_NONE, utf8ToUtf16(spec.diffuse).c_str())))
-        {
-            ABORT("DirectX::SaveToDDSFile failed.");
-        }
-    }
-
-    CoUninitialize();
-    return 0;
-}
\ No newline at end of file
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ibl/prefilter.h"
+#include "ibl/spherical_harmonics.h"
+#include "ibl/trace.h"
+#include "json11/json11.hpp"
+#include "cache.h"
+#include "dds.h"
+#include "fsutil.h"
+#include "hdr.h"
+#include "jsonwriter.h"
+#include "pfm.h"
+#include "serve.h"
+#include "shb.h"
+
+#define VERSION "1.0.0"
+
+#define ABORT(msg) { puts(msg); return 1; }
+#define ARG_CASE(s) if (kv.first == s)
+#define ARG_CASE2(s1, s2) if (kv.first == s1 || kv.first == s2)
+#define CHECK_NUM_ARGS(p) if (kv.second.size() < p) continue;
+
+namespace
+{
+    const char helpText[] =
+        "\n"
+        "shgen v" VERSION "\n"
+        "---------------------------------------------------------------------\n"
+        "  Usage: shgen <input specification> <options>\n"
+        "\n"
+        "INPUT SPECIFICATION\n"
+        "  -i, --input <filename>\n"
+            "\t入力ファイルパスを指定します。DDS形式のキューブマップで、次のフォーマットに対応します。\n"
+            "\tR32G32B32_FLOAT, R32G32B32A32_FLOAT, R16G16B16A16_FLOAT, R11G11B10_FLOAT, R9G9B9E5_SHAREDEXP\n"
+            "\t拡張子が.hdr(Radiance RGBE)または.pfmのファイルは正距円筒図法の画像として読み込み、\n"
+            "\tキューブマップに変換せずに直接射影します。画像の上端が+Y、中央が+Zの方向です。\n"
+            "\tワイルドカード(*)を含むパスまたはディレクトリを指定すると、サブディレクトリも含めて\n"
+            "\t該当する.dds, .hdr, .pfmファイルをすべて処理します。読み込み、射影、書き出しは並行して行います。\n"
+            "\t--mmap, --stream, --verboseとは併用できません。\n"
+        "\n"
+        "OPTIONS\n"
+        "  -h, --help\n"
+            "\tこれを表示します。\n"
+        "  -o, --output <filename>\n"
+            "\t出力ファイルパスを指定します。初期値は\"diffuse.json\"です。\n"
+            "\t複数のファイルを処理する場合は出力先のディレクトリを指定します。入力と同じ相対パスに\n"
+            "\t拡張子を.jsonに変えて出力し、省略時は入力ファイルと同じ場所に出力します。\n"
+        "  --order <1-8>\n"
+            "\t指定した次数までの正規直交基底の係数を出力します。\n"
+            "\t省略時は従来の3バンド(係数9個)の形式で出力します。\n"
+        "  --precision <double|kahan|pairwise>\n"
+            "\t射影の演算精度を指定します。初期値は\"double\"です。\n"
+            "\tkahan, pairwiseはfloatで演算し、それぞれの方法で誤差を抑えて加算します。\n"
+        "  --mip-tolerance <value>\n"
+            "\t推定誤差が指定値(バンド0に対する相対値)以下となる最も粗いミップレベルを射影します。\n"
+            "\t入力にミップマップがあればそれを使い、なければ生成します。\n"
+        "  --irradiance-map <filename> [face size] [half|float]\n"
+            "\t放射照度を指定したサイズ(初期値32)のキューブマップに描画し、DDS形式で出力します。\n"
+            "\t形式はhalf(R16G16B16A16_FLOAT、初期値)またはfloat(R32G32B32_FLOAT)です。\n"
+            "\t放射照度は滑らかなので、入力の解像度によらず小さなサイズで十分です。\n"
+        "  --irradiance-matrices <filename>\n"
+            "\tバンド0～2の放射照度を、単位ベクトルnに対して(n, 1)^T M (n, 1)で評価できる\n"
+            "\t4x4の対称行列Mとして色成分ごとに出力します。[成分][行][列]の配列で、行と列はx, y, z, 1の順です。\n"
+            "\t--orderに3以上を指定した場合はバンド2までを使い、--order 1とは併用できません。\n"
+        "  --specular <filename> [face size] [mip levels] [half|float]\n"
+            "\tGGX分布で事前フィルタリングした鏡面反射用のキューブマップを、ミップごとにラフネスを変えて\n"
+            "\tDDS形式で出力します。ミップiのラフネス(α = ラフネスの2乗)はi / (ミップ数 - 1)です。\n"
+            "\tサイズの初期値は入力と同じで、ミップ数の初期値は8x8までです。形式は--irradiance-mapと同じです。\n"
+            "\tDDS形式のキューブマップのみ対応し、--streamとは併用できません。\n"
+        "  --specular-samples <count>\n"
+            "\t--specularの1テクセルあたりのサンプル数を指定します。初期値は128です。\n"
+            "\tサンプルごとに立体角に見合ったミップから読むので、少ないサンプル数でもノイズは出にくくなります。\n"
+        "  --mmap\n"
+            "\t入力ファイルをメモリにマップし、コピーせずに直接射影します。\n"
+            "\tDXGI_FORMAT_R32G32B32_FLOAT形式のみ対応し、--verboseとは併用できません。\n"
+        "  --stream\n"
+            "\t入力ファイルを数行ずつ読み込みながら射影し、メモリ使用量を入力サイズによらず数MBに抑えます。\n"
+            "\t--verbose, --mip-toleranceとは併用できません。\n"
+            "\t--mmap, --stream, --mip-toleranceはDDS形式のキューブマップのみ対応します。\n"
+        "  --binary [float|half]\n"
+            "\t係数をJSONの代わりにバイナリ形式(.shb)で出力します。16バイトのヘッダーに続けて、\n"
+            "\t係数ごとのr, g, bをfloat(初期値)またはhalfで格納します。出力ファイルの初期値は\"diffuse.shb\"です。\n"
+        "  --archive <filename> [float|half]\n"
+            "\t複数のファイルを処理する場合に、すべての係数を1つのアーカイブにまとめて出力します。\n"
+            "\tプローブは入力の相対パスを名前として名前順に固定長で並び、名前のハッシュで引ける索引が付きます。\n"
+            "\tメモリにマップすれば解析せずにi番目のプローブを参照できます。形式はshgen/shb.hを参照してください。\n"
+            "\t-oを指定しなければ、ファイルごとの出力は行いません。\n"
+        "  --probe-grid <manifest> [float|half]\n"
+            "\tマニフェストに並べた格子状のプローブのキューブマップをまとめて射影し、1つのボリューム(.shv)に\n"
+            "\t出力します。マニフェストは{\"size\": [x, y, z], \"inputs\": [入力ファイル, ...]}の形式のJSONで、\n"
+            "\t入力はxが先、次にy、zの順にx * y * z個並べ、相対パスはマニフェストの場所からのパスです。\n"
+            "\tボリュームは係数ごとの平面を並べたもので、各平面はプローブごとにr, g, b, 0を持つ3Dテクスチャの\n"
+            "\tデータとしてそのまま転送できます。形式はfloat(初期値)またはhalfで、出力ファイルの初期値は\n"
+            "\t\"probes.shv\"です。詳しくはshgen/shb.hを参照してください。\n"
+        "  --digits <1-17>\n"
+            "\tJSON形式の出力で、実数を指定した有効桁数で書き出します。\n"
+            "\t省略時は、読み戻したときに同じ値になる最短の桁数で書き出します。\n"
+        "  --cache <directory>\n"
+            "\t計算結果を指定したディレクトリにキャッシュし、入力ファイルの内容とオプションが\n"
+            "\t以前と同じであれば射影せずにキャッシュから出力します。\n"
+            "\tサイズと更新日時が前回と同じファイルは内容を読まずにキャッシュを引きます。\n"
+        "  --trace <filename>\n"
+            "\t読み込み、射影、書き出しなどの各段階とスレッドプールのタスクの時間を記録し、終了時に\n"
+            "\tChromeのトレースイベント形式(JSON)で出力します。chrome://tracingまたはPerfettoで表示できます。\n"
+        "  --serve [socket path]\n"
+            "\t常駐し、1行に1つのJSON形式のジョブを標準入力またはUnixドメインソケットから受け付けます。\n"
+            "\tジョブは{\"id\": 任意, \"input\": 入力ファイル, \"output\": 出力ファイル(省略可),\n"
+            "\t\"order\": 次数, \"precision\": 精度, \"mip_tolerance\": 許容誤差}で、省略した項目は\n"
+            "\tコマンドラインの指定に従います。結果は{\"id\", \"sh\"}または{\"id\", \"error\"}の形式で、\n"
+            "\t終わったジョブから順に1行ずつ返します。\n"
+        "  -v, --verbose\n"
+            "\t詳細な出力を行います。\n"
+        "\n";
+
+    // largest face of --irradiance-map
+    const size_t MAX_IRRADIANCE_SIZE = 4096;
+
+    // largest face and number of samples of --specular
+    const size_t MAX_SPECULAR_SIZE = 8192;
+    const size_t MAX_SPECULAR_SAMPLES = 65536;
+
+    struct Spec
+    {
+        std::string source;
+        std::string output = "diffuse.json";
+        std::string diffuse = "diffuse.dds";
+        size_t order = 0;
+        std::string precision = "double";
+        double mipTolerance = 0;
+        bool mapped = false;
+        bool stream = false;
+        bool latLong = false;
+        bool batch = false;
+        std::string irradianceMap;
+        size_t irradianceSize = 32;
+        ibl::TexelFormat irradianceFormat = ibl::TexelFormat::RGBA16F;
+        std::string irradianceMatrices;
+        std::string specularMap;
+        size_t specularSize = 0;        // of the input if 0
+        size_t specularLevels = 0;      // SpecularPrefilter::getDefaultLevelCount() if 0
+        size_t specularSamples = ibl::SpecularPrefilter::DEFAULT_SAMPLE_COUNT;
+        ibl::TexelFormat specularFormat = ibl::TexelFormat::RGBA16F;
+        bool binary = false;
+        shb::Format binaryFormat = shb::Format::Float32;
+        std::string archive;
+        shb::Format archiveFormat = shb::Format::Float32;
+        std::string probeGrid;      // the manifest
+        shb::Format probeGridFormat = shb::Format::Float32;
+        int digits = 0;             // of the doubles of the JSON outputs, 0 for the shortest round trip
+        std::string cacheDir;
+        bool serve = false;
+        std::string socketPath;     // of serve mode, the standard input if empty
+        std::string trace;
+        bool verboseSpecified = false;
+    };
+
+    std::string getExtension(const std::string& path)
+    {
+        const size_t dot = path.find_last_of('.');
+        const size_t slash = path.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return std::string();
+        }
+        std::string ext = path.substr(dot);
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return char(std::tolower(uint8_t(c))); });
+        return ext;
+    }
+
+    std::map<std::string, std::vector<std::string>> parseOptions(int argc, char* argv[])
+    {
+        std::map<std::string, std::vector<std::string>> options;
+        int argPos = 1;
+        bool suggestHelp = false;
+        while (argPos < argc) {
+            const char* arg = argv[argPos];
+            if (arg[0] != '-') {
+                printf("Unknown setting or insufficient parameters: %s\n", arg);
+                suggestHelp = true;
+            }
+            else {
+                int pos = argPos;
+                while (pos+1 < argc) {
+                    if (argv[pos+1][0] == '-') break;
+                    ++pos;
+                }
+                int count = pos - argPos;
+                if (count <= 0) {
+                    options[arg].clear();
+                    ++argPos;
+                }
+                else {
+                    for (int i = argPos+1, end = i+count; i < end; ++i)
+                        options[arg].push_back(argv[i]);
+                    argPos += 1 + count;
+                }
+            }
+        }
+        if (suggestHelp) printf("Use --help for more information.\n");
+        return options;
+    }
+
+    int parseArguments(Spec& spec, int argc, char* argv[])
+    {
+        auto options = parseOptions(argc, argv);
+        bool inputSpecified = false;
+        bool outputSpecified = false;
+        for (auto& kv : options) {
+            ARG_CASE2("-i", "--input") {
+                CHECK_NUM_ARGS(1);
+                inputSpecified = true;
+                spec.source = kv.second[0];
+                continue;
+            }
+            ARG_CASE2("-o", "--output") {
+                CHECK_NUM_ARGS(1);
+                outputSpecified = true;
+                spec.output = kv.second[0];
+                continue;
+            }
+            ARG_CASE("--order") {
+                CHECK_NUM_ARGS(1);
+                spec.order = std::strtoul(kv.second[0].c_str(), nullptr, 10);
+                if (spec.order < 1 || spec.order > ibl::sh::MAX_ORDER) ABORT("--order must be between 1 and 8.");
+                continue;
+            }
+            ARG_CASE("--precision") {
+                CHECK_NUM_ARGS(1);
+                spec.precision = kv.second[0];
+                if (spec.precision != "double" && spec.precision != "kahan" && spec.precision != "pairwise")
+                    ABORT("--precision must be double, kahan or pairwise.");
+                continue;
+            }
+            ARG_CASE("--mip-tolerance") {
+                CHECK_NUM_ARGS(1);
+                spec.mipTolerance = std::strtod(kv.second[0].c_str(), nullptr);
+                if (spec.mipTolerance <= 0) ABORT("--mip-tolerance must be positive.");
+                continue;
+            }
+            ARG_CASE("--irradiance-map") {
+                CHECK_NUM_ARGS(1);
+                spec.irradianceMap = kv.second[0];
+                if (kv.second.size() > 1) {
+                    spec.irradianceSize = std::strtoul(kv.second[1].c_str(), nullptr, 10);
+                    if (spec.irradianceSize < 1 || spec.irradianceSize > MAX_IRRADIANCE_SIZE)
+                        ABORT("The size of --irradiance-map must be between 1 and 4096.");
+                }
+                if (kv.second.size() > 2) {
+                    if (kv.second[2] != "half" && kv.second[2] != "float")
+                        ABORT("The format of --irradiance-map must be half or float.");
+                    spec.irradianceFormat = kv.second[2] == "half" ? ibl::TexelFormat::RGBA16F : ibl::TexelFormat::RGB32F;
+                }
+                continue;
+            }
+            ARG_CASE("--irradiance-matrices") {
+                CHECK_NUM_ARGS(1);
+                spec.irradianceMatrices = kv.second[0];
+                continue;
+            }
+            ARG_CASE("--specular") {
+                CHECK_NUM_ARGS(1);
+                spec.specularMap = kv.second[0];
+                if (kv.second.size() > 1) {
+                    spec.specularSize = std::strtoul(kv.second[1].c_str(), nullptr, 10);
+                    if (spec.specularSize < 1 || spec.specularSize > MAX_SPECULAR_SIZE)
+                        ABORT("The size of --specular must be between 1 and 8192.");
+                }
+                if (kv.second.size() > 2) {
+                    spec.specularLevels = std::strtoul(kv.second[2].c_str(), nullptr, 10);
+                    if (spec.specularLevels < 1)
+                        ABORT("The mip levels of --specular must be 1 or more.");
+                }
+                if (kv.second.size() > 3) {
+                    if (kv.second[3] != "half" && kv.second[3] != "float")
+                        ABORT("The format of --specular must be half or float.");
+                    spec.specularFormat = kv.second[3] == "half" ? ibl::TexelFormat::RGBA16F : ibl::TexelFormat::RGB32F;
+                }
+                continue;
+            }
+            ARG_CASE("--specular-samples") {
+                CHECK_NUM_ARGS(1);
+                spec.specularSamples = std::strtoul(kv.second[0].c_str(), nullptr, 10);
+                if (spec.specularSamples < 1 || spec.specularSamples > MAX_SPECULAR_SAMPLES)
+                    ABORT("--specular-samples must be between 1 and 65536.");
+                continue;
+            }
+            ARG_CASE("--mmap") {
+                spec.mapped = true;
+                continue;
+            }
+            ARG_CASE("--stream") {
+                spec.stream = true;
+                continue;
+            }
+            ARG_CASE("--binary") {
+                spec.binary = true;
+                if (!kv.second.empty()) {
+                    if (kv.second[0] != "half" && kv.second[0] != "float")
+                        ABORT("The format of --binary must be half or float.");
+                    spec.binaryFormat = kv.second[0] == "half" ? shb::Format::Float16 : shb::Format::Float32;
+                }
+                continue;
+            }
+            ARG_CASE("--archive") {
+                CHECK_NUM_ARGS(1);
+                spec.archive = kv.second[0];
+                if (kv.second.size() > 1) {
+                    if (kv.second[1] != "half" && kv.second[1] != "float")
+                        ABORT("The format of --archive must be half or float.");
+                    spec.archiveFormat = kv.second[1] == "half" ? shb::Format::Float16 : shb::Format::Float32;
+                }
+                continue;
+            }
+            ARG_CASE("--probe-grid") {
+                CHECK_NUM_ARGS(1);
+                spec.probeGrid = kv.second[0];
+                if (kv.second.size() > 1) {
+                    if (kv.second[1] != "half" && kv.second[1] != "float")
+                        ABORT("The format of --probe-grid must be half or float.");
+                    spec.probeGridFormat = kv.second[1] == "half" ? shb::Format::Float16 : shb::Format::Float32;
+                }
+                continue;
+            }
+            ARG_CASE("--digits") {
+                CHECK_NUM_ARGS(1);
+                spec.digits = int(std::strtol(kv.second[0].c_str(), nullptr, 10));
+                if (spec.digits < 1 || spec.digits > 17) ABORT("--digits must be between 1 and 17.");
+                continue;
+            }
+            ARG_CASE("--cache") {
+                CHECK_NUM_ARGS(1);
+                spec.cacheDir = kv.second[0];
+                continue;
+            }
+            ARG_CASE("--trace") {
+                CHECK_NUM_ARGS(1);
+                spec.trace = kv.second[0];
+                continue;
+            }
+            ARG_CASE("--serve") {
+                spec.serve = true;
+                if (!kv.second.empty()) spec.socketPath = kv.second[0];
+                continue;
+            }
+            ARG_CASE2("-v", "--verbose") {
+                spec.verboseSpecified = true;
+                continue;
+            }
+            ARG_CASE2("-h", "--help") {
+                ABORT(helpText);
+            }
+        }
+        if (spec.serve) {
+            if (inputSpecified || outputSpecified || spec.stream || spec.mapped || spec.verboseSpecified || !spec.cacheDir.empty() ||
+                !spec.irradianceMap.empty() || !spec.irradianceMatrices.empty() || !spec.specularMap.empty() || !spec.archive.empty() ||
+                !spec.probeGrid.empty())
+                ABORT("--serve takes the files from its jobs, it cannot be combined with --input, --output, --stream, --mmap, --verbose, --cache, --irradiance-map, --irradiance-matrices, --specular, --archive or --probe-grid.");
+            return 0;
+        }
+        if (!spec.probeGrid.empty()) {
+            if (inputSpecified || spec.stream || spec.mapped || spec.verboseSpecified || spec.binary || !spec.archive.empty() ||
+                !spec.irradianceMap.empty() || !spec.irradianceMatrices.empty() || !spec.specularMap.empty())
+                ABORT("--probe-grid takes the files from its manifest, it cannot be combined with --input, --stream, --mmap, --verbose, --binary, --archive, --irradiance-map, --irradiance-matrices or --specular.");
+            if (!outputSpecified) spec.output = "probes.shv";
+            return 0;
+        }
+        if (!spec.irradianceMatrices.empty() && spec.order == 1)
+            ABORT("--irradiance-matrices needs bands 0..2, it cannot be combined with --order 1.");
+        if (!inputSpecified) ABORT("No input source specified! Use --input <filename/folder>, or see --help");
+        spec.batch = spec.source.find('*') != std::string::npos || fs::isDirectory(spec.source);
+        if (spec.batch) {
+            if (spec.stream || spec.mapped || spec.verboseSpecified || !spec.irradianceMap.empty() || !spec.irradianceMatrices.empty() ||
+                !spec.specularMap.empty())
+                ABORT("--stream, --mmap, --verbose, --irradiance-map, --irradiance-matrices and --specular cannot be used with several input files.");
+            // the outputs go next to the inputs unless a directory is given
+            if (!outputSpecified) spec.output.clear();
+            return 0;
+        }
+        if (!spec.archive.empty())
+            ABORT("--archive needs several input files, give a directory or a path with *.");
+        if (spec.binary && !outputSpecified) spec.output = "diffuse.shb";
+        const std::string ext = getExtension(spec.source);
+        spec.latLong = ext == ".hdr" || ext == ".pfm";
+        if (spec.latLong && (spec.stream || spec.mapped || spec.mipTolerance > 0 || !spec.specularMap.empty()))
+            ABORT("--stream, --mmap, --mip-tolerance and --specular need a DDS cubemap as input.");
+        if (spec.stream && (spec.verboseSpecified || spec.mipTolerance > 0 || !spec.specularMap.empty()))
+            ABORT("--stream cannot be combined with --verbose, --mip-tolerance or --specular.");
+        if (spec.mapped && (spec.verboseSpecified || spec.stream))
+            ABORT("--mmap cannot be combined with --verbose or --stream.");
+        return 0;
+    }
+
+    // the faces point into surfaces, as loaded by dds::load()
+    ibl::Cubemap createCubemap(const dds::Info& info, std::vector<ibl::Image>& surfaces, size_t mip = 0)
+    {
+        TRACE_SCOPE("create cubemap");
+        size_t dim = std::max(size_t(1), info.width >> mip);
+
+        ibl::Cubemap cm(dim);
+
+        for (size_t item = 0; item < 6; item++) {
+            ibl::Image& image = surfaces[item * info.mipLevels + mip];
+            cm.setImageForFace(dds::getCubemapFace(item), ibl::Image(image.getData(), dim, dim));
+        }
+        return cm;
+    }
+
+    // the faces point into the mapping, which is read only
+    ibl::Cubemap createCubemap(const fs::MappedFile& file, const dds::Info& info, size_t mip = 0)
+    {
+        TRACE_SCOPE("create cubemap");
+        size_t dim = std::max(size_t(1), info.width >> mip);
+
+        ibl::Cubemap cm(dim);
+
+        for (size_t item = 0; item < 6; item++) {
+            void* pixels = static_cast<uint8_t*>(file.data) + dds::getSurfaceOffset(info, item, mip);
+            cm.setImageForFace(dds::getCubemapFace(item), ibl::Image(pixels, dim, dim));
+        }
+        return cm;
+    }
+
+    // the mips of the file if it has some, built from level 0 otherwise
+    template <typename CreateLevel>
+    std::unique_ptr<ibl::MipChain> createMipChain(const Spec& spec, const ibl::Cubemap& cm, size_t numMips,
+                                                  const CreateLevel& createLevel)
+    {
+        if (spec.mipTolerance <= 0) {
+            return nullptr;
+        }
+        TRACE_SCOPE("mip chain");
+        if (numMips > 1) {
+            std::vector<ibl::Cubemap> levels;
+            for (size_t mip = 0; mip < numMips; mip++) {
+                levels.push_back(createLevel(mip));
+            }
+            return std::make_unique<ibl::MipChain>(std::move(levels));
+        }
+        return std::make_unique<ibl::MipChain>(cm);
+    }
+
+    template <typename P>
+    std::unique_ptr<ibl::math::double3[]> computeSphericalHarmonics(const Spec& spec, const ibl::Cubemap& cm,
+                                                                   const ibl::MipChain* mips)
+    {
+        if (mips) {
+            ibl::MipSelection selection;
+            auto sh = ibl::computeIrradianceSH<P>(*mips, spec.order ? spec.order : 2, spec.mipTolerance, &selection);
+            if (spec.verboseSpecified) {
+                const size_t dim = mips->getLevel(selection.level).getDimensions();
+                printf("mip level %zu (%zux%zu), estimated error %g\n", selection.level, dim, dim, selection.error);
+            }
+            if (!spec.order) {
+                ibl::preScaleSH3Bands(sh.get());
+            }
+            return sh;
+        }
+        if (spec.order) {
+            return ibl::computeIrradianceSH<P>(cm, spec.order);
+        }
+        return ibl::computeIrradianceSH3Bands<P>(cm);
+    }
+
+    std::unique_ptr<ibl::math::double3[]> computeSphericalHarmonics(const Spec& spec, const ibl::Cubemap& cm,
+                                                                   const ibl::MipChain* mips)
+    {
+        TRACE_SCOPE("compute sh");
+        if (spec.precision == "kahan") {
+            return computeSphericalHarmonics<ibl::precision::FloatKahan>(spec, cm, mips);
+        } else if (spec.precision == "pairwise") {
+            return computeSphericalHarmonics<ibl::precision::FloatPairwise>(spec, cm, mips);
+        }
+        return computeSphericalHarmonics<ibl::precision::Double>(spec, cm, mips);
+    }
+
+    // the coefficients as an array of [r, g, b]
+    void writeSH(json::Writer& writer, const Spec& spec, const std::unique_ptr<ibl::math::double3[]>& sh)
+    {
+        const size_t numCoefs = spec.order ? ibl::sh::getCoefCount(spec.order) : 9;
+        writer.beginArray();
+        for (size_t i = 0; i < numCoefs; ++i) {
+            writer.array(&sh[i].x, 3);
+        }
+        writer.endArray();
+    }
+
+    bool saveSphericalHarmonics(const Spec& spec, const std::unique_ptr<ibl::math::double3[]>& sh)
+    {
+        TRACE_SCOPE("write sh", spec.output);
+        if (spec.binary) {
+            return shb::save(spec.output, spec.order ? spec.order : 2, spec.order ? 0 : shb::PRE_SCALED,
+                             spec.binaryFormat, sh.get());
+        }
+
+        json::Writer writer(spec.output);
+        writer.setPrecision(spec.digits);
+        writeSH(writer, spec, sh);
+        return writer.close();
+    }
+
+    // renders the coefficients into cm and writes it to spec.diffuse
+    bool saveIrradianceCubemap(const Spec& spec, ibl::Cubemap& cm, const std::unique_ptr<ibl::math::double3[]>& sh)
+    {
+        TRACE_SCOPE("verbose");
+        if (spec.order) {
+            ibl::renderSH(cm, spec.order, sh);
+        } else {
+            ibl::renderPreScaledSH3Bands(cm, sh);
+        }
+        return dds::save(spec.diffuse, cm);
+    }
+
+    // the coefficients of bands 0..2 pre-scaled as computeIrradianceSH3Bands() does, spec.order is 0 or at least 2
+    std::unique_ptr<ibl::math::double3[]> getPreScaledSH3Bands(const Spec& spec, const std::unique_ptr<ibl::math::double3[]>& sh)
+    {
+        std::unique_ptr<ibl::math::double3[]> coefs(new ibl::math::double3[9]);
+        std::copy(sh.get(), sh.get() + 9, coefs.get());
+        if (spec.order) {
+            ibl::preScaleSH3Bands(coefs.get());
+        }
+        return coefs;
+    }
+
+    // evaluates the coefficients into a cubemap of its own at spec.irradianceSize and writes it to spec.irradianceMap
+    bool saveIrradianceMap(const Spec& spec, const std::unique_ptr<ibl::math::double3[]>& sh)
+    {
+        TRACE_SCOPE("irradiance map");
+        const size_t dim = spec.irradianceSize;
+        std::unique_ptr<uint8_t[]> faces(new uint8_t[6 * dim * dim * ibl::getBytesPerTexel(spec.irradianceFormat)]);
+
+        // 3 bands are evaluated as quadratic forms
+        if (spec.order == 0 || spec.order == 2) {
+            ibl::renderPreScaledSH3Bands(dim, getPreScaledSH3Bands(spec, sh).get(), spec.irradianceFormat, faces.get());
+        } else {
+            ibl::renderSH(dim, spec.order, sh.get(), spec.irradianceFormat, faces.get());
+        }
+        return dds::save(spec.irradianceMap, dim, spec.irradianceFormat, faces.get());
+    }
+
+    // writes the IrradianceMatrices of bands 0..2 to spec.irradianceMatrices as [channel][row][column]
+    bool saveIrradianceMatrices(const Spec& spec, const std::unique_ptr<ibl::math::double3[]>& sh)
+    {
+        TRACE_SCOPE("irradiance matrices");
+        const ibl::IrradianceMatrices matrices = ibl::computeIrradianceMatrices(getPreScaledSH3Bands(spec, sh).get());
+
+        json::Writer writer(spec.irradianceMatrices);
+        writer.setPrecision(spec.digits);
+        writer.beginArray();
+        for (size_t ch = 0; ch < 3; ch++) {
+            writer.beginArray();
+            for (size_t row = 0; row < 4; row++) {
+                writer.array(matrices.M[ch][row], 4);
+            }
+            writer.endArray();
+        }
+        writer.endArray();
+        return writer.close();
+    }
+
+    // prefilters the radiance of cm into the mips of spec.specularMap. the levels of mips are
+    // read if there are some, those built from cm otherwise.
+    bool saveSpecularMap(const Spec& spec, const ibl::Cubemap& cm, const ibl::MipChain* mips)
+    {
+        TRACE_SCOPE("specular");
+        std::unique_ptr<ibl::MipChain> built;
+        if (!mips) {
+            built = std::make_unique<ibl::MipChain>(cm);
+            mips = built.get();
+        }
+
+        const size_t dim = spec.specularSize ? spec.specularSize : cm.getDimensions();
+        const size_t numLevels = spec.specularLevels ? spec.specularLevels : ibl::SpecularPrefilter::getDefaultLevelCount(dim);
+        const ibl::SpecularPrefilter prefilter(dim, numLevels, spec.specularSamples);
+
+        std::vector<std::unique_ptr<uint8_t[]>> levels;
+        std::vector<const void*> faces;
+        for (size_t level = 0; level < prefilter.getLevelCount(); level++) {
+            const size_t levelDim = prefilter.getDimensions(level);
+            levels.emplace_back(new uint8_t[6 * levelDim * levelDim * ibl::getBytesPerTexel(spec.specularFormat)]);
+            prefilter.render(*mips, level, spec.specularFormat, levels.back().get());
+            faces.push_back(levels.back().get());
+        }
+        return dds::save(spec.specularMap, dim, faces.size(), spec.specularFormat, faces.data());
+    }
+
+    // the streaming mode keeps at most this many chunks of rows in memory
+    const size_t STREAM_CHUNKS = 4;
+    const size_t STREAM_CHUNK_BYTES = 1 << 20;
+
+    // projects the cubemap in level 0 of file while a second thread reads and decodes it ahead
+    // into a ring of chunks, so that the memory used does not depend on the size of the cubemap
+    template <typename P>
+    std::unique_ptr<ibl::math::double3[]> computeSphericalHarmonicsStreaming(const Spec& spec, fs::FileHandle file,
+                                                                            const dds::Info& info)
+    {
+        struct Chunk
+        {
+            std::unique_ptr<ibl::Cubemap::Texel[]> rows;
+            size_t face = 0;
+            size_t y = 0;
+            size_t count = 0;
+        };
+
+        const size_t dim = info.width;
+        const size_t rowPitch = dds::getRowPitch(info, 0);
+        const size_t texelPitch = dim * sizeof(ibl::Cubemap::Texel);
+        const size_t rowsPerChunk = std::min(dim, std::max(size_t(1), STREAM_CHUNK_BYTES / texelPitch));
+        const size_t chunksPerFace = (dim + rowsPerChunk - 1) / rowsPerChunk;
+        const size_t numChunks = 6 * chunksPerFace;
+
+        Chunk ring[STREAM_CHUNKS];
+        for (Chunk& chunk : ring) {
+            chunk.rows.reset(new ibl::Cubemap::Texel[rowsPerChunk * dim]);
+        }
+
+        // the rows as stored in the file, unless they are texels already
+        const ibl::simd::DecodeRowFn decodeRow = ibl::simd::getDecodeRow(info.texelFormat);
+        const bool isNative = info.texelFormat == ibl::TexelFormat::RGB32F;
+        std::unique_ptr<uint8_t[]> staging(isNative ? nullptr : new uint8_t[rowsPerChunk * rowPitch]);
+
+        // chunks [consumed, produced) are ready to be projected
+        std::mutex lock;
+        std::condition_variable changed;
+        size_t produced = 0;
+        size_t consumed = 0;
+        bool failed = false;
+
+        std::thread reader([&]() {
+            ibl::trace::setThreadName("stream reader");
+            for (size_t i = 0; i < numChunks; i++) {
+                TRACE_SCOPE("read chunk");
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&] { return failed || i - consumed < STREAM_CHUNKS; });
+                    if (failed) {
+                        return;
+                    }
+                }
+
+                Chunk& chunk = ring[i % STREAM_CHUNKS];
+                chunk.face = i / chunksPerFace;
+                chunk.y = (i % chunksPerFace) * rowsPerChunk;
+                chunk.count = std::min(rowsPerChunk, dim - chunk.y);
+
+                const size_t bytes = chunk.count * rowPitch;
+                bool ok = true;
+                if (chunk.y == 0) {
+                    const size_t offset = dds::getSurfaceOffset(info, chunk.face, 0);
+                    ok = fs::seekFile(file, int64_t(offset), fs::FileSeek::Begin) == offset;
+                }
+                void* dst = isNative ? static_cast<void*>(chunk.rows.get()) : staging.get();
+                ok = ok && fs::readFile(file, dst, bytes) == bytes;
+                if (ok && !isNative) {
+                    for (size_t row = 0; row < chunk.count; row++) {
+                        decodeRow(staging.get() + row * rowPitch, dim, chunk.rows.get() + row * dim);
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (ok) {
+                        produced++;
+                    } else {
+                        failed = true;
+                    }
+                }
+                changed.notify_all();
+                if (!ok) {
+                    return;
+                }
+            }
+        });
+
+        std::unique_ptr<ibl::math::double3[]> sh;
+        try {
+            ibl::StreamingProjector<P> projector(dim, spec.order ? spec.order : 2);
+            for (size_t i = 0; i < numChunks; i++) {
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&] { return failed || i < produced; });
+                    if (failed) {
+                        break;
+                    }
+                }
+
+                const Chunk& chunk = ring[i % STREAM_CHUNKS];
+                projector.addRows(dds::getCubemapFace(chunk.face), chunk.y, chunk.count, chunk.rows.get(), texelPitch);
+
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    consumed++;
+                }
+                changed.notify_all();
+            }
+            sh = projector.getIrradianceSH();
+        } catch (...) {
+            // the reader has to be stopped and joined before its thread object goes away
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                failed = true;
+            }
+            changed.notify_all();
+            reader.join();
+            throw;
+        }
+        reader.join();
+
+        if (failed) {
+            return nullptr;
+        }
+
+        if (!spec.order) {
+            ibl::preScaleSH3Bands(sh.get());
+        }
+        return sh;
+    }
+
+    int computeStreaming(const Spec& spec)
+    {
+        fs::FileHandle file = fs::openFile(spec.source, fs::FileMode::Open | fs::FileAccess::Read | fs::FileShare::Read);
+        if (file.isInvalid())
+            ABORT("Failed to open the input file.");
+
+        dds::Info info;
+        if (!dds::readInfo(file, info) || !info.isCubemap || info.width != info.height ||
+            fs::fileSize(file) < dds::getSurfaceOffset(info, 6, 0))
+        {
+            fs::closeFile(file);
+            ABORT("Given file is not a DDS cubemap of a supported format.");
+        }
+
+        std::unique_ptr<ibl::math::double3[]> sh;
+        if (spec.precision == "kahan") {
+            sh = computeSphericalHarmonicsStreaming<ibl::precision::FloatKahan>(spec, file, info);
+        } else if (spec.precision == "pairwise") {
+            sh = computeSphericalHarmonicsStreaming<ibl::precision::FloatPairwise>(spec, file, info);
+        } else {
+            sh = computeSphericalHarmonicsStreaming<ibl::precision::Double>(spec, file, info);
+        }
+        fs::closeFile(file);
+        if (!sh)
+            ABORT("Failed to read the input file.");
+
+        saveSphericalHarmonics(spec, sh);
+        if (!spec.irradianceMap.empty() && !saveIrradianceMap(spec, sh))
+            ABORT("Failed to save the irradiance map.");
+        if (!spec.irradianceMatrices.empty() && !saveIrradianceMatrices(spec, sh))
+            ABORT("Failed to save the irradiance matrices.");
+        return 0;
+    }
+
+    template <typename P>
+    std::unique_ptr<ibl::math::double3[]> computeSphericalHarmonicsLatLong(const Spec& spec, const ibl::Image& image)
+    {
+        if (spec.order) {
+            return ibl::computeIrradianceSHLatLong<P>(image, spec.order);
+        }
+        return ibl::computeIrradianceSH3BandsLatLong<P>(image);
+    }
+
+    std::unique_ptr<ibl::math::double3[]> computeSphericalHarmonics(const Spec& spec, const ibl::Image& image)
+    {
+        TRACE_SCOPE("compute sh");
+        if (spec.precision == "kahan") {
+            return computeSphericalHarmonicsLatLong<ibl::precision::FloatKahan>(spec, image);
+        } else if (spec.precision == "pairwise") {
+            return computeSphericalHarmonicsLatLong<ibl::precision::FloatPairwise>(spec, image);
+        }
+        return computeSphericalHarmonicsLatLong<ibl::precision::Double>(spec, image);
+    }
+
+    bool loadLatLong(const std::string& path, ibl::Image& image)
+    {
+        return getExtension(path) == ".pfm" ? pfm::load(path, image) : hdr::load(path, image);
+    }
+
+    // projects an equirectangular .hdr or .pfm image as it is
+    int computeLatLong(const Spec& spec)
+    {
+        ibl::Image image;
+        if (!loadLatLong(spec.source, image))
+            ABORT("Failed to load the input file, it must be a Radiance HDR or PFM file.");
+
+        auto sh = computeSphericalHarmonics(spec, image);
+
+        saveSphericalHarmonics(spec, sh);
+        if (!spec.irradianceMap.empty() && !saveIrradianceMap(spec, sh))
+            ABORT("Failed to save the irradiance map.");
+        if (!spec.irradianceMatrices.empty() && !saveIrradianceMatrices(spec, sh))
+            ABORT("Failed to save the irradiance matrices.");
+
+        if (spec.verboseSpecified) {
+            // a cubemap with about as many texels on the equator as the image
+            const size_t dim = std::max(size_t(1), image.getWidth() / 4);
+            ibl::Cubemap cm(dim);
+            std::vector<ibl::Image> faces;
+            faces.reserve(6);
+            for (size_t f = 0; f < 6; f++) {
+                faces.emplace_back(dim, dim);
+                cm.setImageForFace(ibl::Cubemap::Face(f), ibl::Image(faces.back().getData(), dim, dim));
+            }
+            if (!saveIrradianceCubemap(spec, cm, sh))
+                ABORT("Failed to save the irradiance cubemap.");
+        }
+        return 0;
+    }
+
+    int computeMapped(const Spec& spec)
+    {
+        // the mip selection jumps between the levels, so the file is only read in order without it
+        uint32_t hints = fs::MapHint::HugePages;
+        if (spec.mipTolerance <= 0) hints |= fs::MapHint::Sequential;
+
+        fs::MappedFile file = fs::mapFile(spec.source, hints);
+        if (file.isInvalid())
+            ABORT("Failed to map the input file.");
+
+        dds::Info info;
+        if (!dds::parseInfo(file.data, file.size, info) || !info.isCubemap || info.width != info.height ||
+            dds::getSurfaceOffset(info, 6, 0) > file.size)
+        {
+            fs::unmapFile(file);
+            ABORT("Given file is not a DDS cubemap.");
+        }
+        if (info.format != dds::Format::R32G32B32_FLOAT) {
+            fs::unmapFile(file);
+            ABORT("Given cubemap format must be DXGI_FORMAT_R32G32B32_FLOAT");
+        }
+
+        ibl::Cubemap cm = createCubemap(file, info);
+
+        auto mips = createMipChain(spec, cm, info.mipLevels, [&file, &info](size_t mip) {
+            return createCubemap(file, info, mip);
+        });
+
+        // cm and the levels of the file are not used after this
+        auto sh = computeSphericalHarmonics(spec, cm, mips.get());
+        const bool specularSaved = spec.specularMap.empty() || saveSpecularMap(spec, cm, mips.get());
+        fs::unmapFile(file);
+        if (!specularSaved)
+            ABORT("Failed to save the specular cubemap.");
+
+        saveSphericalHarmonics(spec, sh);
+        if (!spec.irradianceMap.empty() && !saveIrradianceMap(spec, sh))
+            ABORT("Failed to save the irradiance map.");
+        if (!spec.irradianceMatrices.empty() && !saveIrradianceMatrices(spec, sh))
+            ABORT("Failed to save the irradiance matrices.");
+        return 0;
+    }
+
+    // computes the outputs of a single input
+    int compute(const Spec& spec)
+    {
+        if (spec.latLong)
+            return computeLatLong(spec);
+        if (spec.stream)
+            return computeStreaming(spec);
+        if (spec.mapped)
+            return computeMapped(spec);
+
+        dds::Info info;
+        std::vector<ibl::Image> surfaces;
+        if (!dds::load(spec.source, info, surfaces))
+            ABORT("Failed to load the input file, it must be a DDS file of a supported format.");
+
+        if (!info.isCubemap || info.width != info.height)
+            ABORT("Given file must be a cubemap.");
+
+        ibl::Cubemap cm = createCubemap(info, surfaces);
+
+        auto mips = createMipChain(spec, cm, info.mipLevels, [&info, &surfaces](size_t mip) {
+            return createCubemap(info, surfaces, mip);
+        });
+
+        auto sh = computeSphericalHarmonics(spec, cm, mips.get());
+
+        saveSphericalHarmonics(spec, sh);
+        if (!spec.irradianceMap.empty() && !saveIrradianceMap(spec, sh))
+            ABORT("Failed to save the irradiance map.");
+        if (!spec.irradianceMatrices.empty() && !saveIrradianceMatrices(spec, sh))
+            ABORT("Failed to save the irradiance matrices.");
+        if (!spec.specularMap.empty() && !saveSpecularMap(spec, cm, mips.get()))
+            ABORT("Failed to save the specular cubemap.");
+
+        if (spec.verboseSpecified) {
+            if (!saveIrradianceCubemap(spec, cm, sh))
+                ABORT("Failed to save the irradiance cubemap.");
+        }
+
+        return 0;
+    }
+
+    // the cache key of the input and of the options of spec, 0 if the input cannot be read
+    uint64_t getCacheKey(cache::ResultCache& resultCache, const Spec& spec)
+    {
+        TRACE_SCOPE("cache key", spec.source);
+        char options[256];
+        snprintf(options, sizeof(options), "shgen " VERSION " order=%zu precision=%s mip-tolerance=%.17g",
+                 spec.order, spec.precision.c_str(), spec.mipTolerance);
+        uint64_t key = 0;
+        return resultCache.getKey(spec.source, options, key) ? key : 0;
+    }
+
+    // the irradiance maps of the different sizes and formats are kept side by side
+    std::string getIrradianceMapSuffix(const Spec& spec)
+    {
+        return "-irradiance-" + std::to_string(spec.irradianceSize) +
+               (spec.irradianceFormat == ibl::TexelFormat::RGBA16F ? "h.dds" : "f.dds");
+    }
+
+    // same for the specular cubemaps
+    std::string getSpecularMapSuffix(const Spec& spec)
+    {
+        return "-specular-" + std::to_string(spec.specularSize) + "-" + std::to_string(spec.specularLevels) + "-" +
+               std::to_string(spec.specularSamples) + (spec.specularFormat == ibl::TexelFormat::RGBA16F ? "h.dds" : "f.dds");
+    }
+
+    // the matrices are JSON, written with spec.digits
+    std::string getMatricesSuffix(const Spec& spec)
+    {
+        return spec.digits ? "-matrices-" + std::to_string(spec.digits) + ".json" : std::string("-matrices.json");
+    }
+
+    // the coefficients in each of the formats of the output, .shb also holds those of the archive
+    std::string getOutputSuffix(const Spec& spec)
+    {
+        if (!spec.binary) {
+            return spec.digits ? "-" + std::to_string(spec.digits) + ".json" : std::string(".json");
+        }
+        return spec.binaryFormat == shb::Format::Float16 ? "-half.shb" : ".shb";
+    }
+
+    // copies the outputs of spec from the cache, false if one of them is not there
+    bool restoreFromCache(const cache::ResultCache& resultCache, const Spec& spec, uint64_t key)
+    {
+        TRACE_SCOPE("cache restore");
+        return (spec.output.empty() || resultCache.fetch(key, getOutputSuffix(spec), spec.output)) &&
+               (!spec.verboseSpecified || resultCache.fetch(key, ".dds", spec.diffuse)) &&
+               (spec.irradianceMap.empty() || resultCache.fetch(key, getIrradianceMapSuffix(spec), spec.irradianceMap)) &&
+               (spec.irradianceMatrices.empty() || resultCache.fetch(key, getMatricesSuffix(spec), spec.irradianceMatrices)) &&
+               (spec.specularMap.empty() || resultCache.fetch(key, getSpecularMapSuffix(spec), spec.specularMap));
+    }
+
+    void storeInCache(cache::ResultCache& resultCache, const Spec& spec, uint64_t key)
+    {
+        TRACE_SCOPE("cache store");
+        if (!spec.output.empty()) {
+            resultCache.store(key, getOutputSuffix(spec), spec.output);
+        }
+        if (spec.verboseSpecified) {
+            resultCache.store(key, ".dds", spec.diffuse);
+        }
+        if (!spec.irradianceMap.empty()) {
+            resultCache.store(key, getIrradianceMapSuffix(spec), spec.irradianceMap);
+        }
+        if (!spec.irradianceMatrices.empty()) {
+            resultCache.store(key, getMatricesSuffix(spec), spec.irradianceMatrices);
+        }
+        if (!spec.specularMap.empty()) {
+            resultCache.store(key, getSpecularMapSuffix(spec), spec.specularMap);
+        }
+    }
+
+    // a queue between two stages of the batch pipeline, push blocks while it is full
+    template <typename T>
+    class BoundedQueue
+    {
+    public:
+        explicit BoundedQueue(size_t capacity) : mCapacity(capacity) {}
+
+        void push(T value)
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mNotFull.wait(lock, [this] { return mItems.size() < mCapacity; });
+            mItems.push_back(std::move(value));
+            mNotEmpty.notify_one();
+        }
+
+        // false once the queue is closed and empty
+        bool pop(T& value)
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mNotEmpty.wait(lock, [this] { return !mItems.empty() || mClosed; });
+            if (mItems.empty()) {
+                return false;
+            }
+            value = std::move(mItems.front());
+            mItems.pop_front();
+            mNotFull.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mClosed = true;
+            mNotEmpty.notify_all();
+        }
+
+    private:
+        const size_t mCapacity;
+        std::deque<T> mItems;
+        std::mutex mLock;
+        std::condition_variable mNotEmpty;
+        std::condition_variable mNotFull;
+        bool mClosed = false;
+    };
+
+    // threads that read and decode the inputs ahead of the projection
+    const size_t BATCH_READERS = 2;
+
+    // loaded inputs waiting for the projection, and results waiting to be written
+    const size_t BATCH_QUEUE_INPUTS = 4;
+    const size_t BATCH_QUEUE_RESULTS = 64;
+
+    // a file of the batch, spec has its source and output
+    struct BatchItem
+    {
+        Spec spec;
+        std::string name;       // the path of the source relative to the root of the batch
+        bool loaded = false;
+        dds::Info info;
+        std::vector<ibl::Image> surfaces;   // of a DDS cubemap
+        ibl::Image image;                   // of an equirectangular image
+        std::unique_ptr<ibl::math::double3[]> sh;
+        uint64_t cacheKey = 0;
+        bool cached = false;    // the outputs were restored from the cache
+    };
+
+    bool isSupportedInput(const std::string& path)
+    {
+        const std::string ext = getExtension(path);
+        return ext == ".dds" || ext == ".hdr" || ext == ".pfm";
+    }
+
+    // the input files of the batch and the directory they are searched from
+    std::vector<fs::FileInfo> findBatchInputs(const Spec& spec, std::string& root)
+    {
+        std::string pattern = fs::standardizePath(spec.source);
+        if (pattern.find('*') == std::string::npos) {
+            pattern = fs::standardizePath(pattern, true) + '*';
+        }
+        const size_t slash = pattern.substr(0, pattern.find('*')).find_last_of('/');
+        root = slash == std::string::npos ? std::string() : pattern.substr(0, slash + 1);
+
+        std::vector<fs::FileInfo> files = fs::findFiles(pattern);
+        files.erase(std::remove_if(files.begin(), files.end(), [](const fs::FileInfo& f) {
+            return !isSupportedInput(f.path);
+        }), files.end());
+        std::sort(files.begin(), files.end(), [](const fs::FileInfo& a, const fs::FileInfo& b) {
+            return a.path < b.path;
+        });
+        return files;
+    }
+
+    // the path of path relative to root, under the output directory or next to the input if there
+    // is none, with the extension replaced by .json or .shb
+    std::string getBatchOutput(const Spec& spec, const std::string& root, const std::string& path)
+    {
+        std::string output = spec.output.empty() ? path : fs::standardizePath(spec.output, true) + path.substr(root.size());
+        const size_t dot = output.find_last_of('.');
+        const size_t slash = output.find_last_of('/');
+        if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+            output.resize(dot);
+        }
+        return output + (spec.binary ? ".shb" : ".json");
+    }
+
+    void createOutputDirectory(const Spec& spec)
+    {
+        std::string dirname, basename;
+        fs::split(spec.output, dirname, basename);
+        if (!dirname.empty()) {
+            fs::createDirectory(dirname);
+        }
+    }
+
+    bool loadBatchItem(BatchItem& item)
+    {
+        if (item.spec.latLong) {
+            return loadLatLong(item.spec.source, item.image);
+        }
+        return dds::load(item.spec.source, item.info, item.surfaces) &&
+               item.info.isCubemap && item.info.width == item.info.height;
+    }
+
+    std::unique_ptr<ibl::math::double3[]> computeBatchItem(BatchItem& item)
+    {
+        if (item.spec.latLong) {
+            return computeSphericalHarmonics(item.spec, item.image);
+        }
+        ibl::Cubemap cm = createCubemap(item.info, item.surfaces);
+        auto mips = createMipChain(item.spec, cm, item.info.mipLevels, [&item](size_t mip) {
+            return createCubemap(item.info, item.surfaces, mip);
+        });
+        return computeSphericalHarmonics(item.spec, cm, mips.get());
+    }
+
+    // the coefficients of the entry key stored for the archive, false if there are none
+    bool loadCachedSH(const cache::ResultCache& resultCache, uint64_t key, std::unique_ptr<ibl::math::double3[]>& sh)
+    {
+        std::vector<uint8_t> data;
+        shb::Header header;
+        std::vector<ibl::math::double3> coefs;
+        if (!resultCache.read(key, ".shb", data) || !shb::decode(data.data(), data.size(), header, coefs)) {
+            return false;
+        }
+        sh.reset(new ibl::math::double3[coefs.size()]);
+        std::copy(coefs.begin(), coefs.end(), sh.get());
+        return true;
+    }
+
+    // Projects every file found by the glob or in the directory of spec.source. Reader threads
+    // load and decode the next inputs while the pool projects the current one and a writer
+    // thread saves the previous results, the bounded queues between them keep the memory in
+    // check, so the time is that of the slower of the disk and the projection.
+    int computeBatch(const Spec& spec, cache::ResultCache* resultCache)
+    {
+        std::string root;
+        const std::vector<fs::FileInfo> files = findBatchInputs(spec, root);
+        if (files.empty())
+            ABORT("No input file found.");
+
+        // the archive replaces the outputs of the files unless a directory is given for them
+        const bool writeOutputs = spec.archive.empty() || !spec.output.empty();
+        const size_t order = spec.order ? spec.order : 2;
+        const uint8_t flags = spec.order ? 0 : shb::PRE_SCALED;
+        std::unique_ptr<shb::ArchiveWriter> archive;
+        if (!spec.archive.empty()) {
+            archive = std::make_unique<shb::ArchiveWriter>(order, flags, spec.archiveFormat);
+        }
+
+        BoundedQueue<std::unique_ptr<BatchItem>> inputs(BATCH_QUEUE_INPUTS);
+        BoundedQueue<std::unique_ptr<BatchItem>> results(BATCH_QUEUE_RESULTS);
+
+        std::atomic<size_t> next(0);
+        std::atomic<size_t> activeReaders(BATCH_READERS);
+        std::vector<std::thread> readers;
+        for (size_t i = 0; i < BATCH_READERS; i++) {
+            readers.emplace_back([&, i]() {
+                ibl::trace::setThreadName("reader " + std::to_string(i + 1));
+                for (size_t index = next++; index < files.size(); index = next++) {
+                    TRACE_SCOPE("read item", files[index].path);
+                    std::unique_ptr<BatchItem> item(new BatchItem);
+                    item->spec = spec;
+                    item->spec.source = files[index].path;
+                    item->spec.output = writeOutputs ? getBatchOutput(spec, root, files[index].path) : std::string();
+                    item->name = files[index].path.substr(root.size());
+                    const std::string ext = getExtension(item->spec.source);
+                    item->spec.latLong = ext == ".hdr" || ext == ".pfm";
+                    if (resultCache) {
+                        item->cacheKey = getCacheKey(*resultCache, item->spec);
+                        if (item->cacheKey) {
+                            createOutputDirectory(item->spec);
+                            item->cached = restoreFromCache(*resultCache, item->spec, item->cacheKey) &&
+                                           (!archive || loadCachedSH(*resultCache, item->cacheKey, item->sh));
+                        }
+                    }
+                    item->loaded = item->cached || loadBatchItem(*item);
+                    inputs.push(std::move(item));
+                }
+                if (--activeReaders == 0) {
+                    inputs.close();
+                }
+            });
+        }
+
+        std::atomic<size_t> failed(0);
+        std::thread writer([&]() {
+            ibl::trace::setThreadName("writer");
+            std::unique_ptr<BatchItem> item;
+            while (results.pop(item)) {
+                TRACE_SCOPE("write item", item->spec.source);
+                if (!item->cached) {
+                    if (!item->spec.output.empty()) {
+                        createOutputDirectory(item->spec);
+                        if (!saveSphericalHarmonics(item->spec, item->sh)) {
+                            printf("Failed to write %s\n", item->spec.output.c_str());
+                            failed++;
+                            continue;
+                        }
+                    }
+                    if (resultCache && item->cacheKey) {
+                        storeInCache(*resultCache, item->spec, item->cacheKey);
+                        if (archive) {
+                            const std::vector<uint8_t> data = shb::encode(order, flags, shb::Format::Float32, item->sh.get());
+                            resultCache->write(item->cacheKey, ".shb", data.data(), data.size());
+                        }
+                    }
+                }
+                if (archive) {
+                    archive->add(item->name, item->sh.get());
+                }
+            }
+        });
+
+        // the projection runs on the default pool, one input at a time
+        std::unique_ptr<BatchItem> item;
+        size_t cached = 0;
+        while (inputs.pop(item)) {
+            if (!item->loaded) {
+                printf("Failed to load %s\n", item->spec.source.c_str());
+                failed++;
+                continue;
+            }
+            if (item->cached) {
+                cached++;
+                if (archive) {
+                    results.push(std::move(item));
+                }
+                continue;
+            }
+            {
+                TRACE_SCOPE("project item", item->spec.source);
+                item->sh = computeBatchItem(*item);
+            }
+
+            // the texels are not needed any more, only the coefficients go to the writer
+            item->surfaces.clear();
+            item->image = ibl::Image();
+            results.push(std::move(item));
+        }
+        results.close();
+
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        writer.join();
+
+        if (resultCache) {
+            resultCache->saveIndex();
+        }
+        if (archive && !archive->save(spec.archive)) {
+            printf("Failed to write %s\n", spec.archive.c_str());
+            return 1;
+        }
+        printf("%zu of %zu files processed, %zu from the cache.\n", files.size() - failed, files.size(), cached);
+        return failed ? 1 : 0;
+    }
+
+    // the largest side of a probe grid, that of a 3D texture in most APIs
+    const size_t MAX_PROBE_GRID_SIZE = 2048;
+
+    // the grid of --probe-grid as given by its manifest
+    struct ProbeGrid
+    {
+        size_t size[3] = {};                // probes along x, y and z
+        std::vector<std::string> inputs;    // x first then y then z
+    };
+
+    bool isAbsolutePath(const std::string& path)
+    {
+        return !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+    }
+
+    // reads {"size": [x, y, z], "inputs": [...]}, the relative inputs are made relative to the
+    // directory of the manifest
+    bool loadProbeGrid(const std::string& path, ProbeGrid& grid, std::string& error)
+    {
+        fs::FileHandle file = fs::openFile(path, fs::FileMode::Open | fs::FileAccess::Read | fs::FileShare::Read);
+        if (file.isInvalid()) {
+            error = "failed to open " + path;
+            return false;
+        }
+        std::string text(fs::fileSize(file), '\0');
+        const bool read = fs::readFile(file, &text[0], text.size()) == text.size();
+        fs::closeFile(file);
+        if (!read) {
+            error = "failed to read " + path;
+            return false;
+        }
+
+        const json11::Json manifest = json11::Json::parse(text, error);
+        if (!error.empty()) {
+            return false;
+        }
+        const json11::Json::array& size = manifest["size"].array_items();
+        if (size.size() != 3) {
+            error = "size must be [x, y, z]";
+            return false;
+        }
+        for (size_t axis = 0; axis < 3; axis++) {
+            if (!size[axis].is_number() || size[axis].int_value() < 1 || size_t(size[axis].int_value()) > MAX_PROBE_GRID_SIZE) {
+                error = "the sides of the grid must be between 1 and 2048";
+                return false;
+            }
+            grid.size[axis] = size_t(size[axis].int_value());
+        }
+
+        const json11::Json::array& inputs = manifest["inputs"].array_items();
+        if (inputs.size() != grid.size[0] * grid.size[1] * grid.size[2]) {
+            error = "inputs must have x * y * z files";
+            return false;
+        }
+        std::string dirname, basename;
+        fs::split(path, dirname, basename);
+        dirname = fs::standardizePath(dirname, true);
+        grid.inputs.reserve(inputs.size());
+        for (const json11::Json& input : inputs) {
+            if (!input.is_string() || input.string_value().empty()) {
+                error = "inputs must be file names";
+                return false;
+            }
+            const std::string& name = input.string_value();
+            grid.inputs.push_back(isAbsolutePath(name) ? name : dirname + name);
+        }
+        return true;
+    }
+
+    // Projects the probes of the manifest of spec.probeGrid into one volume of spec.output.
+    // The probes are spread over the default pool, every task loads its input and projects it
+    // on the same pool, so that small probes still keep all the threads busy while at most one
+    // input per thread is in memory. The coefficients go straight into their planes.
+    int computeProbeGrid(const Spec& spec, cache::ResultCache* resultCache)
+    {
+        ProbeGrid grid;
+        std::string error;
+        if (!loadProbeGrid(spec.probeGrid, grid, error)) {
+            printf("Failed to load the probe grid: %s\n", error.c_str());
+            return 1;
+        }
+
+        const size_t order = spec.order ? spec.order : 2;
+        const uint8_t flags = spec.order ? 0 : shb::PRE_SCALED;
+        shb::VolumeWriter volume(order, flags, spec.probeGridFormat, grid.size[0], grid.size[1], grid.size[2]);
+
+        std::atomic<size_t> failed(0);
+        std::atomic<size_t> cached(0);
+        {
+            TRACE_SCOPE("probe grid", spec.probeGrid);
+            ibl::ThreadPool::getDefault().parallelFor(grid.inputs.size(), 1, [&](size_t, size_t begin, size_t end) {
+                for (size_t probe = begin; probe < end; probe++) {
+                    BatchItem item;
+                    item.spec = spec;
+                    item.spec.source = grid.inputs[probe];
+                    const std::string ext = getExtension(item.spec.source);
+                    item.spec.latLong = ext == ".hdr" || ext == ".pfm";
+                    if (resultCache) {
+                        item.cacheKey = getCacheKey(*resultCache, item.spec);
+                        item.cached = item.cacheKey && loadCachedSH(*resultCache, item.cacheKey, item.sh);
+                    }
+                    if (item.cached) {
+                        cached++;
+                    } else {
+                        {
+                            TRACE_SCOPE("read item", item.spec.source);
+                            item.loaded = loadBatchItem(item);
+                        }
+                        if (!item.loaded) {
+                            printf("Failed to load %s\n", item.spec.source.c_str());
+                            failed++;
+                            continue;
+                        }
+                        {
+                            TRACE_SCOPE("project item", item.spec.source);
+                            item.sh = computeBatchItem(item);
+                        }
+                        if (resultCache && item.cacheKey) {
+                            const std::vector<uint8_t> data = shb::encode(order, flags, shb::Format::Float32, item.sh.get());
+                            resultCache->write(item.cacheKey, ".shb", data.data(), data.size());
+                        }
+                    }
+                    volume.set(probe, item.sh.get());
+                }
+            });
+        }
+
+        if (resultCache) {
+            resultCache->saveIndex();
+        }
+        // a volume with holes would light the scene wrongly without notice
+        if (failed) {
+            printf("%zu of %zu probes failed, %s is not written.\n", size_t(failed), grid.inputs.size(), spec.output.c_str());
+            return 1;
+        }
+        createOutputDirectory(spec);
+        {
+            TRACE_SCOPE("write volume", spec.output);
+            if (!volume.save(spec.output)) {
+                printf("Failed to write %s\n", spec.output.c_str());
+                return 1;
+            }
+        }
+        printf("%zu probes (%zux%zux%zu) processed, %zu from the cache.\n", grid.inputs.size(),
+               grid.size[0], grid.size[1], grid.size[2], size_t(cached));
+        return 0;
+    }
+
+    // threads running the jobs of serve mode, so that one loads its input while another projects
+    const size_t SERVE_WORKERS = 2;
+    const size_t SERVE_QUEUE = 64;
+
+    struct ServeJob
+    {
+        std::shared_ptr<serve::Channel> channel;   // where the result goes
+        std::string request;
+    };
+
+    // the spec of a job of serve mode, the options it does not give are those of the command line
+    bool parseJob(const json11::Json& job, const Spec& defaults, Spec& spec, std::string& error)
+    {
+        spec = defaults;
+        if (!job["input"].is_string()) {
+            error = "input is missing";
+            return false;
+        }
+        spec.source = job["input"].string_value();
+        spec.output = job["output"].string_value();
+        if (job["order"].is_number()) {
+            spec.order = size_t(std::max(0, job["order"].int_value()));
+            if (spec.order < 1 || spec.order > ibl::sh::MAX_ORDER) {
+                error = "order must be between 1 and 8";
+                return false;
+            }
+        }
+        if (job["precision"].is_string()) {
+            spec.precision = job["precision"].string_value();
+            if (spec.precision != "double" && spec.precision != "kahan" && spec.precision != "pairwise") {
+                error = "precision must be double, kahan or pairwise";
+                return false;
+            }
+        }
+        if (job["mip_tolerance"].is_number()) {
+            spec.mipTolerance = job["mip_tolerance"].number_value();
+        }
+        const std::string ext = getExtension(spec.source);
+        spec.latLong = ext == ".hdr" || ext == ".pfm";
+        if (spec.latLong && spec.mipTolerance > 0) {
+            error = "mip_tolerance needs a DDS cubemap";
+            return false;
+        }
+        return true;
+    }
+
+    // the response line to a request line
+    std::string runJob(const std::string& request, const Spec& defaults)
+    {
+        TRACE_SCOPE("job");
+        std::string error;
+        const json11::Json job = json11::Json::parse(request, error);
+        json::Writer response;
+        response.setPrecision(defaults.digits);
+        response.beginObject();
+        response.key("id");
+        response.raw(job["id"].dump());
+
+        // a job that throws, e.g. out of memory, fails alone and the server keeps running
+        try {
+            BatchItem item;
+            if (error.empty() && parseJob(job, defaults, item.spec, error)) {
+                if (!loadBatchItem(item)) {
+                    error = "failed to load " + item.spec.source;
+                } else {
+                    item.sh = computeBatchItem(item);
+                    if (!item.spec.output.empty() && !saveSphericalHarmonics(item.spec, item.sh)) {
+                        error = "failed to write " + item.spec.output;
+                    }
+                    std::string sh;
+                    {
+                        json::Writer writer;
+                        writer.setPrecision(defaults.digits);
+                        writeSH(writer, item.spec, item.sh);
+                        sh = writer.getString();
+                    }
+                    response.key("sh");
+                    response.raw(sh);
+                }
+            }
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        if (!error.empty()) {
+            response.key("error");
+            response.value(error);
+        }
+        response.endObject();
+        return response.getString();
+    }
+
+    // Runs the jobs read from the standard input or from the clients of a socket until the
+    // input ends, or forever with a socket. The pool, its threads and the kernels of the last
+    // sizes, see SHKernel::get(), stay warm between the jobs, which run a few at a time and
+    // are answered as soon as they are done.
+    int runServer(const Spec& spec)
+    {
+        BoundedQueue<ServeJob> jobs(SERVE_QUEUE);
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < SERVE_WORKERS; i++) {
+            workers.emplace_back([&jobs, &spec, i]() {
+                ibl::trace::setThreadName("serve " + std::to_string(i + 1));
+                ServeJob job;
+                while (jobs.pop(job)) {
+                    job.channel->writeLine(runJob(job.request, spec));
+                    job = ServeJob();
+                }
+            });
+        }
+
+        // a channel is closed when it has no more lines and all its results have been written
+        auto readJobs = [&jobs](std::shared_ptr<serve::Channel> channel) {
+            std::string line;
+            while (channel->readLine(line)) {
+                if (!line.empty()) {
+                    jobs.push({channel, line});
+                }
+            }
+        };
+
+        bool listening = true;
+        if (spec.socketPath.empty()) {
+            readJobs(std::make_shared<serve::Channel>(stdin, stdout, false));
+        } else {
+            listening = serve::listen(spec.socketPath, readJobs);
+        }
+
+        jobs.close();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        if (!listening)
+            ABORT("Failed to listen on the socket.");
+        return 0;
+    }
+
+    // writes the events of every thread as Chrome trace events, for chrome://tracing or Perfetto
+    bool saveTrace(const std::string& path)
+    {
+        json::Writer writer(path);
+        writer.beginObject();
+        writer.key("displayTimeUnit");
+        writer.value("ms");
+        writer.key("traceEvents");
+        writer.beginArray();
+        for (const ibl::trace::ThreadEvents& thread : ibl::trace::collect()) {
+            writer.beginObject();
+            writer.key("name");
+            writer.value("thread_name");
+            writer.key("ph");
+            writer.value("M");
+            writer.key("pid");
+            writer.value(1);
+            writer.key("tid");
+            writer.value(thread.id);
+            writer.key("args");
+            writer.beginObject();
+            writer.key("name");
+            writer.value(thread.name);
+            writer.endObject();
+            writer.endObject();
+
+            // complete events in microseconds
+            for (const ibl::trace::Event& event : thread.events) {
+                writer.beginObject();
+                writer.key("name");
+                writer.value(event.name);
+                writer.key("ph");
+                writer.value("X");
+                writer.key("pid");
+                writer.value(1);
+                writer.key("tid");
+                writer.value(thread.id);
+                writer.key("ts");
+                writer.value(double(event.begin) * 1e-3);
+                writer.key("dur");
+                writer.value(double(event.end - event.begin) * 1e-3);
+                if (!event.detail.empty()) {
+                    writer.key("args");
+                    writer.beginObject();
+                    writer.key("detail");
+                    writer.value(event.detail);
+                    writer.endObject();
+                }
+                writer.endObject();
+            }
+        }
+        writer.endArray();
+        writer.endObject();
+        return writer.close();
+    }
+
+    int run(const Spec& spec)
+    {
+        if (spec.serve)
+            return runServer(spec);
+
+        std::unique_ptr<cache::ResultCache> resultCache;
+        if (!spec.cacheDir.empty())
+            resultCache.reset(new cache::ResultCache(spec.cacheDir));
+
+        if (!spec.probeGrid.empty())
+            return computeProbeGrid(spec, resultCache.get());
+        if (spec.batch)
+            return computeBatch(spec, resultCache.get());
+
+        uint64_t key = 0;
+        if (resultCache) {
+            key = getCacheKey(*resultCache, spec);
+            if (key && restoreFromCache(*resultCache, spec, key))
+                return 0;
+        }
+
+        const int result = compute(spec);
+        if (result == 0 && key)
+            storeInCache(*resultCache, spec, key);
+        return result;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Spec spec;
+    if (parseArguments(spec, argc, argv) != 0)
+        return 1;
+
+    if (!spec.trace.empty()) {
+        ibl::trace::enable();
+        ibl::trace::setThreadName("main");
+    }
+
+    const int result = run(spec);
+    if (!spec.trace.empty() && !saveTrace(spec.trace))
+        ABORT("Failed to write the trace.");
+    return result;
+}